@@ -1,9 +1,30 @@
+#include <array>
+#include <chrono>
+#include <thread>
+
+#include "draco_async.h"
+#include "draco_cache.h"
 #include "draco_decode.h"
 #include "draco_encode.h"
+#include "draco_gltf.h"
+#include "draco_interleave.h"
+#include "draco_lod.h"
+#include "draco_out_of_core.h"
+#include "draco_sequence.h"
+#include "draco_tile.h"
+#include "draco_trace.h"
+#include "draco_tune.h"
+#include "draco_typed.h"
+#include "file_util.h"
+#include "mesh_util.h"
 #include "ugu/mesh.h"
 #include "ugu/timer.h"
 #include "ugu/util/path_util.h"
 
+#ifndef _WIN32
+#include "draco_service.h"
+#endif
+
 void TestObjMesh() {
   std::cout << "wavefront obj with multiple uvs per vertex" << std::endl;
 
@@ -34,10 +55,18 @@ void TestObjMesh() {
   ugu::EnsureDirExists("../data_out");
   std::string drc_path = "../data_out/bunny.drc";
 
-  std::ofstream ofs(drc_path, std::ios::binary);
-  for (const char& b : bytes) {
-    ofs << b;
-  }
+  file_util::WriteFile(drc_path, bytes.data(), bytes.size());
+
+  // Decode from the mapped file instead of |bytes|
+  file_util::MappedFile drc;
+  drc.Open(drc_path);
+
+  draco_decode::DracoStreamInfo info;
+  draco_decode::DracoReadInfo(drc.data(), drc.size(), info);
+  std::cout << "Header: " << info.num_points << " points, " << info.num_faces
+            << " faces, " << info.attributes.size() << " attributes"
+            << std::endl;
+
   std::vector<Eigen::Vector3f> verts;
   std::vector<Eigen::Vector2f> uvs;
   std::vector<Eigen::Vector3i> indices;
@@ -45,8 +74,8 @@ void TestObjMesh() {
   std::vector<Eigen::Vector<uint8_t, 3>> colors;
   std::vector<Eigen::Vector3f> normals;
   timer.Start();
-  draco_decode::DracoDecode(bytes, verts, uvs, indices, uv_indices, colors,
-                            normals);
+  draco_decode::DracoDecode(drc.data(), drc.size(), verts, uvs, indices,
+                            uv_indices, colors, normals);
   timer.End();
   std::cout << "Decode time: " << timer.elapsed_msec() << " ms" << std::endl;
 
@@ -63,21 +92,96 @@ void TestObjMesh() {
   decoded->WriteObj("../data_out/bunny_from_draco.obj");
 }
 
+void TestGlbMesh() {
+  std::cout << "Single GLB with Draco geometry and embedded texture"
+            << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadObj("../data/bunny.obj");
+  ugu::Timer timer;
+
+  // The atlas is embedded as the original JPEG bytes
+  file_util::MappedFile jpg;
+  jpg.Open("../data/bunny-atlas.jpg");
+  draco_gltf::GlbImage texture;
+  texture.data = jpg.data();
+  texture.size = jpg.size();
+
+  ugu::EnsureDirExists("../data_out");
+  const std::string glb_path = "../data_out/bunny.glb";
+  draco_encode::DracoEncodeOptions options;
+  timer.Start();
+  draco_gltf::DracoEncodeGlbFile(mesh->vertices(), mesh->uv(),
+                                 mesh->vertex_indices(), mesh->uv_indices(),
+                                 {}, {}, options, texture, glb_path);
+  timer.End();
+  std::cout << "Encode and write time: " << timer.elapsed_msec() << " ms"
+            << std::endl;
+
+  file_util::MappedFile glb;
+  glb.Open(glb_path);
+  std::cout << "GLB size: " << glb.size() / 1024 << " kb, texture "
+            << jpg.size() / 1024 << " kb" << std::endl;
+
+  std::vector<Eigen::Vector3f> verts;
+  std::vector<Eigen::Vector2f> uvs;
+  std::vector<Eigen::Vector3i> indices;
+  std::vector<Eigen::Vector3i> uv_indices;
+  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+  std::vector<Eigen::Vector3f> normals;
+  draco_gltf::GlbImage decoded_texture;
+  timer.Start();
+  draco_gltf::DracoDecodeGlb(glb.data(), glb.size(), verts, uvs, indices,
+                             uv_indices, colors, normals, &decoded_texture);
+  timer.End();
+  std::cout << "Decode time: " << timer.elapsed_msec() << " ms, "
+            << verts.size() << " points, " << indices.size() << " faces, "
+            << decoded_texture.size / 1024 << " kb texture" << std::endl;
+}
+
+void TestInterleavedMesh() {
+  std::cout << "Decode into interleaved vertex and index buffers" << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadObj("../data/bunny.obj");
+  ugu::Timer timer;
+
+  std::vector<char> bytes;
+  draco_encode::DracoEncodeOptions options;
+  draco_encode::DracoEncode(mesh->vertices(), mesh->uv(),
+                            mesh->vertex_indices(), mesh->uv_indices(), {}, {},
+                            options, bytes);
+
+  // float3 position, half2 uv
+  draco_interleave::VertexLayout layout;
+  layout.stride = 16;
+  layout.position.offset = 0;
+  layout.uv.offset = 12;
+  layout.uv.format = draco_interleave::ComponentFormat::kFloat16;
+
+  timer.Start();
+  draco_interleave::InterleavedDecoder decoder;
+  decoder.Decode(bytes.data(), bytes.size());
+  // Stand-ins for mapped GPU buffers
+  std::vector<char> vertex_buffer(decoder.num_vertices() * layout.stride);
+  std::vector<uint32_t> index_buffer(decoder.num_indices());
+  decoder.WriteVertices(layout, vertex_buffer.data());
+  decoder.WriteIndices(draco_interleave::IndexFormat::kUint32,
+                       index_buffer.data());
+  timer.End();
+  std::cout << "Decode time: " << timer.elapsed_msec() << " ms, "
+            << decoder.num_vertices() << " vertices, "
+            << decoder.num_indices() << " indices" << std::endl;
+}
+
 void TestPlyPc() {
   std::cout << "Colored point cloud with normals" << std::endl;
 
   ugu::MeshPtr mesh = ugu::Mesh::Create();
   mesh->LoadPly("../data/longdress_viewdep_vox12_sampled.ply");
-  std::vector<Eigen::Vector<uint8_t, 3>> mesh_colors_8;
-  std::transform(mesh->vertex_colors().begin(), mesh->vertex_colors().end(),
-                 std::back_inserter(mesh_colors_8),
-                 [&](const Eigen::Vector3f& c) {
-                   return Eigen::Vector<uint8_t, 3>(static_cast<uint8_t>(c[0]),
-                                                    static_cast<uint8_t>(c[1]),
-                                                    static_cast<uint8_t>(c[2]));
-                 });
   ugu::Timer timer;
 
+  using draco_typed::Semantic;
   std::vector<char> bytes;
   draco_encode::DracoEncodeOptions options;
   options.pos_quantization_bits = 11;
@@ -85,9 +189,13 @@ void TestPlyPc() {
   options.normals_quantization_bits = 8;
   options.compression_level = 7;
   timer.Start();
-  draco_encode::DracoEncode(mesh->vertices(), mesh->uv(),
-                            mesh->vertex_indices(), mesh->uv_indices(),
-                            mesh_colors_8, mesh->normals(), options, bytes);
+  // Float colors are converted to uint8 while they are copied into Draco
+  draco_typed::DracoEncode(
+      {draco_typed::Attribute(Semantic::kPosition, mesh->vertices()),
+       draco_typed::Attribute<uint8_t>(Semantic::kColor,
+                                       mesh->vertex_colors()),
+       draco_typed::Attribute(Semantic::kNormal, mesh->normals())},
+      mesh->vertex_indices(), options, bytes);
   timer.End();
   std::cout << "Encode time: " << timer.elapsed_msec() << " ms" << std::endl;
 
@@ -95,7 +203,7 @@ void TestPlyPc() {
                     mesh->uv().size() * sizeof(float) * 2 +
                     mesh->vertex_indices().size() * sizeof(int) * 3 +
                     mesh->uv_indices().size() * sizeof(int) * 3 +
-                    mesh_colors_8.size() * sizeof(uint8_t) * 3 +
+                    mesh->vertex_colors().size() * sizeof(uint8_t) * 3 +
                     mesh->normals().size() * sizeof(float) * 3;
 
   std::cout << "Original size: " << org_size / 1024 << " kb" << std::endl;
@@ -104,10 +212,7 @@ void TestPlyPc() {
   ugu::EnsureDirExists("../data_out");
   std::string drc_path = "../data_out/longdress_viewdep_vox12_sampled.drc";
 
-  std::ofstream ofs(drc_path, std::ios::binary);
-  for (const char& b : bytes) {
-    ofs << b;
-  }
+  file_util::WriteFile(drc_path, bytes.data(), bytes.size());
   std::vector<Eigen::Vector3f> verts;
   std::vector<Eigen::Vector2f> uvs;
   std::vector<Eigen::Vector3i> indices;
@@ -137,10 +242,597 @@ void TestPlyPc() {
       "../data_out/longdress_viewdep_vox12_sampled_from_draco.ply");
 }
 
+void TestIntegerPc() {
+  std::cout << "Point cloud on an integer grid" << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadPly("../data/longdress_viewdep_vox12_sampled.ply");
+  // vox12 positions are integers in [0, 4096)
+  std::vector<Eigen::Vector<uint16_t, 3>> grid;
+  for (const auto& v : mesh->vertices()) {
+    grid.push_back(v.cast<uint16_t>());
+  }
+  std::vector<Eigen::Vector<uint8_t, 3>> colors_8;
+  mesh_util::ToColors8(mesh->vertex_colors(), colors_8);
+  ugu::Timer timer;
+
+  std::vector<char> bytes;
+  draco_encode::DracoEncodeOptions options;
+  timer.Start();
+  draco_encode::DracoEncode(grid, {}, {}, {}, colors_8, {}, options, bytes);
+  timer.End();
+  std::cout << "Encode time: " << timer.elapsed_msec() << " ms" << std::endl;
+  std::cout << "Draco size: " << bytes.size() / 1024 << " kb" << std::endl;
+
+  std::vector<Eigen::Vector<uint16_t, 3>> verts;
+  std::vector<Eigen::Vector2f> uvs;
+  std::vector<Eigen::Vector3i> indices;
+  std::vector<Eigen::Vector3i> uv_indices;
+  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+  std::vector<Eigen::Vector3f> normals;
+  timer.Start();
+  draco_decode::DracoDecode(bytes, verts, uvs, indices, uv_indices, colors,
+                            normals);
+  timer.End();
+  std::cout << "Decode time: " << timer.elapsed_msec() << " ms" << std::endl;
+
+  // The kd-tree encoder reorders points, so compare sorted points
+  auto sorted_points = [](const std::vector<Eigen::Vector<uint16_t, 3>>& v,
+                          const std::vector<Eigen::Vector<uint8_t, 3>>& c) {
+    std::vector<std::array<int, 6>> points;
+    for (size_t i = 0; i < v.size(); i++) {
+      points.push_back({v[i][0], v[i][1], v[i][2], c[i][0], c[i][1], c[i][2]});
+    }
+    std::sort(points.begin(), points.end());
+    return points;
+  };
+  std::cout << "Lossless: "
+            << (sorted_points(verts, colors) == sorted_points(grid, colors_8))
+            << std::endl;
+}
+
+void TestTypedPc() {
+  std::cout << "Point cloud with float colors and a per point scalar"
+            << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadPly("../data/longdress_viewdep_vox12_sampled.ply");
+  // Luma as an example of an extra per point attribute
+  std::vector<uint16_t> luma;
+  luma.reserve(mesh->vertex_colors().size());
+  for (const auto& c : mesh->vertex_colors()) {
+    luma.push_back(static_cast<uint16_t>(
+        (0.299f * c[0] + 0.587f * c[1] + 0.114f * c[2]) * 257.f));
+  }
+  ugu::Timer timer;
+
+  using draco_typed::Semantic;
+  std::vector<char> bytes;
+  draco_encode::DracoEncodeOptions options;
+  timer.Start();
+  // Float colors are converted to uint8 while they are copied into Draco
+  draco_typed::DracoEncode(
+      {draco_typed::Attribute(Semantic::kPosition, mesh->vertices()),
+       draco_typed::Attribute<uint8_t>(Semantic::kColor,
+                                       mesh->vertex_colors()),
+       draco_typed::Attribute(Semantic::kNormal, mesh->normals()),
+       draco_typed::Attribute(Semantic::kGeneric, luma)},
+      {}, options, bytes);
+  timer.End();
+  std::cout << "Encode time: " << timer.elapsed_msec() << " ms" << std::endl;
+  std::cout << "Draco size: " << bytes.size() / 1024 << " kb" << std::endl;
+
+  std::vector<Eigen::Vector3f> verts;
+  std::vector<Eigen::Vector3f> colors;
+  std::vector<Eigen::Vector3f> normals;
+  std::vector<uint16_t> decoded_luma;
+  std::vector<Eigen::Vector3i> indices;
+  timer.Start();
+  draco_typed::DracoDecode(
+      bytes,
+      {draco_typed::Output(Semantic::kPosition, verts),
+       draco_typed::Output(Semantic::kColor, colors),
+       draco_typed::Output(Semantic::kNormal, normals),
+       draco_typed::Output(Semantic::kGeneric, decoded_luma)},
+      indices);
+  timer.End();
+  std::cout << "Decode time: " << timer.elapsed_msec() << " ms, "
+            << decoded_luma.size() << " luma values" << std::endl;
+
+  ugu::MeshPtr decoded = ugu::Mesh::Create();
+  decoded->set_vertices(verts);
+  decoded->set_normals(normals);
+  decoded->set_vertex_colors(colors);
+  ugu::EnsureDirExists("../data_out");
+  decoded->WritePly(
+      "../data_out/longdress_viewdep_vox12_sampled_typed_from_draco.ply");
+}
+
+void TestEncoderSession() {
+  std::cout << "Encoder session vs DracoEncode on repeated frames"
+            << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadPly("../data/longdress_viewdep_vox12_sampled.ply");
+  std::vector<Eigen::Vector<uint8_t, 3>> mesh_colors_8;
+  mesh_util::ToColors8(mesh->vertex_colors(), mesh_colors_8);
+
+  const int num_frames = 20;
+  draco_encode::DracoEncodeOptions options;
+  ugu::Timer timer;
+
+  std::vector<char> bytes;
+  timer.Start();
+  for (int i = 0; i < num_frames; i++) {
+    draco_encode::DracoEncode(mesh->vertices(), mesh->uv(),
+                              mesh->vertex_indices(), mesh->uv_indices(),
+                              mesh_colors_8, mesh->normals(), options, bytes);
+  }
+  timer.End();
+  std::cout << "DracoEncode: " << timer.elapsed_msec() / num_frames
+            << " ms/frame" << std::endl;
+
+  draco_encode::DracoEncoderSession session(options);
+  timer.Start();
+  for (int i = 0; i < num_frames; i++) {
+    session.Encode(mesh->vertices(), mesh->uv(), mesh->vertex_indices(),
+                   mesh->uv_indices(), mesh_colors_8, mesh->normals());
+  }
+  timer.End();
+  std::cout << "DracoEncoderSession: " << timer.elapsed_msec() / num_frames
+            << " ms/frame" << std::endl;
+  std::cout << "Draco size: " << session.bytes().size() / 1024 << " kb"
+            << std::endl;
+}
+
+void TestMakeMeshBreakdown() {
+  std::cout << "MakeMesh vs EncodeToBuffer time" << std::endl;
+
+  auto run = [](const std::string& name, const ugu::MeshPtr& mesh,
+                const std::vector<Eigen::Vector<uint8_t, 3>>& colors) {
+    const int num_runs = 10;
+    draco_encode::DracoEncodeOptions options;
+    draco_encode::DracoEncoderSession session(options);
+    double make_mesh_ms = 0.0;
+    double encode_ms = 0.0;
+    for (int i = 0; i < num_runs; i++) {
+      session.Encode(mesh->vertices(), mesh->uv(), mesh->vertex_indices(),
+                     mesh->uv_indices(), colors, mesh->normals());
+      make_mesh_ms += session.timings().make_mesh_ms;
+      encode_ms += session.timings().encode_ms;
+    }
+    std::cout << name << " MakeMesh: " << make_mesh_ms / num_runs
+              << " ms, EncodeToBuffer: " << encode_ms / num_runs << " ms"
+              << std::endl;
+  };
+
+  ugu::MeshPtr obj = ugu::Mesh::Create();
+  obj->LoadObj("../data/bunny.obj");
+  run("bunny", obj, {});
+
+  ugu::MeshPtr ply = ugu::Mesh::Create();
+  ply->LoadPly("../data/longdress_viewdep_vox12_sampled.ply");
+  std::vector<Eigen::Vector<uint8_t, 3>> ply_colors_8;
+  mesh_util::ToColors8(ply->vertex_colors(), ply_colors_8);
+  run("longdress", ply, ply_colors_8);
+}
+
+void TestTiledPc() {
+  std::cout << "Tiled point cloud with partial decode" << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadPly("../data/longdress_viewdep_vox12_sampled.ply");
+  std::vector<Eigen::Vector<uint8_t, 3>> mesh_colors_8;
+  mesh_util::ToColors8(mesh->vertex_colors(), mesh_colors_8);
+  ugu::Timer timer;
+
+  std::vector<char> bytes;
+  draco_tile::TileEncodeOptions options;
+  timer.Start();
+  draco_tile::DracoEncodeTiled(mesh->vertices(), mesh->uv(),
+                               mesh->vertex_indices(), mesh->uv_indices(),
+                               mesh_colors_8, mesh->normals(), options, bytes);
+  timer.End();
+  std::cout << "Encode time: " << timer.elapsed_msec() << " ms" << std::endl;
+  std::cout << "Draco size: " << bytes.size() / 1024 << " kb" << std::endl;
+
+  std::vector<draco_tile::TileInfo> tiles;
+  draco_tile::ReadTileIndex(bytes, tiles);
+  std::cout << "Tiles: " << tiles.size() << std::endl;
+
+  // Query the lower half of the bounding box
+  Eigen::AlignedBox3f box;
+  for (const auto& v : mesh->vertices()) {
+    box.extend(v);
+  }
+  Eigen::AlignedBox3f query = box;
+  query.max()[1] = box.center()[1];
+
+  std::vector<Eigen::Vector3f> verts;
+  std::vector<Eigen::Vector2f> uvs;
+  std::vector<Eigen::Vector3i> indices;
+  std::vector<Eigen::Vector3i> uv_indices;
+  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+  std::vector<Eigen::Vector3f> normals;
+  timer.Start();
+  draco_tile::DracoDecodeTiled(bytes, query, verts, uvs, indices, uv_indices,
+                               colors, normals);
+  timer.End();
+  std::cout << "Partial decode time: " << timer.elapsed_msec() << " ms, "
+            << verts.size() << " / " << mesh->vertices().size() << " points"
+            << std::endl;
+}
+
+void TestLodPc() {
+  std::cout << "Progressive point cloud" << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadPly("../data/longdress_viewdep_vox12_sampled.ply");
+  ugu::Timer timer;
+
+  std::vector<char> bytes;
+  draco_lod::LodEncodeOptions options;
+  timer.Start();
+  draco_lod::DracoEncodeLod(mesh->vertices(), mesh->uv(),
+                            mesh->vertex_indices(), mesh->uv_indices(), {},
+                            mesh->normals(), options, bytes);
+  timer.End();
+  std::cout << "Encode time: " << timer.elapsed_msec() << " ms" << std::endl;
+  std::cout << "Draco size: " << bytes.size() / 1024 << " kb" << std::endl;
+
+  // Feed the stream in 8 chunks as if it arrived over a slow link
+  draco_lod::LodDecoder decoder;
+  const size_t chunk = bytes.size() / 8 + 1;
+  for (size_t pos = 0; pos < bytes.size(); pos += chunk) {
+    decoder.Append(bytes.data() + pos, std::min(chunk, bytes.size() - pos));
+    timer.Start();
+    if (decoder.Update()) {
+      timer.End();
+      std::cout << "Received " << std::min(pos + chunk, bytes.size()) / 1024
+                << " kb: " << decoder.num_layers_decoded() << "/"
+                << decoder.num_layers() << " layers, "
+                << decoder.geometry().verts.size() << " points in "
+                << timer.elapsed_msec() << " ms" << std::endl;
+    }
+  }
+}
+
+void TestSequencePc() {
+  std::cout << "Point cloud sequence with prefetching playback" << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadPly("../data/longdress_viewdep_vox12_sampled.ply");
+  std::vector<Eigen::Vector<uint8_t, 3>> mesh_colors_8;
+  mesh_util::ToColors8(mesh->vertex_colors(), mesh_colors_8);
+
+  // Moving copies of the frame stand in for a captured sequence
+  const int num_frames = 30;
+  std::vector<mesh_util::MeshArrays> frames(num_frames);
+  for (int i = 0; i < num_frames; i++) {
+    frames[i].verts = mesh->vertices();
+    for (auto& v : frames[i].verts) {
+      v[0] += static_cast<float>(i);
+    }
+    frames[i].colors = mesh_colors_8;
+    frames[i].normals = mesh->normals();
+  }
+  ugu::Timer timer;
+
+  std::vector<char> bytes;
+  draco_sequence::SequenceEncodeOptions options;
+  timer.Start();
+  draco_sequence::DracoEncodeSequence(frames, options, bytes);
+  timer.End();
+  std::cout << "Encode time: " << timer.elapsed_msec() / num_frames
+            << " ms/frame" << std::endl;
+  std::cout << "Draco size: " << bytes.size() / 1024 / num_frames
+            << " kb/frame" << std::endl;
+
+  draco_sequence::SequenceInfo info;
+  draco_sequence::ReadSequenceIndex(bytes, info);
+
+  // Play at the stored frame rate and count frames that were not ready
+  const auto frame_time = std::chrono::duration<double>(1.0 / info.frame_rate);
+  draco_sequence::SequencePlayer player(bytes, info);
+  mesh_util::MeshArrays frame;
+  int num_late = 0;
+  auto next_time = std::chrono::steady_clock::now();
+  timer.Start();
+  while (player.position() < info.frames.size()) {
+    if (player.num_ready() == 0) {
+      num_late++;
+    }
+    player.Next(frame);
+    next_time += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        frame_time);
+    std::this_thread::sleep_until(next_time);
+  }
+  timer.End();
+  std::cout << "Played " << info.frames.size() << " frames in "
+            << timer.elapsed_msec() << " ms, " << num_late
+            << " not ready in time" << std::endl;
+}
+
+void TestAsyncPc() {
+  std::cout << "Live capture encoded asynchronously within a latency budget"
+            << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadPly("../data/longdress_viewdep_vox12_sampled.ply");
+  std::vector<Eigen::Vector<uint8_t, 3>> mesh_colors_8;
+  mesh_util::ToColors8(mesh->vertex_colors(), mesh_colors_8);
+
+  // A 30 fps capture loop that must not wait for the encoder
+  const int num_frames = 60;
+  const auto frame_time = std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+      1.0 / 30.0));
+  draco_async::AsyncEncodeOptions options;
+  options.latency_budget_ms = 1000.0 / 30.0;
+  options.policy = draco_async::BudgetPolicy::kFallback;
+  draco_async::AsyncEncoder encoder(options);
+  std::vector<std::future<draco_async::FrameResult>> results;
+  auto next_time = std::chrono::steady_clock::now();
+  for (int i = 0; i < num_frames; i++) {
+    mesh_util::MeshArrays frame;
+    frame.verts = mesh->vertices();
+    for (auto& v : frame.verts) {
+      v[0] += static_cast<float>(i);
+    }
+    frame.colors = mesh_colors_8;
+    frame.normals = mesh->normals();
+    results.push_back(encoder.Submit(std::move(frame)));
+    next_time += frame_time;
+    std::this_thread::sleep_until(next_time);
+  }
+
+  size_t total_size = 0;
+  for (auto& result : results) {
+    total_size += result.get().bytes.size();
+  }
+  const draco_async::AsyncStats stats = encoder.stats();
+  std::cout << "Encoded " << stats.encoded << " of " << stats.submitted
+            << " frames, " << stats.fallbacks << " at the fallback level, "
+            << stats.dropped << " dropped" << std::endl;
+  std::cout << "Latency p50 " << stats.latency_p50_ms << " ms, p99 "
+            << stats.latency_p99_ms << " ms" << std::endl;
+  if (stats.encoded > 0) {
+    std::cout << "Draco size: " << total_size / 1024 / stats.encoded
+              << " kb/frame" << std::endl;
+  }
+}
+
+void TestTuneMesh() {
+  std::cout << "Quantization tuned to an error and a size budget" << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadObj("../data/bunny.obj");
+  ugu::Timer timer;
+
+  auto print = [](const draco_tune::TuneResult& result) {
+    std::cout << "pos/tex bits " << result.options.pos_quantization_bits
+              << "/" << result.options.tex_coords_quantization_bits
+              << ", level " << result.options.compression_level << ", "
+              << result.size / 1024 << " kb, position error "
+              << result.position_error << ", uv error " << result.uv_error
+              << (result.met_target ? "" : " (target missed)") << ", "
+              << result.num_trial_encodes << " trial encodes" << std::endl;
+  };
+
+  draco_tune::TuneOptions options;
+  options.max_position_error = 1e-4f;
+  options.max_uv_error = 1e-3f;
+  draco_tune::TuneResult result;
+  timer.Start();
+  draco_tune::DracoTune(mesh->vertices(), mesh->uv(), mesh->vertex_indices(),
+                        mesh->uv_indices(), {}, {}, options, result);
+  timer.End();
+  std::cout << "Error budget: " << timer.elapsed_msec() << " ms, ";
+  print(result);
+
+  options = draco_tune::TuneOptions();
+  options.max_uv_error = 1e-3f;
+  options.max_bytes = 64 * 1024;
+  timer.Start();
+  draco_tune::DracoTune(mesh->vertices(), mesh->uv(), mesh->vertex_indices(),
+                        mesh->uv_indices(), {}, {}, options, result);
+  timer.End();
+  std::cout << "Size budget: " << timer.elapsed_msec() << " ms, ";
+  print(result);
+}
+
+void TestTraceMesh() {
+  std::cout << "Per stage trace of encode and decode" << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadObj("../data/bunny.obj");
+
+  draco_trace::Trace trace;
+  draco_encode::DracoEncodeOptions options;
+  options.deduplicate_points = true;
+  options.write_stream_info = true;
+  options.trace = &trace;
+  std::vector<char> bytes;
+  draco_encode::DracoEncode(mesh->vertices(), mesh->uv(),
+                            mesh->vertex_indices(), mesh->uv_indices(), {}, {},
+                            options, bytes);
+
+  std::vector<Eigen::Vector3f> verts;
+  std::vector<Eigen::Vector2f> uvs;
+  std::vector<Eigen::Vector3i> indices;
+  std::vector<Eigen::Vector3i> uv_indices;
+  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+  std::vector<Eigen::Vector3f> normals;
+  draco_decode::DracoDecode(bytes, verts, uvs, indices, uv_indices, colors,
+                            normals, draco_decode::kDecodeAll, &trace);
+
+  for (const auto& stage : trace.Summarize()) {
+    std::cout << stage.name << ": " << stage.total_ms << " ms, "
+              << stage.bytes / 1024 << " kb" << std::endl;
+  }
+
+  ugu::EnsureDirExists("../data_out");
+  trace.WriteChromeTrace("../data_out/bunny_trace.json");
+}
+
+void TestEncodeCache() {
+  std::cout << "Encode cache" << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadObj("../data/bunny.obj");
+  ugu::Timer timer;
+
+  draco_cache::CacheOptions cache_options;
+  cache_options.directory = "../data_out/cache";
+  draco_cache::EncodeCache cache(cache_options);
+  draco_encode::DracoEncodeOptions options;
+  std::vector<char> bytes;
+  for (int i = 0; i < 3; i++) {
+    // The first call encodes unless an earlier run left it on disk
+    if (i == 2) {
+      cache.Clear();
+    }
+    timer.Start();
+    cache.Encode(mesh->vertices(), mesh->uv(), mesh->vertex_indices(),
+                 mesh->uv_indices(), {}, {}, options, bytes);
+    timer.End();
+    std::cout << "Call " << i << ": " << timer.elapsed_msec() << " ms"
+              << std::endl;
+  }
+
+  const draco_cache::CacheStats stats = cache.stats();
+  std::cout << "Memory hits " << stats.memory_hits << ", disk hits "
+            << stats.disk_hits << ", misses " << stats.misses
+            << ", evictions " << stats.evictions << std::endl;
+}
+
+void TestOutOfCorePc() {
+  std::cout << "Out-of-core point cloud" << std::endl;
+
+  ugu::Timer timer;
+  ugu::EnsureDirExists("../data_out");
+  const std::string path = "../data_out/longdress_ooc.c3dt";
+  draco_out_of_core::OutOfCoreOptions options;
+  options.memory_budget = size_t(64) << 20;
+  draco_out_of_core::OutOfCoreStats stats;
+  timer.Start();
+  draco_out_of_core::DracoEncodeFile(
+      "../data/longdress_viewdep_vox12_sampled.ply", path, options, &stats);
+  timer.End();
+  std::cout << "Encode time: " << timer.elapsed_msec() << " ms" << std::endl;
+  std::cout << "Points " << stats.num_vertices << ", parts "
+            << stats.num_parts << ", largest part " << stats.max_part_points
+            << ", temporary files " << stats.temp_bytes / 1024 << " kb"
+            << std::endl;
+
+  file_util::MappedFile file;
+  file.Open(path);
+  std::vector<Eigen::Vector3f> verts;
+  std::vector<Eigen::Vector2f> uvs;
+  std::vector<Eigen::Vector3i> indices;
+  std::vector<Eigen::Vector3i> uv_indices;
+  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+  std::vector<Eigen::Vector3f> normals;
+  // The container is decoded straight from the mapping
+  draco_tile::DracoDecodeTiled(
+      file.data(), file.size(),
+      [](const Eigen::AlignedBox3f&) { return true; }, verts, uvs, indices,
+      uv_indices, colors, normals);
+  std::cout << "Decoded " << verts.size() << " points" << std::endl;
+}
+
+#ifndef _WIN32
+void TestService() {
+  std::cout << "Encode and decode through a resident service" << std::endl;
+
+  ugu::MeshPtr mesh = ugu::Mesh::Create();
+  mesh->LoadObj("../data/bunny.obj");
+  ugu::Timer timer;
+
+  draco_service::ServiceOptions service_options;
+  service_options.socket_path = "/tmp/compress_3d_test.sock";
+  service_options.num_workers = 2;
+  draco_service::Server server(service_options);
+  if (!server.Start()) {
+    return;
+  }
+  std::thread server_thread([&]() { server.Run(); });
+
+  draco_service::Client client;
+  client.Connect(service_options.socket_path);
+  draco_encode::DracoEncodeOptions options;
+  std::vector<char> local_bytes, bytes;
+  draco_encode::DracoEncode(mesh->vertices(), mesh->uv(),
+                            mesh->vertex_indices(), mesh->uv_indices(), {}, {},
+                            options, local_bytes);
+  for (int i = 0; i < 3; i++) {
+    timer.Start();
+    client.Encode(mesh->vertices(), mesh->uv(), mesh->vertex_indices(),
+                  mesh->uv_indices(), {}, {}, options, bytes);
+    timer.End();
+    std::cout << "Call " << i << ": " << timer.elapsed_msec() << " ms"
+              << std::endl;
+  }
+  std::cout << "Same stream as in process: "
+            << (bytes == local_bytes ? "yes" : "no") << std::endl;
+
+  std::vector<Eigen::Vector3f> verts;
+  std::vector<Eigen::Vector2f> uvs;
+  std::vector<Eigen::Vector3i> indices;
+  std::vector<Eigen::Vector3i> uv_indices;
+  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+  std::vector<Eigen::Vector3f> normals;
+  client.Decode(bytes.data(), bytes.size(), verts, uvs, indices, uv_indices,
+                colors, normals);
+  std::cout << "Decoded " << verts.size() << " points, " << indices.size()
+            << " faces" << std::endl;
+
+  client.Close();
+  server.Stop();
+  server_thread.join();
+  const draco_service::ServiceStats stats = server.stats();
+  std::cout << "Requests " << stats.requests << ", shared memory requests "
+            << stats.shm_requests << " and replies " << stats.shm_replies
+            << std::endl;
+}
+#endif
+
 int main() {
   TestObjMesh();
   std::cout << std::endl;
+  TestGlbMesh();
+  std::cout << std::endl;
+  TestInterleavedMesh();
+  std::cout << std::endl;
   TestPlyPc();
+  std::cout << std::endl;
+  TestIntegerPc();
+  std::cout << std::endl;
+  TestTypedPc();
+  std::cout << std::endl;
+  TestEncoderSession();
+  std::cout << std::endl;
+  TestMakeMeshBreakdown();
+  std::cout << std::endl;
+  TestTiledPc();
+  std::cout << std::endl;
+  TestLodPc();
+  std::cout << std::endl;
+  TestSequencePc();
+  std::cout << std::endl;
+  TestAsyncPc();
+  std::cout << std::endl;
+  TestTuneMesh();
+  std::cout << std::endl;
+  TestTraceMesh();
+  std::cout << std::endl;
+  TestEncodeCache();
+  std::cout << std::endl;
+  TestOutOfCorePc();
+#ifndef _WIN32
+  std::cout << std::endl;
+  TestService();
+#endif
 
   return 0;
 }
@@ -0,0 +1,882 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+// windows.h must come first
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "draco_async.h"
+#include "draco_batch.h"
+#include "draco_decode.h"
+#include "draco_encode.h"
+#include "draco_out_of_core.h"
+#include "ugu/mesh.h"
+
+#ifndef _WIN32
+#include "draco_service.h"
+#endif
+
+// Heap allocations of the whole process, Draco's included, counted for
+// --decode-session
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(std::size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct BenchInput {
+  std::string path;
+  std::vector<Eigen::Vector3f> verts;
+  std::vector<Eigen::Vector2f> uvs;
+  std::vector<Eigen::Vector3i> indices;
+  std::vector<Eigen::Vector3i> uv_indices;
+  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+  std::vector<Eigen::Vector3f> normals;
+  size_t org_size = 0;
+};
+
+struct BenchResult {
+  std::string input;
+  draco_encode::DracoEncodeOptions options;
+  size_t org_size = 0;
+  size_t draco_size = 0;
+  std::vector<double> encode_ms;
+  std::vector<double> decode_ms;
+  long peak_rss_kb = 0;
+};
+
+bool LoadInput(const std::string& path, BenchInput& input) {
+  mesh_util::MeshArrays arrays;
+  if (!mesh_util::LoadMeshFile(path, ugu::Mesh::Create(), arrays)) {
+    return false;
+  }
+
+  input.path = path;
+  input.verts = std::move(arrays.verts);
+  input.uvs = std::move(arrays.uvs);
+  input.indices = std::move(arrays.indices);
+  input.uv_indices = std::move(arrays.uv_indices);
+  input.colors = std::move(arrays.colors);
+  input.normals = std::move(arrays.normals);
+
+  input.org_size = input.verts.size() * sizeof(float) * 3 +
+                   input.uvs.size() * sizeof(float) * 2 +
+                   input.indices.size() * sizeof(int) * 3 +
+                   input.uv_indices.size() * sizeof(int) * 3 +
+                   input.colors.size() * sizeof(uint8_t) * 3 +
+                   input.normals.size() * sizeof(float) * 3;
+  return true;
+}
+
+#ifndef _WIN32
+long MaxRssKb(const struct rusage& usage) {
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+  return usage.ru_maxrss;
+#endif
+}
+#endif
+
+// Peak resident set size of this process so far in kilobytes.
+long PeakRssKb() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+    return static_cast<long>(pmc.PeakWorkingSetSize / 1024);
+  }
+  return 0;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return MaxRssKb(usage);
+#endif
+}
+
+#ifndef _WIN32
+// Runs |fn| in a forked child, so that its peak RSS is its own and not
+// hidden by earlier work, and copies the bytes it writes to |out| back.
+// |peak_rss_kb| gets the peak RSS of the child. Returns false if the child
+// fails or |fn| returns false. Call before this process starts threads,
+// which the child would not have.
+bool RunInChild(const std::function<bool(std::vector<char>&)>& fn,
+                std::vector<char>& out, long& peak_rss_kb) {
+  out.clear();
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  // Buffered output would be written twice
+  std::cout.flush();
+  std::cerr.flush();
+  std::fflush(nullptr);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    std::vector<char> result;
+    bool ok = fn(result);
+    std::fflush(nullptr);
+    for (size_t pos = 0; ok && pos < result.size();) {
+      const ssize_t n = write(fds[1], result.data() + pos, result.size() - pos);
+      ok = n > 0;
+      pos += ok ? static_cast<size_t>(n) : 0;
+    }
+    _exit(ok ? 0 : 1);
+  }
+  close(fds[1]);
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+    out.insert(out.end(), buffer, buffer + n);
+  }
+  close(fds[0]);
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) != pid) {
+    return false;
+  }
+  peak_rss_kb = MaxRssKb(usage);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+#endif
+
+double ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Nearest-rank percentile of sorted |values|.
+double Percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.5);
+  rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+  return sorted[rank - 1];
+}
+
+double Mean(const std::vector<double>& values) {
+  double sum = 0.0;
+  for (double v : values) {
+    sum += v;
+  }
+  return values.empty() ? 0.0 : sum / values.size();
+}
+
+BenchResult Run(const BenchInput& input,
+                const draco_encode::DracoEncodeOptions& options, int warmup,
+                int runs) {
+  BenchResult result;
+  result.input = input.path;
+  result.options = options;
+  result.org_size = input.org_size;
+
+  std::vector<char> bytes;
+  std::vector<Eigen::Vector3f> verts;
+  std::vector<Eigen::Vector2f> uvs;
+  std::vector<Eigen::Vector3i> indices;
+  std::vector<Eigen::Vector3i> uv_indices;
+  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+  std::vector<Eigen::Vector3f> normals;
+  for (int i = 0; i < warmup + runs; i++) {
+    auto start = std::chrono::steady_clock::now();
+    draco_encode::DracoEncode(input.verts, input.uvs, input.indices,
+                              input.uv_indices, input.colors, input.normals,
+                              options, bytes);
+    const double encode_ms = ElapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    draco_decode::DracoDecode(bytes, verts, uvs, indices, uv_indices, colors,
+                              normals);
+    const double decode_ms = ElapsedMs(start);
+
+    if (i >= warmup) {
+      result.encode_ms.push_back(encode_ms);
+      result.decode_ms.push_back(decode_ms);
+    }
+  }
+  result.draco_size = bytes.size();
+  result.peak_rss_kb = PeakRssKb();
+  std::sort(result.encode_ms.begin(), result.encode_ms.end());
+  std::sort(result.decode_ms.begin(), result.decode_ms.end());
+  return result;
+}
+
+// Runs Run() in a child process, so that |peak_rss_kb| is the peak of this
+// setting alone rather than of every setting so far. In process on Windows.
+bool RunIsolated(const BenchInput& input,
+                 const draco_encode::DracoEncodeOptions& options, int warmup,
+                 int runs, BenchResult& result) {
+#ifdef _WIN32
+  result = Run(input, options, warmup, runs);
+  return true;
+#else
+  // Passed back as draco_size, then the encode and decode times
+  std::vector<char> out;
+  long peak_kb = 0;
+  const bool ok = RunInChild(
+      [&](std::vector<char>& bytes) {
+        const BenchResult r = Run(input, options, warmup, runs);
+        const uint64_t draco_size = r.draco_size;
+        const size_t times = r.encode_ms.size() * sizeof(double);
+        bytes.resize(sizeof(draco_size) + 2 * times);
+        std::memcpy(bytes.data(), &draco_size, sizeof(draco_size));
+        std::memcpy(bytes.data() + sizeof(draco_size), r.encode_ms.data(),
+                    times);
+        std::memcpy(bytes.data() + sizeof(draco_size) + times,
+                    r.decode_ms.data(), times);
+        return true;
+      },
+      out, peak_kb);
+  const size_t times = static_cast<size_t>(runs) * sizeof(double);
+  if (!ok || out.size() != sizeof(uint64_t) + 2 * times) {
+    std::cerr << "Failed to run " << input.path << std::endl;
+    return false;
+  }
+  result = BenchResult();
+  result.input = input.path;
+  result.options = options;
+  result.org_size = input.org_size;
+  uint64_t draco_size;
+  std::memcpy(&draco_size, out.data(), sizeof(draco_size));
+  result.draco_size = static_cast<size_t>(draco_size);
+  result.encode_ms.resize(runs);
+  result.decode_ms.resize(runs);
+  std::memcpy(result.encode_ms.data(), out.data() + sizeof(draco_size),
+              times);
+  std::memcpy(result.decode_ms.data(),
+              out.data() + sizeof(draco_size) + times, times);
+  result.peak_rss_kb = peak_kb;
+  return true;
+#endif
+}
+
+double MBps(size_t bytes, double ms) {
+  return ms > 0.0 ? bytes / (1024.0 * 1024.0) / (ms / 1000.0) : 0.0;
+}
+
+void WriteCsv(const std::vector<BenchResult>& results, std::ostream& os) {
+  os << "input,pos_bits,tex_bits,nor_bits,level,voxelize,org_bytes,"
+        "draco_bytes,ratio,enc_mean_ms,enc_p50_ms,enc_p90_ms,enc_p99_ms,"
+        "enc_mbps,dec_mean_ms,dec_p50_ms,dec_p90_ms,dec_p99_ms,dec_mbps,"
+        "peak_rss_kb\n";
+  for (const auto& r : results) {
+    const double enc_mean = Mean(r.encode_ms);
+    const double dec_mean = Mean(r.decode_ms);
+    os << r.input << "," << r.options.pos_quantization_bits << ","
+       << r.options.tex_coords_quantization_bits << ","
+       << r.options.normals_quantization_bits << ","
+       << r.options.compression_level << ","
+       << (r.options.voxelize_points ? 1 : 0) << "," << r.org_size << ","
+       << r.draco_size << ","
+       << (r.draco_size > 0 ? double(r.org_size) / r.draco_size : 0.0) << ","
+       << enc_mean << "," << Percentile(r.encode_ms, 50) << ","
+       << Percentile(r.encode_ms, 90) << "," << Percentile(r.encode_ms, 99)
+       << "," << MBps(r.org_size, enc_mean) << "," << dec_mean << ","
+       << Percentile(r.decode_ms, 50) << "," << Percentile(r.decode_ms, 90)
+       << "," << Percentile(r.decode_ms, 99) << ","
+       << MBps(r.org_size, dec_mean) << "," << r.peak_rss_kb << "\n";
+  }
+}
+
+void WriteJson(const std::vector<BenchResult>& results, std::ostream& os) {
+  os << "[\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto& r = results[i];
+    const double enc_mean = Mean(r.encode_ms);
+    const double dec_mean = Mean(r.decode_ms);
+    os << "  {\"input\": \"" << r.input << "\", "
+       << "\"pos_bits\": " << r.options.pos_quantization_bits << ", "
+       << "\"tex_bits\": " << r.options.tex_coords_quantization_bits << ", "
+       << "\"nor_bits\": " << r.options.normals_quantization_bits << ", "
+       << "\"level\": " << r.options.compression_level << ", "
+       << "\"voxelize\": " << (r.options.voxelize_points ? 1 : 0) << ", "
+       << "\"org_bytes\": " << r.org_size << ", "
+       << "\"draco_bytes\": " << r.draco_size << ", "
+       << "\"ratio\": "
+       << (r.draco_size > 0 ? double(r.org_size) / r.draco_size : 0.0)
+       << ", "
+       << "\"encode\": {\"mean_ms\": " << enc_mean
+       << ", \"p50_ms\": " << Percentile(r.encode_ms, 50)
+       << ", \"p90_ms\": " << Percentile(r.encode_ms, 90)
+       << ", \"p99_ms\": " << Percentile(r.encode_ms, 99)
+       << ", \"mbps\": " << MBps(r.org_size, enc_mean) << "}, "
+       << "\"decode\": {\"mean_ms\": " << dec_mean
+       << ", \"p50_ms\": " << Percentile(r.decode_ms, 50)
+       << ", \"p90_ms\": " << Percentile(r.decode_ms, 90)
+       << ", \"p99_ms\": " << Percentile(r.decode_ms, 99)
+       << ", \"mbps\": " << MBps(r.org_size, dec_mean) << "}, "
+       << "\"peak_rss_kb\": " << r.peak_rss_kb << "}"
+       << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  os << "]\n";
+}
+
+// Encodes and decodes |batch_size| copies of each input as one batch with
+// 1, 2, 4, ... threads up to the hardware thread count and writes items/s
+// and the speedup over one thread as CSV.
+void RunBatchScaling(const std::vector<BenchInput>& inputs, int batch_size,
+                     int runs, std::ostream& os) {
+  os << "input,threads,items,enc_items_per_s,enc_speedup,dec_items_per_s,"
+        "dec_speedup\n";
+  std::vector<int> thread_counts;
+  const int hw_threads =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  for (int t = 1; t < hw_threads; t *= 2) {
+    thread_counts.push_back(t);
+  }
+  thread_counts.push_back(hw_threads);
+
+  draco_encode::DracoEncodeOptions options;
+  for (const auto& input : inputs) {
+    mesh_util::MeshArrays arrays;
+    arrays.verts = input.verts;
+    arrays.uvs = input.uvs;
+    arrays.indices = input.indices;
+    arrays.uv_indices = input.uv_indices;
+    arrays.colors = input.colors;
+    arrays.normals = input.normals;
+    const std::vector<mesh_util::MeshArrays> batch(batch_size, arrays);
+
+    double enc_base = 0.0;
+    double dec_base = 0.0;
+    for (int threads : thread_counts) {
+      parallel_util::ThreadPool pool(threads);
+      std::vector<std::vector<char>> streams;
+      std::vector<mesh_util::MeshArrays> decoded;
+      // Called from a worker so that this thread does not help and exactly
+      // |threads| threads do the work
+      auto on_pool = [&pool](const std::function<void()>& func) {
+        std::promise<void> done;
+        pool.Submit([&]() {
+          func();
+          done.set_value();
+        });
+        done.get_future().wait();
+      };
+      // Warmup
+      on_pool([&]() {
+        draco_batch::DracoEncodeBatch(batch, options, streams, pool);
+        draco_batch::DracoDecodeBatch(streams, decoded, pool);
+      });
+
+      auto start = std::chrono::steady_clock::now();
+      on_pool([&]() {
+        for (int r = 0; r < runs; r++) {
+          draco_batch::DracoEncodeBatch(batch, options, streams, pool);
+        }
+      });
+      const double enc_rate = batch_size * runs / (ElapsedMs(start) / 1000.0);
+
+      start = std::chrono::steady_clock::now();
+      on_pool([&]() {
+        for (int r = 0; r < runs; r++) {
+          draco_batch::DracoDecodeBatch(streams, decoded, pool);
+        }
+      });
+      const double dec_rate = batch_size * runs / (ElapsedMs(start) / 1000.0);
+
+      if (threads == 1) {
+        enc_base = enc_rate;
+        dec_base = dec_rate;
+      }
+      os << input.path << "," << threads << "," << batch_size << ","
+         << enc_rate << "," << enc_rate / enc_base << "," << dec_rate << ","
+         << dec_rate / dec_base << "\n";
+      std::cerr << input.path << " threads " << threads << std::endl;
+    }
+  }
+}
+
+#ifndef _WIN32
+// Encodes each input out of core with a memory budget of |budget_mb| in a
+// child process of its own and writes sizes, time and peak RSS as CSV.
+// Inputs are never loaded and this process runs nothing else, so the peak
+// RSS of a child over this process's RSS is the encoder's own. Returns
+// false if any encode fails or exceeds the budget.
+bool RunOutOfCore(const std::vector<std::string>& paths, size_t budget_mb,
+                  std::ostream& os) {
+  struct OutOfCoreRun {
+    uint32_t num_parts = 0;
+    double ms = 0.0;
+  };
+  os << "input,budget_mb,parts,input_mb,output_mb,ms,baseline_rss_mb,"
+        "peak_rss_mb,within_budget\n";
+  bool ret = true;
+  for (const auto& path : paths) {
+    const std::string output =
+        std::filesystem::path(path).stem().string() + ".c3dt";
+    const long baseline_kb = PeakRssKb();
+    std::vector<char> out;
+    long peak_kb = 0;
+    const bool encoded = RunInChild(
+        [&](std::vector<char>& result) {
+          draco_out_of_core::OutOfCoreOptions options;
+          options.memory_budget = budget_mb << 20;
+          draco_out_of_core::OutOfCoreStats stats;
+          const auto start = std::chrono::steady_clock::now();
+          if (!draco_out_of_core::DracoEncodeFile(path, output, options,
+                                                  &stats)) {
+            return false;
+          }
+          OutOfCoreRun run;
+          run.num_parts = stats.num_parts;
+          run.ms = ElapsedMs(start);
+          result.resize(sizeof(run));
+          std::memcpy(result.data(), &run, sizeof(run));
+          return true;
+        },
+        out, peak_kb);
+    OutOfCoreRun run;
+    if (!encoded || out.size() != sizeof(run)) {
+      std::cerr << "Failed to encode " << path << std::endl;
+      ret = false;
+      continue;
+    }
+    std::memcpy(&run, out.data(), sizeof(run));
+    const bool within_budget =
+        peak_kb - baseline_kb <= static_cast<long>(budget_mb * 1024);
+    if (!within_budget) {
+      std::cerr << path << " exceeded the budget of " << budget_mb << " MB"
+                << std::endl;
+    }
+    ret = ret && within_budget;
+    std::error_code ec;
+    os << path << "," << budget_mb << "," << run.num_parts << ","
+       << std::filesystem::file_size(path, ec) / 1e6 << ","
+       << std::filesystem::file_size(output, ec) / 1e6 << "," << run.ms
+       << "," << baseline_kb / 1024.0 << "," << peak_kb / 1024.0 << ","
+       << (within_budget ? 1 : 0) << "\n";
+  }
+  return ret;
+}
+#endif
+
+// Decodes each input |runs| times with DracoDecode into fresh vectors, into
+// reused vectors and with a DracoDecoderSession, encodes it as many times
+// with a DracoEncoderSession, and writes latency and heap allocations per
+// call as CSV. session_allocs counts the decoder session's own output
+// allocations after warmup, which should be zero.
+void RunDecodeSession(const std::vector<BenchInput>& inputs, int warmup,
+                      int runs, std::ostream& os) {
+  os << "input,mode,runs,mean_ms,p50_ms,p99_ms,allocs_per_call,"
+        "session_allocs\n";
+  for (const auto& input : inputs) {
+    std::vector<char> bytes;
+    draco_encode::DracoEncode(input.verts, input.uvs, input.indices,
+                              input.uv_indices, input.colors, input.normals,
+                              draco_encode::DracoEncodeOptions(), bytes);
+
+    std::vector<Eigen::Vector3f> verts;
+    std::vector<Eigen::Vector2f> uvs;
+    std::vector<Eigen::Vector3i> indices;
+    std::vector<Eigen::Vector3i> uv_indices;
+    std::vector<Eigen::Vector<uint8_t, 3>> colors;
+    std::vector<Eigen::Vector3f> normals;
+    draco_decode::DracoDecoderSession session;
+    draco_decode::DecodedArrays arrays;
+    uint64_t session_allocs = 0;
+    draco_encode::DracoEncoderSession encoder(
+        draco_encode::DracoEncodeOptions{});
+    std::vector<char> encoded;
+
+    const char* const modes[] = {"decode", "decode_reused", "session",
+                                 "encode_session"};
+    for (int mode = 0; mode < 4; mode++) {
+      auto decode = [&]() {
+        if (mode == 0) {
+          std::vector<Eigen::Vector3f> v;
+          std::vector<Eigen::Vector2f> t;
+          std::vector<Eigen::Vector3i> f;
+          std::vector<Eigen::Vector3i> tf;
+          std::vector<Eigen::Vector<uint8_t, 3>> c;
+          std::vector<Eigen::Vector3f> n;
+          draco_decode::DracoDecode(bytes, v, t, f, tf, c, n);
+        } else if (mode == 1) {
+          draco_decode::DracoDecode(bytes, verts, uvs, indices, uv_indices,
+                                    colors, normals);
+        } else if (mode == 2) {
+          session.Decode(bytes, arrays);
+        } else {
+          draco_encode::VectorSink sink(encoded);
+          encoder.Encode(input.verts, input.uvs, input.indices,
+                         input.uv_indices, input.colors, input.normals, sink);
+        }
+      };
+      for (int i = 0; i < warmup; i++) {
+        decode();
+      }
+      const uint64_t session_start = session.stats().allocations;
+      const uint64_t allocs_start = g_allocations.load();
+      std::vector<double> ms;
+      for (int i = 0; i < runs; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        decode();
+        ms.push_back(ElapsedMs(start));
+      }
+      const double allocs =
+          double(g_allocations.load() - allocs_start) / runs;
+      if (mode == 2) {
+        session_allocs = session.stats().allocations - session_start;
+      }
+      std::sort(ms.begin(), ms.end());
+      os << input.path << "," << modes[mode] << "," << runs << ","
+         << Mean(ms) << "," << Percentile(ms, 50) << ","
+         << Percentile(ms, 99) << "," << allocs << ","
+         << (mode == 2 ? std::to_string(session_allocs) : "") << "\n";
+    }
+    std::cerr << input.path << " decode session" << std::endl;
+  }
+}
+
+// Submits each input to an AsyncEncoder at |fps| frames per second for
+// |num_frames| frames per budget policy, with a budget of one frame period,
+// and writes the latency from submission to completion as CSV.
+void RunLive(const std::vector<BenchInput>& inputs, double fps,
+             int num_frames, std::ostream& os) {
+  os << "input,policy,frames,encoded,fallbacks,dropped,p50_ms,p99_ms,"
+        "max_ms,encode_p50_ms\n";
+  const auto frame_time = std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(1.0 / fps));
+  const draco_async::BudgetPolicy policies[] = {
+      draco_async::BudgetPolicy::kIgnore, draco_async::BudgetPolicy::kDrop,
+      draco_async::BudgetPolicy::kFallback};
+  const char* const policy_names[] = {"ignore", "drop", "fallback"};
+  for (const auto& input : inputs) {
+    for (int p = 0; p < 3; p++) {
+      draco_async::AsyncEncodeOptions options;
+      options.latency_budget_ms = 1000.0 / fps;
+      options.policy = policies[p];
+      draco_async::AsyncStats stats;
+      {
+        draco_async::AsyncEncoder encoder(options);
+        auto next_time = std::chrono::steady_clock::now();
+        for (int i = 0; i < num_frames; i++) {
+          mesh_util::MeshArrays frame;
+          frame.verts = input.verts;
+          frame.uvs = input.uvs;
+          frame.indices = input.indices;
+          frame.uv_indices = input.uv_indices;
+          frame.colors = input.colors;
+          frame.normals = input.normals;
+          encoder.Submit(std::move(frame), [](draco_async::FrameResult&&) {});
+          next_time += frame_time;
+          std::this_thread::sleep_until(next_time);
+        }
+        encoder.Flush();
+        stats = encoder.stats();
+      }
+      os << input.path << "," << policy_names[p] << "," << stats.submitted
+         << "," << stats.encoded << "," << stats.fallbacks << ","
+         << stats.dropped << "," << stats.latency_p50_ms << ","
+         << stats.latency_p99_ms << "," << stats.latency_max_ms << ","
+         << stats.encode_p50_ms << "\n";
+      std::cerr << input.path << " live " << policy_names[p] << std::endl;
+    }
+  }
+}
+
+#ifndef _WIN32
+// Runs each input |runs| times in process and through the compress_3d_daemon
+// listening on |socket_path|, and writes latency per call as CSV. ping is
+// the transport alone; the gap between encode and service_encode is what a
+// client pays for not linking the encoder.
+bool RunService(const std::vector<BenchInput>& inputs,
+                const std::string& socket_path, int warmup, int runs,
+                std::ostream& os) {
+  draco_service::Client client;
+  if (!client.Connect(socket_path)) {
+    return false;
+  }
+  os << "input,mode,runs,mean_ms,p50_ms,p99_ms\n";
+  const draco_encode::DracoEncodeOptions options;
+  for (const auto& input : inputs) {
+    std::vector<char> bytes;
+    draco_encode::DracoEncode(input.verts, input.uvs, input.indices,
+                              input.uv_indices, input.colors, input.normals,
+                              options, bytes);
+    std::vector<char> out;
+    std::vector<Eigen::Vector3f> verts;
+    std::vector<Eigen::Vector2f> uvs;
+    std::vector<Eigen::Vector3i> indices;
+    std::vector<Eigen::Vector3i> uv_indices;
+    std::vector<Eigen::Vector<uint8_t, 3>> colors;
+    std::vector<Eigen::Vector3f> normals;
+
+    const char* const modes[] = {"ping", "encode", "service_encode", "decode",
+                                 "service_decode"};
+    for (int mode = 0; mode < 5; mode++) {
+      auto call = [&]() {
+        switch (mode) {
+          case 0:
+            return client.Ping();
+          case 1:
+            return draco_encode::DracoEncode(
+                input.verts, input.uvs, input.indices, input.uv_indices,
+                input.colors, input.normals, options, out);
+          case 2:
+            return client.Encode(input.verts, input.uvs, input.indices,
+                                 input.uv_indices, input.colors,
+                                 input.normals, options, out);
+          case 3:
+            return draco_decode::DracoDecode(bytes, verts, uvs, indices,
+                                             uv_indices, colors, normals);
+          default:
+            return client.Decode(bytes.data(), bytes.size(), verts, uvs,
+                                 indices, uv_indices, colors, normals);
+        }
+      };
+      for (int i = 0; i < warmup; i++) {
+        call();
+      }
+      std::vector<double> ms;
+      for (int i = 0; i < runs; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        if (!call()) {
+          return false;
+        }
+        ms.push_back(ElapsedMs(start));
+      }
+      std::sort(ms.begin(), ms.end());
+      os << input.path << "," << modes[mode] << "," << runs << ","
+         << Mean(ms) << "," << Percentile(ms, 50) << ","
+         << Percentile(ms, 99) << "\n";
+    }
+    std::cerr << input.path << " service" << std::endl;
+  }
+  return true;
+}
+#endif
+
+std::vector<int> ParseIntList(const std::string& s) {
+  std::vector<int> values;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(std::atoi(item.c_str()));
+  }
+  return values;
+}
+
+void PrintUsage() {
+  std::cout
+      << "Usage: compress_3d_bench [options] [input.obj|input.ply ...]\n"
+         "  --warmup N         warmup runs per setting (default 2)\n"
+         "  --runs N           measured runs per setting (default 10)\n"
+         "  --pos a,b,..       pos_quantization_bits (default 8,11,14)\n"
+         "  --tex a,b,..       tex_coords_quantization_bits (default 8,10,12)\n"
+         "  --nor a,b,..       normals_quantization_bits (default 6,8,10)\n"
+         "  --level a,b,..     compression_level (default 0,3,7,10)\n"
+         "  --voxelize a,b,..  voxelize_points, 0 or 1 (default 0); only\n"
+         "                     swept for point clouds\n"
+         "  --format csv|json  output format (default csv)\n"
+         "  --out path         output file (default stdout)\n"
+         "  --batch N          instead of sweeping settings, measure batch\n"
+         "                     throughput of N copies per input over thread\n"
+         "                     counts (CSV only)\n"
+         "  --decode-session   instead of sweeping settings, compare heap\n"
+         "                     allocations and latency per decode of\n"
+         "                     DracoDecode and DracoDecoderSession, and per\n"
+         "                     encode of DracoEncoderSession (CSV only)\n"
+         "  --live FPS         instead of sweeping settings, submit --runs\n"
+         "                     frames (at least 100) per input at FPS to the\n"
+         "                     asynchronous encoder with each budget policy\n"
+         "                     and report latency percentiles (CSV only)\n"
+#ifndef _WIN32
+         "  --ooc-budget MB    instead of sweeping settings, encode each\n"
+         "                     input out of core to <name>.c3dt within MB of\n"
+         "                     memory in a child process and check its peak\n"
+         "                     RSS against it (CSV only, exit code 1 if\n"
+         "                     exceeded)\n"
+         "  --service path     instead of sweeping settings, compare latency\n"
+         "                     in process and through compress_3d_daemon on\n"
+         "                     the socket at path (CSV only)\n"
+#endif
+      ;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int warmup = 2;
+  int runs = 10;
+  std::vector<int> pos_bits = {8, 11, 14};
+  std::vector<int> tex_bits = {8, 10, 12};
+  std::vector<int> nor_bits = {6, 8, 10};
+  std::vector<int> levels = {0, 3, 7, 10};
+  std::vector<int> voxelize = {0};
+  std::string format = "csv";
+  std::string out_path;
+  int batch_size = 0;
+  size_t ooc_budget_mb = 0;
+  bool decode_session = false;
+  std::string service_socket;
+  double live_fps = 0.0;
+  std::vector<std::string> paths;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--help" || arg == "-h") {
+      PrintUsage();
+      return 0;
+    } else if (arg == "--warmup" && has_value) {
+      warmup = std::atoi(argv[++i]);
+    } else if (arg == "--runs" && has_value) {
+      runs = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--pos" && has_value) {
+      pos_bits = ParseIntList(argv[++i]);
+    } else if (arg == "--tex" && has_value) {
+      tex_bits = ParseIntList(argv[++i]);
+    } else if (arg == "--nor" && has_value) {
+      nor_bits = ParseIntList(argv[++i]);
+    } else if (arg == "--level" && has_value) {
+      levels = ParseIntList(argv[++i]);
+    } else if (arg == "--voxelize" && has_value) {
+      voxelize = ParseIntList(argv[++i]);
+    } else if (arg == "--format" && has_value) {
+      format = argv[++i];
+    } else if (arg == "--out" && has_value) {
+      out_path = argv[++i];
+    } else if (arg == "--batch" && has_value) {
+      batch_size = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--decode-session") {
+      decode_session = true;
+    } else if (arg == "--ooc-budget" && has_value) {
+      ooc_budget_mb = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--live" && has_value) {
+      live_fps = std::max(1.0, std::atof(argv[++i]));
+    } else if (arg == "--service" && has_value) {
+      service_socket = argv[++i];
+    } else if (arg.rfind("--", 0) == 0) {
+      PrintUsage();
+      return 1;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty()) {
+    paths = {"../data/bunny.obj",
+             "../data/longdress_viewdep_vox12_sampled.ply"};
+  }
+
+  std::ofstream ofs;
+  if (!out_path.empty()) {
+    ofs.open(out_path);
+  }
+  std::ostream& os = out_path.empty() ? std::cout : ofs;
+
+#ifndef _WIN32
+  if (ooc_budget_mb > 0) {
+    return RunOutOfCore(paths, ooc_budget_mb, os) ? 0 : 1;
+  }
+#endif
+
+  std::vector<BenchInput> inputs;
+  for (const auto& path : paths) {
+    BenchInput input;
+    if (LoadInput(path, input)) {
+      inputs.push_back(std::move(input));
+    }
+  }
+
+  if (batch_size > 0) {
+    RunBatchScaling(inputs, batch_size, runs, os);
+    return 0;
+  }
+  if (decode_session) {
+    RunDecodeSession(inputs, warmup, runs, os);
+    return 0;
+  }
+  if (live_fps > 0.0) {
+    RunLive(inputs, live_fps, std::max(runs, 100), os);
+    return 0;
+  }
+#ifndef _WIN32
+  if (!service_socket.empty()) {
+    return RunService(inputs, service_socket, warmup, runs, os) ? 0 : 1;
+  }
+#endif
+
+  std::vector<BenchResult> results;
+  for (const auto& input : inputs) {
+    // Settings an input has no attribute for are not swept.
+    const bool with_uvs = !input.uvs.empty();
+    const bool with_normals = input.normals.size() == input.verts.size();
+    const std::vector<int> input_tex_bits =
+        with_uvs ? tex_bits : std::vector<int>{tex_bits.front()};
+    const std::vector<int> input_nor_bits =
+        with_normals ? nor_bits : std::vector<int>{nor_bits.front()};
+    const std::vector<int> input_voxelize =
+        input.indices.empty() ? voxelize : std::vector<int>{0};
+    for (int pos : pos_bits) {
+      for (int tex : input_tex_bits) {
+        for (int nor : input_nor_bits) {
+          for (int level : levels) {
+            for (int vox : input_voxelize) {
+              draco_encode::DracoEncodeOptions options;
+              options.pos_quantization_bits = pos;
+              options.tex_coords_quantization_bits = tex;
+              options.normals_quantization_bits = nor;
+              options.compression_level = level;
+              options.voxelize_points = vox != 0;
+              BenchResult result;
+              if (!RunIsolated(input, options, warmup, runs, result)) {
+                return 1;
+              }
+              results.push_back(std::move(result));
+              std::cerr << input.path << " pos " << pos << " tex " << tex
+                        << " nor " << nor << " level " << level
+                        << " voxelize " << vox << std::endl;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if (format == "json") {
+    WriteJson(results, os);
+  } else {
+    WriteCsv(results, os);
+  }
+
+  return 0;
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "draco_service.h"
+#include "ugu/mesh.h"
+
+namespace {
+
+draco_service::Server* g_server = nullptr;
+
+void HandleSignal(int) {
+  if (g_server != nullptr) {
+    g_server->Stop();
+  }
+}
+
+bool LoadFile(const std::string& path, mesh_util::MeshArrays& out) {
+  return mesh_util::LoadMeshFile(path, ugu::Mesh::Create(), out);
+}
+
+void PrintUsage() {
+  std::cout
+      << "Usage: compress_3d_daemon [options]\n"
+         "  --socket path        Unix domain socket to listen on\n"
+         "                       (default /tmp/compress_3d.sock)\n"
+         "  --workers N          encode/decode threads (default hardware\n"
+         "                       threads)\n"
+         "  --queue N            requests waiting for a worker before\n"
+         "                       connections stop being read (default 64)\n"
+         "  --shm-kb N           replies from N kb on go through shared\n"
+         "                       memory (default 256)\n"
+         "  --cache-mb N         in-memory encode cache shared by all\n"
+         "                       clients (default 0, disabled)\n"
+         "  --cache-dir path     disk tier of the encode cache\n"
+         "Clients connect with draco_service::Client. SIGINT or SIGTERM\n"
+         "finishes queued requests, prints statistics and exits.\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  draco_service::ServiceOptions options;
+  options.socket_path = "/tmp/compress_3d.sock";
+  options.load_file = LoadFile;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--help" || arg == "-h") {
+      PrintUsage();
+      return 0;
+    } else if (arg == "--socket" && has_value) {
+      options.socket_path = argv[++i];
+    } else if (arg == "--workers" && has_value) {
+      options.num_workers = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--queue" && has_value) {
+      options.queue_capacity = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--shm-kb" && has_value) {
+      options.shm_threshold = size_t(std::max(1, std::atoi(argv[++i]))) << 10;
+    } else if (arg == "--cache-mb" && has_value) {
+      options.cache_memory_bytes = size_t(std::max(0, std::atoi(argv[++i])))
+                                   << 20;
+    } else if (arg == "--cache-dir" && has_value) {
+      options.cache_directory = argv[++i];
+    } else {
+      PrintUsage();
+      return 1;
+    }
+  }
+
+  draco_service::Server server(options);
+  if (!server.Start()) {
+    return 1;
+  }
+  g_server = &server;
+  std::signal(SIGINT, HandleSignal);
+  std::signal(SIGTERM, HandleSignal);
+  std::signal(SIGPIPE, SIG_IGN);
+  std::cout << "Listening on " << options.socket_path << std::endl;
+
+  server.Run();
+  g_server = nullptr;
+
+  const draco_service::ServiceStats stats = server.stats();
+  std::cout << "Connections " << stats.connections << ", requests "
+            << stats.requests << " (" << stats.failed << " failed), encodes "
+            << stats.encodes << ", decodes " << stats.decodes
+            << ", shared memory requests " << stats.shm_requests
+            << " and replies " << stats.shm_replies << ", busy "
+            << stats.busy_ms << " ms" << std::endl;
+  return 0;
+}
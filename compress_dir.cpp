@@ -0,0 +1,392 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "draco_encode.h"
+#include "file_util.h"
+#include "mesh_util.h"
+#include "ugu/mesh.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// An input file and where its stream goes, relative to the output directory.
+struct Task {
+  fs::path src;
+  fs::path dst;
+};
+
+struct ParsedJob {
+  fs::path dst;
+  mesh_util::MeshArrays arrays;
+};
+
+struct EncodedJob {
+  fs::path dst;
+  std::vector<char> bytes;
+};
+
+// The writer stage has no downstream queue.
+struct Written {};
+
+struct StageCounters {
+  size_t items = 0;
+  size_t failed = 0;
+  uint64_t bytes = 0;
+  // Time spent processing items, waiting for an input item and waiting for
+  // room downstream. Summed over the workers of a stage.
+  double busy_ms = 0.0;
+  double wait_in_ms = 0.0;
+  double wait_out_ms = 0.0;
+};
+
+struct Stage {
+  Stage(const char* name, int num_workers)
+      : name(name), num_workers(num_workers), running(num_workers) {}
+  const char* name;
+  int num_workers;
+  std::atomic<int> running;
+  std::mutex mutex;
+  StageCounters totals;
+};
+
+double ElapsedMs(std::chrono::steady_clock::time_point start,
+                 std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Pops items from |in| until it is closed and drained, runs
+// func(item, result, bytes) on each, and pushes successful results to |out|.
+// The last worker of |stage| to finish closes |out|.
+template <typename In, typename Out, typename Func>
+void StageWorker(parallel_util::BoundedQueue<In>& in,
+                 parallel_util::BoundedQueue<Out>* out, Func func,
+                 Stage& stage) {
+  StageCounters counters;
+  auto t = std::chrono::steady_clock::now();
+  In item;
+  while (in.Pop(item)) {
+    const auto popped = std::chrono::steady_clock::now();
+    counters.wait_in_ms += ElapsedMs(t, popped);
+
+    Out result;
+    uint64_t bytes = 0;
+    const bool ok = func(item, result, bytes);
+    const auto done = std::chrono::steady_clock::now();
+    counters.busy_ms += ElapsedMs(popped, done);
+    if (ok) {
+      counters.items++;
+      counters.bytes += bytes;
+      if (out != nullptr) {
+        out->Push(std::move(result));
+      }
+    } else {
+      counters.failed++;
+    }
+    t = std::chrono::steady_clock::now();
+    counters.wait_out_ms += ElapsedMs(done, t);
+  }
+  counters.wait_in_ms += ElapsedMs(t, std::chrono::steady_clock::now());
+
+  {
+    std::lock_guard<std::mutex> lock(stage.mutex);
+    stage.totals.items += counters.items;
+    stage.totals.failed += counters.failed;
+    stage.totals.bytes += counters.bytes;
+    stage.totals.busy_ms += counters.busy_ms;
+    stage.totals.wait_in_ms += counters.wait_in_ms;
+    stage.totals.wait_out_ms += counters.wait_out_ms;
+  }
+  if (--stage.running == 0 && out != nullptr) {
+    out->Close();
+  }
+}
+
+bool IsInputFile(const fs::path& path) {
+  const std::string ext = mesh_util::LowerExtension(path.string());
+  return ext == ".obj" || ext == ".ply";
+}
+
+// Directories are searched recursively and mirrored in the output
+// directory. Files are written to the top of it. Fails if two inputs would
+// be written to the same .drc, e.g. a.obj and a.ply.
+bool CollectTasks(const std::vector<std::string>& inputs,
+                  std::vector<Task>& tasks) {
+  for (const auto& input : inputs) {
+    std::error_code ec;
+    if (fs::is_directory(input, ec)) {
+      std::vector<Task> found;
+      for (fs::recursive_directory_iterator it(input, ec), end;
+           !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec) && IsInputFile(it->path())) {
+          Task task;
+          task.src = it->path();
+          task.dst = fs::relative(it->path(), input, ec);
+          found.push_back(std::move(task));
+        }
+      }
+      if (ec) {
+        printf("Error: Failed to list %s.\n", input.c_str());
+        return false;
+      }
+      // Directory order is unspecified
+      std::sort(found.begin(), found.end(),
+                [](const Task& a, const Task& b) { return a.src < b.src; });
+      tasks.insert(tasks.end(), found.begin(), found.end());
+    } else if (IsInputFile(input)) {
+      Task task;
+      task.src = input;
+      task.dst = task.src.filename();
+      tasks.push_back(std::move(task));
+    } else {
+      printf("Error: %s is neither a directory nor an obj/ply file.\n",
+             input.c_str());
+      return false;
+    }
+  }
+  std::map<fs::path, fs::path> src_of_dst;
+  for (auto& task : tasks) {
+    task.dst.replace_extension(".drc");
+    auto it = src_of_dst.emplace(task.dst.lexically_normal(), task.src);
+    if (!it.second) {
+      printf("Error: %s and %s would both be written to %s.\n",
+             it.first->second.string().c_str(), task.src.string().c_str(),
+             task.dst.string().c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Parse(const Task& task, ParsedJob& job, uint64_t& bytes) {
+  if (!mesh_util::LoadMeshFile(task.src.string(), ugu::Mesh::Create(),
+                               job.arrays)) {
+    return false;
+  }
+  job.dst = task.dst;
+
+  const mesh_util::MeshArrays& a = job.arrays;
+  bytes = a.verts.size() * sizeof(float) * 3 +
+          a.uvs.size() * sizeof(float) * 2 +
+          a.indices.size() * sizeof(int) * 3 +
+          a.uv_indices.size() * sizeof(int) * 3 +
+          a.colors.size() * sizeof(uint8_t) * 3 +
+          a.normals.size() * sizeof(float) * 3;
+  return true;
+}
+
+bool Write(const fs::path& out_dir, EncodedJob& job, uint64_t& bytes) {
+  const fs::path path = out_dir / job.dst;
+  std::error_code ec;
+  fs::create_directories(path.parent_path(), ec);
+  if (!file_util::WriteFile(path.string(), job.bytes.data(),
+                            job.bytes.size())) {
+    return false;
+  }
+  bytes = job.bytes.size();
+  return true;
+}
+
+void PrintReport(const std::vector<Stage*>& stages, double wall_ms) {
+  printf("%-8s %7s %7s %6s %10s %9s %8s %7s %9s %9s\n", "stage", "workers",
+         "items", "failed", "MB", "items/s", "MB/s", "busy%", "starved%",
+         "blocked%");
+  const Stage* slowest = nullptr;
+  double slowest_busy = -1.0;
+  for (const Stage* stage : stages) {
+    const StageCounters& c = stage->totals;
+    // Shares of the stage's total worker time
+    const double worker_ms = std::max(wall_ms * stage->num_workers, 1e-9);
+    const double busy = 100.0 * c.busy_ms / worker_ms;
+    const double seconds = std::max(wall_ms / 1000.0, 1e-9);
+    printf("%-8s %7d %7zu %6zu %10.2f %9.2f %8.2f %7.1f %9.1f %9.1f\n",
+           stage->name, stage->num_workers, c.items, c.failed,
+           c.bytes / 1e6, c.items / seconds, c.bytes / 1e6 / seconds, busy,
+           100.0 * c.wait_in_ms / worker_ms, 100.0 * c.wait_out_ms / worker_ms);
+    if (busy > slowest_busy) {
+      slowest_busy = busy;
+      slowest = stage;
+    }
+  }
+  printf("Total: %.1f ms\n", wall_ms);
+  if (slowest != nullptr) {
+    printf("Slowest stage: %s (%.1f%% busy)\n", slowest->name, slowest_busy);
+  }
+}
+
+void PrintUsage() {
+  std::cout
+      << "Usage: compress_3d_dir [options] <dir|file.obj|file.ply> ...\n"
+         "  --out dir            output directory (default drc)\n"
+         "  --list path          also read inputs from a file, one per line\n"
+         "  --parse-workers N    threads loading obj/ply (default 2)\n"
+         "  --encode-workers N   threads encoding (default hardware threads\n"
+         "                       minus parse and write workers)\n"
+         "  --write-workers N    threads writing .drc files (default 1)\n"
+         "  --queue N            capacity of each queue between stages\n"
+         "                       (default 4)\n"
+         "  --pos N              pos_quantization_bits\n"
+         "  --tex N              tex_coords_quantization_bits\n"
+         "  --nor N              normals_quantization_bits\n"
+         "  --level N            compression_level\n"
+         "Directories are searched recursively and mirrored in the output\n"
+         "directory.\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string out_dir = "drc";
+  int parse_workers = 2;
+  int encode_workers = 0;
+  int write_workers = 1;
+  size_t queue_capacity = 4;
+  draco_encode::DracoEncodeOptions options;
+  std::vector<std::string> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--help" || arg == "-h") {
+      PrintUsage();
+      return 0;
+    } else if (arg == "--out" && has_value) {
+      out_dir = argv[++i];
+    } else if (arg == "--list" && has_value) {
+      std::ifstream ifs(argv[++i]);
+      if (!ifs) {
+        printf("Error: Failed to open %s.\n", argv[i]);
+        return 1;
+      }
+      std::string line;
+      while (std::getline(ifs, line)) {
+        if (!line.empty() && line.back() == '\r') {
+          line.pop_back();
+        }
+        if (!line.empty()) {
+          inputs.push_back(line);
+        }
+      }
+    } else if (arg == "--parse-workers" && has_value) {
+      parse_workers = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--encode-workers" && has_value) {
+      encode_workers = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--write-workers" && has_value) {
+      write_workers = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--queue" && has_value) {
+      queue_capacity = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--pos" && has_value) {
+      options.pos_quantization_bits = std::atoi(argv[++i]);
+    } else if (arg == "--tex" && has_value) {
+      options.tex_coords_quantization_bits = std::atoi(argv[++i]);
+    } else if (arg == "--nor" && has_value) {
+      options.normals_quantization_bits = std::atoi(argv[++i]);
+    } else if (arg == "--level" && has_value) {
+      options.compression_level = std::atoi(argv[++i]);
+    } else if (arg.rfind("--", 0) == 0) {
+      PrintUsage();
+      return 1;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  if (inputs.empty()) {
+    PrintUsage();
+    return 1;
+  }
+  if (encode_workers == 0) {
+    const int hw_threads =
+        static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    encode_workers = std::max(1, hw_threads - parse_workers - write_workers);
+  }
+
+  std::vector<Task> tasks;
+  if (!CollectTasks(inputs, tasks)) {
+    return 1;
+  }
+  printf("%zu files\n", tasks.size());
+
+  // Queues hold at most |queue_capacity| items each, so memory is bounded by
+  // the number of workers and queued items rather than the library size.
+  parallel_util::BoundedQueue<Task> task_queue(queue_capacity);
+  parallel_util::BoundedQueue<ParsedJob> parsed_queue(queue_capacity);
+  parallel_util::BoundedQueue<EncodedJob> encoded_queue(queue_capacity);
+
+  Stage parse_stage("parse", parse_workers);
+  Stage encode_stage("encode", encode_workers);
+  Stage write_stage("write", write_workers);
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < parse_workers; i++) {
+    threads.emplace_back([&]() {
+      StageWorker(task_queue, &parsed_queue, Parse, parse_stage);
+    });
+  }
+  for (int i = 0; i < encode_workers; i++) {
+    threads.emplace_back([&]() {
+      // Buffers are reused across the files of a worker
+      draco_encode::DracoEncoderSession session(options);
+      StageWorker(
+          parsed_queue, &encoded_queue,
+          [&](ParsedJob& job, EncodedJob& result, uint64_t& bytes) {
+            const mesh_util::MeshArrays& a = job.arrays;
+            draco_encode::VectorSink sink(result.bytes);
+            if (!session.Encode(a.verts, a.uvs, a.indices, a.uv_indices,
+                                a.colors, a.normals, sink)) {
+              printf("Error: Failed to encode %s.\n",
+                     job.dst.string().c_str());
+              return false;
+            }
+            result.dst = std::move(job.dst);
+            bytes = result.bytes.size();
+            // Release the geometry before waiting on the writer
+            job = ParsedJob();
+            return true;
+          },
+          encode_stage);
+    });
+  }
+  const fs::path out_path(out_dir);
+  for (int i = 0; i < write_workers; i++) {
+    threads.emplace_back([&]() {
+      StageWorker(
+          encoded_queue,
+          static_cast<parallel_util::BoundedQueue<Written>*>(nullptr),
+          [&](EncodedJob& job, Written&, uint64_t& bytes) {
+            return Write(out_path, job, bytes);
+          },
+          write_stage);
+    });
+  }
+
+  // Feeding blocks while the parsers are behind
+  for (auto& task : tasks) {
+    task_queue.Push(std::move(task));
+  }
+  task_queue.Close();
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const double wall_ms = ElapsedMs(start, std::chrono::steady_clock::now());
+
+  PrintReport({&parse_stage, &encode_stage, &write_stage}, wall_ms);
+
+  const size_t failed = parse_stage.totals.failed +
+                        encode_stage.totals.failed +
+                        write_stage.totals.failed;
+  return failed == 0 ? 0 : 1;
+}
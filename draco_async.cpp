@@ -0,0 +1,385 @@
+#include "draco_async.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Latency percentiles are taken over this many most recent frames
+constexpr size_t kLatencyWindow = 1024;
+
+// Weight of the newest frame in the encode time per point estimate
+constexpr double kEstimateWeight = 0.25;
+
+constexpr int kNumLevels = 11;
+
+double ElapsedMs(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Nearest rank percentile, |values| is reordered
+double Percentile(std::vector<double>& values, double p) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  size_t rank = static_cast<size_t>(p / 100.0 * values.size() + 0.5);
+  rank = std::min(std::max<size_t>(rank, 1), values.size());
+  std::nth_element(values.begin(), values.begin() + (rank - 1), values.end());
+  return values[rank - 1];
+}
+
+int ClampLevel(int level) { return std::min(std::max(level, 0), 10); }
+
+}  // namespace
+
+namespace draco_async {
+
+AsyncEncodeOptions::AsyncEncodeOptions()
+    : num_workers(2),
+      max_in_flight(4),
+      drop_when_full(true),
+      latency_budget_ms(0.0),
+      policy(BudgetPolicy::kFallback),
+      fallback_compression_level(0) {}
+
+class AsyncEncoder::Impl {
+ public:
+  explicit Impl(const AsyncEncodeOptions& options)
+      : options_(options),
+        running_(0),
+        completing_(0),
+        next_frame_id_(0),
+        stop_(false) {
+    options_.max_in_flight = std::max<size_t>(options_.max_in_flight, 1);
+    std::fill(std::begin(ms_per_point_), std::end(ms_per_point_), -1.0);
+    int num_workers = options_.num_workers;
+    if (num_workers <= 0) {
+      num_workers =
+          std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i < num_workers; i++) {
+      workers_.emplace_back([this]() { WorkerLoop(); });
+    }
+  }
+
+  ~Impl() {
+    Flush();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  void Submit(mesh_util::MeshArrays frame,
+              std::function<void(FrameResult&&)> done,
+              std::function<void()> then) {
+    Job job;
+    job.frame = std::move(frame);
+    job.done = std::move(done);
+    job.then = std::move(then);
+    Job dropped;
+    bool drop_oldest = false;
+    bool drop_new = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job.frame_id = next_frame_id_++;
+      stats_.submitted++;
+      if (!options_.drop_when_full) {
+        room_cv_.wait(lock, [&]() {
+          return pending_.size() + running_ < options_.max_in_flight;
+        });
+      } else if (pending_.size() + running_ >= options_.max_in_flight) {
+        // The newest frame is the most useful one to a live consumer
+        if (!pending_.empty()) {
+          dropped = std::move(pending_.front());
+          pending_.pop_front();
+          drop_oldest = true;
+        } else {
+          drop_new = true;
+        }
+        stats_.dropped++;
+        completing_++;
+      }
+      job.submitted = Clock::now();
+      if (!drop_new) {
+        pending_.push_back(std::move(job));
+      }
+    }
+    if (!drop_new) {
+      work_cv_.notify_one();
+    }
+    if (drop_oldest || drop_new) {
+      Job& job_to_drop = drop_new ? job : dropped;
+      FrameResult result;
+      result.frame_id = job_to_drop.frame_id;
+      result.status = FrameStatus::kDropped;
+      result.queue_ms = drop_new ? 0.0
+                                 : ElapsedMs(job_to_drop.submitted,
+                                             Clock::now());
+      result.latency_ms = result.queue_ms;
+      if (job_to_drop.done) {
+        job_to_drop.done(std::move(result));
+      }
+      FinishCompletion();
+      if (job_to_drop.then) {
+        job_to_drop.then();
+      }
+    }
+  }
+
+  void Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [&]() {
+      return pending_.empty() && running_ == 0 && completing_ == 0;
+    });
+  }
+
+  size_t in_flight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size() + running_;
+  }
+
+  AsyncStats stats() const {
+    std::vector<double> latency, encode;
+    AsyncStats stats;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats = stats_;
+      latency = latency_ms_;
+      encode = encode_ms_;
+    }
+    if (!latency.empty()) {
+      stats.latency_max_ms = *std::max_element(latency.begin(), latency.end());
+    }
+    stats.latency_p50_ms = Percentile(latency, 50);
+    stats.latency_p99_ms = Percentile(latency, 99);
+    stats.encode_p50_ms = Percentile(encode, 50);
+    stats.encode_p99_ms = Percentile(encode, 99);
+    return stats;
+  }
+
+ private:
+  struct Job {
+    uint64_t frame_id = 0;
+    mesh_util::MeshArrays frame;
+    Clock::time_point submitted;
+    std::function<void(FrameResult&&)> done;
+    std::function<void()> then;
+  };
+
+  // Encoder sessions of a worker, created on first use of a level
+  struct WorkerState {
+    std::unique_ptr<draco_encode::DracoEncoderSession> sessions[kNumLevels];
+  };
+
+  // Chooses the level of a frame that waited |queue_ms|, or -1 to drop it.
+  // Called with |mutex_| held.
+  int ChooseLevel(double queue_ms, size_t num_points) const {
+    const int level =
+        ClampLevel(options_.encode_options.compression_level);
+    if (options_.latency_budget_ms <= 0.0 ||
+        options_.policy == BudgetPolicy::kIgnore) {
+      return level;
+    }
+    auto fits = [&](int l) {
+      // Unknown levels are given the benefit of the doubt
+      return ms_per_point_[l] < 0.0 ||
+             queue_ms + ms_per_point_[l] * num_points <=
+                 options_.latency_budget_ms;
+    };
+    if (fits(level)) {
+      return level;
+    }
+    if (options_.policy == BudgetPolicy::kDrop) {
+      return -1;
+    }
+    // Late frames still get encoded, as fast as possible
+    return ClampLevel(options_.fallback_compression_level);
+  }
+
+  void WorkerLoop() {
+    WorkerState state;
+    while (true) {
+      Job job;
+      int level;
+      Clock::time_point start;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_cv_.wait(lock, [&]() { return stop_ || !pending_.empty(); });
+        if (pending_.empty()) {
+          return;
+        }
+        job = std::move(pending_.front());
+        pending_.pop_front();
+        start = Clock::now();
+        level = ChooseLevel(ElapsedMs(job.submitted, start),
+                            job.frame.verts.size());
+        if (level >= 0) {
+          running_++;
+        } else {
+          stats_.dropped++;
+          completing_++;
+        }
+      }
+      if (level < 0) {
+        // The popped frame freed a slot a blocked Submit() may wait for
+        room_cv_.notify_one();
+      }
+
+      FrameResult result;
+      result.frame_id = job.frame_id;
+      result.queue_ms = ElapsedMs(job.submitted, start);
+      if (level < 0) {
+        result.status = FrameStatus::kDropped;
+        result.latency_ms = result.queue_ms;
+        if (job.done) {
+          job.done(std::move(result));
+        }
+        FinishCompletion();
+        if (job.then) {
+          job.then();
+        }
+        continue;
+      }
+
+      Encode(job.frame, level, state, result);
+      const Clock::time_point end = Clock::now();
+      result.encode_ms = ElapsedMs(start, end);
+      result.latency_ms = ElapsedMs(job.submitted, end);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_--;
+        completing_++;
+        if (result.status == FrameStatus::kEncoded) {
+          Record(result, job.frame.verts.size());
+        } else {
+          stats_.failed++;
+        }
+      }
+      room_cv_.notify_one();
+      if (job.done) {
+        job.done(std::move(result));
+      }
+      FinishCompletion();
+      if (job.then) {
+        job.then();
+      }
+    }
+  }
+
+  void Encode(const mesh_util::MeshArrays& frame, int level,
+              WorkerState& state, FrameResult& result) const {
+    std::unique_ptr<draco_encode::DracoEncoderSession>& session =
+        state.sessions[level];
+    if (!session) {
+      draco_encode::DracoEncodeOptions options = options_.encode_options;
+      options.compression_level = level;
+      session = std::make_unique<draco_encode::DracoEncoderSession>(options);
+    }
+    result.compression_level = level;
+    result.fell_back =
+        level != ClampLevel(options_.encode_options.compression_level);
+    draco_encode::VectorSink sink(result.bytes);
+    const bool ok =
+        session->Encode(frame.verts, frame.uvs, frame.indices,
+                        frame.uv_indices, frame.colors, frame.normals, sink);
+    result.status = ok ? FrameStatus::kEncoded : FrameStatus::kFailed;
+  }
+
+  // Adds an encoded frame to the statistics and the encode time estimate.
+  // Called with |mutex_| held.
+  void Record(const FrameResult& result, size_t num_points) {
+    stats_.encoded++;
+    stats_.fallbacks += result.fell_back ? 1 : 0;
+    if (latency_ms_.size() < kLatencyWindow) {
+      latency_ms_.push_back(result.latency_ms);
+      encode_ms_.push_back(result.encode_ms);
+    } else {
+      latency_ms_[window_pos_] = result.latency_ms;
+      encode_ms_[window_pos_] = result.encode_ms;
+    }
+    window_pos_ = (window_pos_ + 1) % kLatencyWindow;
+
+    if (num_points > 0) {
+      double& estimate = ms_per_point_[result.compression_level];
+      const double sample = result.encode_ms / num_points;
+      estimate = estimate < 0.0 ? sample
+                                : estimate + kEstimateWeight *
+                                                 (sample - estimate);
+    }
+  }
+
+  void FinishCompletion() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      completing_--;
+    }
+    idle_cv_.notify_all();
+  }
+
+  AsyncEncodeOptions options_;
+  mutable std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable room_cv_;
+  std::condition_variable idle_cv_;
+  std::deque<Job> pending_;
+  // Frames being encoded, and frames whose callback has not returned yet
+  size_t running_;
+  size_t completing_;
+  uint64_t next_frame_id_;
+  bool stop_;
+  // Encode time per point by level, < 0 until measured
+  double ms_per_point_[kNumLevels];
+  AsyncStats stats_;
+  // Ring buffers of the last kLatencyWindow encoded frames
+  std::vector<double> latency_ms_;
+  std::vector<double> encode_ms_;
+  size_t window_pos_ = 0;
+  std::vector<std::thread> workers_;
+};
+
+AsyncEncoder::AsyncEncoder(const AsyncEncodeOptions& options)
+    : impl_(std::make_unique<Impl>(options)) {}
+
+AsyncEncoder::~AsyncEncoder() = default;
+
+void AsyncEncoder::Submit(mesh_util::MeshArrays frame,
+                          std::function<void(FrameResult&&)> done) {
+  impl_->Submit(std::move(frame), std::move(done), nullptr);
+}
+
+void AsyncEncoder::Submit(mesh_util::MeshArrays frame,
+                          std::function<void(FrameResult&&)> done,
+                          std::function<void()> then) {
+  impl_->Submit(std::move(frame), std::move(done), std::move(then));
+}
+
+std::future<FrameResult> AsyncEncoder::Submit(mesh_util::MeshArrays frame) {
+  auto promise = std::make_shared<std::promise<FrameResult>>();
+  std::future<FrameResult> future = promise->get_future();
+  impl_->Submit(
+      std::move(frame),
+      [promise](FrameResult&& result) {
+        promise->set_value(std::move(result));
+      },
+      nullptr);
+  return future;
+}
+
+void AsyncEncoder::Flush() { impl_->Flush(); }
+
+size_t AsyncEncoder::in_flight() const { return impl_->in_flight(); }
+
+AsyncStats AsyncEncoder::stats() const { return impl_->stats(); }
+
+}  // namespace draco_async
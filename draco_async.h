@@ -0,0 +1,179 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define COMPRESS_3D_HAS_COROUTINES 1
+#endif
+
+#include "draco_encode.h"
+#include "mesh_util.h"
+#include "thread_pool.h"
+
+namespace draco_async {
+
+// What to do with a frame predicted to miss the latency budget when a
+// worker picks it up.
+enum class BudgetPolicy {
+  // Encode it anyway
+  kIgnore,
+  // Skip it; it completes with FrameStatus::kDropped
+  kDrop,
+  // Encode it at AsyncEncodeOptions::fallback_compression_level
+  kFallback,
+};
+
+struct AsyncEncodeOptions {
+  AsyncEncodeOptions();
+  draco_encode::DracoEncodeOptions encode_options;
+  // Encode threads. <= 0 means the number of hardware threads.
+  int num_workers;
+  // Frames queued or being encoded at once
+  size_t max_in_flight;
+  // If true, Submit() on a full encoder drops the oldest queued frame, or
+  // the new one if every frame in flight is already being encoded, so the
+  // caller never waits. If false, Submit() waits for room.
+  bool drop_when_full;
+  // Time from Submit() to completion a frame should stay within, in
+  // milliseconds. 0 disables the budget.
+  double latency_budget_ms;
+  BudgetPolicy policy;
+  // Usually 0, the fastest level
+  int fallback_compression_level;
+};
+
+enum class FrameStatus { kEncoded, kDropped, kFailed };
+
+struct FrameResult {
+  // Order of submission, from 0
+  uint64_t frame_id = 0;
+  FrameStatus status = FrameStatus::kFailed;
+  std::vector<char> bytes;
+  // Level the frame was encoded at, the fallback level if it fell back
+  int compression_level = 0;
+  bool fell_back = false;
+  // Time waiting for a worker, encoding, and from Submit() to completion
+  double queue_ms = 0.0;
+  double encode_ms = 0.0;
+  double latency_ms = 0.0;
+};
+
+struct AsyncStats {
+  uint64_t submitted = 0;
+  uint64_t encoded = 0;
+  // Encoded frames that fell back to the faster level
+  uint64_t fallbacks = 0;
+  uint64_t dropped = 0;
+  uint64_t failed = 0;
+  // Over the most recent encoded frames
+  double latency_p50_ms = 0.0;
+  double latency_p99_ms = 0.0;
+  double latency_max_ms = 0.0;
+  double encode_p50_ms = 0.0;
+  double encode_p99_ms = 0.0;
+};
+
+// Encodes frames on dedicated worker threads so that the submitting thread,
+// e.g. a capture loop, never runs or waits for DracoEncode. Each worker
+// keeps a DracoEncoderSession per compression level, so frames with the
+// same attribute layout reuse the encoder's storage.
+//
+// Whether a frame fits the budget is predicted when a worker picks it up
+// from its time in the queue plus the encode time per point measured on
+// earlier frames at that level. Frames are not predicted before the first
+// one at a level completes.
+class AsyncEncoder {
+ public:
+  explicit AsyncEncoder(const AsyncEncodeOptions& options);
+  // Waits for all frames in flight.
+  ~AsyncEncoder();
+  AsyncEncoder(const AsyncEncoder&) = delete;
+  AsyncEncoder& operator=(const AsyncEncoder&) = delete;
+
+  // Takes |frame| and encodes it in the background. |done|, if not empty,
+  // runs once per frame, on a worker thread, or on the calling thread if
+  // the frame is dropped because the encoder is full. It must not throw,
+  // call Flush() or destroy the encoder.
+  void Submit(mesh_util::MeshArrays frame,
+              std::function<void(FrameResult&&)> done);
+
+  // Same as above, and |then|, if not empty, runs on the same thread once
+  // |done| has returned and the frame no longer counts as in flight. Unlike
+  // |done| it may call Flush(). If |then| runs before Submit() returns, the
+  // frame was dropped on the calling thread.
+  void Submit(mesh_util::MeshArrays frame,
+              std::function<void(FrameResult&&)> done,
+              std::function<void()> then);
+
+  // Same as above with the result delivered through a future.
+  std::future<FrameResult> Submit(mesh_util::MeshArrays frame);
+
+  // Waits until every submitted frame has completed and its callback has
+  // returned.
+  void Flush();
+
+  // Frames queued or being encoded.
+  size_t in_flight() const;
+
+  AsyncStats stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+#ifdef COMPRESS_3D_HAS_COROUTINES
+// co_await EncodeAsync(encoder, std::move(frame)) in a C++20 coroutine
+// suspends until the frame completes and yields its FrameResult. The
+// coroutine resumes as a task on the thread pool of the thread that awaited
+// (parallel_util::ThreadPool::Current()), never on an encoder worker, so it
+// may flush or destroy the encoder. A frame dropped at once completes
+// without suspending.
+class EncodeAwaiter {
+ public:
+  EncodeAwaiter(AsyncEncoder& encoder, mesh_util::MeshArrays frame)
+      : encoder_(encoder), frame_(std::move(frame)), completed_(false) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    pool_ = &parallel_util::ThreadPool::Current();
+    encoder_.Submit(
+        std::move(frame_),
+        [this](FrameResult&& result) { result_ = std::move(result); },
+        [this]() {
+          // Whichever of this and await_suspend() comes second resumes
+          if (completed_.exchange(true, std::memory_order_acq_rel)) {
+            const std::coroutine_handle<> handle = handle_;
+            pool_->Submit([handle]() { handle.resume(); });
+          }
+        });
+    return !completed_.exchange(true, std::memory_order_acq_rel);
+  }
+
+  FrameResult await_resume() { return std::move(result_); }
+
+ private:
+  AsyncEncoder& encoder_;
+  mesh_util::MeshArrays frame_;
+  FrameResult result_;
+  std::coroutine_handle<> handle_;
+  parallel_util::ThreadPool* pool_ = nullptr;
+  std::atomic<bool> completed_;
+};
+
+inline EncodeAwaiter EncodeAsync(AsyncEncoder& encoder,
+                                 mesh_util::MeshArrays frame) {
+  return EncodeAwaiter(encoder, std::move(frame));
+}
+#endif
+
+}  // namespace draco_async
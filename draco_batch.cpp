@@ -0,0 +1,127 @@
+#include "draco_batch.h"
+
+#include <memory>
+
+#include "draco_decode.h"
+
+namespace {
+
+bool SameOptions(const draco_encode::DracoEncodeOptions& a,
+                 const draco_encode::DracoEncodeOptions& b) {
+  return a.pos_quantization_bits == b.pos_quantization_bits &&
+         a.tex_coords_quantization_bits == b.tex_coords_quantization_bits &&
+         a.tex_coords_deleted == b.tex_coords_deleted &&
+         a.normals_quantization_bits == b.normals_quantization_bits &&
+         a.normals_deleted == b.normals_deleted &&
+         a.compression_level == b.compression_level &&
+         a.deduplicate_points == b.deduplicate_points &&
+         a.voxelize_points == b.voxelize_points &&
+         a.write_stream_info == b.write_stream_info &&
+         a.pos_quantization_range == b.pos_quantization_range &&
+         a.pos_quantization_origin == b.pos_quantization_origin &&
+         a.trace == b.trace;
+}
+
+// Encoder sessions kept by a thread across batches. A thread waiting in
+// ThreadPool::Run() may pick up another batch task in the middle of an
+// encode, so it holds as many sessions as it runs encodes at once.
+class ThreadSessions {
+ public:
+  std::unique_ptr<draco_encode::DracoEncoderSession> Acquire(
+      const draco_encode::DracoEncodeOptions& options) {
+    if (!SameOptions(options_, options)) {
+      free_.clear();
+      options_ = options;
+    }
+    if (free_.empty()) {
+      return std::unique_ptr<draco_encode::DracoEncoderSession>(
+          new draco_encode::DracoEncoderSession(options));
+    }
+    std::unique_ptr<draco_encode::DracoEncoderSession> session =
+        std::move(free_.back());
+    free_.pop_back();
+    return session;
+  }
+
+  void Release(const draco_encode::DracoEncodeOptions& options,
+               std::unique_ptr<draco_encode::DracoEncoderSession> session) {
+    if (SameOptions(options_, options)) {
+      free_.push_back(std::move(session));
+    }
+  }
+
+ private:
+  draco_encode::DracoEncodeOptions options_;
+  std::vector<std::unique_ptr<draco_encode::DracoEncoderSession>> free_;
+};
+
+thread_local ThreadSessions tls_sessions;
+
+}  // namespace
+
+namespace draco_batch {
+
+bool DracoEncodeBatch(const std::vector<mesh_util::MeshArrays>& inputs,
+                      const draco_encode::DracoEncodeOptions& options,
+                      std::vector<std::vector<char>>& streams,
+                      parallel_util::ThreadPool& pool) {
+  streams.resize(inputs.size());
+  std::vector<char> succeeded(inputs.size(), 0);
+
+  std::vector<std::function<void()>> tasks;
+  tasks.reserve(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    tasks.push_back([&, i]() {
+      const mesh_util::MeshArrays& in = inputs[i];
+      std::unique_ptr<draco_encode::DracoEncoderSession> session =
+          tls_sessions.Acquire(options);
+      draco_encode::VectorSink sink(streams[i]);
+      succeeded[i] = session->Encode(in.verts, in.uvs, in.indices,
+                                     in.uv_indices, in.colors, in.normals,
+                                     sink);
+      tls_sessions.Release(options, std::move(session));
+    });
+  }
+  pool.Run(std::move(tasks));
+
+  bool ret = true;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!succeeded[i]) {
+      printf("Failed to encode batch item %zu.\n", i);
+      streams[i].clear();
+      ret = false;
+    }
+  }
+  return ret;
+}
+
+bool DracoDecodeBatch(const std::vector<std::vector<char>>& streams,
+                      std::vector<mesh_util::MeshArrays>& outputs,
+                      parallel_util::ThreadPool& pool) {
+  outputs.resize(streams.size());
+  std::vector<char> succeeded(streams.size(), 0);
+
+  std::vector<std::function<void()>> tasks;
+  tasks.reserve(streams.size());
+  for (size_t i = 0; i < streams.size(); i++) {
+    tasks.push_back([&, i]() {
+      mesh_util::MeshArrays& out = outputs[i];
+      succeeded[i] = draco_decode::DracoDecode(streams[i], out.verts, out.uvs,
+                                               out.indices, out.uv_indices,
+                                               out.colors, out.normals);
+    });
+  }
+  pool.Run(std::move(tasks));
+
+  bool ret = true;
+  for (size_t i = 0; i < streams.size(); i++) {
+    if (!succeeded[i]) {
+      printf("Failed to decode batch item %zu.\n", i);
+      outputs[i] = mesh_util::MeshArrays();
+      ret = false;
+    }
+  }
+  return ret;
+}
+
+}  // namespace draco_batch
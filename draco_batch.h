@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "draco_encode.h"
+#include "mesh_util.h"
+#include "thread_pool.h"
+
+namespace draco_batch {
+
+// Encodes every input with |options| on |pool| and stores the streams in
+// input order. Threads running the tasks keep their DracoEncoderSessions
+// for their lifetime, so encoder state is reused across inputs and across
+// calls with the same options. A failed input leaves its stream
+// empty. Returns true if all succeeded.
+// Pass a parallel_util::ThreadPool of the desired size to control the
+// number of threads; the calling thread helps while it waits, and parallel
+// work inside the encoder and decoder stays on |pool|.
+bool DracoEncodeBatch(
+    const std::vector<mesh_util::MeshArrays>& inputs,
+    const draco_encode::DracoEncodeOptions& options,
+    std::vector<std::vector<char>>& streams,
+    parallel_util::ThreadPool& pool = parallel_util::ThreadPool::Shared());
+
+// Decodes every stream on |pool| and stores the results in input order.
+// A failed stream leaves its output empty. Returns true if all succeeded.
+bool DracoDecodeBatch(
+    const std::vector<std::vector<char>>& streams,
+    std::vector<mesh_util::MeshArrays>& outputs,
+    parallel_util::ThreadPool& pool = parallel_util::ThreadPool::Shared());
+
+}  // namespace draco_batch
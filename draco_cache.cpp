@@ -0,0 +1,437 @@
+#include "draco_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+#include "draco_trace.h"
+#include "file_util.h"
+#include "parallel_util.h"
+
+namespace {
+
+using draco_cache::CacheKey;
+
+// Disk tier file: magic, version, key, stream size, then the stream
+constexpr char kMagic[4] = {'C', '3', 'D', 'C'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 32;
+
+// Part of every key. Bump it when encoder changes alter the output for the
+// same input, so stale disk entries are never hit.
+constexpr uint64_t kKeyVersion = 1;
+
+// Arrays are hashed in chunks of this size, in parallel from 4 chunks on.
+constexpr size_t kChunkSize = 1 << 20;
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+template <typename T>
+void WritePod(char* dst, size_t& pos, const T& value) {
+  std::memcpy(dst + pos, &value, sizeof(T));
+  pos += sizeof(T);
+}
+
+template <typename T>
+T ReadPod(const char* src, size_t& pos) {
+  T value;
+  std::memcpy(&value, src + pos, sizeof(T));
+  pos += sizeof(T);
+  return value;
+}
+
+uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  return Rotl(acc, 31) * kPrime1;
+}
+
+uint64_t Avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t Load64(const uint8_t* p) {
+  uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// xxHash64 style hash widened to 128 bits. The four lanes of a 32 byte
+// stripe are independent, so their multiplies overlap in the pipeline.
+CacheKey HashBytes(const void* data, size_t size, uint64_t seed) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  const uint8_t* const end = p + size;
+  uint64_t v1 = seed + kPrime1 + kPrime2;
+  uint64_t v2 = seed + kPrime2;
+  uint64_t v3 = seed;
+  uint64_t v4 = seed - kPrime1;
+  while (end - p >= 32) {
+    v1 = Round(v1, Load64(p));
+    v2 = Round(v2, Load64(p + 8));
+    v3 = Round(v3, Load64(p + 16));
+    v4 = Round(v4, Load64(p + 24));
+    p += 32;
+  }
+
+  uint64_t tail = seed + kPrime5 + size;
+  while (end - p >= 8) {
+    tail ^= Round(0, Load64(p));
+    tail = Rotl(tail, 27) * kPrime1 + kPrime4;
+    p += 8;
+  }
+  while (p < end) {
+    tail ^= *p * kPrime5;
+    tail = Rotl(tail, 11) * kPrime1;
+    ++p;
+  }
+
+  CacheKey key;
+  key.hi = Avalanche(Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) +
+                     Rotl(v4, 18) + tail);
+  key.lo = Avalanche((v1 ^ Rotl(v3, 29)) * kPrime3 +
+                     (v2 ^ Rotl(v4, 37)) * kPrime4 + Rotl(tail, 17));
+  return key;
+}
+
+// Collects per array chunk hashes and scalar fields, and hashes them all at
+// the end. The key does not depend on the number of threads.
+class Hasher {
+ public:
+  template <typename T>
+  void AddArray(const std::vector<T>& values) {
+    AddBytes(values.data(), values.size() * sizeof(T));
+  }
+
+  void Add(uint64_t value) { parts_.push_back(value); }
+
+  void Add(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    parts_.push_back(bits);
+  }
+
+  CacheKey Finish() const {
+    return HashBytes(parts_.data(), parts_.size() * sizeof(uint64_t),
+                     kKeyVersion);
+  }
+
+ private:
+  void AddBytes(const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    const size_t num_chunks = (size + kChunkSize - 1) / kChunkSize;
+    const size_t first = parts_.size() + 1;
+    parts_.push_back(size);
+    parts_.resize(first + num_chunks * 2);
+    uint64_t* out = parts_.data() + first;
+    parallel_util::ParallelFor(
+        0, num_chunks,
+        [&](size_t c) {
+          const size_t begin = c * kChunkSize;
+          const CacheKey key = HashBytes(
+              bytes + begin, std::min(size - begin, kChunkSize), c);
+          out[c * 2] = key.hi;
+          out[c * 2 + 1] = key.lo;
+        },
+        4);
+  }
+
+  std::vector<uint64_t> parts_;
+};
+
+struct KeyHash {
+  size_t operator()(const CacheKey& key) const {
+    return static_cast<size_t>(key.lo);
+  }
+};
+
+}  // namespace
+
+namespace draco_cache {
+
+std::string CacheKey::ToHex() const {
+  char hex[33];
+  snprintf(hex, sizeof(hex), "%016llx%016llx",
+           static_cast<unsigned long long>(hi),
+           static_cast<unsigned long long>(lo));
+  return hex;
+}
+
+CacheKey HashInput(const std::vector<Eigen::Vector3f>& verts,
+                   const std::vector<Eigen::Vector2f>& uvs,
+                   const std::vector<Eigen::Vector3i>& indices,
+                   const std::vector<Eigen::Vector3i>& uv_indices,
+                   const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                   const std::vector<Eigen::Vector3f>& normals,
+                   const draco_encode::DracoEncodeOptions& options) {
+  Hasher hasher;
+  hasher.AddArray(verts);
+  hasher.AddArray(uvs);
+  hasher.AddArray(indices);
+  hasher.AddArray(uv_indices);
+  hasher.AddArray(colors);
+  hasher.AddArray(normals);
+  hasher.Add(static_cast<uint64_t>(options.pos_quantization_bits));
+  hasher.Add(static_cast<uint64_t>(options.tex_coords_quantization_bits));
+  hasher.Add(static_cast<uint64_t>(options.tex_coords_deleted));
+  hasher.Add(static_cast<uint64_t>(options.normals_quantization_bits));
+  hasher.Add(static_cast<uint64_t>(options.normals_deleted));
+  hasher.Add(static_cast<uint64_t>(options.compression_level));
+  hasher.Add(static_cast<uint64_t>(options.deduplicate_points));
+  hasher.Add(static_cast<uint64_t>(options.voxelize_points));
+  hasher.Add(static_cast<uint64_t>(options.write_stream_info));
+  hasher.Add(options.pos_quantization_range);
+  for (int k = 0; k < 3; k++) {
+    hasher.Add(options.pos_quantization_origin[k]);
+  }
+  return hasher.Finish();
+}
+
+CacheOptions::CacheOptions() : max_memory_bytes(256 << 20), directory() {}
+
+class EncodeCache::Impl {
+ public:
+  explicit Impl(const CacheOptions& options) : options_(options) {
+    std::random_device random;
+    nonce_ = (static_cast<uint64_t>(random()) << 32) | random();
+    if (!options_.directory.empty()) {
+      std::error_code ec;
+      std::filesystem::create_directories(options_.directory, ec);
+      if (ec) {
+        printf("Error: Failed to create %s. Disk cache disabled.\n",
+               options_.directory.c_str());
+        options_.directory.clear();
+      }
+    }
+  }
+
+  bool Lookup(const CacheKey& key, std::vector<char>& bytes) {
+    Stream stream;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = index_.find(key);
+      if (it != index_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        stream = it->second->second;
+        stats_.memory_hits++;
+      }
+    }
+    // Copy outside of the lock
+    if (stream != nullptr) {
+      bytes.assign(stream->begin(), stream->end());
+      return true;
+    }
+
+    if (ReadDisk(key, bytes)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.disk_hits++;
+      InsertMemory(key, std::make_shared<const std::vector<char>>(bytes));
+      return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.misses++;
+    return false;
+  }
+
+  void Insert(const CacheKey& key, const std::vector<char>& bytes) {
+    {
+      Stream stream = std::make_shared<const std::vector<char>>(bytes);
+      std::lock_guard<std::mutex> lock(mutex_);
+      InsertMemory(key, std::move(stream));
+    }
+    if (WriteDisk(key, bytes)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.disk_writes++;
+    }
+  }
+
+  CacheStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CacheStats stats = stats_;
+    stats.memory_bytes = memory_bytes_;
+    stats.memory_entries = lru_.size();
+    return stats;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+    memory_bytes_ = 0;
+  }
+
+ private:
+  using Stream = std::shared_ptr<const std::vector<char>>;
+  using Entry = std::pair<CacheKey, Stream>;
+
+  // Must be called with |mutex_| held.
+  void InsertMemory(const CacheKey& key, Stream stream) {
+    if (stream->size() > options_.max_memory_bytes) {
+      return;
+    }
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      memory_bytes_ -= it->second->second->size();
+      lru_.erase(it->second);
+      index_.erase(it);
+    }
+    memory_bytes_ += stream->size();
+    lru_.emplace_front(key, std::move(stream));
+    index_[key] = lru_.begin();
+    while (memory_bytes_ > options_.max_memory_bytes) {
+      memory_bytes_ -= lru_.back().second->size();
+      index_.erase(lru_.back().first);
+      lru_.pop_back();
+      stats_.evictions++;
+    }
+  }
+
+  std::filesystem::path DiskPath(const CacheKey& key) const {
+    return std::filesystem::path(options_.directory) / (key.ToHex() + ".c3dc");
+  }
+
+  bool ReadDisk(const CacheKey& key, std::vector<char>& bytes) const {
+    if (options_.directory.empty()) {
+      return false;
+    }
+    const std::filesystem::path path = DiskPath(key);
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+      return false;
+    }
+    file_util::MappedFile file;
+    if (!file.Open(path.string()) || file.size() < kHeaderSize ||
+        std::memcmp(file.data(), kMagic, sizeof(kMagic)) != 0) {
+      return false;
+    }
+    size_t pos = sizeof(kMagic);
+    const uint32_t version = ReadPod<uint32_t>(file.data(), pos);
+    CacheKey stored;
+    stored.hi = ReadPod<uint64_t>(file.data(), pos);
+    stored.lo = ReadPod<uint64_t>(file.data(), pos);
+    const uint64_t size = ReadPod<uint64_t>(file.data(), pos);
+    if (version != kVersion || !(stored == key) ||
+        file.size() != kHeaderSize + size) {
+      return false;
+    }
+    bytes.assign(file.data() + kHeaderSize, file.data() + file.size());
+    return true;
+  }
+
+  // Writes to a unique temporary file and renames it into place, so readers
+  // in other threads and processes never see a partial file.
+  bool WriteDisk(const CacheKey& key, const std::vector<char>& bytes) {
+    if (options_.directory.empty()) {
+      return false;
+    }
+    const std::filesystem::path path = DiskPath(key);
+    std::error_code ec;
+    if (std::filesystem::exists(path, ec)) {
+      return false;
+    }
+
+    std::vector<char> file(kHeaderSize + bytes.size());
+    std::memcpy(file.data(), kMagic, sizeof(kMagic));
+    size_t pos = sizeof(kMagic);
+    WritePod(file.data(), pos, kVersion);
+    WritePod(file.data(), pos, key.hi);
+    WritePod(file.data(), pos, key.lo);
+    WritePod(file.data(), pos, static_cast<uint64_t>(bytes.size()));
+    std::copy(bytes.begin(), bytes.end(), file.begin() + kHeaderSize);
+
+    char suffix[40];
+    snprintf(suffix, sizeof(suffix), ".%016llx.%llu.tmp",
+             static_cast<unsigned long long>(nonce_),
+             static_cast<unsigned long long>(next_temp_++));
+    std::filesystem::path temp = path;
+    temp += suffix;
+    if (!file_util::WriteFile(temp.string(), file.data(), file.size())) {
+      std::filesystem::remove(temp, ec);
+      return false;
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+      std::filesystem::remove(temp, ec);
+      return false;
+    }
+    return true;
+  }
+
+  CacheOptions options_;
+  // Distinguishes temporary files of this cache from those of other
+  // processes
+  uint64_t nonce_ = 0;
+  std::atomic<uint64_t> next_temp_{0};
+
+  mutable std::mutex mutex_;
+  // Most recently used first
+  std::list<Entry> lru_;
+  std::unordered_map<CacheKey, std::list<Entry>::iterator, KeyHash> index_;
+  size_t memory_bytes_ = 0;
+  CacheStats stats_;
+};
+
+EncodeCache::EncodeCache(const CacheOptions& options)
+    : impl_(new Impl(options)) {}
+
+EncodeCache::~EncodeCache() = default;
+
+bool EncodeCache::Encode(const std::vector<Eigen::Vector3f>& verts,
+                         const std::vector<Eigen::Vector2f>& uvs,
+                         const std::vector<Eigen::Vector3i>& indices,
+                         const std::vector<Eigen::Vector3i>& uv_indices,
+                         const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                         const std::vector<Eigen::Vector3f>& normals,
+                         const draco_encode::DracoEncodeOptions& options,
+                         std::vector<char>& bytes) {
+  CacheKey key;
+  {
+    draco_trace::ScopedEvent event(options.trace, "cache_hash");
+    key = HashInput(verts, uvs, indices, uv_indices, colors, normals,
+                    options);
+  }
+  {
+    draco_trace::ScopedEvent event(options.trace, "cache_lookup");
+    if (impl_->Lookup(key, bytes)) {
+      event.set_bytes(bytes.size());
+      return true;
+    }
+  }
+  if (!draco_encode::DracoEncode(verts, uvs, indices, uv_indices, colors,
+                                 normals, options, bytes)) {
+    return false;
+  }
+  impl_->Insert(key, bytes);
+  return true;
+}
+
+bool EncodeCache::Lookup(const CacheKey& key, std::vector<char>& bytes) {
+  return impl_->Lookup(key, bytes);
+}
+
+void EncodeCache::Insert(const CacheKey& key,
+                         const std::vector<char>& bytes) {
+  impl_->Insert(key, bytes);
+}
+
+CacheStats EncodeCache::stats() const { return impl_->stats(); }
+
+void EncodeCache::Clear() { impl_->Clear(); }
+
+}  // namespace draco_cache
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "draco_encode.h"
+
+namespace draco_cache {
+
+// 128 bit content hash of an encode input and its options.
+struct CacheKey {
+  uint64_t hi = 0;
+  uint64_t lo = 0;
+
+  bool operator==(const CacheKey& other) const {
+    return hi == other.hi && lo == other.lo;
+  }
+  // 32 hex digits, used as the file name of the disk tier
+  std::string ToHex() const;
+};
+
+// Hashes every byte of the arrays and all options that affect the stream.
+// Arrays are split into 1 MB chunks hashed in parallel with four
+// independent 64 bit lanes each, so hashing runs at memory bandwidth rather
+// than at encode speed. DracoEncodeOptions::trace is not part of the key.
+CacheKey HashInput(const std::vector<Eigen::Vector3f>& verts,
+                   const std::vector<Eigen::Vector2f>& uvs,
+                   const std::vector<Eigen::Vector3i>& indices,
+                   const std::vector<Eigen::Vector3i>& uv_indices,
+                   const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                   const std::vector<Eigen::Vector3f>& normals,
+                   const draco_encode::DracoEncodeOptions& options);
+
+struct CacheOptions {
+  CacheOptions();
+  // Budget of the in-memory tier. Least recently used streams are evicted
+  // beyond it.
+  size_t max_memory_bytes;
+  // Directory of the disk tier, created if missing. Empty disables it.
+  // Files are published with an atomic rename, so several processes may
+  // share a directory. The disk tier is never evicted.
+  std::string directory;
+};
+
+struct CacheStats {
+  uint64_t memory_hits = 0;
+  uint64_t disk_hits = 0;
+  uint64_t misses = 0;
+  // Streams dropped from the memory tier
+  uint64_t evictions = 0;
+  uint64_t disk_writes = 0;
+  size_t memory_bytes = 0;
+  size_t memory_entries = 0;
+};
+
+// Two tier cache of encoded streams keyed by CacheKey. Safe to share between
+// threads.
+class EncodeCache {
+ public:
+  explicit EncodeCache(const CacheOptions& options = CacheOptions());
+  ~EncodeCache();
+  EncodeCache(const EncodeCache&) = delete;
+  EncodeCache& operator=(const EncodeCache&) = delete;
+
+  // Same as draco_encode::DracoEncode, but returns the cached stream if the
+  // same input was encoded with the same options before. Threads missing
+  // the same key at once each encode it.
+  bool Encode(const std::vector<Eigen::Vector3f>& verts,
+              const std::vector<Eigen::Vector2f>& uvs,
+              const std::vector<Eigen::Vector3i>& indices,
+              const std::vector<Eigen::Vector3i>& uv_indices,
+              const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+              const std::vector<Eigen::Vector3f>& normals,
+              const draco_encode::DracoEncodeOptions& options,
+              std::vector<char>& bytes);
+
+  // Looks up the memory tier, then the disk tier. Disk hits are promoted to
+  // memory.
+  bool Lookup(const CacheKey& key, std::vector<char>& bytes);
+  void Insert(const CacheKey& key, const std::vector<char>& bytes);
+
+  CacheStats stats() const;
+  // Empties the memory tier. Counters are kept.
+  void Clear();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace draco_cache
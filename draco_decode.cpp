@@ -1,192 +1,648 @@
 #include "draco_decode.h"
 
 #include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <type_traits>
 
 #include "draco/compression/decode.h"
-#include "draco/core/cycle_timer.h"
+#include "draco/compression/point_cloud/point_cloud_decoder.h"
+#include "draco/metadata/metadata_decoder.h"
+#include "draco_metadata_keys.h"
+#include "draco_trace.h"
+#include "thread_pool.h"
 
 namespace {
 
-std::vector<Eigen::Vector3f> DecodePositions(draco::PointCloud* pc) {
-  std::vector<Eigen::Vector3f> verts;
+// Inputs with at least this many points extract attributes and faces
+// concurrently on the shared thread pool.
+constexpr uint32_t kParallelMinPoints = 1 << 15;
 
-  const draco::PointAttribute* const att =
-      pc->GetNamedAttribute(draco::GeometryAttribute::POSITION);
-  if (att == nullptr || att->size() == 0) {
-    return verts;  // Position attribute must be valid.
+template <typename T>
+draco::DataType ToDataType();
+template <>
+draco::DataType ToDataType<float>() {
+  return draco::DT_FLOAT32;
+}
+template <>
+draco::DataType ToDataType<uint8_t>() {
+  return draco::DT_UINT8;
+}
+template <>
+draco::DataType ToDataType<uint16_t>() {
+  return draco::DT_UINT16;
+}
+template <>
+draco::DataType ToDataType<int32_t>() {
+  return draco::DT_INT32;
+}
+
+// Copies the values of |att| into |values|, which has room for att->size()
+// entries. If the stored type and layout already match the output, the
+// attribute buffer is copied at once, otherwise values are converted one by
+// one.
+template <typename T, int N>
+void ExtractValues(const draco::PointAttribute* att,
+                   Eigen::Matrix<T, N, 1>* values) {
+  if (att->data_type() == ToDataType<T>() && att->num_components() == N &&
+      att->byte_stride() == static_cast<int64_t>(sizeof(T) * N)) {
+    static_assert(sizeof(Eigen::Matrix<T, N, 1>) == sizeof(T) * N, "");
+    std::memcpy(static_cast<void*>(values),
+                att->GetAddress(draco::AttributeValueIndex(0)),
+                att->size() * sizeof(T) * N);
+    return;
   }
-  verts.resize(att->size());
   for (draco::AttributeValueIndex i(0); i < static_cast<uint32_t>(att->size());
        ++i) {
-    if (!att->ConvertValue<float, 3>(i, verts[i.value()].data())) {
-      return verts;
+    if (!att->ConvertValue<T, N>(i, values[i.value()].data())) {
+      return;
+    }
+  }
+}
+
+template <typename T, int N>
+void ExtractValues(const draco::PointAttribute* att,
+                   std::vector<Eigen::Matrix<T, N, 1>>& values) {
+  values.resize(att->size());
+  ExtractValues(att, values.data());
+}
+
+// Writes the position indices of the faces of |mesh| to |indices| and, if
+// |uvs| is set, the uv indices to |uv_indices|. Both have room for
+// mesh->num_faces() entries.
+void ExtractFaces(const draco::Mesh* mesh, const draco::PointAttribute* verts,
+                  const draco::PointAttribute* uvs, Eigen::Vector3i* indices,
+                  Eigen::Vector3i* uv_indices) {
+  const uint32_t num_faces = mesh->num_faces();
+  for (uint32_t i = 0; i < num_faces; i++) {
+    const draco::Mesh::Face& face = mesh->face(draco::FaceIndex(i));
+    for (uint32_t j = 0; j < 3; j++) {
+      const draco::PointIndex vert_index = face[j];
+      indices[i][j] =
+          static_cast<int32_t>(verts->mapped_index(vert_index).value());
+      if (uvs != nullptr) {
+        uv_indices[i][j] =
+            static_cast<int32_t>(uvs->mapped_index(vert_index).value());
+      }
     }
   }
-  return verts;
 }
 
-std::vector<Eigen::Vector2f> DecodeUvs(draco::PointCloud* pc) {
-  std::vector<Eigen::Vector2f> uvs;
+template <typename T>
+void DecodePositions(const draco::PointCloud* pc,
+                     std::vector<Eigen::Matrix<T, 3, 1>>& verts) {
+  verts.clear();
 
   const draco::PointAttribute* const att =
-      pc->GetNamedAttribute(draco::GeometryAttribute::TEX_COORD);
+      pc->GetNamedAttribute(draco::GeometryAttribute::POSITION);
   if (att == nullptr || att->size() == 0) {
-    return uvs;
+    return;  // Position attribute must be valid.
   }
-  uvs.resize(att->size());
-  for (draco::AttributeValueIndex i(0); i < static_cast<uint32_t>(att->size());
-       ++i) {
-    if (!att->ConvertValue<float, 2>(i, uvs[i.value()].data())) {
-      return uvs;
-    }
+  ExtractValues(att, verts);
+}
+
+void DecodeUvs(const draco::PointCloud* pc, std::vector<Eigen::Vector2f>& uvs) {
+  uvs.clear();
+
+  const draco::PointAttribute* const att =
+      pc->GetNamedAttribute(draco::GeometryAttribute::TEX_COORD);
+  if (att == nullptr || att->size() == 0) {
+    return;
   }
-  return uvs;
+  ExtractValues(att, uvs);
 }
 
-std::vector<Eigen::Vector<uint8_t, 3>> DecodeColors(draco::PointCloud* pc) {
-  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+void DecodeColors(const draco::PointCloud* pc,
+                  std::vector<Eigen::Vector<uint8_t, 3>>& colors) {
+  colors.clear();
 
   const draco::PointAttribute* const att =
       pc->GetNamedAttribute(draco::GeometryAttribute::COLOR);
   if (att == nullptr || att->size() == 0) {
-    return colors;  // Position attribute must be valid.
-  }
-  colors.resize(att->size());
-  for (draco::AttributeValueIndex i(0); i < static_cast<uint32_t>(att->size());
-       ++i) {
-    if (!att->ConvertValue<uint8_t, 3>(i, colors[i.value()].data())) {
-      return colors;
-    }
+    return;
   }
-  return colors;
+  ExtractValues(att, colors);
 }
 
-std::vector<Eigen::Vector3f> DecodeNormals(draco::PointCloud* pc) {
-  std::vector<Eigen::Vector3f> normals;
+void DecodeNormals(const draco::PointCloud* pc,
+                   std::vector<Eigen::Vector3f>& normals) {
+  normals.clear();
 
   const draco::PointAttribute* const att =
       pc->GetNamedAttribute(draco::GeometryAttribute::NORMAL);
   if (att == nullptr || att->size() == 0) {
-    return normals;  // Position attribute must be valid.
+    return;
   }
-  normals.resize(att->size());
-  for (draco::AttributeValueIndex i(0); i < static_cast<uint32_t>(att->size());
-       ++i) {
-    if (!att->ConvertValue<float, 3>(i, normals[i.value()].data())) {
-      return normals;
-    }
-  }
-  return normals;
+  ExtractValues(att, normals);
 }
 
-std::pair<std::vector<Eigen::Vector3i>, std::vector<Eigen::Vector3i>>
-DecodeFaces(draco::Mesh* mesh) {
-  uint32_t num_faces = mesh->num_faces();
+void DecodeFaces(const draco::Mesh* mesh, bool with_uv_indices,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices) {
+  const uint32_t num_faces = mesh->num_faces();
 
   const draco::PointAttribute* const verts =
       mesh->GetNamedAttribute(draco::GeometryAttribute::POSITION);
   if (verts == nullptr || verts->size() == 0) {
-    return std::make_pair(std::vector<Eigen::Vector3i>(),
-                          std::vector<Eigen::Vector3i>());
+    indices.clear();
+    uv_indices.clear();
+    return;
   }
 
   const draco::PointAttribute* const uvs =
       mesh->GetNamedAttribute(draco::GeometryAttribute::TEX_COORD);
 
-  std::vector<Eigen::Vector3i> indices(num_faces);
-  std::vector<Eigen::Vector3i> uv_indices(num_faces);
-  const bool with_uv = uvs != nullptr && uvs->size() > 0;
-  for (uint32_t i = 0; i < num_faces; i++) {
-    for (uint32_t j = 0; j < 3; j++) {
-      const draco::PointIndex vert_index = mesh->face(draco::FaceIndex(i))[j];
-      indices[i][j] =
-          static_cast<int32_t>(verts->mapped_index(vert_index).value());
-      if (with_uv) {
-        uv_indices[i][j] =
-            static_cast<int32_t>(uvs->mapped_index(vert_index).value());
-      }
+  const bool with_uv = with_uv_indices && uvs != nullptr && uvs->size() > 0;
+  indices.resize(num_faces);
+  if (with_uv) {
+    uv_indices.resize(num_faces);
+  } else {
+    uv_indices.clear();
+  }
+  ExtractFaces(mesh, verts, with_uv ? uvs : nullptr, indices.data(),
+               uv_indices.data());
+}
+
+uint32_t ToDecodeMask(draco::GeometryAttribute::Type type) {
+  switch (type) {
+    case draco::GeometryAttribute::POSITION:
+      return draco_decode::kDecodePositions;
+    case draco::GeometryAttribute::TEX_COORD:
+      return draco_decode::kDecodeUvs;
+    case draco::GeometryAttribute::COLOR:
+      return draco_decode::kDecodeColors;
+    case draco::GeometryAttribute::NORMAL:
+      return draco_decode::kDecodeNormals;
+    default:
+      return 0;
+  }
+}
+
+// Fills |info| from stream info metadata. Returns false if it is missing.
+bool ReadStreamInfo(const draco::GeometryMetadata& metadata,
+                    draco_decode::DracoStreamInfo& info) {
+  int32_t num_points = 0;
+  int32_t num_faces = 0;
+  std::vector<int32_t> attributes;
+  if (!metadata.GetEntryInt(draco_metadata_keys::kNumPoints, &num_points) ||
+      !metadata.GetEntryInt(draco_metadata_keys::kNumFaces, &num_faces) ||
+      !metadata.GetEntryIntArray(draco_metadata_keys::kAttributes,
+                                 &attributes) ||
+      attributes.size() % draco_metadata_keys::kAttributeFields != 0) {
+    return false;
+  }
+  info.num_points = static_cast<uint32_t>(num_points);
+  info.num_faces = static_cast<uint32_t>(num_faces);
+  info.attributes.clear();
+  for (size_t i = 0; i < attributes.size();
+       i += draco_metadata_keys::kAttributeFields) {
+    draco_decode::DracoAttributeInfo att;
+    att.kind = ToDecodeMask(
+        static_cast<draco::GeometryAttribute::Type>(attributes[i]));
+    att.component_size = draco::DataTypeLength(
+        static_cast<draco::DataType>(attributes[i + 1]));
+    att.num_components = attributes[i + 2];
+    att.num_values = static_cast<uint32_t>(attributes[i + 3]);
+    info.attributes.push_back(att);
+  }
+  return true;
+}
+
+// Fills |info| from decoded geometry.
+void ReadStreamInfo(const draco::PointCloud* pc, const draco::Mesh* mesh,
+                    draco_decode::DracoStreamInfo& info) {
+  info.num_points = pc->num_points();
+  info.num_faces = mesh != nullptr ? mesh->num_faces() : 0;
+  info.attributes.clear();
+  for (int32_t i = 0; i < pc->num_attributes(); ++i) {
+    const draco::PointAttribute* att = pc->attribute(i);
+    draco_decode::DracoAttributeInfo att_info;
+    att_info.kind = ToDecodeMask(att->attribute_type());
+    att_info.component_size = draco::DataTypeLength(att->data_type());
+    att_info.num_components = att->num_components();
+    att_info.num_values = static_cast<uint32_t>(att->size());
+    info.attributes.push_back(att_info);
+  }
+}
+
+template <typename T>
+uint64_t ByteSize(const std::vector<T>& values) {
+  return values.size() * sizeof(T);
+}
+
+// Runs the extraction stages, concurrently if the input is large.
+void RunStages(uint32_t num_points, std::vector<std::function<void()>> stages) {
+  if (num_points < kParallelMinPoints) {
+    for (auto& stage : stages) {
+      stage();
+    }
+    return;
+  }
+  parallel_util::ThreadPool::Current().Run(std::move(stages));
+}
+
+// Bump allocator for the outputs of a DracoDecoderSession. Reset() rewinds
+// it; if the last round spilled into more than one block, the blocks are
+// replaced by a single block of their total size, so similar-sized rounds
+// settle on one block and stop allocating.
+class Arena {
+ public:
+  Arena() { blocks_.reserve(kMaxBlocks); }
+
+  void Reserve(size_t bytes) {
+    if (capacity() < bytes) {
+      blocks_.clear();
+      AddBlock(bytes);
+    }
+    Rewind();
+  }
+
+  void Reset() {
+    if (blocks_.size() > 1) {
+      const size_t total = capacity();
+      blocks_.clear();
+      AddBlock(total);
+    }
+    Rewind();
+  }
+
+  // Storage for |n| default constructed values of T. Valid until Reset().
+  template <typename T>
+  T* Allocate(size_t n) {
+    static_assert(alignof(T) <= kAlignment, "");
+    const size_t bytes =
+        (n * sizeof(T) + kAlignment - 1) / kAlignment * kAlignment;
+    while (current_ < blocks_.size() &&
+           offset_ + bytes > blocks_[current_].size) {
+      current_++;
+      offset_ = 0;
     }
+    if (current_ == blocks_.size()) {
+      // Grow geometrically so that a round needs few blocks
+      AddBlock(std::max(bytes, std::max(capacity(), kMinBlockSize)));
+      offset_ = 0;
+    }
+    T* values = reinterpret_cast<T*>(blocks_[current_].data.get() + offset_);
+    offset_ += bytes;
+    used_ += bytes;
+    std::uninitialized_default_construct_n(values, n);
+    return values;
+  }
+
+  size_t capacity() const {
+    size_t total = 0;
+    for (const auto& block : blocks_) {
+      total += block.size;
+    }
+    return total;
+  }
+  size_t used() const { return used_; }
+  uint64_t allocations() const { return allocations_; }
+  uint64_t allocated_bytes() const { return allocated_bytes_; }
+
+ private:
+  // operator new[] storage is aligned to at least this
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+  static constexpr size_t kMinBlockSize = 64 * 1024;
+  static constexpr size_t kMaxBlocks = 32;
+
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size = 0;
+  };
+
+  void AddBlock(size_t size) {
+    blocks_.push_back(Block{std::unique_ptr<char[]>(new char[size]), size});
+    allocations_++;
+    allocated_bytes_ += size;
+  }
+
+  void Rewind() {
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
   }
 
-  return std::make_pair(indices, uv_indices);
+  std::vector<Block> blocks_;
+  size_t current_ = 0;
+  size_t offset_ = 0;
+  size_t used_ = 0;
+  uint64_t allocations_ = 0;
+  uint64_t allocated_bytes_ = 0;
+};
+
+// Named attribute of |pc| if it has values.
+const draco::PointAttribute* FindAttribute(
+    const draco::PointCloud* pc, draco::GeometryAttribute::Type type) {
+  const draco::PointAttribute* att = pc->GetNamedAttribute(type);
+  return att != nullptr && att->size() > 0 ? att : nullptr;
 }
 
 }  // namespace
 
 namespace draco_decode {
 
+bool DracoReadInfo(const std::vector<char>& data, DracoStreamInfo& info,
+                   bool decode_if_missing) {
+  return DracoReadInfo(data.data(), data.size(), info, decode_if_missing);
+}
+
+bool DracoReadInfo(const char* data, size_t size, DracoStreamInfo& info,
+                   bool decode_if_missing) {
+  info = DracoStreamInfo();
+
+  draco::DecoderBuffer buffer;
+  buffer.Init(data, size);
+
+  draco::DracoHeader header;
+  const draco::Status status =
+      draco::PointCloudDecoder::DecodeHeader(&buffer, &header);
+  if (!status.ok()) {
+    printf("Decode error: %s\n", status.error_msg());
+    return false;
+  }
+  info.is_mesh = header.encoder_type == draco::TRIANGULAR_MESH;
+
+  // Metadata follows the header since bitstream 1.3
+  const bool has_metadata =
+      (header.version_major > 1 ||
+       (header.version_major == 1 && header.version_minor >= 3)) &&
+      (header.flags & draco::METADATA_FLAG_MASK) != 0;
+  if (has_metadata) {
+    draco::GeometryMetadata metadata;
+    draco::MetadataDecoder metadata_decoder;
+    if (metadata_decoder.DecodeGeometryMetadata(&buffer, &metadata) &&
+        ReadStreamInfo(metadata, info)) {
+      info.from_header = true;
+      return true;
+    }
+  }
+
+  if (!decode_if_missing) {
+    printf("Error: No stream info in the stream.\n");
+    return false;
+  }
+
+  // No stream info in the stream, so decode it.
+  buffer.Init(data, size);
+  draco::Decoder decoder;
+  if (info.is_mesh) {
+    auto statusor = decoder.DecodeMeshFromBuffer(&buffer);
+    if (!statusor.ok()) {
+      printf("Decode error: %s\n", statusor.status().error_msg());
+      return false;
+    }
+    const std::unique_ptr<draco::Mesh>& mesh = statusor.value();
+    ReadStreamInfo(mesh.get(), mesh.get(), info);
+  } else {
+    auto statusor = decoder.DecodePointCloudFromBuffer(&buffer);
+    if (!statusor.ok()) {
+      printf("Decode error: %s\n", statusor.status().error_msg());
+      return false;
+    }
+    ReadStreamInfo(statusor.value().get(), nullptr, info);
+  }
+
+  return true;
+}
+
 bool DracoDecode(const std::vector<char>& data,
                  std::vector<Eigen::Vector3f>& verts,
                  std::vector<Eigen::Vector2f>& uvs,
                  std::vector<Eigen::Vector3i>& indices,
                  std::vector<Eigen::Vector3i>& uv_indices,
                  std::vector<Eigen::Vector<uint8_t, 3>>& colors,
-                 std::vector<Eigen::Vector3f>& normals) {
+                 std::vector<Eigen::Vector3f>& normals, uint32_t mask,
+                 draco_trace::Trace* trace) {
+  return DracoDecode(data.data(), data.size(), verts, uvs, indices,
+                     uv_indices, colors, normals, mask, trace);
+}
+
+namespace {
+
+// True if every value of integer type S fits in integer type T.
+template <typename T, typename S>
+bool RangeFits() {
+  return static_cast<int64_t>(std::numeric_limits<S>::min()) >=
+             static_cast<int64_t>(std::numeric_limits<T>::min()) &&
+         static_cast<uint64_t>(std::numeric_limits<S>::max()) <=
+             static_cast<uint64_t>(std::numeric_limits<T>::max());
+}
+
+// True if positions of scalar type T can be filled from |pc| without loss:
+// float outputs take anything, integer outputs need integer positions whose
+// type fits in T, e.g. uint16 outputs refuse int16 or int32 streams.
+template <typename T>
+bool CheckPositionType(const draco::PointCloud* pc, uint32_t mask) {
+  const draco::PointAttribute* att =
+      pc->GetNamedAttribute(draco::GeometryAttribute::POSITION);
+  if (std::is_floating_point<T>::value || !(mask & kDecodePositions) ||
+      att == nullptr || att->size() == 0) {
+    return true;
+  }
+  bool fits;
+  switch (att->data_type()) {
+    case draco::DT_INT8:
+      fits = RangeFits<T, int8_t>();
+      break;
+    case draco::DT_UINT8:
+      fits = RangeFits<T, uint8_t>();
+      break;
+    case draco::DT_INT16:
+      fits = RangeFits<T, int16_t>();
+      break;
+    case draco::DT_UINT16:
+      fits = RangeFits<T, uint16_t>();
+      break;
+    case draco::DT_INT32:
+      fits = RangeFits<T, int32_t>();
+      break;
+    case draco::DT_UINT32:
+      fits = RangeFits<T, uint32_t>();
+      break;
+    default:
+      printf("Error: Positions of the stream are not integers.\n");
+      return false;
+  }
+  if (!fits) {
+    printf("Error: Positions of the stream do not fit the output type.\n");
+  }
+  return fits;
+}
+
+// DracoDecode with positions of scalar type T.
+template <typename T>
+bool DecodeImpl(const char* data, size_t size,
+                std::vector<Eigen::Matrix<T, 3, 1>>& verts,
+                std::vector<Eigen::Vector2f>& uvs,
+                std::vector<Eigen::Vector3i>& indices,
+                std::vector<Eigen::Vector3i>& uv_indices,
+                std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                std::vector<Eigen::Vector3f>& normals, uint32_t mask,
+                draco_trace::Trace* trace) {
   // Create a draco decoding buffer. Note that no data is copied in this step.
   draco::DecoderBuffer buffer;
-  buffer.Init(data.data(), data.size());
+  buffer.Init(data, size);
 
-  draco::CycleTimer timer;
   // Decode the input data into a geometry.
   std::unique_ptr<draco::PointCloud> pc;
   draco::Mesh* mesh = nullptr;
-  auto type_statusor = draco::Decoder::GetEncodedGeometryType(&buffer);
+  auto type_statusor = [&]() {
+    draco_trace::ScopedEvent event(trace, "probe_geometry_type");
+    return draco::Decoder::GetEncodedGeometryType(&buffer);
+  }();
   if (!type_statusor.ok()) {
     printf("Decode error: %s\n", type_statusor.status().error_msg());
     return false;
   }
   const draco::EncodedGeometryType geom_type = type_statusor.value();
+
+  // Clear outputs which are not requested. They are never filled.
+  if (!(mask & kDecodePositions)) {
+    verts.clear();
+  }
+  if (!(mask & kDecodeUvs)) {
+    uvs.clear();
+  }
+  if (!(mask & kDecodeColors)) {
+    colors.clear();
+  }
+  if (!(mask & kDecodeNormals)) {
+    normals.clear();
+  }
+  if (!(mask & kDecodeFaces) || geom_type != draco::TRIANGULAR_MESH) {
+    indices.clear();
+    uv_indices.clear();
+  }
+
+  draco::Decoder decoder;
+  // Attributes which are not requested are still decoded by Draco, but their
+  // dequantization is skipped.
+  const std::pair<uint32_t, draco::GeometryAttribute::Type> skippable[] = {
+      {kDecodePositions, draco::GeometryAttribute::POSITION},
+      {kDecodeUvs, draco::GeometryAttribute::TEX_COORD},
+      {kDecodeNormals, draco::GeometryAttribute::NORMAL}};
+  for (const auto& [bit, type] : skippable) {
+    if (!(mask & bit)) {
+      decoder.SetSkipAttributeTransform(type);
+    }
+  }
+
   if (geom_type == draco::TRIANGULAR_MESH) {
-    timer.Start();
-    draco::Decoder decoder;
-    auto statusor = decoder.DecodeMeshFromBuffer(&buffer);
-    if (!statusor.ok()) {
-      printf("Decode error: %s\n", statusor.status().error_msg());
-      return false;
+    std::unique_ptr<draco::Mesh> in_mesh;
+    {
+      draco_trace::ScopedEvent event(trace, "decode");
+      event.set_bytes(size);
+      auto statusor = decoder.DecodeMeshFromBuffer(&buffer);
+      if (!statusor.ok()) {
+        printf("Decode error: %s\n", statusor.status().error_msg());
+        return false;
+      }
+      in_mesh = std::move(statusor).value();
     }
-    std::unique_ptr<draco::Mesh> in_mesh = std::move(statusor).value();
-    timer.Stop();
     if (in_mesh) {
       mesh = in_mesh.get();
       pc = std::move(in_mesh);
     }
 
-    // Decode positions
-    verts = DecodePositions(mesh);
-
-    // Decode UVs
-    uvs = DecodeUvs(mesh);
-
-    // Decode colors
-    colors = DecodeColors(mesh);
-
-    // Decode normals
-    normals = DecodeNormals(mesh);
-
-    // Decode faces
-    std::tie(indices, uv_indices) = DecodeFaces(mesh);
+    if (mesh != nullptr && !CheckPositionType<T>(mesh, mask)) {
+      return false;
+    }
+    if (mesh != nullptr) {
+      std::vector<std::function<void()>> stages;
+      if (mask & kDecodePositions) {
+        // Decode positions
+        stages.push_back([&]() {
+          draco_trace::ScopedEvent event(trace, "positions");
+          DecodePositions(mesh, verts);
+          event.set_bytes(ByteSize(verts));
+        });
+      }
+      if (mask & kDecodeUvs) {
+        // Decode UVs
+        stages.push_back([&]() {
+          draco_trace::ScopedEvent event(trace, "uvs");
+          DecodeUvs(mesh, uvs);
+          event.set_bytes(ByteSize(uvs));
+        });
+      }
+      if (mask & kDecodeColors) {
+        // Decode colors
+        stages.push_back([&]() {
+          draco_trace::ScopedEvent event(trace, "colors");
+          DecodeColors(mesh, colors);
+          event.set_bytes(ByteSize(colors));
+        });
+      }
+      if (mask & kDecodeNormals) {
+        // Decode normals
+        stages.push_back([&]() {
+          draco_trace::ScopedEvent event(trace, "normals");
+          DecodeNormals(mesh, normals);
+          event.set_bytes(ByteSize(normals));
+        });
+      }
+      if (mask & kDecodeFaces) {
+        // Decode faces
+        const bool with_uv_indices = (mask & kDecodeUvs) != 0;
+        stages.push_back([&, with_uv_indices]() {
+          draco_trace::ScopedEvent event(trace, "faces");
+          DecodeFaces(mesh, with_uv_indices, indices, uv_indices);
+          event.set_bytes(ByteSize(indices) + ByteSize(uv_indices));
+        });
+      }
+      RunStages(mesh->num_points(), std::move(stages));
+    }
 
   } else if (geom_type == draco::POINT_CLOUD) {
     // Failed to decode it as mesh, so let's try to decode it as a point
     // cloud.
-    timer.Start();
-    draco::Decoder decoder;
-    auto statusor = decoder.DecodePointCloudFromBuffer(&buffer);
-    if (!statusor.ok()) {
-      printf("Decode error: %s\n", statusor.status().error_msg());
-      return false;
+    {
+      draco_trace::ScopedEvent event(trace, "decode");
+      event.set_bytes(size);
+      auto statusor = decoder.DecodePointCloudFromBuffer(&buffer);
+      if (!statusor.ok()) {
+        printf("Decode error: %s\n", statusor.status().error_msg());
+        return false;
+      }
+      pc = std::move(statusor).value();
     }
-    pc = std::move(statusor).value();
-    timer.Stop();
-
-    // Decode positions
-    verts = DecodePositions(pc.get());
-
-    // Decode colors
-    colors = DecodeColors(pc.get());
 
-    // Decode normals
-    normals = DecodeNormals(pc.get());
+    const draco::PointCloud* in_pc = pc.get();
+    if (in_pc != nullptr && !CheckPositionType<T>(in_pc, mask)) {
+      return false;
+    }
+    if (in_pc != nullptr) {
+      std::vector<std::function<void()>> stages;
+      if (mask & kDecodePositions) {
+        // Decode positions
+        stages.push_back([&]() {
+          draco_trace::ScopedEvent event(trace, "positions");
+          DecodePositions(in_pc, verts);
+          event.set_bytes(ByteSize(verts));
+        });
+      }
+      if (mask & kDecodeColors) {
+        // Decode colors
+        stages.push_back([&]() {
+          draco_trace::ScopedEvent event(trace, "colors");
+          DecodeColors(in_pc, colors);
+          event.set_bytes(ByteSize(colors));
+        });
+      }
+      if (mask & kDecodeNormals) {
+        // Decode normals
+        stages.push_back([&]() {
+          draco_trace::ScopedEvent event(trace, "normals");
+          DecodeNormals(in_pc, normals);
+          event.set_bytes(ByteSize(normals));
+        });
+      }
+      RunStages(in_pc->num_points(), std::move(stages));
+    }
   }
 
   if (pc == nullptr) {
@@ -197,4 +653,270 @@ bool DracoDecode(const std::vector<char>& data,
   return true;
 }
 
-}  // namespace draco_decode
\ No newline at end of file
+}  // namespace
+
+bool DracoDecode(const char* data, size_t size,
+                 std::vector<Eigen::Vector3f>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals, uint32_t mask,
+                 draco_trace::Trace* trace) {
+  return DecodeImpl(data, size, verts, uvs, indices, uv_indices, colors,
+                    normals, mask, trace);
+}
+
+bool DracoDecode(const std::vector<char>& data,
+                 std::vector<Eigen::Vector<uint16_t, 3>>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals, uint32_t mask,
+                 draco_trace::Trace* trace) {
+  return DecodeImpl(data.data(), data.size(), verts, uvs, indices,
+                    uv_indices, colors, normals, mask, trace);
+}
+
+bool DracoDecode(const char* data, size_t size,
+                 std::vector<Eigen::Vector<uint16_t, 3>>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals, uint32_t mask,
+                 draco_trace::Trace* trace) {
+  return DecodeImpl(data, size, verts, uvs, indices, uv_indices, colors,
+                    normals, mask, trace);
+}
+
+bool DracoDecode(const std::vector<char>& data,
+                 std::vector<Eigen::Vector3i>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals, uint32_t mask,
+                 draco_trace::Trace* trace) {
+  return DecodeImpl(data.data(), data.size(), verts, uvs, indices,
+                    uv_indices, colors, normals, mask, trace);
+}
+
+bool DracoDecode(const char* data, size_t size,
+                 std::vector<Eigen::Vector3i>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals, uint32_t mask,
+                 draco_trace::Trace* trace) {
+  return DecodeImpl(data, size, verts, uvs, indices, uv_indices, colors,
+                    normals, mask, trace);
+}
+
+class DracoDecoderSession::Impl {
+ public:
+  explicit Impl(size_t initial_arena_bytes) {
+    if (initial_arena_bytes > 0) {
+      arena_.Reserve(initial_arena_bytes);
+    }
+  }
+
+  bool Decode(const char* data, size_t size, DecodedArrays& out,
+              uint32_t mask, draco_trace::Trace* trace) {
+    out = DecodedArrays();
+    arena_.Reset();
+    stats_.decodes++;
+
+    draco::DecoderBuffer buffer;
+    buffer.Init(data, size);
+    auto type_statusor = [&]() {
+      draco_trace::ScopedEvent event(trace, "probe_geometry_type");
+      return draco::Decoder::GetEncodedGeometryType(&buffer);
+    }();
+    if (!type_statusor.ok()) {
+      printf("Decode error: %s\n", type_statusor.status().error_msg());
+      return false;
+    }
+    const draco::EncodedGeometryType geom_type = type_statusor.value();
+    if (geom_type != draco::TRIANGULAR_MESH &&
+        geom_type != draco::POINT_CLOUD) {
+      printf("Failed to decode the input file.\n");
+      return false;
+    }
+
+    // The decoder is reused, so skipping is switched both ways every call
+    const std::pair<uint32_t, draco::GeometryAttribute::Type> skippable[] = {
+        {kDecodePositions, draco::GeometryAttribute::POSITION},
+        {kDecodeUvs, draco::GeometryAttribute::TEX_COORD},
+        {kDecodeNormals, draco::GeometryAttribute::NORMAL}};
+    for (const auto& [bit, type] : skippable) {
+      decoder_.options()->SetAttributeBool(type, "skip_attribute_transform",
+                                           !(mask & bit));
+    }
+
+    std::unique_ptr<draco::PointCloud> pc;
+    const draco::Mesh* mesh = nullptr;
+    {
+      draco_trace::ScopedEvent event(trace, "decode");
+      event.set_bytes(size);
+      if (geom_type == draco::TRIANGULAR_MESH) {
+        auto statusor = decoder_.DecodeMeshFromBuffer(&buffer);
+        if (!statusor.ok()) {
+          printf("Decode error: %s\n", statusor.status().error_msg());
+          return false;
+        }
+        std::unique_ptr<draco::Mesh> in_mesh = std::move(statusor).value();
+        mesh = in_mesh.get();
+        pc = std::move(in_mesh);
+      } else {
+        auto statusor = decoder_.DecodePointCloudFromBuffer(&buffer);
+        if (!statusor.ok()) {
+          printf("Decode error: %s\n", statusor.status().error_msg());
+          return false;
+        }
+        pc = std::move(statusor).value();
+      }
+    }
+    if (pc == nullptr) {
+      printf("Failed to decode the input file.\n");
+      return false;
+    }
+
+    // Carve all outputs from the arena first; the stages only write to them
+    const draco::PointAttribute* pos_att =
+        FindAttribute(pc.get(), draco::GeometryAttribute::POSITION);
+    const draco::PointAttribute* uv_att =
+        FindAttribute(pc.get(), draco::GeometryAttribute::TEX_COORD);
+    const draco::PointAttribute* col_att =
+        FindAttribute(pc.get(), draco::GeometryAttribute::COLOR);
+    const draco::PointAttribute* nor_att =
+        FindAttribute(pc.get(), draco::GeometryAttribute::NORMAL);
+    Eigen::Vector3f* verts = nullptr;
+    Eigen::Vector2f* uvs = nullptr;
+    Eigen::Vector<uint8_t, 3>* colors = nullptr;
+    Eigen::Vector3f* normals = nullptr;
+    Eigen::Vector3i* indices = nullptr;
+    Eigen::Vector3i* uv_indices = nullptr;
+    if ((mask & kDecodePositions) && pos_att != nullptr) {
+      verts = Allocate(pos_att->size(), out.verts);
+    }
+    if ((mask & kDecodeUvs) && uv_att != nullptr) {
+      uvs = Allocate(uv_att->size(), out.uvs);
+    }
+    if ((mask & kDecodeColors) && col_att != nullptr) {
+      colors = Allocate(col_att->size(), out.colors);
+    }
+    if ((mask & kDecodeNormals) && nor_att != nullptr) {
+      normals = Allocate(nor_att->size(), out.normals);
+    }
+    const bool with_faces =
+        mesh != nullptr && (mask & kDecodeFaces) && pos_att != nullptr;
+    const bool with_uv_indices = with_faces && uvs != nullptr;
+    if (with_faces) {
+      indices = Allocate(mesh->num_faces(), out.indices);
+    }
+    if (with_uv_indices) {
+      uv_indices = Allocate(mesh->num_faces(), out.uv_indices);
+    }
+    stats_.allocations = arena_.allocations();
+    stats_.allocated_bytes = arena_.allocated_bytes();
+    stats_.arena_capacity = arena_.capacity();
+    stats_.arena_used = arena_.used();
+
+    auto run_stage = [&](int stage) {
+      switch (stage) {
+        case 0:
+          if (verts != nullptr) {
+            draco_trace::ScopedEvent event(trace, "positions");
+            ExtractValues(pos_att, verts);
+            event.set_bytes(out.verts.size * sizeof(*verts));
+          }
+          break;
+        case 1:
+          if (uvs != nullptr) {
+            draco_trace::ScopedEvent event(trace, "uvs");
+            ExtractValues(uv_att, uvs);
+            event.set_bytes(out.uvs.size * sizeof(*uvs));
+          }
+          break;
+        case 2:
+          if (colors != nullptr) {
+            draco_trace::ScopedEvent event(trace, "colors");
+            ExtractValues(col_att, colors);
+            event.set_bytes(out.colors.size * sizeof(*colors));
+          }
+          break;
+        case 3:
+          if (normals != nullptr) {
+            draco_trace::ScopedEvent event(trace, "normals");
+            ExtractValues(nor_att, normals);
+            event.set_bytes(out.normals.size * sizeof(*normals));
+          }
+          break;
+        case 4:
+          if (with_faces) {
+            draco_trace::ScopedEvent event(trace, "faces");
+            ExtractFaces(mesh, pos_att, with_uv_indices ? uv_att : nullptr,
+                         indices, uv_indices);
+            event.set_bytes((out.indices.size + out.uv_indices.size) *
+                            sizeof(*indices));
+          }
+          break;
+      }
+    };
+    constexpr int kNumStages = 5;
+    if (pc->num_points() < kParallelMinPoints) {
+      // Called directly; std::function closures could allocate
+      for (int stage = 0; stage < kNumStages; stage++) {
+        run_stage(stage);
+      }
+    } else {
+      std::vector<std::function<void()>> stages;
+      for (int stage = 0; stage < kNumStages; stage++) {
+        stages.push_back([&run_stage, stage]() { run_stage(stage); });
+      }
+      parallel_util::ThreadPool::Current().Run(std::move(stages));
+    }
+    return true;
+  }
+
+  const DecoderSessionStats& stats() const { return stats_; }
+
+ private:
+  template <typename T>
+  T* Allocate(size_t n, ArrayView<T>& view) {
+    T* values = arena_.Allocate<T>(n);
+    view.data = values;
+    view.size = n;
+    return values;
+  }
+
+  draco::Decoder decoder_;
+  Arena arena_;
+  DecoderSessionStats stats_;
+};
+
+DracoDecoderSession::DracoDecoderSession(size_t initial_arena_bytes)
+    : impl_(new Impl(initial_arena_bytes)) {}
+
+DracoDecoderSession::~DracoDecoderSession() = default;
+
+bool DracoDecoderSession::Decode(const char* data, size_t size,
+                                 DecodedArrays& out, uint32_t mask,
+                                 draco_trace::Trace* trace) {
+  return impl_->Decode(data, size, out, mask, trace);
+}
+
+bool DracoDecoderSession::Decode(const std::vector<char>& bytes,
+                                 DecodedArrays& out, uint32_t mask,
+                                 draco_trace::Trace* trace) {
+  return impl_->Decode(bytes.data(), bytes.size(), out, mask, trace);
+}
+
+DecoderSessionStats DracoDecoderSession::stats() const {
+  return impl_->stats();
+}
+
+}  // namespace draco_decode
@@ -1,15 +1,195 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 #include "Eigen/Geometry"
 
+namespace draco_trace {
+class Trace;
+}  // namespace draco_trace
+
 namespace draco_decode {
 
+// Outputs of DracoDecode. Combine with | to select which ones are filled.
+enum DracoDecodeMask : uint32_t {
+  kDecodePositions = 1u << 0,
+  kDecodeUvs = 1u << 1,
+  kDecodeColors = 1u << 2,
+  kDecodeNormals = 1u << 3,
+  // indices, and uv_indices if kDecodeUvs is also set
+  kDecodeFaces = 1u << 4,
+  kDecodeAll = 0x1fu,
+};
+
+struct DracoAttributeInfo {
+  // One of kDecodePositions, kDecodeUvs, kDecodeColors and kDecodeNormals,
+  // or 0 for other attributes
+  uint32_t kind = 0;
+  int num_components = 0;
+  // Size of a component in bytes
+  int component_size = 0;
+  uint32_t num_values = 0;
+};
+
+// Summary of an encoded stream. Counts are those of the encoded geometry;
+// Draco may split a few vertices on decode, so treat them as preallocation
+// hints rather than exact output sizes.
+struct DracoStreamInfo {
+  bool is_mesh = false;
+  uint32_t num_points = 0;
+  uint32_t num_faces = 0;
+  std::vector<DracoAttributeInfo> attributes;
+  // True if the info was read from the stream header. False if the stream
+  // was encoded without stream info and was decoded on request.
+  bool from_header = false;
+};
+
+// Reads geometry type, counts and attribute list of |bytes| from the stream
+// info written with DracoEncodeOptions::write_stream_info, without decoding.
+// Streams without it fail, unless |decode_if_missing| is set, in which case
+// they are fully decoded to get the info.
+bool DracoReadInfo(const std::vector<char>& bytes, DracoStreamInfo& info,
+                   bool decode_if_missing = false);
+
+// Same as above for a stream in memory owned by the caller, e.g. a mapped
+// file or a shared memory region.
+bool DracoReadInfo(const char* data, size_t size, DracoStreamInfo& info,
+                   bool decode_if_missing = false);
+
+// Only outputs selected by |mask| are converted and filled; the others are
+// cleared. If |trace| is set, stage timings and output sizes are added to it.
 bool DracoDecode(const std::vector<char>& bytes,
                  std::vector<Eigen::Vector3f>& verts,
                  std::vector<Eigen::Vector2f>& uvs,
                  std::vector<Eigen::Vector3i>& indices,
                  std::vector<Eigen::Vector3i>& uv_indices,
                  std::vector<Eigen::Vector<uint8_t, 3>>& colors,
-                 std::vector<Eigen::Vector3f>& normals);
+                 std::vector<Eigen::Vector3f>& normals,
+                 uint32_t mask = kDecodeAll,
+                 draco_trace::Trace* trace = nullptr);
+
+// Decodes |size| bytes at |data| in place. The stream is read directly and
+// is not copied.
+bool DracoDecode(const char* data, size_t size,
+                 std::vector<Eigen::Vector3f>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals,
+                 uint32_t mask = kDecodeAll,
+                 draco_trace::Trace* trace = nullptr);
+
+// Decodes integer positions, e.g. from the integer-grid overloads of
+// draco_encode::DracoEncode, without conversion to float. Fails if the
+// positions in the stream are not integers or their type does not fit the
+// output, e.g. int32 positions into uint16.
+bool DracoDecode(const std::vector<char>& bytes,
+                 std::vector<Eigen::Vector<uint16_t, 3>>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals,
+                 uint32_t mask = kDecodeAll,
+                 draco_trace::Trace* trace = nullptr);
+
+bool DracoDecode(const char* data, size_t size,
+                 std::vector<Eigen::Vector<uint16_t, 3>>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals,
+                 uint32_t mask = kDecodeAll,
+                 draco_trace::Trace* trace = nullptr);
+
+bool DracoDecode(const std::vector<char>& bytes,
+                 std::vector<Eigen::Vector3i>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals,
+                 uint32_t mask = kDecodeAll,
+                 draco_trace::Trace* trace = nullptr);
+
+bool DracoDecode(const char* data, size_t size,
+                 std::vector<Eigen::Vector3i>& verts,
+                 std::vector<Eigen::Vector2f>& uvs,
+                 std::vector<Eigen::Vector3i>& indices,
+                 std::vector<Eigen::Vector3i>& uv_indices,
+                 std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 std::vector<Eigen::Vector3f>& normals,
+                 uint32_t mask = kDecodeAll,
+                 draco_trace::Trace* trace = nullptr);
+
+// Read-only view of an array owned by a DracoDecoderSession.
+template <typename T>
+struct ArrayView {
+  const T* data = nullptr;
+  size_t size = 0;
+
+  bool empty() const { return size == 0; }
+  const T* begin() const { return data; }
+  const T* end() const { return data + size; }
+  const T& operator[](size_t i) const { return data[i]; }
+};
+
+// Outputs of DracoDecoderSession::Decode, in the layout of DracoDecode.
+struct DecodedArrays {
+  ArrayView<Eigen::Vector3f> verts;
+  ArrayView<Eigen::Vector2f> uvs;
+  ArrayView<Eigen::Vector3i> indices;
+  ArrayView<Eigen::Vector3i> uv_indices;
+  ArrayView<Eigen::Vector<uint8_t, 3>> colors;
+  ArrayView<Eigen::Vector3f> normals;
+};
+
+struct DecoderSessionStats {
+  uint64_t decodes = 0;
+  // Heap allocations the session made for output storage, and their bytes.
+  // Stops growing once the arena fits the inputs. Draco's own allocations
+  // while decoding are not included.
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+  // Arena size and the part of it used by the last decode
+  size_t arena_capacity = 0;
+  size_t arena_used = 0;
+};
+
+// Decoder for many streams in a row, e.g. in a tile or frame server. The
+// draco::Decoder is kept between calls and all outputs are carved from one
+// arena which is rewound on every Decode(). When a decode needs more than
+// the arena holds, the arena grows and is consolidated into one block at the
+// next Decode(), so a steady stream of similar-sized inputs stops allocating
+// output storage after the first few calls.
+class DracoDecoderSession {
+ public:
+  // |initial_arena_bytes| preallocates the arena
+  explicit DracoDecoderSession(size_t initial_arena_bytes = 0);
+  ~DracoDecoderSession();
+  DracoDecoderSession(const DracoDecoderSession&) = delete;
+  DracoDecoderSession& operator=(const DracoDecoderSession&) = delete;
+
+  // Decodes |size| bytes at |data| in place like DracoDecode. Views in |out|
+  // stay valid until the next Decode() on this session; outputs not
+  // selected by |mask| are empty.
+  bool Decode(const char* data, size_t size, DecodedArrays& out,
+              uint32_t mask = kDecodeAll,
+              draco_trace::Trace* trace = nullptr);
+  bool Decode(const std::vector<char>& bytes, DecodedArrays& out,
+              uint32_t mask = kDecodeAll,
+              draco_trace::Trace* trace = nullptr);
+
+  DecoderSessionStats stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
 
 }  // namespace draco_decode
@@ -1,12 +1,18 @@
 #include "draco_encode.h"
 
+#include <chrono>
 #include <cinttypes>
 #include <cstdlib>
+#include <cstring>
 
 #include "draco/compression/encode.h"
 #include "draco/compression/expert_encode.h"
-#include "draco/core/cycle_timer.h"
 #include "draco/mesh/mesh.h"
+#include "draco_metadata_keys.h"
+#include "draco_trace.h"
+#include "draco_typed.h"
+#include "mesh_util.h"
+#include "parallel_util.h"
 
 namespace draco_encode {
 
@@ -16,242 +22,640 @@ DracoEncodeOptions::DracoEncodeOptions()
       tex_coords_deleted(false),
       normals_quantization_bits(8),
       normals_deleted(false),
-      compression_level(7) {}
+      compression_level(7),
+      deduplicate_points(true),
+      voxelize_points(false),
+      write_stream_info(true),
+      pos_quantization_range(0.f),
+      pos_quantization_origin(Eigen::Vector3f::Zero()),
+      trace(nullptr) {}
+
+VectorSink::VectorSink(std::vector<char>& out) : out_(out) {}
+
+bool VectorSink::Consume(std::vector<char>& buffer) {
+  out_.swap(buffer);
+  return true;
+}
 
-std::unique_ptr<draco::Mesh> MakeMesh(
-    const std::vector<Eigen::Vector3f>& positions,
-    const std::vector<Eigen::Vector2f>& uvs,
-    const std::vector<Eigen::Vector3i>& indices,
-    const std::vector<Eigen::Vector3i>& uv_indices,
-    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
-    const std::vector<Eigen::Vector3f>& normals) {
-  std::unique_ptr<draco::Mesh> mesh(new draco::Mesh());
+SpanSink::SpanSink(char* data, size_t capacity)
+    : data_(data), capacity_(capacity), required_size_(0), size_(0) {}
 
-  if (positions.empty()) {
-    return mesh;
+bool SpanSink::Consume(std::vector<char>& buffer) {
+  required_size_ = buffer.size();
+  if (required_size_ > capacity_) {
+    size_ = 0;
+    return false;
   }
+  std::memcpy(data_, buffer.data(), buffer.size());
+  size_ = buffer.size();
+  return true;
+}
 
-  const bool is_mesh = indices.size() > 0;
+size_t SpanSink::capacity() const { return capacity_; }
 
-  if (is_mesh) {
-    // Set face size
-    mesh->SetNumFaces(indices.size());
+size_t SpanSink::required_size() const { return required_size_; }
 
-    // Set splitted vertices size
-    mesh->set_num_points(indices.size() * 3);
-  } else {
-    mesh->set_num_points(positions.size());
+size_t SpanSink::size() const { return size_; }
+
+FileSink::FileSink(std::FILE* fp) : fp_(fp) {}
+
+bool FileSink::Consume(std::vector<char>& buffer) {
+  if (fp_ == nullptr) {
+    return false;
   }
-  const bool identity_mapping = !is_mesh;
-
-  // Init vertex positions
-  draco::GeometryAttribute pos_att;
-  pos_att.Init(draco::GeometryAttribute::POSITION, nullptr, 3,
-               draco::DT_FLOAT32, false, sizeof(float) * 3, 0);
-  int pos_att_id =
-      mesh->AddAttribute(pos_att, identity_mapping, positions.size());
-  draco::PointAttribute* pos_attribute = mesh->attribute(pos_att_id);
-
-  // Init UVs
-  const bool with_uvs = uvs.size() > 0 && uv_indices.size() == indices.size();
-  draco::GeometryAttribute uv_att;
-  int uv_att_id = -1;
-  draco::PointAttribute* uv_attribute = nullptr;
-  if (with_uvs) {
-    uv_att.Init(draco::GeometryAttribute::TEX_COORD, nullptr, 2,
-                draco::DT_FLOAT32, false, sizeof(float) * 2, 0);
-    uv_att_id = mesh->AddAttribute(uv_att, identity_mapping, uvs.size());
-    uv_attribute = mesh->attribute(uv_att_id);
+  return std::fwrite(buffer.data(), 1, buffer.size(), fp_) == buffer.size();
+}
+
+namespace {
+
+// Collapses face corners which share the same position and uv into a single
+// point. Colors and normals are stored per position, so they never split a
+// wedge further.
+void DeduplicateWedges(const std::vector<Eigen::Vector3i>& indices,
+                       const std::vector<Eigen::Vector3i>& uv_indices,
+                       bool with_uvs, mesh_util::WedgeTable& table,
+                       std::vector<uint32_t>& corner_to_point,
+                       std::vector<uint32_t>& point_to_pos,
+                       std::vector<uint32_t>& point_to_uv) {
+  const size_t num_corners = indices.size() * 3;
+  corner_to_point.resize(num_corners);
+  point_to_pos.clear();
+  point_to_uv.clear();
+
+  table.Reset(num_corners);
+  for (size_t i = 0; i < indices.size(); ++i) {
+    for (int j = 0; j < 3; ++j) {
+      const uint32_t pos = static_cast<uint32_t>(indices[i][j]);
+      const uint32_t uv =
+          with_uvs ? static_cast<uint32_t>(uv_indices[i][j]) : 0u;
+      const uint64_t key = (static_cast<uint64_t>(pos) << 32) | uv;
+      const uint32_t next = static_cast<uint32_t>(point_to_pos.size());
+      const uint32_t point = table.FindOrInsert(key, next);
+      if (point == next) {
+        point_to_pos.push_back(pos);
+        point_to_uv.push_back(uv);
+      }
+      corner_to_point[i * 3 + j] = point;
+    }
   }
+}
 
-  // Init colors
-  const bool with_colors = colors.size() == positions.size();
-  draco::GeometryAttribute col_att;
-  int col_att_id = -1;
-  draco::PointAttribute* col_attribute = nullptr;
-  if (with_colors) {
-    col_att.Init(draco::GeometryAttribute::COLOR, nullptr, 3, draco::DT_UINT8,
-                 true, sizeof(uint8_t) * 3, 0);
-    col_att_id = mesh->AddAttribute(col_att, identity_mapping, colors.size());
-    col_attribute = mesh->attribute(col_att_id);
+// Eigen fixed-size vectors used for input are tightly packed.
+static_assert(sizeof(Eigen::Vector3f) == sizeof(float) * 3, "");
+static_assert(sizeof(Eigen::Vector2f) == sizeof(float) * 2, "");
+static_assert(sizeof(Eigen::Vector<uint8_t, 3>) == sizeof(uint8_t) * 3, "");
+
+// Copies all values into the buffer of |att| with a single write. |att| must
+// have been reset to values.size() entries of sizeof(T) bytes.
+template <typename T>
+void CopyAttributeValues(const std::vector<T>& values,
+                         draco::PointAttribute* att) {
+  if (values.empty()) {
+    return;
   }
+  att->buffer()->Write(0, values.data(), values.size() * sizeof(T));
+}
 
-  // Init normals
-  const bool with_normals = normals.size() == positions.size();
-  draco::GeometryAttribute nor_att;
-  int nor_att_id = -1;
-  draco::PointAttribute* nor_attribute = nullptr;
-  if (with_normals) {
-    nor_att.Init(draco::GeometryAttribute::NORMAL, nullptr, 3,
-                 draco::DT_FLOAT32, false, sizeof(float) * 3, 0);
-    nor_att_id = mesh->AddAttribute(nor_att, identity_mapping, normals.size());
-    nor_attribute = mesh->attribute(nor_att_id);
+// Which attributes a mesh was built with. A mesh can be refilled in place
+// only if the layout of the new input is the same.
+struct MeshLayout {
+  bool is_mesh = false;
+  bool with_uvs = false;
+  bool with_colors = false;
+  bool with_normals = false;
+
+  bool operator==(const MeshLayout& other) const {
+    return is_mesh == other.is_mesh && with_uvs == other.with_uvs &&
+           with_colors == other.with_colors &&
+           with_normals == other.with_normals;
   }
+};
 
-  // Set vertex positions
-  for (uint32_t i = 0; i < static_cast<uint32_t>(positions.size()); ++i) {
-    pos_attribute->SetAttributeValue(draco::AttributeValueIndex(i),
-                                     &positions[i]);
+// Encodes integer positions as an integer attribute through draco_typed,
+// which leaves non-float attributes unquantized.
+template <typename T>
+bool EncodeIntegerPositions(
+    const std::vector<Eigen::Matrix<T, 3, 1>>& verts,
+    const std::vector<Eigen::Vector2f>& uvs,
+    const std::vector<Eigen::Vector3i>& indices,
+    const std::vector<Eigen::Vector3i>& uv_indices,
+    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+    const std::vector<Eigen::Vector3f>& normals,
+    const DracoEncodeOptions& options, std::vector<char>& bytes) {
+  using draco_typed::Semantic;
+  std::vector<draco_typed::AttributeSource> attributes;
+  attributes.push_back(draco_typed::Attribute(Semantic::kPosition, verts));
+  if (!indices.empty() && !uvs.empty() &&
+      uv_indices.size() == indices.size()) {
+    attributes.push_back(
+        draco_typed::Attribute(Semantic::kTexCoord, uvs, &uv_indices));
+  } else if (indices.empty() && uvs.size() == verts.size()) {
+    attributes.push_back(draco_typed::Attribute(Semantic::kTexCoord, uvs));
+  }
+  if (colors.size() == verts.size()) {
+    attributes.push_back(draco_typed::Attribute(Semantic::kColor, colors));
   }
+  if (normals.size() == verts.size()) {
+    attributes.push_back(draco_typed::Attribute(Semantic::kNormal, normals));
+  }
+  return draco_typed::DracoEncode(attributes, indices, options, bytes);
+}
 
-  // Set UVs
-  if (with_uvs) {
-    for (uint32_t i = 0; i < static_cast<uint32_t>(uvs.size()); ++i) {
-      uv_attribute->SetAttributeValue(draco::AttributeValueIndex(i), &(uvs[i]));
+}  // namespace
+
+class DracoEncoderSession::Impl {
+ public:
+  explicit Impl(const DracoEncodeOptions& options) : options_(options) {
+    // Convert compression level to speed (that 0 = slowest, 10 = fastest).
+    const int speed = 10 - options_.compression_level;
+
+    // Setup encoder options.
+    if (options_.pos_quantization_bits > 0 &&
+        options_.pos_quantization_range > 0.f) {
+      encoder_.SetAttributeExplicitQuantization(
+          draco::GeometryAttribute::POSITION, options_.pos_quantization_bits, 3,
+          options_.pos_quantization_origin.data(),
+          options_.pos_quantization_range);
+    } else if (options_.pos_quantization_bits > 0) {
+      encoder_.SetAttributeQuantization(draco::GeometryAttribute::POSITION,
+                                        options_.pos_quantization_bits);
+    }
+    if (options_.tex_coords_quantization_bits > 0) {
+      encoder_.SetAttributeQuantization(draco::GeometryAttribute::TEX_COORD,
+                                        options_.tex_coords_quantization_bits);
+    }
+    if (options_.normals_quantization_bits > 0) {
+      encoder_.SetAttributeQuantization(draco::GeometryAttribute::NORMAL,
+                                        options_.normals_quantization_bits);
     }
+
+    encoder_.SetSpeedOptions(speed, speed);
   }
 
-  // Set colors
-  if (with_colors) {
-    for (uint32_t i = 0; i < static_cast<uint32_t>(colors.size()); ++i) {
-      col_attribute->SetAttributeValue(draco::AttributeValueIndex(i),
-                                       &(colors[i]));
+  bool Encode(const std::vector<Eigen::Vector3f>& positions,
+              const std::vector<Eigen::Vector2f>& uvs,
+              const std::vector<Eigen::Vector3i>& indices,
+              const std::vector<Eigen::Vector3i>& uv_indices,
+              const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+              const std::vector<Eigen::Vector3f>& normals) {
+    buffer_.Clear();
+    encoded_info_ = DracoEncodedInfo();
+
+    if (options_.pos_quantization_bits < 0) {
+      printf("Error: Position attribute cannot be skipped.\n");
+      return false;
+    }
+
+    const bool voxelize = options_.voxelize_points && indices.empty() &&
+                          !positions.empty() &&
+                          options_.pos_quantization_bits > 0 &&
+                          options_.pos_quantization_bits <=
+                              mesh_util::kMaxVoxelBits;
+    auto start = std::chrono::steady_clock::now();
+    if (voxelize) {
+      Voxelize(positions, uvs, colors, normals);
+    }
+    {
+      draco_trace::ScopedEvent event(options_.trace, "make_mesh");
+      if (voxelize) {
+        MakeMesh(voxels_.verts, voxels_.uvs, voxels_.indices,
+                 voxels_.uv_indices, voxels_.colors, voxels_.normals);
+      } else {
+        MakeMesh(positions, uvs, indices, uv_indices, colors, normals);
+      }
+      if (options_.trace != nullptr) {
+        event.set_bytes(AttributeBytes());
+      }
+    }
+    timings_.make_mesh_ms = ElapsedMs(start);
+
+    if (options_.write_stream_info) {
+      draco_trace::ScopedEvent event(options_.trace, "stream_info");
+      draco_metadata_keys::AddStreamInfo(mesh_.get());
     }
+
+    if (expert_encoder_ == nullptr) {
+      // Convert to ExpertEncoder that allows us to set per-attribute options.
+      if (layout_.is_mesh) {
+        expert_encoder_.reset(new draco::ExpertEncoder(*mesh_));
+      } else {
+        expert_encoder_.reset(
+            new draco::ExpertEncoder(static_cast<draco::PointCloud&>(*mesh_)));
+      }
+      expert_encoder_->Reset(encoder_.CreateExpertEncoderOptions(*mesh_));
+      // Reset() replaces the options, so this must follow it
+      expert_encoder_->SetTrackEncodedProperties(true);
+    }
+    if (voxelize && options_.pos_quantization_range <= 0.f) {
+      // Merging may shrink the bounding box; keep the grid the points were
+      // snapped to
+      expert_encoder_->SetAttributeExplicitQuantization(
+          pos_att_id_, options_.pos_quantization_bits, 3,
+          voxel_origin_.data(), voxel_range_);
+    }
+
+    start = std::chrono::steady_clock::now();
+    draco::Status status;
+    {
+      draco_trace::ScopedEvent event(options_.trace, "encode");
+      status = expert_encoder_->EncodeToBuffer(&buffer_);
+      event.set_bytes(buffer_.size());
+    }
+    timings_.encode_ms = ElapsedMs(start);
+    if (!status.ok()) {
+      printf("Failed to encode the mesh.\n");
+      printf("%s\n", status.error_msg());
+      return false;
+    }
+
+    // Attributes keep their ids as unique ids in the stream
+    encoded_info_.num_points = expert_encoder_->num_encoded_points();
+    encoded_info_.num_faces = expert_encoder_->num_encoded_faces();
+    encoded_info_.position_id = pos_att_id_;
+    encoded_info_.tex_coord_id = uv_att_id_;
+    encoded_info_.color_id = col_att_id_;
+    encoded_info_.normal_id = nor_att_id_;
+    return true;
   }
 
-  // Set normals
-  if (with_normals) {
-    for (uint32_t i = 0; i < static_cast<uint32_t>(normals.size()); ++i) {
-      nor_attribute->SetAttributeValue(draco::AttributeValueIndex(i),
-                                       &(normals[i]));
+  bool Consume(EncodeSink& sink) {
+    draco_trace::ScopedEvent event(options_.trace, "buffer_copy");
+    event.set_bytes(buffer_.size());
+    return sink.Consume(*buffer_.buffer());
+  }
+
+  const std::vector<char>& bytes() { return *buffer_.buffer(); }
+
+  const DracoEncodeTimings& timings() const { return timings_; }
+
+  const DracoEncodedInfo& encoded_info() const { return encoded_info_; }
+
+ private:
+  static double ElapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  // Snaps, merges and sorts the points into |voxels_| on the position
+  // quantization grid: the explicit one of the options, or the one Draco
+  // would derive from the bounding box.
+  void Voxelize(const std::vector<Eigen::Vector3f>& positions,
+                const std::vector<Eigen::Vector2f>& uvs,
+                const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                const std::vector<Eigen::Vector3f>& normals) {
+    draco_trace::ScopedEvent event(options_.trace, "voxelize");
+    if (options_.pos_quantization_range > 0.f) {
+      voxel_origin_ = options_.pos_quantization_origin;
+      voxel_range_ = options_.pos_quantization_range;
+    } else {
+      Eigen::AlignedBox3f box;
+      for (const auto& p : positions) {
+        box.extend(p);
+      }
+      voxel_origin_ = box.min();
+      voxel_range_ = box.sizes().maxCoeff();
+      if (voxel_range_ <= 0.f) {
+        voxel_range_ = 1.f;
+      }
     }
+    mesh_util::VoxelizePoints(positions, uvs, colors, normals, voxel_origin_,
+                              voxel_range_, options_.pos_quantization_bits,
+                              voxels_);
+    event.set_bytes(voxels_.verts.size() * sizeof(Eigen::Vector3f));
   }
 
-  if (is_mesh) {
-    // Set splitted faces
-    for (uint32_t i = 0; i < static_cast<uint32_t>(indices.size()); ++i) {
-      draco::Mesh::Face face;
-      for (uint32_t j = 0; j < 3; ++j) {
-        face[j] = 3 * i + j;
+  // Fills |mesh_| with the input. |mesh_| and its attributes are recreated
+  // only when the attribute layout changes, otherwise their storage is reused.
+  void MakeMesh(const std::vector<Eigen::Vector3f>& positions,
+                const std::vector<Eigen::Vector2f>& uvs,
+                const std::vector<Eigen::Vector3i>& indices,
+                const std::vector<Eigen::Vector3i>& uv_indices,
+                const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                const std::vector<Eigen::Vector3f>& normals) {
+    MeshLayout layout;
+    layout.is_mesh = indices.size() > 0;
+    // Attributes which would be deleted by the options are never added.
+    // This needs to happen before we set any quantization settings.
+    layout.with_uvs = uvs.size() > 0 && uv_indices.size() == indices.size() &&
+                      options_.tex_coords_quantization_bits >= 0;
+    layout.with_colors = colors.size() == positions.size();
+    layout.with_normals = normals.size() == positions.size() &&
+                          options_.normals_quantization_bits >= 0;
+    if (positions.empty()) {
+      layout = MeshLayout();
+    }
+
+    const bool is_mesh = layout.is_mesh;
+    const bool with_uvs = layout.with_uvs;
+    const bool with_colors = layout.with_colors;
+    const bool with_normals = layout.with_normals;
+
+    // Corner to point mapping and point to attribute value mappings.
+    // Without deduplication every corner is its own point.
+    const bool dedup = is_mesh && options_.deduplicate_points;
+    if (dedup) {
+      draco_trace::ScopedEvent event(options_.trace, "deduplicate_points");
+      DeduplicateWedges(indices, uv_indices, with_uvs, wedge_table_,
+                        corner_to_point_, point_to_pos_, point_to_uv_);
+    }
+
+    uint32_t num_points = static_cast<uint32_t>(positions.size());
+    if (dedup) {
+      // Deduplicated vertices size
+      num_points = static_cast<uint32_t>(point_to_pos_.size());
+    } else if (is_mesh) {
+      // Splitted vertices size
+      num_points = static_cast<uint32_t>(indices.size() * 3);
+    }
+
+    const bool rebuild = mesh_ == nullptr || !(layout == layout_);
+    if (rebuild) {
+      mesh_.reset(new draco::Mesh());
+      expert_encoder_.reset();
+      layout_ = layout;
+      pos_att_id_ = uv_att_id_ = col_att_id_ = nor_att_id_ = -1;
+    }
+
+    if (positions.empty()) {
+      mesh_->SetNumFaces(0);
+      mesh_->set_num_points(0);
+      return;
+    }
+
+    // Set face size
+    mesh_->SetNumFaces(indices.size());
+    mesh_->set_num_points(num_points);
+    const bool identity_mapping = !is_mesh;
+
+    if (rebuild) {
+      // Init vertex positions
+      draco::GeometryAttribute pos_att;
+      pos_att.Init(draco::GeometryAttribute::POSITION, nullptr, 3,
+                   draco::DT_FLOAT32, false, sizeof(float) * 3, 0);
+      pos_att_id_ =
+          mesh_->AddAttribute(pos_att, identity_mapping, positions.size());
+
+      // Init UVs
+      if (with_uvs) {
+        draco::GeometryAttribute uv_att;
+        uv_att.Init(draco::GeometryAttribute::TEX_COORD, nullptr, 2,
+                    draco::DT_FLOAT32, false, sizeof(float) * 2, 0);
+        uv_att_id_ = mesh_->AddAttribute(uv_att, identity_mapping, uvs.size());
+      }
+
+      // Init colors
+      if (with_colors) {
+        draco::GeometryAttribute col_att;
+        col_att.Init(draco::GeometryAttribute::COLOR, nullptr, 3,
+                     draco::DT_UINT8, true, sizeof(uint8_t) * 3, 0);
+        col_att_id_ =
+            mesh_->AddAttribute(col_att, identity_mapping, colors.size());
       }
-      mesh->SetFace(draco::FaceIndex(i), face);
+
+      // Init normals
+      if (with_normals) {
+        draco::GeometryAttribute nor_att;
+        nor_att.Init(draco::GeometryAttribute::NORMAL, nullptr, 3,
+                     draco::DT_FLOAT32, false, sizeof(float) * 3, 0);
+        nor_att_id_ =
+            mesh_->AddAttribute(nor_att, identity_mapping, normals.size());
+      }
+    } else {
+      // Resize existing attributes. Their buffers keep their capacity.
+      ResetAttribute(pos_att_id_, positions.size(), identity_mapping,
+                     num_points);
+      ResetAttribute(uv_att_id_, uvs.size(), identity_mapping, num_points);
+      ResetAttribute(col_att_id_, colors.size(), identity_mapping, num_points);
+      ResetAttribute(nor_att_id_, normals.size(), identity_mapping,
+                     num_points);
+    }
+
+    draco::PointAttribute* pos_attribute = mesh_->attribute(pos_att_id_);
+    draco::PointAttribute* uv_attribute =
+        with_uvs ? mesh_->attribute(uv_att_id_) : nullptr;
+    draco::PointAttribute* col_attribute =
+        with_colors ? mesh_->attribute(col_att_id_) : nullptr;
+    draco::PointAttribute* nor_attribute =
+        with_normals ? mesh_->attribute(nor_att_id_) : nullptr;
+
+    // Set attribute values. Eigen vectors are tightly packed, so each array
+    // is copied into the attribute buffer at once.
+    CopyAttributeValues(positions, pos_attribute);
+    if (with_uvs) {
+      CopyAttributeValues(uvs, uv_attribute);
+    }
+    if (with_colors) {
+      CopyAttributeValues(colors, col_attribute);
+    }
+    if (with_normals) {
+      CopyAttributeValues(normals, nor_attribute);
     }
 
-    // Set mapping from splitted vertex id to original vertex id
-    for (uint32_t i = 0; i < static_cast<uint32_t>(uv_indices.size()); ++i) {
-      for (uint32_t j = 0; j < 3; ++j) {
-        pos_attribute->SetPointMapEntry(
-            draco::PointIndex(i * 3 + j),
-            draco::AttributeValueIndex(indices[i][j]));
+    // Faces and point maps are written to disjoint entries per index, so
+    // large ones are filled in parallel.
+    draco::Mesh* mesh = mesh_.get();
+    if (dedup) {
+      // Set deduplicated faces
+      const uint32_t* corner_to_point = corner_to_point_.data();
+      parallel_util::ParallelFor(0, indices.size(), [&](size_t i) {
+        draco::Mesh::Face face;
+        for (uint32_t j = 0; j < 3; ++j) {
+          face[j] = corner_to_point[3 * i + j];
+        }
+        mesh->SetFace(draco::FaceIndex(static_cast<uint32_t>(i)), face);
+      });
+
+      // Set mapping from deduplicated vertex id to original vertex id
+      const uint32_t* point_to_pos = point_to_pos_.data();
+      const uint32_t* point_to_uv = point_to_uv_.data();
+      parallel_util::ParallelFor(0, num_points, [&](size_t i) {
+        const draco::PointIndex point(static_cast<uint32_t>(i));
+        const draco::AttributeValueIndex pos_index(point_to_pos[i]);
+        pos_attribute->SetPointMapEntry(point, pos_index);
 
         if (with_uvs) {
           uv_attribute->SetPointMapEntry(
-              draco::PointIndex(i * 3 + j),
-              draco::AttributeValueIndex(uv_indices[i][j]));
+              point, draco::AttributeValueIndex(point_to_uv[i]));
         }
 
         if (with_colors) {
-          col_attribute->SetPointMapEntry(
-              draco::PointIndex(i * 3 + j),
-              draco::AttributeValueIndex(indices[i][j]));
+          col_attribute->SetPointMapEntry(point, pos_index);
         }
 
         if (with_normals) {
-          nor_attribute->SetPointMapEntry(
-              draco::PointIndex(i * 3 + j),
-              draco::AttributeValueIndex(indices[i][j]));
+          nor_attribute->SetPointMapEntry(point, pos_index);
         }
-      }
+      });
+    } else if (is_mesh) {
+      // Set splitted faces and mapping from splitted vertex id to original
+      // vertex id
+      parallel_util::ParallelFor(0, indices.size(), [&](size_t i) {
+        draco::Mesh::Face face;
+        for (uint32_t j = 0; j < 3; ++j) {
+          const draco::PointIndex point(static_cast<uint32_t>(i * 3 + j));
+          face[j] = point;
+
+          pos_attribute->SetPointMapEntry(
+              point, draco::AttributeValueIndex(indices[i][j]));
+
+          if (with_uvs) {
+            uv_attribute->SetPointMapEntry(
+                point, draco::AttributeValueIndex(uv_indices[i][j]));
+          }
+
+          if (with_colors) {
+            col_attribute->SetPointMapEntry(
+                point, draco::AttributeValueIndex(indices[i][j]));
+          }
+
+          if (with_normals) {
+            nor_attribute->SetPointMapEntry(
+                point, draco::AttributeValueIndex(indices[i][j]));
+          }
+        }
+        mesh->SetFace(draco::FaceIndex(static_cast<uint32_t>(i)), face);
+      });
     }
   }
 
-  return mesh;
-}
-
-bool DracoEncode(const std::vector<Eigen::Vector3f>& verts,
-                 const std::vector<Eigen::Vector2f>& uvs,
-                 const std::vector<Eigen::Vector3i>& indices,
-                 const std::vector<Eigen::Vector3i>& uv_indices,
-                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
-                 const std::vector<Eigen::Vector3f>& normals,
-                 const DracoEncodeOptions& options_, std::vector<char>& bytes) {
-  DracoEncodeOptions options = options_;
-
-  std::unique_ptr<draco::PointCloud> pc;
-  draco::Mesh* mesh = nullptr;
-
-  std::unique_ptr<draco::Mesh> maybe_mesh =
-      MakeMesh(verts, uvs, indices, uv_indices, colors, normals);
-
-  mesh = maybe_mesh.get();
-  pc = std::move(maybe_mesh);
-
-  if (options.pos_quantization_bits < 0) {
-    printf("Error: Position attribute cannot be skipped.\n");
-    return false;
-  }
-
-  // Delete attributes if needed. This needs to happen before we set any
-  // quantization settings.
-  if (options.tex_coords_quantization_bits < 0) {
-    if (pc->NumNamedAttributes(draco::GeometryAttribute::TEX_COORD) > 0) {
-      options.tex_coords_deleted = true;
+  // Size of the attribute values and face storage of |mesh_|.
+  uint64_t AttributeBytes() const {
+    if (mesh_ == nullptr) {
+      return 0;
     }
-    while (pc->NumNamedAttributes(draco::GeometryAttribute::TEX_COORD) > 0) {
-      pc->DeleteAttribute(
-          pc->GetNamedAttributeId(draco::GeometryAttribute::TEX_COORD, 0));
+    uint64_t bytes = static_cast<uint64_t>(mesh_->num_faces()) *
+                     sizeof(draco::Mesh::Face);
+    for (int32_t i = 0; i < mesh_->num_attributes(); ++i) {
+      bytes += mesh_->attribute(i)->buffer()->data_size();
     }
+    return bytes;
   }
-  if (options.normals_quantization_bits < 0) {
-    if (pc->NumNamedAttributes(draco::GeometryAttribute::NORMAL) > 0) {
-      options.normals_deleted = true;
+
+  void ResetAttribute(int att_id, size_t num_values, bool identity_mapping,
+                      uint32_t num_points) {
+    if (att_id < 0) {
+      return;
     }
-    while (pc->NumNamedAttributes(draco::GeometryAttribute::NORMAL) > 0) {
-      pc->DeleteAttribute(
-          pc->GetNamedAttributeId(draco::GeometryAttribute::NORMAL, 0));
+    draco::PointAttribute* att = mesh_->attribute(att_id);
+    att->Reset(num_values);
+    if (identity_mapping) {
+      att->SetIdentityMapping();
+    } else {
+      att->SetExplicitMapping(num_points);
     }
   }
 
-  // Convert compression level to speed (that 0 = slowest, 10 = fastest).
-  const int speed = 10 - options.compression_level;
-
-  draco::Encoder encoder;
+  const DracoEncodeOptions options_;
+  draco::Encoder encoder_;
+  std::unique_ptr<draco::ExpertEncoder> expert_encoder_;
+  draco::EncoderBuffer buffer_;
+  DracoEncodeTimings timings_;
+  DracoEncodedInfo encoded_info_;
+
+  std::unique_ptr<draco::Mesh> mesh_;
+  MeshLayout layout_;
+  int pos_att_id_ = -1;
+  int uv_att_id_ = -1;
+  int col_att_id_ = -1;
+  int nor_att_id_ = -1;
+
+  // Scratch for wedge deduplication
+  mesh_util::WedgeTable wedge_table_;
+  std::vector<uint32_t> corner_to_point_;
+  std::vector<uint32_t> point_to_pos_;
+  std::vector<uint32_t> point_to_uv_;
+
+  // Voxelized point cloud and its grid
+  mesh_util::MeshArrays voxels_;
+  Eigen::Vector3f voxel_origin_ = Eigen::Vector3f::Zero();
+  float voxel_range_ = 0.f;
+};
+
+DracoEncoderSession::DracoEncoderSession(const DracoEncodeOptions& options)
+    : impl_(new Impl(options)) {}
+
+DracoEncoderSession::~DracoEncoderSession() = default;
+
+bool DracoEncoderSession::Encode(
+    const std::vector<Eigen::Vector3f>& verts,
+    const std::vector<Eigen::Vector2f>& uvs,
+    const std::vector<Eigen::Vector3i>& indices,
+    const std::vector<Eigen::Vector3i>& uv_indices,
+    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+    const std::vector<Eigen::Vector3f>& normals) {
+  return impl_->Encode(verts, uvs, indices, uv_indices, colors, normals);
+}
 
-  // Setup encoder options.
-  if (options.pos_quantization_bits > 0) {
-    encoder.SetAttributeQuantization(draco::GeometryAttribute::POSITION,
-                                     options.pos_quantization_bits);
-  }
-  if (options.tex_coords_quantization_bits > 0) {
-    encoder.SetAttributeQuantization(draco::GeometryAttribute::TEX_COORD,
-                                     options.tex_coords_quantization_bits);
-  }
-  if (options.normals_quantization_bits > 0) {
-    encoder.SetAttributeQuantization(draco::GeometryAttribute::NORMAL,
-                                     options.normals_quantization_bits);
+bool DracoEncoderSession::Encode(
+    const std::vector<Eigen::Vector3f>& verts,
+    const std::vector<Eigen::Vector2f>& uvs,
+    const std::vector<Eigen::Vector3i>& indices,
+    const std::vector<Eigen::Vector3i>& uv_indices,
+    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+    const std::vector<Eigen::Vector3f>& normals, EncodeSink& sink) {
+  if (!impl_->Encode(verts, uvs, indices, uv_indices, colors, normals)) {
+    return false;
   }
+  return impl_->Consume(sink);
+}
 
-  encoder.SetSpeedOptions(speed, speed);
+const std::vector<char>& DracoEncoderSession::bytes() const {
+  return impl_->bytes();
+}
 
-  const bool input_is_mesh = mesh && mesh->num_faces() > 0;
+const DracoEncodeTimings& DracoEncoderSession::timings() const {
+  return impl_->timings();
+}
 
-  // Convert to ExpertEncoder that allows us to set per-attribute options.
-  std::unique_ptr<draco::ExpertEncoder> expert_encoder;
-  if (input_is_mesh) {
-    expert_encoder.reset(new draco::ExpertEncoder(*mesh));
-  } else {
-    expert_encoder.reset(new draco::ExpertEncoder(*pc));
-  }
-  expert_encoder->Reset(encoder.CreateExpertEncoderOptions(*pc));
-
-  bool ret = false;
-  draco::EncoderBuffer buffer;
-  draco::CycleTimer timer;
-  timer.Start();
-  const draco::Status status = expert_encoder.get()->EncodeToBuffer(&buffer);
-  timer.Stop();
-  // printf("encode: %i\n", timer.GetInMs());
-  if (!status.ok()) {
-    printf("Failed to encode the mesh.\n");
-    printf("%s\n", status.error_msg());
-    ret = false;
-  } else {
-    ret = true;
-  }
+const DracoEncodedInfo& DracoEncoderSession::encoded_info() const {
+  return impl_->encoded_info();
+}
+
+bool DracoEncode(const std::vector<Eigen::Vector3f>& verts,
+                 const std::vector<Eigen::Vector2f>& uvs,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const std::vector<Eigen::Vector3i>& uv_indices,
+                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 const std::vector<Eigen::Vector3f>& normals,
+                 const DracoEncodeOptions& options, std::vector<char>& bytes) {
+  VectorSink sink(bytes);
+  return DracoEncode(verts, uvs, indices, uv_indices, colors, normals, options,
+                     sink);
+}
+
+bool DracoEncode(const std::vector<Eigen::Vector3f>& verts,
+                 const std::vector<Eigen::Vector2f>& uvs,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const std::vector<Eigen::Vector3i>& uv_indices,
+                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 const std::vector<Eigen::Vector3f>& normals,
+                 const DracoEncodeOptions& options, EncodeSink& sink) {
+  DracoEncoderSession session(options);
+  return session.Encode(verts, uvs, indices, uv_indices, colors, normals,
+                        sink);
+}
 
-  bytes = *buffer.buffer();
+bool DracoEncode(const std::vector<Eigen::Vector<uint16_t, 3>>& verts,
+                 const std::vector<Eigen::Vector2f>& uvs,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const std::vector<Eigen::Vector3i>& uv_indices,
+                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 const std::vector<Eigen::Vector3f>& normals,
+                 const DracoEncodeOptions& options, std::vector<char>& bytes) {
+  return EncodeIntegerPositions(verts, uvs, indices, uv_indices, colors,
+                                normals, options, bytes);
+}
 
-  return ret;
+bool DracoEncode(const std::vector<Eigen::Vector3i>& verts,
+                 const std::vector<Eigen::Vector2f>& uvs,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const std::vector<Eigen::Vector3i>& uv_indices,
+                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 const std::vector<Eigen::Vector3f>& normals,
+                 const DracoEncodeOptions& options, std::vector<char>& bytes) {
+  return EncodeIntegerPositions(verts, uvs, indices, uv_indices, colors,
+                                normals, options, bytes);
 }
 
 }  // namespace draco_encode
@@ -1,7 +1,15 @@
 #pragma once
 
+#include <cstdio>
+#include <memory>
+#include <vector>
+
 #include "Eigen/Geometry"
 
+namespace draco_trace {
+class Trace;
+}  // namespace draco_trace
+
 namespace draco_encode {
 
 struct DracoEncodeOptions {
@@ -12,9 +20,176 @@ struct DracoEncodeOptions {
   int normals_quantization_bits;
   bool normals_deleted;
   int compression_level;
+  // Merge face corners sharing the same position and uv into one point
+  // instead of splitting every face into 3 points. Only affects meshes.
+  bool deduplicate_points;
+  // Point clouds only: snap positions to the quantization grid, merge points
+  // on the same grid point (averaging uvs, colors and normals) and sort them
+  // in Morton order before encoding. Decoded positions are the same as
+  // without it, but there are fewer points and their order changes.
+  // Requires pos_quantization_bits in [1, 21]; ignored otherwise.
+  bool voxelize_points;
+  // Write point/face counts and the attribute list as geometry metadata so
+  // that draco_decode::DracoReadInfo() can read them without decoding. On
+  // by default; it costs a few bytes per stream.
+  bool write_stream_info;
+  // If > 0, positions are quantized on a grid over the cube at
+  // |pos_quantization_origin| with sides |pos_quantization_range| instead of
+  // over their own bounding box. Streams sharing the cube decode to the same
+  // grid. All positions must lie inside it.
+  float pos_quantization_range;
+  Eigen::Vector3f pos_quantization_origin;
+  // If set, stage timings and sizes of every encode are added to it
+  draco_trace::Trace* trace;
+};
+
+// Wall time of the stages of an encode in milliseconds.
+struct DracoEncodeTimings {
+  // Building draco::Mesh from the input arrays, voxelization included
+  double make_mesh_ms = 0.0;
+  // Draco's EncodeToBuffer
+  double encode_ms = 0.0;
+};
+
+// What a decoder gets from an encoded stream, known without decoding it.
+struct DracoEncodedInfo {
+  // Points and faces, as counted by Draco while encoding
+  size_t num_points = 0;
+  size_t num_faces = 0;
+  // Draco attribute unique ids, -1 for attributes the stream does not have
+  int position_id = -1;
+  int tex_coord_id = -1;
+  int color_id = -1;
+  int normal_id = -1;
+};
+
+// Destination of an encoded stream.
+class EncodeSink {
+ public:
+  virtual ~EncodeSink() = default;
+  // Takes the encoded stream. |buffer| holds exactly the encoded bytes. Sinks
+  // may swap it out instead of copying; whatever is left in |buffer| is
+  // reused by the encoder for the next stream.
+  virtual bool Consume(std::vector<char>& buffer) = 0;
+};
+
+// Moves the stream into a growable vector owned by the caller. No bytes are
+// copied; the previous storage of |out| is handed back to the encoder.
+class VectorSink : public EncodeSink {
+ public:
+  explicit VectorSink(std::vector<char>& out);
+  bool Consume(std::vector<char>& buffer) override;
+
+ private:
+  std::vector<char>& out_;
+};
+
+// Writes the stream into a fixed caller-owned region. Fails if the region is
+// too small; required_size() then tells how much is needed.
+class SpanSink : public EncodeSink {
+ public:
+  SpanSink(char* data, size_t capacity);
+  bool Consume(std::vector<char>& buffer) override;
+
+  size_t capacity() const;
+  // Size of the last stream, also set when it did not fit.
+  size_t required_size() const;
+  // Bytes written to the region.
+  size_t size() const;
+
+ private:
+  char* data_;
+  size_t capacity_;
+  size_t required_size_;
+  size_t size_;
+};
+
+// Writes the stream to an open file with a single fwrite.
+class FileSink : public EncodeSink {
+ public:
+  explicit FileSink(std::FILE* fp);
+  bool Consume(std::vector<char>& buffer) override;
+
+ private:
+  std::FILE* fp_;
 };
 
+// Encoder configured once and called repeatedly, e.g. for frames of a
+// sequence. The mesh, its attribute storage and the output buffer are kept
+// between calls and reused as long as the attribute layout does not change.
+// Inputs with 65536 or more faces or points fill the mesh in parallel on
+// ThreadPool::Current() without allocating task storage; the Draco encoder
+// itself still allocates internally.
+class DracoEncoderSession {
+ public:
+  explicit DracoEncoderSession(const DracoEncodeOptions& options);
+  ~DracoEncoderSession();
+  DracoEncoderSession(const DracoEncoderSession&) = delete;
+  DracoEncoderSession& operator=(const DracoEncoderSession&) = delete;
+
+  bool Encode(const std::vector<Eigen::Vector3f>& verts,
+              const std::vector<Eigen::Vector2f>& uvs,
+              const std::vector<Eigen::Vector3i>& indices,
+              const std::vector<Eigen::Vector3i>& uv_indices,
+              const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+              const std::vector<Eigen::Vector3f>& normals);
+
+  // Encodes and hands the stream to |sink|. If the sink fails, the stream is
+  // still available from bytes().
+  bool Encode(const std::vector<Eigen::Vector3f>& verts,
+              const std::vector<Eigen::Vector2f>& uvs,
+              const std::vector<Eigen::Vector3i>& indices,
+              const std::vector<Eigen::Vector3i>& uv_indices,
+              const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+              const std::vector<Eigen::Vector3f>& normals, EncodeSink& sink);
+
+  // Result of the last Encode() without a sink. Valid until the next
+  // Encode().
+  const std::vector<char>& bytes() const;
+
+  // Stage timings of the last Encode().
+  const DracoEncodeTimings& timings() const;
+
+  // What the stream of the last Encode() decodes to.
+  const DracoEncodedInfo& encoded_info() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+bool DracoEncode(const std::vector<Eigen::Vector3f>& verts,
+                 const std::vector<Eigen::Vector2f>& uvs,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const std::vector<Eigen::Vector3i>& uv_indices,
+                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 const std::vector<Eigen::Vector3f>& normals,
+                 const DracoEncodeOptions& options, std::vector<char>& bytes);
+
 bool DracoEncode(const std::vector<Eigen::Vector3f>& verts,
+                 const std::vector<Eigen::Vector2f>& uvs,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const std::vector<Eigen::Vector3i>& uv_indices,
+                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 const std::vector<Eigen::Vector3f>& normals,
+                 const DracoEncodeOptions& options, EncodeSink& sink);
+
+// Positions on an integer grid, e.g. voxelized captures, stored as integer
+// attributes: no conversion to float and no quantization, so positions
+// round-trip exactly and uint16 input reads 6 bytes per point instead of 12.
+// pos_quantization_bits must not be negative but is otherwise ignored, as
+// are pos_quantization_range and voxelize_points. Stream info is written as
+// for float positions. Decode with the integer overloads of
+// draco_decode::DracoDecode.
+bool DracoEncode(const std::vector<Eigen::Vector<uint16_t, 3>>& verts,
+                 const std::vector<Eigen::Vector2f>& uvs,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const std::vector<Eigen::Vector3i>& uv_indices,
+                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 const std::vector<Eigen::Vector3f>& normals,
+                 const DracoEncodeOptions& options, std::vector<char>& bytes);
+
+bool DracoEncode(const std::vector<Eigen::Vector3i>& verts,
                  const std::vector<Eigen::Vector2f>& uvs,
                  const std::vector<Eigen::Vector3i>& indices,
                  const std::vector<Eigen::Vector3i>& uv_indices,
@@ -0,0 +1,834 @@
+#include "draco_gltf.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t kGlbMagic = 0x46546C67;  // "glTF"
+constexpr uint32_t kGlbVersion = 2;
+constexpr uint32_t kChunkJson = 0x4E4F534A;
+constexpr uint32_t kChunkBin = 0x004E4942;
+constexpr size_t kGlbHeaderSize = 12;
+constexpr size_t kChunkHeaderSize = 8;
+
+constexpr char kDracoExtension[] = "KHR_draco_mesh_compression";
+
+// glTF accessor component types
+constexpr int kUnsignedByte = 5121;
+constexpr int kUnsignedInt = 5125;
+constexpr int kFloat = 5126;
+
+constexpr char kZeros[4] = {0, 0, 0, 0};
+
+size_t Padding(size_t size) { return (4 - size % 4) % 4; }
+
+template <typename T>
+void WritePod(char* dst, size_t& pos, const T& value) {
+  std::memcpy(dst + pos, &value, sizeof(T));
+  pos += sizeof(T);
+}
+
+template <typename T>
+T ReadPod(const char* src, size_t& pos) {
+  T value;
+  std::memcpy(&value, src + pos, sizeof(T));
+  pos += sizeof(T);
+  return value;
+}
+
+// Flips v between OBJ's bottom left and glTF's top left uv origin.
+void FlipV(std::vector<Eigen::Vector2f>& uvs) {
+  for (auto& uv : uvs) {
+    uv[1] = 1.0f - uv[1];
+  }
+}
+
+const char* ImageMimeType(const draco_gltf::GlbImage& image) {
+  static const unsigned char kPng[8] = {0x89, 'P',  'N',  'G',
+                                        '\r', '\n', 0x1a, '\n'};
+  static const unsigned char kJpeg[3] = {0xff, 0xd8, 0xff};
+  if (image.size >= sizeof(kPng) &&
+      std::memcmp(image.data, kPng, sizeof(kPng)) == 0) {
+    return "image/png";
+  }
+  if (image.size >= sizeof(kJpeg) &&
+      std::memcmp(image.data, kJpeg, sizeof(kJpeg)) == 0) {
+    return "image/jpeg";
+  }
+  return nullptr;
+}
+
+// What the glTF JSON needs to know about an encoded stream
+struct StreamDescription {
+  draco_encode::DracoEncodedInfo info;
+  Eigen::Vector3f min = Eigen::Vector3f::Zero();
+  Eigen::Vector3f max = Eigen::Vector3f::Zero();
+};
+
+// Bounds of the positions a decoder outputs: the referenced input positions
+// snapped to the quantization grid, computed the way Draco's
+// AttributeQuantizationTransform quantizes and dequantizes them.
+void PositionBounds(const std::vector<Eigen::Vector3f>& verts,
+                    const std::vector<Eigen::Vector3i>& indices,
+                    const draco_encode::DracoEncodeOptions& options,
+                    Eigen::Vector3f& min, Eigen::Vector3f& max) {
+  min.setConstant(std::numeric_limits<float>::max());
+  max.setConstant(std::numeric_limits<float>::lowest());
+  for (const auto& face : indices) {
+    for (int j = 0; j < 3; j++) {
+      min = min.cwiseMin(verts[face[j]]);
+      max = max.cwiseMax(verts[face[j]]);
+    }
+  }
+  const int bits = options.pos_quantization_bits;
+  if (bits <= 0) {
+    return;
+  }
+
+  // The grid spans every position of the attribute, referenced or not
+  Eigen::Vector3f origin = options.pos_quantization_origin;
+  float range = options.pos_quantization_range;
+  if (range <= 0.f) {
+    origin = verts[0];
+    Eigen::Vector3f all_max = verts[0];
+    for (const auto& v : verts) {
+      origin = origin.cwiseMin(v);
+      all_max = all_max.cwiseMax(v);
+    }
+    range = (all_max - origin).maxCoeff();
+    if (range == 0.f) {
+      range = 1.f;
+    }
+  }
+  const float max_quantized = static_cast<float>((1u << bits) - 1);
+  const float inverse_delta = max_quantized / range;
+  const float delta = range / max_quantized;
+  auto snap = [&](float value, float grid_min) {
+    const float q = std::floor((value - grid_min) * inverse_delta + 0.5f);
+    return q * delta + grid_min;
+  };
+  for (int k = 0; k < 3; k++) {
+    min[k] = snap(min[k], origin[k]);
+    max[k] = snap(max[k], origin[k]);
+  }
+}
+
+void AppendFormat(std::string& s, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  va_list args_copy;
+  va_copy(args_copy, args);
+  const int n = vsnprintf(nullptr, 0, format, args_copy);
+  va_end(args_copy);
+  if (n > 0) {
+    const size_t old_size = s.size();
+    s.resize(old_size + n + 1);
+    vsnprintf(&s[old_size], n + 1, format, args);
+    s.resize(old_size + n);
+  }
+  va_end(args);
+}
+
+std::string BuildJson(const StreamDescription& desc, size_t stream_size,
+                      const char* image_mime, size_t image_offset,
+                      size_t image_size, size_t bin_size) {
+  // Accessors in the order POSITION, TEXCOORD_0, NORMAL, COLOR_0, indices
+  std::string attributes;
+  std::string draco_attributes;
+  std::string accessors;
+  int num_accessors = 0;
+  auto add_accessor = [&](const char* semantic, int id, int component_type,
+                          bool normalized, const char* type) {
+    if (id < 0) {
+      return;
+    }
+    AppendFormat(attributes, "%s\"%s\":%d", num_accessors > 0 ? "," : "",
+                 semantic, num_accessors);
+    AppendFormat(draco_attributes, "%s\"%s\":%d",
+                 num_accessors > 0 ? "," : "", semantic, id);
+    AppendFormat(accessors,
+                 "%s{\"componentType\":%d,%s\"count\":%zu,\"type\":\"%s\"",
+                 num_accessors > 0 ? "," : "", component_type,
+                 normalized ? "\"normalized\":true," : "",
+                 desc.info.num_points, type);
+    if (num_accessors == 0) {
+      AppendFormat(accessors, ",\"min\":[%.9g,%.9g,%.9g]",
+                   static_cast<double>(desc.min[0]),
+                   static_cast<double>(desc.min[1]),
+                   static_cast<double>(desc.min[2]));
+      AppendFormat(accessors, ",\"max\":[%.9g,%.9g,%.9g]",
+                   static_cast<double>(desc.max[0]),
+                   static_cast<double>(desc.max[1]),
+                   static_cast<double>(desc.max[2]));
+    }
+    accessors += "}";
+    num_accessors++;
+  };
+  add_accessor("POSITION", desc.info.position_id, kFloat, false, "VEC3");
+  add_accessor("TEXCOORD_0", desc.info.tex_coord_id, kFloat, false, "VEC2");
+  add_accessor("NORMAL", desc.info.normal_id, kFloat, false, "VEC3");
+  add_accessor("COLOR_0", desc.info.color_id, kUnsignedByte, true, "VEC3");
+
+  std::string primitive;
+  AppendFormat(primitive, "{\"attributes\":{%s}", attributes.c_str());
+  AppendFormat(accessors,
+               ",{\"componentType\":%d,\"count\":%zu,\"type\":\"SCALAR\"}",
+               kUnsignedInt, desc.info.num_faces * 3);
+  AppendFormat(primitive, ",\"indices\":%d,\"mode\":4", num_accessors);
+  if (image_mime != nullptr) {
+    primitive += ",\"material\":0";
+  }
+  AppendFormat(primitive,
+               ",\"extensions\":{\"%s\":{\"bufferView\":0,"
+               "\"attributes\":{%s}}}}",
+               kDracoExtension, draco_attributes.c_str());
+
+  std::string json;
+  AppendFormat(json,
+               "{\"asset\":{\"version\":\"2.0\",\"generator\":"
+               "\"compress_3d\"},\"extensionsUsed\":[\"%s\"],"
+               "\"extensionsRequired\":[\"%s\"],",
+               kDracoExtension, kDracoExtension);
+  json += "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+          "\"nodes\":[{\"mesh\":0}],";
+  json += "\"meshes\":[{\"primitives\":[" + primitive + "]}],";
+  json += "\"accessors\":[" + accessors + "],";
+  if (image_mime != nullptr) {
+    // OBJ diffuse maps carry no metalness
+    json += "\"materials\":[{\"pbrMetallicRoughness\":{\"baseColorTexture\":"
+            "{\"index\":0},\"metallicFactor\":0}}],"
+            "\"textures\":[{\"source\":0}],";
+    AppendFormat(json, "\"images\":[{\"bufferView\":1,\"mimeType\":\"%s\"}],",
+                 image_mime);
+  }
+  AppendFormat(json,
+               "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,"
+               "\"byteLength\":%zu}",
+               stream_size);
+  if (image_mime != nullptr) {
+    AppendFormat(json, ",{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu}",
+                 image_offset, image_size);
+  }
+  AppendFormat(json, "],\"buffers\":[{\"byteLength\":%zu}]}", bin_size);
+  return json;
+}
+
+// A GLB as a list of byte ranges. Headers, JSON and the stream are owned
+// here, the texture is referenced.
+struct GlbPieces {
+  std::vector<char> stream;
+  std::string json;
+  char header[kGlbHeaderSize + kChunkHeaderSize];
+  char bin_header[kChunkHeaderSize];
+  std::vector<std::pair<const char*, size_t>> ranges;
+  size_t size = 0;
+};
+
+bool BuildGlb(const std::vector<Eigen::Vector3f>& verts,
+              const std::vector<Eigen::Vector2f>& uvs,
+              const std::vector<Eigen::Vector3i>& indices,
+              const std::vector<Eigen::Vector3i>& uv_indices,
+              const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+              const std::vector<Eigen::Vector3f>& normals,
+              const draco_encode::DracoEncodeOptions& options,
+              const draco_gltf::GlbImage& texture, GlbPieces& glb) {
+  const char* image_mime = nullptr;
+  if (texture.size > 0) {
+    image_mime = ImageMimeType(texture);
+    if (image_mime == nullptr) {
+      printf("Error: The texture is neither PNG nor JPEG.\n");
+      return false;
+    }
+  }
+
+  // The extension allows triangles only
+  if (indices.empty()) {
+    printf("Error: %s does not support point clouds.\n", kDracoExtension);
+    return false;
+  }
+
+  std::vector<Eigen::Vector2f> gltf_uvs = uvs;
+  FlipV(gltf_uvs);
+  draco_encode::DracoEncoderSession session(options);
+  draco_encode::VectorSink sink(glb.stream);
+  if (!session.Encode(verts, gltf_uvs, indices, uv_indices, colors, normals,
+                      sink)) {
+    return false;
+  }
+  StreamDescription desc;
+  desc.info = session.encoded_info();
+  PositionBounds(verts, indices, options, desc.min, desc.max);
+
+  const size_t stream_padding = Padding(glb.stream.size());
+  const size_t image_offset = glb.stream.size() + stream_padding;
+  const size_t bin_size = image_offset + texture.size + Padding(texture.size);
+  glb.json = BuildJson(desc, glb.stream.size(), image_mime, image_offset,
+                       texture.size, bin_size);
+  // The JSON chunk is padded with spaces
+  glb.json.append(Padding(glb.json.size()), ' ');
+  glb.size = kGlbHeaderSize + kChunkHeaderSize + glb.json.size() +
+             kChunkHeaderSize + bin_size;
+  if (glb.size > std::numeric_limits<uint32_t>::max()) {
+    printf("Error: The GLB exceeds 4 GB.\n");
+    return false;
+  }
+
+  size_t pos = 0;
+  WritePod(glb.header, pos, kGlbMagic);
+  WritePod(glb.header, pos, kGlbVersion);
+  WritePod(glb.header, pos, static_cast<uint32_t>(glb.size));
+  WritePod(glb.header, pos, static_cast<uint32_t>(glb.json.size()));
+  WritePod(glb.header, pos, kChunkJson);
+  pos = 0;
+  WritePod(glb.bin_header, pos, static_cast<uint32_t>(bin_size));
+  WritePod(glb.bin_header, pos, kChunkBin);
+
+  glb.ranges = {{glb.header, sizeof(glb.header)},
+                {glb.json.data(), glb.json.size()},
+                {glb.bin_header, sizeof(glb.bin_header)},
+                {glb.stream.data(), glb.stream.size()},
+                {kZeros, stream_padding},
+                {texture.data, texture.size},
+                {kZeros, Padding(texture.size)}};
+  return true;
+}
+
+// Minimal JSON DOM, enough to walk the glTF JSON
+struct JsonValue {
+  enum Type { kNull, kBool, kNumber, kString, kArray, kObject };
+  Type type = kNull;
+  bool boolean = false;
+  double number = 0.0;
+  std::string string;
+  std::vector<JsonValue> array;
+  std::vector<std::pair<std::string, JsonValue>> object;
+
+  // Member |key| of an object, or null if absent or not an object
+  const JsonValue* Find(const char* key) const {
+    if (type != kObject) {
+      return nullptr;
+    }
+    for (const auto& member : object) {
+      if (member.first == key) {
+        return &member.second;
+      }
+    }
+    return nullptr;
+  }
+
+  // Element |i| of an array, or null
+  const JsonValue* At(size_t i) const {
+    return type == kArray && i < array.size() ? &array[i] : nullptr;
+  }
+
+  // Non-negative integer value
+  bool GetIndex(size_t& index) const {
+    if (type != kNumber || number < 0 || number != static_cast<double>(
+                                             static_cast<uint64_t>(number))) {
+      return false;
+    }
+    index = static_cast<size_t>(number);
+    return true;
+  }
+};
+
+class JsonParser {
+ public:
+  JsonParser(const char* data, size_t size)
+      : p_(data), end_(data + size), depth_(0) {}
+
+  bool Parse(JsonValue& value) {
+    if (!ParseValue(value)) {
+      return false;
+    }
+    SkipSpace();
+    // Only padding may follow the root. Some writers pad with zeros.
+    while (p_ < end_ && *p_ == '\0') {
+      p_++;
+    }
+    return p_ == end_;
+  }
+
+ private:
+  static constexpr int kMaxDepth = 64;
+
+  void SkipSpace() {
+    while (p_ < end_ &&
+           (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+      p_++;
+    }
+  }
+
+  bool Consume(char c) {
+    SkipSpace();
+    if (p_ < end_ && *p_ == c) {
+      p_++;
+      return true;
+    }
+    return false;
+  }
+
+  bool ConsumeLiteral(const char* literal) {
+    const size_t n = std::strlen(literal);
+    if (static_cast<size_t>(end_ - p_) < n ||
+        std::memcmp(p_, literal, n) != 0) {
+      return false;
+    }
+    p_ += n;
+    return true;
+  }
+
+  bool ParseValue(JsonValue& value) {
+    SkipSpace();
+    if (p_ == end_) {
+      return false;
+    }
+    switch (*p_) {
+      case '{':
+        return ParseObject(value);
+      case '[':
+        return ParseArray(value);
+      case '"':
+        value.type = JsonValue::kString;
+        return ParseString(value.string);
+      case 't':
+        value.type = JsonValue::kBool;
+        value.boolean = true;
+        return ConsumeLiteral("true");
+      case 'f':
+        value.type = JsonValue::kBool;
+        return ConsumeLiteral("false");
+      case 'n':
+        return ConsumeLiteral("null");
+      default:
+        return ParseNumber(value);
+    }
+  }
+
+  bool ParseObject(JsonValue& value) {
+    if (++depth_ > kMaxDepth) {
+      return false;
+    }
+    p_++;
+    value.type = JsonValue::kObject;
+    if (Consume('}')) {
+      depth_--;
+      return true;
+    }
+    do {
+      SkipSpace();
+      std::string key;
+      if (p_ == end_ || *p_ != '"' || !ParseString(key) || !Consume(':')) {
+        return false;
+      }
+      value.object.emplace_back(std::move(key), JsonValue());
+      if (!ParseValue(value.object.back().second)) {
+        return false;
+      }
+    } while (Consume(','));
+    depth_--;
+    return Consume('}');
+  }
+
+  bool ParseArray(JsonValue& value) {
+    if (++depth_ > kMaxDepth) {
+      return false;
+    }
+    p_++;
+    value.type = JsonValue::kArray;
+    if (Consume(']')) {
+      depth_--;
+      return true;
+    }
+    do {
+      value.array.emplace_back();
+      if (!ParseValue(value.array.back())) {
+        return false;
+      }
+    } while (Consume(','));
+    depth_--;
+    return Consume(']');
+  }
+
+  static void AppendUtf8(std::string& out, uint32_t c) {
+    if (c < 0x80) {
+      out += static_cast<char>(c);
+    } else if (c < 0x800) {
+      out += static_cast<char>(0xc0 | (c >> 6));
+      out += static_cast<char>(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      out += static_cast<char>(0xe0 | (c >> 12));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (c & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (c >> 18));
+      out += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (c & 0x3f));
+    }
+  }
+
+  bool ParseHex4(uint32_t& c) {
+    if (end_ - p_ < 4) {
+      return false;
+    }
+    c = 0;
+    for (int i = 0; i < 4; i++) {
+      const char h = *p_++;
+      c <<= 4;
+      if (h >= '0' && h <= '9') {
+        c |= h - '0';
+      } else if (h >= 'a' && h <= 'f') {
+        c |= h - 'a' + 10;
+      } else if (h >= 'A' && h <= 'F') {
+        c |= h - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool ParseString(std::string& out) {
+    p_++;
+    out.clear();
+    while (p_ < end_ && *p_ != '"') {
+      if (*p_ != '\\') {
+        out += *p_++;
+        continue;
+      }
+      if (++p_ == end_) {
+        return false;
+      }
+      const char e = *p_++;
+      switch (e) {
+        case '"':
+        case '\\':
+        case '/':
+          out += e;
+          break;
+        case 'b':
+          out += '\b';
+          break;
+        case 'f':
+          out += '\f';
+          break;
+        case 'n':
+          out += '\n';
+          break;
+        case 'r':
+          out += '\r';
+          break;
+        case 't':
+          out += '\t';
+          break;
+        case 'u': {
+          uint32_t c;
+          if (!ParseHex4(c)) {
+            return false;
+          }
+          // Surrogate pair
+          uint32_t low;
+          if (c >= 0xd800 && c < 0xdc00 && end_ - p_ >= 6 && p_[0] == '\\' &&
+              p_[1] == 'u') {
+            p_ += 2;
+            if (!ParseHex4(low)) {
+              return false;
+            }
+            c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+          }
+          AppendUtf8(out, c);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    if (p_ == end_) {
+      return false;
+    }
+    p_++;
+    return true;
+  }
+
+  bool ParseNumber(JsonValue& value) {
+    const char* start = p_;
+    while (p_ < end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '-' ||
+                         *p_ == '+' || *p_ == '.' || *p_ == 'e' ||
+                         *p_ == 'E')) {
+      p_++;
+    }
+    if (p_ == start) {
+      return false;
+    }
+    // strtod needs a terminated string
+    const std::string text(start, p_);
+    char* parsed_end;
+    value.type = JsonValue::kNumber;
+    value.number = std::strtod(text.c_str(), &parsed_end);
+    return parsed_end == text.c_str() + text.size();
+  }
+
+  const char* p_;
+  const char* const end_;
+  int depth_;
+};
+
+// Byte range of buffer view |index| inside the BIN chunk
+bool GetBufferView(const JsonValue& root, const JsonValue* index_value,
+                   const char* bin, size_t bin_size, const char*& data,
+                   size_t& size) {
+  size_t index;
+  if (index_value == nullptr || !index_value->GetIndex(index)) {
+    return false;
+  }
+  const JsonValue* views = root.Find("bufferViews");
+  const JsonValue* view = views != nullptr ? views->At(index) : nullptr;
+  if (view == nullptr) {
+    return false;
+  }
+  size_t buffer = 0, offset = 0, length = 0;
+  const JsonValue* buffer_value = view->Find("buffer");
+  const JsonValue* offset_value = view->Find("byteOffset");
+  const JsonValue* length_value = view->Find("byteLength");
+  if (buffer_value == nullptr || !buffer_value->GetIndex(buffer) ||
+      buffer != 0 || (offset_value != nullptr &&
+                      !offset_value->GetIndex(offset)) ||
+      length_value == nullptr || !length_value->GetIndex(length)) {
+    return false;
+  }
+  if (bin == nullptr || offset > bin_size || length > bin_size - offset) {
+    return false;
+  }
+  data = bin + offset;
+  size = length;
+  return true;
+}
+
+// Follows material -> baseColorTexture -> texture -> image -> buffer view.
+bool FindBaseColorImage(const JsonValue& root, const JsonValue& primitive,
+                        const char* bin, size_t bin_size,
+                        draco_gltf::GlbImage& image) {
+  size_t index;
+  const JsonValue* material_index = primitive.Find("material");
+  if (material_index == nullptr || !material_index->GetIndex(index)) {
+    return false;
+  }
+  const JsonValue* materials = root.Find("materials");
+  const JsonValue* material =
+      materials != nullptr ? materials->At(index) : nullptr;
+  const JsonValue* pbr =
+      material != nullptr ? material->Find("pbrMetallicRoughness") : nullptr;
+  const JsonValue* base =
+      pbr != nullptr ? pbr->Find("baseColorTexture") : nullptr;
+  const JsonValue* texture_index =
+      base != nullptr ? base->Find("index") : nullptr;
+  if (texture_index == nullptr || !texture_index->GetIndex(index)) {
+    return false;
+  }
+  const JsonValue* textures = root.Find("textures");
+  const JsonValue* texture =
+      textures != nullptr ? textures->At(index) : nullptr;
+  const JsonValue* source =
+      texture != nullptr ? texture->Find("source") : nullptr;
+  if (source == nullptr || !source->GetIndex(index)) {
+    return false;
+  }
+  const JsonValue* images = root.Find("images");
+  const JsonValue* image_value =
+      images != nullptr ? images->At(index) : nullptr;
+  if (image_value == nullptr) {
+    return false;
+  }
+  // Images referenced by uri are not part of the GLB
+  return GetBufferView(root, image_value->Find("bufferView"), bin, bin_size,
+                       image.data, image.size);
+}
+
+}  // namespace
+
+namespace draco_gltf {
+
+bool DracoEncodeGlb(const std::vector<Eigen::Vector3f>& verts,
+                    const std::vector<Eigen::Vector2f>& uvs,
+                    const std::vector<Eigen::Vector3i>& indices,
+                    const std::vector<Eigen::Vector3i>& uv_indices,
+                    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    const std::vector<Eigen::Vector3f>& normals,
+                    const draco_encode::DracoEncodeOptions& options,
+                    const GlbImage& texture, std::vector<char>& glb) {
+  GlbPieces pieces;
+  if (!BuildGlb(verts, uvs, indices, uv_indices, colors, normals, options,
+                texture, pieces)) {
+    return false;
+  }
+  glb.resize(pieces.size);
+  size_t pos = 0;
+  for (const auto& range : pieces.ranges) {
+    if (range.second > 0) {
+      std::memcpy(glb.data() + pos, range.first, range.second);
+    }
+    pos += range.second;
+  }
+  return true;
+}
+
+bool DracoEncodeGlbFile(const std::vector<Eigen::Vector3f>& verts,
+                        const std::vector<Eigen::Vector2f>& uvs,
+                        const std::vector<Eigen::Vector3i>& indices,
+                        const std::vector<Eigen::Vector3i>& uv_indices,
+                        const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                        const std::vector<Eigen::Vector3f>& normals,
+                        const draco_encode::DracoEncodeOptions& options,
+                        const GlbImage& texture, const std::string& path) {
+  GlbPieces pieces;
+  if (!BuildGlb(verts, uvs, indices, uv_indices, colors, normals, options,
+                texture, pieces)) {
+    return false;
+  }
+  std::FILE* fp = std::fopen(path.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("Error: Failed to open %s.\n", path.c_str());
+    return false;
+  }
+  bool ok = true;
+  for (const auto& range : pieces.ranges) {
+    if (range.second > 0 &&
+        std::fwrite(range.first, 1, range.second, fp) != range.second) {
+      ok = false;
+      break;
+    }
+  }
+  if (std::fclose(fp) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    printf("Error: Failed to write %s.\n", path.c_str());
+  }
+  return ok;
+}
+
+bool DracoDecodeGlb(const char* data, size_t size,
+                    std::vector<Eigen::Vector3f>& verts,
+                    std::vector<Eigen::Vector2f>& uvs,
+                    std::vector<Eigen::Vector3i>& indices,
+                    std::vector<Eigen::Vector3i>& uv_indices,
+                    std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    std::vector<Eigen::Vector3f>& normals, GlbImage* texture,
+                    uint32_t mask, draco_trace::Trace* trace) {
+  if (texture != nullptr) {
+    *texture = GlbImage();
+  }
+  size_t pos = 0;
+  if (size < kGlbHeaderSize + kChunkHeaderSize ||
+      ReadPod<uint32_t>(data, pos) != kGlbMagic) {
+    printf("Error: Not a GLB file.\n");
+    return false;
+  }
+  const uint32_t version = ReadPod<uint32_t>(data, pos);
+  const uint32_t length = ReadPod<uint32_t>(data, pos);
+  if (version != kGlbVersion) {
+    printf("Error: Unsupported GLB version %u.\n", version);
+    return false;
+  }
+  if (length < kGlbHeaderSize) {
+    printf("Error: Invalid GLB length %u.\n", length);
+    return false;
+  }
+  if (length > size) {
+    printf("Error: Truncated GLB file.\n");
+    return false;
+  }
+  // Chunks must lie within both the declared length and the data
+  const size_t end = std::min<size_t>(length, size);
+
+  // JSON chunk, then an optional BIN chunk
+  const char* json = nullptr;
+  size_t json_size = 0;
+  const char* bin = nullptr;
+  size_t bin_size = 0;
+  while (end - pos >= kChunkHeaderSize) {
+    const uint32_t chunk_size = ReadPod<uint32_t>(data, pos);
+    const uint32_t chunk_type = ReadPod<uint32_t>(data, pos);
+    if (chunk_size > end - pos) {
+      printf("Error: Truncated GLB chunk.\n");
+      return false;
+    }
+    if (json == nullptr && chunk_type == kChunkJson) {
+      json = data + pos;
+      json_size = chunk_size;
+    } else if (json != nullptr && bin == nullptr && chunk_type == kChunkBin) {
+      bin = data + pos;
+      bin_size = chunk_size;
+    }
+    pos += chunk_size;
+  }
+  JsonValue root;
+  if (json == nullptr || !JsonParser(json, json_size).Parse(root)) {
+    printf("Error: Invalid GLB JSON.\n");
+    return false;
+  }
+
+  // First primitive with a Draco stream
+  const JsonValue* primitive = nullptr;
+  const JsonValue* draco_view = nullptr;
+  const JsonValue* meshes = root.Find("meshes");
+  for (size_t m = 0; meshes != nullptr && m < meshes->array.size(); m++) {
+    const JsonValue* primitives = meshes->array[m].Find("primitives");
+    for (size_t p = 0; primitives != nullptr && p < primitives->array.size();
+         p++) {
+      const JsonValue* extensions = primitives->array[p].Find("extensions");
+      const JsonValue* draco =
+          extensions != nullptr ? extensions->Find(kDracoExtension) : nullptr;
+      if (draco != nullptr) {
+        primitive = &primitives->array[p];
+        draco_view = draco->Find("bufferView");
+        break;
+      }
+    }
+    if (primitive != nullptr) {
+      break;
+    }
+  }
+  if (primitive == nullptr) {
+    printf("Error: The GLB has no %s primitive.\n", kDracoExtension);
+    return false;
+  }
+  const char* stream = nullptr;
+  size_t stream_size = 0;
+  if (!GetBufferView(root, draco_view, bin, bin_size, stream, stream_size)) {
+    printf("Error: Invalid Draco buffer view.\n");
+    return false;
+  }
+
+  if (!draco_decode::DracoDecode(stream, stream_size, verts, uvs, indices,
+                                 uv_indices, colors, normals, mask, trace)) {
+    return false;
+  }
+  FlipV(uvs);
+  if (texture != nullptr) {
+    FindBaseColorImage(root, *primitive, bin, bin_size, *texture);
+  }
+  return true;
+}
+
+bool DracoDecodeGlb(const std::vector<char>& glb,
+                    std::vector<Eigen::Vector3f>& verts,
+                    std::vector<Eigen::Vector2f>& uvs,
+                    std::vector<Eigen::Vector3i>& indices,
+                    std::vector<Eigen::Vector3i>& uv_indices,
+                    std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    std::vector<Eigen::Vector3f>& normals, GlbImage* texture,
+                    uint32_t mask, draco_trace::Trace* trace) {
+  return DracoDecodeGlb(glb.data(), glb.size(), verts, uvs, indices,
+                        uv_indices, colors, normals, texture, mask, trace);
+}
+
+}  // namespace draco_gltf
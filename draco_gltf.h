@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "draco_decode.h"
+#include "draco_encode.h"
+
+namespace draco_gltf {
+
+// Encoded image stored in a GLB, e.g. the bytes of a .png or .jpg file. The
+// bytes are embedded as is; PNG and JPEG are recognized by their signature.
+struct GlbImage {
+  const char* data = nullptr;
+  size_t size = 0;
+};
+
+// Encodes the input with a DracoEncoderSession and packages the stream as a
+// glTF 2.0 binary with one mesh whose primitive uses
+// KHR_draco_mesh_compression. |texture|, if not empty, is embedded in the
+// binary chunk and used as the base color texture of the material. The
+// extension allows triangle primitives only, so point clouds (no |indices|)
+// are refused.
+//
+// uvs are taken with the origin at the bottom left as in OBJ and are
+// flipped to glTF's top left origin before encoding. Accessor counts come
+// from the encoder and position bounds from the quantization grid, so they
+// match what a viewer decodes without decoding the stream. The stream is
+// copied once, from the encoder's buffer to its place in |glb|.
+bool DracoEncodeGlb(const std::vector<Eigen::Vector3f>& verts,
+                    const std::vector<Eigen::Vector2f>& uvs,
+                    const std::vector<Eigen::Vector3i>& indices,
+                    const std::vector<Eigen::Vector3i>& uv_indices,
+                    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    const std::vector<Eigen::Vector3f>& normals,
+                    const draco_encode::DracoEncodeOptions& options,
+                    const GlbImage& texture, std::vector<char>& glb);
+
+// Same as above but writes the GLB to |path| piece by piece; neither the
+// stream nor the texture is copied.
+bool DracoEncodeGlbFile(const std::vector<Eigen::Vector3f>& verts,
+                        const std::vector<Eigen::Vector2f>& uvs,
+                        const std::vector<Eigen::Vector3i>& indices,
+                        const std::vector<Eigen::Vector3i>& uv_indices,
+                        const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                        const std::vector<Eigen::Vector3f>& normals,
+                        const draco_encode::DracoEncodeOptions& options,
+                        const GlbImage& texture, const std::string& path);
+
+// Decodes the first primitive with KHR_draco_mesh_compression of the GLB
+// at |data|. The Draco buffer view is decoded in place with DracoDecode and
+// uvs are flipped back to the bottom left origin. |texture|, if given, is
+// set to the base color image of the primitive's material as a view into
+// |data|, or left empty if there is none. Node transforms are ignored.
+bool DracoDecodeGlb(const char* data, size_t size,
+                    std::vector<Eigen::Vector3f>& verts,
+                    std::vector<Eigen::Vector2f>& uvs,
+                    std::vector<Eigen::Vector3i>& indices,
+                    std::vector<Eigen::Vector3i>& uv_indices,
+                    std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    std::vector<Eigen::Vector3f>& normals,
+                    GlbImage* texture = nullptr,
+                    uint32_t mask = draco_decode::kDecodeAll,
+                    draco_trace::Trace* trace = nullptr);
+
+bool DracoDecodeGlb(const std::vector<char>& glb,
+                    std::vector<Eigen::Vector3f>& verts,
+                    std::vector<Eigen::Vector2f>& uvs,
+                    std::vector<Eigen::Vector3i>& indices,
+                    std::vector<Eigen::Vector3i>& uv_indices,
+                    std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    std::vector<Eigen::Vector3f>& normals,
+                    GlbImage* texture = nullptr,
+                    uint32_t mask = draco_decode::kDecodeAll,
+                    draco_trace::Trace* trace = nullptr);
+
+}  // namespace draco_gltf
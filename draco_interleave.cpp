@@ -0,0 +1,360 @@
+#include "draco_interleave.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "draco/compression/decode.h"
+#include "draco/mesh/mesh.h"
+#include "parallel_util.h"
+
+namespace {
+
+using draco_interleave::ComponentFormat;
+
+// Rounds to nearest even. Overflows to infinity.
+uint16_t FloatToHalf(float value) {
+  constexpr uint32_t kF32Infinity = 255u << 23;
+  // Smallest float that does not fit in a half
+  constexpr uint32_t kF16Max = (127u + 16u) << 23;
+  // Adding this float aligns the 10 mantissa bits of a subnormal half at the
+  // bottom of the mantissa, rounding to nearest even
+  constexpr uint32_t kDenormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+  uint32_t f;
+  std::memcpy(&f, &value, sizeof(f));
+  const uint32_t sign = f & 0x80000000u;
+  f ^= sign;
+
+  uint16_t h;
+  if (f >= kF16Max) {
+    // Infinity or NaN
+    h = f > kF32Infinity ? 0x7e00 : 0x7c00;
+  } else if (f < (113u << 23)) {
+    // Subnormal or zero
+    float magic;
+    std::memcpy(&magic, &kDenormMagic, sizeof(magic));
+    float shifted;
+    std::memcpy(&shifted, &f, sizeof(shifted));
+    shifted += magic;
+    uint32_t bits;
+    std::memcpy(&bits, &shifted, sizeof(bits));
+    h = static_cast<uint16_t>(bits - kDenormMagic);
+  } else {
+    const uint32_t mantissa_odd = (f >> 13) & 1u;
+    // Rebias the exponent and round
+    f += (static_cast<uint32_t>(15 - 127) << 23) + 0xfffu + mantissa_odd;
+    h = static_cast<uint16_t>(f >> 13);
+  }
+  return static_cast<uint16_t>(h | (sign >> 16));
+}
+
+template <ComponentFormat F>
+struct FormatTraits;
+
+template <>
+struct FormatTraits<ComponentFormat::kFloat32> {
+  using Type = float;
+  static Type Convert(float v) { return v; }
+};
+
+template <>
+struct FormatTraits<ComponentFormat::kFloat16> {
+  using Type = uint16_t;
+  static Type Convert(float v) { return FloatToHalf(v); }
+};
+
+template <>
+struct FormatTraits<ComponentFormat::kUnorm8> {
+  using Type = uint8_t;
+  static Type Convert(float v) {
+    return static_cast<Type>(std::lround(std::clamp(v, 0.f, 1.f) * 255.f));
+  }
+};
+
+template <>
+struct FormatTraits<ComponentFormat::kSnorm8> {
+  using Type = int8_t;
+  static Type Convert(float v) {
+    return static_cast<Type>(std::lround(std::clamp(v, -1.f, 1.f) * 127.f));
+  }
+};
+
+template <>
+struct FormatTraits<ComponentFormat::kUnorm16> {
+  using Type = uint16_t;
+  static Type Convert(float v) {
+    return static_cast<Type>(std::lround(std::clamp(v, 0.f, 1.f) * 65535.f));
+  }
+};
+
+template <>
+struct FormatTraits<ComponentFormat::kSnorm16> {
+  using Type = int16_t;
+  static Type Convert(float v) {
+    return static_cast<Type>(std::lround(std::clamp(v, -1.f, 1.f) * 32767.f));
+  }
+};
+
+size_t ComponentSize(ComponentFormat format) {
+  switch (format) {
+    case ComponentFormat::kFloat32:
+      return 4;
+    case ComponentFormat::kFloat16:
+    case ComponentFormat::kUnorm16:
+    case ComponentFormat::kSnorm16:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
+// Writes the values of |att| for all points at |offset| of every vertex.
+// |att| may be null, in which case the defaults are written.
+template <ComponentFormat F>
+void WriteElement(const draco::PointAttribute* att, uint32_t num_points,
+                  int num_components, uint32_t stride, int offset,
+                  char* vertices) {
+  using Traits = FormatTraits<F>;
+  using T = typename Traits::Type;
+  const int stored = att != nullptr ? att->num_components() : 0;
+  const bool is_float =
+      att != nullptr && att->data_type() == draco::DT_FLOAT32;
+
+  // 8 bit colors are copied as is
+  if constexpr (F == ComponentFormat::kUnorm8) {
+    if (att != nullptr && att->data_type() == draco::DT_UINT8 &&
+        att->normalized()) {
+      parallel_util::ParallelFor(0, num_points, [&](size_t p) {
+        uint8_t out[4] = {0, 0, 0, 255};
+        std::memcpy(out,
+                    att->GetAddress(att->mapped_index(
+                        draco::PointIndex(static_cast<uint32_t>(p)))),
+                    std::min(stored, num_components));
+        std::memcpy(vertices + p * stride + offset, out, num_components);
+      });
+      return;
+    }
+  }
+
+  parallel_util::ParallelFor(0, num_points, [&](size_t p) {
+    float values[4] = {0.f, 0.f, 0.f, 1.f};
+    if (att != nullptr) {
+      const draco::AttributeValueIndex index =
+          att->mapped_index(draco::PointIndex(static_cast<uint32_t>(p)));
+      if (is_float) {
+        std::memcpy(values, att->GetAddress(index), sizeof(float) * stored);
+      } else {
+        att->ConvertValue<float>(index, static_cast<int8_t>(stored), values);
+      }
+    }
+    T out[4];
+    for (int c = 0; c < num_components; c++) {
+      out[c] = Traits::Convert(values[c]);
+    }
+    std::memcpy(vertices + p * stride + offset, out,
+                sizeof(T) * num_components);
+  });
+}
+
+}  // namespace
+
+namespace draco_interleave {
+
+class InterleavedDecoder::Impl {
+ public:
+  bool Decode(const char* data, size_t size, bool deduplicate) {
+    pc_.reset();
+    mesh_ = nullptr;
+
+    draco::DecoderBuffer buffer;
+    buffer.Init(data, size);
+    auto type_statusor = draco::Decoder::GetEncodedGeometryType(&buffer);
+    if (!type_statusor.ok()) {
+      printf("Decode error: %s\n", type_statusor.status().error_msg());
+      return false;
+    }
+
+    draco::Decoder decoder;
+    if (type_statusor.value() == draco::TRIANGULAR_MESH) {
+      auto statusor = decoder.DecodeMeshFromBuffer(&buffer);
+      if (!statusor.ok()) {
+        printf("Decode error: %s\n", statusor.status().error_msg());
+        return false;
+      }
+      std::unique_ptr<draco::Mesh> mesh = std::move(statusor).value();
+      mesh_ = mesh.get();
+      pc_ = std::move(mesh);
+    } else {
+      auto statusor = decoder.DecodePointCloudFromBuffer(&buffer);
+      if (!statusor.ok()) {
+        printf("Decode error: %s\n", statusor.status().error_msg());
+        return false;
+      }
+      pc_ = std::move(statusor).value();
+    }
+    if (pc_ == nullptr) {
+      printf("Failed to decode the input file.\n");
+      return false;
+    }
+
+    if (deduplicate) {
+      // Points are compared by attribute value ids, so values go first
+      pc_->DeduplicateAttributeValues();
+      pc_->DeduplicatePointIds();
+    }
+    return true;
+  }
+
+  uint32_t num_vertices() const {
+    return pc_ != nullptr ? pc_->num_points() : 0;
+  }
+
+  uint32_t num_indices() const {
+    return mesh_ != nullptr ? mesh_->num_faces() * 3 : 0;
+  }
+
+  bool WriteVertices(const VertexLayout& layout, void* vertices) const {
+    if (pc_ == nullptr) {
+      printf("Error: Nothing decoded.\n");
+      return false;
+    }
+    const std::pair<const VertexElement*, draco::GeometryAttribute::Type>
+        elements[] = {{&layout.position, draco::GeometryAttribute::POSITION},
+                      {&layout.uv, draco::GeometryAttribute::TEX_COORD},
+                      {&layout.color, draco::GeometryAttribute::COLOR},
+                      {&layout.normal, draco::GeometryAttribute::NORMAL}};
+    for (const auto& [element, type] : elements) {
+      if (element->offset < 0) {
+        continue;
+      }
+      const draco::PointAttribute* att = pc_->GetNamedAttribute(type);
+      int num_components = element->num_components;
+      if (num_components == 0) {
+        num_components = att != nullptr
+                             ? att->num_components()
+                             : (type == draco::GeometryAttribute::TEX_COORD
+                                    ? 2
+                                    : 3);
+      }
+      if (num_components < 1 || num_components > 4 ||
+          (att != nullptr && att->num_components() > 4) ||
+          element->offset + ComponentSize(element->format) * num_components >
+              layout.stride) {
+        printf("Error: Invalid vertex layout.\n");
+        return false;
+      }
+      WriteElementAs(element->format, att, num_components, layout.stride,
+                     element->offset, static_cast<char*>(vertices));
+    }
+    return true;
+  }
+
+  bool WriteIndices(IndexFormat format, void* indices) const {
+    if (pc_ == nullptr) {
+      printf("Error: Nothing decoded.\n");
+      return false;
+    }
+    if (mesh_ == nullptr) {
+      return true;
+    }
+    if (format == IndexFormat::kUint16 &&
+        min_index_format() != IndexFormat::kUint16) {
+      printf("Error: %u vertices do not fit 16 bit indices.\n",
+             num_vertices());
+      return false;
+    }
+    if (format == IndexFormat::kUint16) {
+      WriteFaces(static_cast<uint16_t*>(indices));
+    } else {
+      WriteFaces(static_cast<uint32_t*>(indices));
+    }
+    return true;
+  }
+
+  IndexFormat min_index_format() const {
+    return num_vertices() <= 0x10000u ? IndexFormat::kUint16
+                                      : IndexFormat::kUint32;
+  }
+
+ private:
+  void WriteElementAs(ComponentFormat format, const draco::PointAttribute* att,
+                      int num_components, uint32_t stride, int offset,
+                      char* vertices) const {
+    const uint32_t n = num_vertices();
+    switch (format) {
+      case ComponentFormat::kFloat32:
+        WriteElement<ComponentFormat::kFloat32>(att, n, num_components, stride,
+                                                offset, vertices);
+        break;
+      case ComponentFormat::kFloat16:
+        WriteElement<ComponentFormat::kFloat16>(att, n, num_components, stride,
+                                                offset, vertices);
+        break;
+      case ComponentFormat::kUnorm8:
+        WriteElement<ComponentFormat::kUnorm8>(att, n, num_components, stride,
+                                               offset, vertices);
+        break;
+      case ComponentFormat::kSnorm8:
+        WriteElement<ComponentFormat::kSnorm8>(att, n, num_components, stride,
+                                               offset, vertices);
+        break;
+      case ComponentFormat::kUnorm16:
+        WriteElement<ComponentFormat::kUnorm16>(att, n, num_components, stride,
+                                                offset, vertices);
+        break;
+      case ComponentFormat::kSnorm16:
+        WriteElement<ComponentFormat::kSnorm16>(att, n, num_components, stride,
+                                                offset, vertices);
+        break;
+    }
+  }
+
+  template <typename T>
+  void WriteFaces(T* indices) const {
+    parallel_util::ParallelFor(0, mesh_->num_faces(), [&](size_t i) {
+      const draco::Mesh::Face& face =
+          mesh_->face(draco::FaceIndex(static_cast<uint32_t>(i)));
+      for (int j = 0; j < 3; j++) {
+        indices[i * 3 + j] = static_cast<T>(face[j].value());
+      }
+    });
+  }
+
+  std::unique_ptr<draco::PointCloud> pc_;
+  draco::Mesh* mesh_ = nullptr;
+};
+
+InterleavedDecoder::InterleavedDecoder() : impl_(new Impl()) {}
+
+InterleavedDecoder::~InterleavedDecoder() = default;
+
+bool InterleavedDecoder::Decode(const char* data, size_t size,
+                                bool deduplicate) {
+  return impl_->Decode(data, size, deduplicate);
+}
+
+uint32_t InterleavedDecoder::num_vertices() const {
+  return impl_->num_vertices();
+}
+
+uint32_t InterleavedDecoder::num_indices() const {
+  return impl_->num_indices();
+}
+
+IndexFormat InterleavedDecoder::min_index_format() const {
+  return impl_->min_index_format();
+}
+
+bool InterleavedDecoder::WriteVertices(const VertexLayout& layout,
+                                       void* vertices) const {
+  return impl_->WriteVertices(layout, vertices);
+}
+
+bool InterleavedDecoder::WriteIndices(IndexFormat format,
+                                      void* indices) const {
+  return impl_->WriteIndices(format, indices);
+}
+
+}  // namespace draco_interleave
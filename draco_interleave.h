@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace draco_interleave {
+
+enum class ComponentFormat {
+  kFloat32,
+  // IEEE half, rounded to nearest even
+  kFloat16,
+  // Normalized integers. Values are clamped to [0, 1] or [-1, 1].
+  kUnorm8,
+  kSnorm8,
+  kUnorm16,
+  kSnorm16,
+};
+
+struct VertexElement {
+  // Byte offset in the vertex. < 0 leaves the element out.
+  int offset = -1;
+  ComponentFormat format = ComponentFormat::kFloat32;
+  // 0 writes the components stored in the stream. Missing components are
+  // filled with 0, and a fourth with 1, e.g. for RGBA colors.
+  int num_components = 0;
+};
+
+// Layout of one vertex. Elements absent from the stream are filled as if
+// they were all missing components.
+struct VertexLayout {
+  uint32_t stride = 0;
+  VertexElement position;
+  VertexElement uv;
+  // Colors are normalized to [0, 1] before conversion
+  VertexElement color;
+  VertexElement normal;
+};
+
+enum class IndexFormat { kUint16, kUint32 };
+
+// Decodes a stream once and writes it as a vertex buffer in a caller chosen
+// layout plus a triangle list index buffer, e.g. straight into mapped GPU
+// buffers sized from num_vertices() and num_indices().
+//
+// A vertex is a Draco point, i.e. a unique combination of position, uv,
+// color and normal, so uv seams are already split and no un-indexing pass
+// is needed. Streams from DracoEncode with deduplicate_points have no
+// duplicate points; pass |deduplicate| to Decode() for other streams.
+class InterleavedDecoder {
+ public:
+  InterleavedDecoder();
+  ~InterleavedDecoder();
+  InterleavedDecoder(const InterleavedDecoder&) = delete;
+  InterleavedDecoder& operator=(const InterleavedDecoder&) = delete;
+
+  bool Decode(const char* data, size_t size, bool deduplicate = false);
+
+  uint32_t num_vertices() const;
+  // Three per face. 0 for point clouds.
+  uint32_t num_indices() const;
+  // kUint16 if every vertex can be indexed with 16 bits
+  IndexFormat min_index_format() const;
+
+  // Writes num_vertices() * layout.stride bytes to |vertices| in parallel.
+  // Bytes of a vertex not covered by the layout are left untouched.
+  bool WriteVertices(const VertexLayout& layout, void* vertices) const;
+
+  // Writes num_indices() indices of |format| to |indices| in parallel.
+  // Fails if |format| cannot hold all vertex indices.
+  bool WriteIndices(IndexFormat format, void* indices) const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace draco_interleave
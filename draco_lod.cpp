@@ -0,0 +1,448 @@
+#include "draco_lod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+#include "draco_decode.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Stream layout (native endianness):
+//   char magic[4] = "C3DL", uint32 version, uint32 num_layers, uint32 flags
+//   num_layers x uint64 layer size
+//   layer Draco streams, coarse to fine
+constexpr char kMagic[4] = {'C', '3', 'D', 'L'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 16;
+// Layers add points to the previous ones instead of replacing them
+constexpr uint32_t kAdditiveFlag = 1u;
+
+template <typename T>
+void WritePod(char* dst, size_t& pos, const T& value) {
+  std::memcpy(dst + pos, &value, sizeof(T));
+  pos += sizeof(T);
+}
+
+template <typename T>
+T ReadPod(const char* src, size_t& pos) {
+  T value;
+  std::memcpy(&value, src + pos, sizeof(T));
+  pos += sizeof(T);
+  return value;
+}
+
+// Spreads the lower 10 bits of |v| to every third bit.
+uint32_t Spread3(uint32_t v) {
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+// Splits a point cloud into layers of disjoint point subsets. Points are
+// sorted along Morton order and layer l takes the points whose rank is a
+// multiple of ratio^(num_layers - 1 - l) but not of any larger stride, so
+// every layer is spread evenly over space.
+std::vector<std::vector<uint32_t>> SplitPoints(
+    const std::vector<Eigen::Vector3f>& verts, int num_layers, int ratio) {
+  Eigen::AlignedBox3f box;
+  for (const auto& v : verts) {
+    box.extend(v);
+  }
+  const Eigen::Vector3f extent =
+      box.sizes().cwiseMax(Eigen::Vector3f::Constant(1e-6f));
+
+  std::vector<uint32_t> codes(verts.size());
+  for (size_t i = 0; i < verts.size(); i++) {
+    uint32_t code = 0;
+    for (int k = 0; k < 3; k++) {
+      const float t = (verts[i][k] - box.min()[k]) / extent[k];
+      const uint32_t q = static_cast<uint32_t>(
+          std::min(1023.f, std::max(0.f, t * 1023.f)));
+      code |= Spread3(q) << k;
+    }
+    codes[i] = code;
+  }
+  std::vector<uint32_t> order(verts.size());
+  std::iota(order.begin(), order.end(), 0u);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+
+  std::vector<uint64_t> strides(num_layers);
+  uint64_t stride = 1;
+  for (int l = num_layers - 1; l >= 0; l--) {
+    strides[l] = stride;
+    stride *= static_cast<uint64_t>(ratio);
+  }
+
+  std::vector<std::vector<uint32_t>> layers(num_layers);
+  for (size_t i = 0; i < order.size(); i++) {
+    for (int l = 0; l < num_layers; l++) {
+      if (i % strides[l] == 0) {
+        layers[l].push_back(order[i]);
+        break;
+      }
+    }
+  }
+  return layers;
+}
+
+// Simplifies a mesh by merging all vertices within each cell of a grid with
+// |resolution| cells along the longest axis. Merged vertices get the mean
+// position; colors and normals are taken from the first vertex of a cell.
+// Faces collapsing to fewer than 3 vertices are removed.
+void ClusterVertices(const std::vector<Eigen::Vector3f>& verts,
+                     const std::vector<Eigen::Vector2f>& uvs,
+                     const std::vector<Eigen::Vector3i>& indices,
+                     const std::vector<Eigen::Vector3i>& uv_indices,
+                     const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                     const std::vector<Eigen::Vector3f>& normals,
+                     int resolution, mesh_util::MeshArrays& out) {
+  Eigen::AlignedBox3f box;
+  for (const auto& v : verts) {
+    box.extend(v);
+  }
+  const float cell =
+      std::max(box.sizes().maxCoeff(), 1e-6f) / static_cast<float>(resolution);
+
+  std::unordered_map<uint64_t, uint32_t> cluster_of_cell;
+  cluster_of_cell.reserve(verts.size());
+  std::vector<uint32_t> cluster(verts.size());
+  std::vector<uint32_t> first;
+  std::vector<Eigen::Vector3f> sum;
+  std::vector<int> count;
+  for (size_t i = 0; i < verts.size(); i++) {
+    uint64_t key = 0;
+    for (int k = 0; k < 3; k++) {
+      const uint64_t c =
+          static_cast<uint64_t>((verts[i][k] - box.min()[k]) / cell);
+      key = (key << 21) | (c & 0x1fffff);
+    }
+    auto it = cluster_of_cell.find(key);
+    if (it == cluster_of_cell.end()) {
+      it = cluster_of_cell
+               .emplace(key, static_cast<uint32_t>(first.size()))
+               .first;
+      first.push_back(static_cast<uint32_t>(i));
+      sum.push_back(Eigen::Vector3f::Zero());
+      count.push_back(0);
+    }
+    cluster[i] = it->second;
+    sum[it->second] += verts[i];
+    count[it->second]++;
+  }
+
+  std::vector<Eigen::Vector3f> cluster_verts(first.size());
+  for (size_t c = 0; c < first.size(); c++) {
+    cluster_verts[c] = sum[c] / static_cast<float>(count[c]);
+  }
+  std::vector<Eigen::Vector<uint8_t, 3>> cluster_colors;
+  if (colors.size() == verts.size()) {
+    for (uint32_t v : first) {
+      cluster_colors.push_back(colors[v]);
+    }
+  }
+  std::vector<Eigen::Vector3f> cluster_normals;
+  if (normals.size() == verts.size()) {
+    for (uint32_t v : first) {
+      cluster_normals.push_back(normals[v]);
+    }
+  }
+
+  const bool with_uvs = uvs.size() > 0 && uv_indices.size() == indices.size();
+  std::vector<Eigen::Vector3i> kept_indices;
+  std::vector<Eigen::Vector3i> kept_uv_indices;
+  for (size_t f = 0; f < indices.size(); f++) {
+    Eigen::Vector3i face;
+    for (int j = 0; j < 3; j++) {
+      face[j] = static_cast<int>(cluster[indices[f][j]]);
+    }
+    if (face[0] == face[1] || face[1] == face[2] || face[2] == face[0]) {
+      continue;
+    }
+    kept_indices.push_back(face);
+    if (with_uvs) {
+      kept_uv_indices.push_back(uv_indices[f]);
+    }
+  }
+
+  std::vector<uint32_t> faces(kept_indices.size());
+  std::iota(faces.begin(), faces.end(), 0u);
+  mesh_util::GatherFaces(cluster_verts, uvs, kept_indices, kept_uv_indices,
+                         cluster_colors, cluster_normals, faces, out);
+}
+
+// Parses the header of a LOD stream. Returns false if it has not fully
+// arrived or is invalid. |layer_offsets| gets num_layers + 1 entries.
+bool ReadHeader(const char* data, size_t size, bool* additive,
+                std::vector<uint64_t>& layer_offsets) {
+  if (size < kHeaderSize) {
+    return false;
+  }
+  if (std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+    printf("Error: Not a LOD stream.\n");
+    return false;
+  }
+  size_t pos = sizeof(kMagic);
+  const uint32_t version = ReadPod<uint32_t>(data, pos);
+  const uint32_t num_layers = ReadPod<uint32_t>(data, pos);
+  const uint32_t flags = ReadPod<uint32_t>(data, pos);
+  if (version != kVersion) {
+    printf("Error: Unsupported LOD stream version %u.\n", version);
+    return false;
+  }
+  if (size < kHeaderSize + sizeof(uint64_t) * num_layers) {
+    return false;
+  }
+  *additive = (flags & kAdditiveFlag) != 0;
+  layer_offsets.resize(num_layers + 1);
+  layer_offsets[0] = kHeaderSize + sizeof(uint64_t) * num_layers;
+  // Layers may not have arrived yet, so sizes are only bounded by what a
+  // stream can address
+  const uint64_t max_size = std::numeric_limits<size_t>::max();
+  for (uint32_t l = 0; l < num_layers; l++) {
+    const uint64_t layer_size = ReadPod<uint64_t>(data, pos);
+    if (layer_size == 0 || layer_size > max_size - layer_offsets[l]) {
+      printf("Error: Invalid size of LOD layer %u.\n", l);
+      layer_offsets.clear();
+      return false;
+    }
+    layer_offsets[l + 1] = layer_offsets[l] + layer_size;
+  }
+  return true;
+}
+
+int NumCompleteLayers(const std::vector<uint64_t>& layer_offsets,
+                      size_t size) {
+  int n = 0;
+  while (n + 1 < static_cast<int>(layer_offsets.size()) &&
+         layer_offsets[n + 1] <= size) {
+    n++;
+  }
+  return n;
+}
+
+// Decodes layers [first, last) of |data| into |layers| in parallel.
+bool DecodeLayers(const char* data, const std::vector<uint64_t>& layer_offsets,
+                  int first, int last,
+                  std::vector<mesh_util::MeshArrays>& layers) {
+  layers.resize(last - first);
+  std::vector<char> succeeded(layers.size(), 0);
+  std::vector<std::function<void()>> tasks;
+  for (int l = first; l < last; l++) {
+    tasks.push_back([&, l]() {
+      mesh_util::MeshArrays& layer = layers[l - first];
+      succeeded[l - first] = draco_decode::DracoDecode(
+          data + layer_offsets[l], layer_offsets[l + 1] - layer_offsets[l],
+          layer.verts, layer.uvs, layer.indices, layer.uv_indices,
+          layer.colors, layer.normals);
+    });
+  }
+  parallel_util::ThreadPool::Current().Run(std::move(tasks));
+  for (size_t i = 0; i < layers.size(); i++) {
+    if (!succeeded[i]) {
+      printf("Failed to decode LOD layer %zu.\n", first + i);
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+namespace draco_lod {
+
+LodEncodeOptions::LodEncodeOptions() : num_layers(4), ratio(4) {}
+
+bool DracoEncodeLod(const std::vector<Eigen::Vector3f>& verts,
+                    const std::vector<Eigen::Vector2f>& uvs,
+                    const std::vector<Eigen::Vector3i>& indices,
+                    const std::vector<Eigen::Vector3i>& uv_indices,
+                    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    const std::vector<Eigen::Vector3f>& normals,
+                    const LodEncodeOptions& options, std::vector<char>& bytes) {
+  bytes.clear();
+  if (verts.empty() || options.num_layers < 1 || options.ratio < 2) {
+    return false;
+  }
+
+  const bool is_mesh = indices.size() > 0;
+  const int num_layers = options.num_layers;
+
+  std::vector<std::vector<uint32_t>> point_layers;
+  if (!is_mesh) {
+    point_layers = SplitPoints(verts, num_layers, options.ratio);
+  }
+
+  // Build and encode layers in parallel
+  std::vector<std::vector<char>> streams(num_layers);
+  std::vector<char> succeeded(num_layers, 0);
+  std::vector<char> degenerate(num_layers, 0);
+  std::vector<std::function<void()>> tasks;
+  for (int l = 0; l < num_layers; l++) {
+    tasks.push_back([&, l]() {
+      const draco_encode::DracoEncodeOptions& enc = options.encode_options;
+      mesh_util::MeshArrays layer;
+      if (!is_mesh) {
+        if (point_layers[l].empty()) {
+          // Fewer points than strides; nothing to add
+          degenerate[l] = 1;
+          return;
+        }
+        mesh_util::GatherPoints(verts, uvs, colors, normals, point_layers[l],
+                                layer);
+      } else if (l + 1 < num_layers) {
+        // Surfaces have roughly resolution^2 vertices
+        const double target = static_cast<double>(verts.size()) /
+                              std::pow(options.ratio, num_layers - 1 - l);
+        const int resolution =
+            std::max(2, static_cast<int>(std::ceil(std::sqrt(target))));
+        ClusterVertices(verts, uvs, indices, uv_indices, colors, normals,
+                        resolution, layer);
+        if (layer.indices.empty()) {
+          // Every face collapsed; the next finer layer replaces it anyway
+          degenerate[l] = 1;
+          return;
+        }
+      } else {
+        succeeded[l] =
+            draco_encode::DracoEncode(verts, uvs, indices, uv_indices, colors,
+                                      normals, enc, streams[l]);
+        return;
+      }
+      succeeded[l] = draco_encode::DracoEncode(
+          layer.verts, layer.uvs, layer.indices, layer.uv_indices,
+          layer.colors, layer.normals, enc, streams[l]);
+    });
+  }
+  parallel_util::ThreadPool::Current().Run(std::move(tasks));
+
+  for (int l = 0; l < num_layers; l++) {
+    if (!succeeded[l] && !degenerate[l]) {
+      printf("Failed to encode LOD layer %d.\n", l);
+      return false;
+    }
+  }
+  streams.erase(std::remove_if(streams.begin(), streams.end(),
+                               [](const std::vector<char>& stream) {
+                                 return stream.empty();
+                               }),
+                streams.end());
+
+  // Write the stream
+  size_t total = kHeaderSize + sizeof(uint64_t) * streams.size();
+  for (const auto& stream : streams) {
+    total += stream.size();
+  }
+  bytes.resize(total);
+  size_t pos = 0;
+  std::memcpy(bytes.data(), kMagic, sizeof(kMagic));
+  pos += sizeof(kMagic);
+  WritePod(bytes.data(), pos, kVersion);
+  WritePod(bytes.data(), pos, static_cast<uint32_t>(streams.size()));
+  WritePod(bytes.data(), pos, is_mesh ? 0u : kAdditiveFlag);
+  for (const auto& stream : streams) {
+    WritePod(bytes.data(), pos, static_cast<uint64_t>(stream.size()));
+  }
+  for (const auto& stream : streams) {
+    std::memcpy(bytes.data() + pos, stream.data(), stream.size());
+    pos += stream.size();
+  }
+
+  return true;
+}
+
+bool DracoDecodeLod(const std::vector<char>& received,
+                    mesh_util::MeshArrays& geometry, int* num_layers) {
+  return DracoDecodeLod(received.data(), received.size(), geometry,
+                        num_layers);
+}
+
+bool DracoDecodeLod(const char* data, size_t size,
+                    mesh_util::MeshArrays& geometry, int* num_layers) {
+  geometry = mesh_util::MeshArrays();
+  if (num_layers != nullptr) {
+    *num_layers = 0;
+  }
+
+  bool additive = false;
+  std::vector<uint64_t> layer_offsets;
+  if (!ReadHeader(data, size, &additive, layer_offsets)) {
+    return false;
+  }
+  const int complete = NumCompleteLayers(layer_offsets, size);
+  if (complete == 0) {
+    return false;
+  }
+
+  // Point layers are all needed; a mesh layer replaces the coarser ones.
+  const int first = additive ? 0 : complete - 1;
+  std::vector<mesh_util::MeshArrays> layers;
+  if (!DecodeLayers(data, layer_offsets, first, complete, layers)) {
+    return false;
+  }
+  for (const auto& layer : layers) {
+    mesh_util::Append(layer, geometry);
+  }
+  if (num_layers != nullptr) {
+    *num_layers = complete;
+  }
+  return true;
+}
+
+LodDecoder::LodDecoder() : additive_(false), num_layers_decoded_(0) {}
+
+void LodDecoder::Append(const char* data, size_t size) {
+  received_.insert(received_.end(), data, data + size);
+}
+
+bool LodDecoder::Update() {
+  if (layer_offsets_.empty() &&
+      !ReadHeader(received_.data(), received_.size(), &additive_,
+                  layer_offsets_)) {
+    return false;
+  }
+  const int complete = NumCompleteLayers(layer_offsets_, received_.size());
+  if (complete <= num_layers_decoded_) {
+    return false;
+  }
+
+  const int first = additive_ ? num_layers_decoded_ : complete - 1;
+  std::vector<mesh_util::MeshArrays> layers;
+  if (!DecodeLayers(received_.data(), layer_offsets_, first, complete,
+                    layers)) {
+    return false;
+  }
+  if (additive_) {
+    for (const auto& layer : layers) {
+      mesh_util::Append(layer, geometry_);
+    }
+  } else {
+    geometry_ = std::move(layers.back());
+  }
+  num_layers_decoded_ = complete;
+  return true;
+}
+
+const mesh_util::MeshArrays& LodDecoder::geometry() const { return geometry_; }
+
+int LodDecoder::num_layers() const {
+  return layer_offsets_.empty() ? -1
+                                : static_cast<int>(layer_offsets_.size()) - 1;
+}
+
+int LodDecoder::num_layers_decoded() const { return num_layers_decoded_; }
+
+bool LodDecoder::complete() const {
+  return num_layers() >= 0 && num_layers_decoded_ == num_layers();
+}
+
+}  // namespace draco_lod
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "draco_encode.h"
+#include "mesh_util.h"
+
+namespace draco_lod {
+
+struct LodEncodeOptions {
+  LodEncodeOptions();
+  // Applied to every layer
+  draco_encode::DracoEncodeOptions encode_options;
+  // Number of layers including the full resolution one
+  int num_layers;
+  // Approximate ratio of points between consecutive layers
+  int ratio;
+};
+
+// Writes |num_layers| Draco streams, coarse to fine, into one stream whose
+// header holds all layer sizes, so any received prefix can be decoded.
+//
+// Point clouds are split into disjoint subsets taken at strides along Morton
+// order; each layer refines the union of the previous ones. Meshes get
+// vertex-clustered approximations of increasing resolution ending with the
+// input itself; each layer replaces the previous one. Empty point subsets
+// and approximations that collapse to no faces are left out, so the stream
+// may hold fewer layers.
+bool DracoEncodeLod(const std::vector<Eigen::Vector3f>& verts,
+                    const std::vector<Eigen::Vector2f>& uvs,
+                    const std::vector<Eigen::Vector3i>& indices,
+                    const std::vector<Eigen::Vector3i>& uv_indices,
+                    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    const std::vector<Eigen::Vector3f>& normals,
+                    const LodEncodeOptions& options, std::vector<char>& bytes);
+
+// Decodes the most detailed geometry available in a received prefix of a
+// LOD stream. |num_layers| is set to the number of complete layers used.
+// Returns false if not even the base layer has arrived.
+bool DracoDecodeLod(const std::vector<char>& received,
+                    mesh_util::MeshArrays& geometry, int* num_layers);
+
+// Decodes the |size| received bytes at |data| in place. The stream is read
+// directly and is not copied.
+bool DracoDecodeLod(const char* data, size_t size,
+                    mesh_util::MeshArrays& geometry, int* num_layers);
+
+// Incremental decoder for a LOD stream arriving in chunks. Layers are
+// decoded once, as soon as they are complete.
+class LodDecoder {
+ public:
+  LodDecoder();
+
+  // Appends received bytes.
+  void Append(const char* data, size_t size);
+
+  // Decodes layers completed since the last call. Returns true if geometry()
+  // changed.
+  bool Update();
+
+  // Most detailed geometry decoded so far.
+  const mesh_util::MeshArrays& geometry() const;
+
+  // Number of layers in the stream, or -1 until the header has arrived.
+  int num_layers() const;
+  int num_layers_decoded() const;
+  bool complete() const;
+
+ private:
+  std::vector<char> received_;
+  std::vector<uint64_t> layer_offsets_;
+  bool additive_;
+  int num_layers_decoded_;
+  mesh_util::MeshArrays geometry_;
+};
+
+}  // namespace draco_lod
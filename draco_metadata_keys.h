@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "draco/mesh/mesh.h"
+#include "draco/metadata/geometry_metadata.h"
+
+// Geometry metadata entries written by draco_encode. Draco stores geometry
+// metadata right after the stream header, so draco_decode can read them
+// without decoding connectivity or attributes.
+namespace draco_metadata_keys {
+
+// Number of points and faces of the encoded geometry
+constexpr char kNumPoints[] = "c3d_num_points";
+constexpr char kNumFaces[] = "c3d_num_faces";
+// Flattened (attribute type, data type, num components, num values) per
+// attribute
+constexpr char kAttributes[] = "c3d_attributes";
+constexpr int kAttributeFields = 4;
+
+// Records counts and the attribute list of |mesh| as geometry metadata.
+inline void AddStreamInfo(draco::Mesh* mesh) {
+  std::unique_ptr<draco::GeometryMetadata> metadata(
+      new draco::GeometryMetadata());
+  metadata->AddEntryInt(kNumPoints, static_cast<int32_t>(mesh->num_points()));
+  metadata->AddEntryInt(kNumFaces, static_cast<int32_t>(mesh->num_faces()));
+  std::vector<int32_t> attributes;
+  for (int32_t i = 0; i < mesh->num_attributes(); ++i) {
+    const draco::PointAttribute* att = mesh->attribute(i);
+    attributes.push_back(static_cast<int32_t>(att->attribute_type()));
+    attributes.push_back(static_cast<int32_t>(att->data_type()));
+    attributes.push_back(static_cast<int32_t>(att->num_components()));
+    attributes.push_back(static_cast<int32_t>(att->size()));
+  }
+  metadata->AddEntryIntArray(kAttributes, attributes);
+  mesh->AddMetadata(std::move(metadata));
+}
+
+}  // namespace draco_metadata_keys
@@ -0,0 +1,1114 @@
+#include "draco_out_of_core.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "draco_tile.h"
+#include "mesh_util.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// Records of the temporary files
+struct VertexRecord {
+  float position[3];
+  float normal[3];
+  uint8_t color[4];
+};
+static_assert(sizeof(VertexRecord) == 28, "");
+
+struct UvRecord {
+  float uv[2];
+};
+
+struct FaceRecord {
+  uint32_t v[3];
+  uint32_t t[3];
+};
+
+// Read and write buffer of every file
+constexpr size_t kIoBufferSize = 1 << 20;
+
+// Parts are made of cells of a grid over the bounding box, cut along the
+// Morton order of the cells so that parts are spatially compact.
+constexpr int kGridBits = 6;
+constexpr uint32_t kGridSize = 1u << kGridBits;
+constexpr uint32_t kNumCells = kGridSize * kGridSize * kGridSize;
+
+// Conservative working set of a part per point: the gathered arrays, the
+// draco::Mesh copy with point maps, the encoder's corner table and the
+// deduplication scratch.
+constexpr size_t kBytesPerPoint = 512;
+
+bool Seek(std::FILE* fp, uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(fp, static_cast<int64_t>(offset), SEEK_SET) == 0;
+#else
+  return fseeko(fp, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+// Binary file removed when closed. Appends go through a write buffer;
+// reads may be at any offset.
+class TempFile {
+ public:
+  TempFile() = default;
+  ~TempFile() { Close(); }
+  TempFile(const TempFile&) = delete;
+  TempFile& operator=(const TempFile&) = delete;
+
+  bool Open(const fs::path& path) {
+    path_ = path;
+    fp_ = std::fopen(path.string().c_str(), "w+b");
+    if (fp_ == nullptr) {
+      printf("Error: Failed to create %s.\n", path.string().c_str());
+      return false;
+    }
+    return true;
+  }
+
+  void Close() {
+    if (fp_ != nullptr) {
+      std::fclose(fp_);
+      fp_ = nullptr;
+      std::error_code ec;
+      fs::remove(path_, ec);
+    }
+    buffer_ = std::vector<char>();
+  }
+
+  bool Append(const void* data, size_t size) {
+    if (buffer_.size() + size > kIoBufferSize && !Flush()) {
+      return false;
+    }
+    if (buffer_.capacity() == 0) {
+      buffer_.reserve(std::max(kIoBufferSize, size));
+    }
+    const char* bytes = static_cast<const char*>(data);
+    buffer_.insert(buffer_.end(), bytes, bytes + size);
+    return true;
+  }
+
+  bool Flush() {
+    if (buffer_.empty()) {
+      return true;
+    }
+    if (!Seek(fp_, written_) ||
+        std::fwrite(buffer_.data(), 1, buffer_.size(), fp_) !=
+            buffer_.size()) {
+      printf("Error: Failed to write %s.\n", path_.string().c_str());
+      return false;
+    }
+    written_ += buffer_.size();
+    buffer_.clear();
+    return true;
+  }
+
+  bool Read(uint64_t offset, void* data, size_t size) {
+    if (offset + size > written_ && !Flush()) {
+      return false;
+    }
+    return Seek(fp_, offset) && std::fread(data, 1, size, fp_) == size;
+  }
+
+  uint64_t size() const { return written_ + buffer_.size(); }
+
+ private:
+  fs::path path_;
+  std::FILE* fp_ = nullptr;
+  uint64_t written_ = 0;
+  std::vector<char> buffer_;
+};
+
+// Random access to the records of a file through an LRU of blocks that
+// stays within |budget| bytes.
+template <typename T>
+class RecordCache {
+ public:
+  RecordCache(TempFile& file, size_t budget)
+      : file_(file),
+        num_records_(file.size() / sizeof(T)),
+        max_blocks_(std::max<size_t>(budget / sizeof(Block::data), 2)) {}
+
+  uint64_t size() const { return num_records_; }
+  bool failed() const { return failed_; }
+
+  // |index| must be less than size().
+  const T& Get(uint64_t index) {
+    const uint64_t id = index / kBlockRecords;
+    auto it = blocks_.find(id);
+    if (it != blocks_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+    } else {
+      it = blocks_.emplace(id, Load(id)).first;
+    }
+    return it->second->data[index % kBlockRecords];
+  }
+
+ private:
+  static constexpr size_t kBlockRecords = 4096;
+  struct Block {
+    uint64_t id = 0;
+    T data[kBlockRecords];
+  };
+
+  typename std::list<Block>::iterator Load(uint64_t id) {
+    if (lru_.size() < max_blocks_) {
+      lru_.emplace_front();
+    } else {
+      // Reuse the least recently used block
+      blocks_.erase(lru_.back().id);
+      lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+    }
+    Block& block = lru_.front();
+    block.id = id;
+    const uint64_t first = id * kBlockRecords;
+    const size_t count = static_cast<size_t>(
+        std::min<uint64_t>(kBlockRecords, num_records_ - first));
+    if (!file_.Read(first * sizeof(T), block.data, count * sizeof(T))) {
+      failed_ = true;
+    }
+    return lru_.begin();
+  }
+
+  TempFile& file_;
+  const uint64_t num_records_;
+  const size_t max_blocks_;
+  std::list<Block> lru_;
+  std::unordered_map<uint64_t, typename std::list<Block>::iterator> blocks_;
+  bool failed_ = false;
+};
+
+// Records of many buckets in one file, written in chunks as per bucket
+// buffers fill up, so the number of buckets is not limited by open files.
+class BucketFile {
+ public:
+  bool Open(const fs::path& path, size_t num_buckets, size_t record_size,
+            size_t buffer_size) {
+    record_size_ = record_size;
+    buffer_size_ = std::max(buffer_size, record_size);
+    buffers_.resize(num_buckets);
+    chunks_.resize(num_buckets);
+    counts_.assign(num_buckets, 0);
+    return file_.Open(path);
+  }
+
+  bool Append(uint32_t bucket, const void* record) {
+    std::vector<char>& buffer = buffers_[bucket];
+    const char* bytes = static_cast<const char*>(record);
+    buffer.insert(buffer.end(), bytes, bytes + record_size_);
+    counts_[bucket]++;
+    return buffer.size() + record_size_ <= buffer_size_ || FlushBucket(bucket);
+  }
+
+  // Writes out and releases all buffers.
+  bool Finish() {
+    for (uint32_t b = 0; b < buffers_.size(); b++) {
+      if (!FlushBucket(b)) {
+        return false;
+      }
+      buffers_[b] = std::vector<char>();
+    }
+    return file_.Flush();
+  }
+
+  uint64_t count(uint32_t bucket) const { return counts_[bucket]; }
+  uint64_t bytes() const { return file_.size(); }
+
+  // Reads the count(bucket) records of |bucket| to |out|.
+  bool Read(uint32_t bucket, void* out) {
+    char* dst = static_cast<char*>(out);
+    for (const auto& chunk : chunks_[bucket]) {
+      if (!file_.Read(chunk.first, dst, chunk.second)) {
+        return false;
+      }
+      dst += chunk.second;
+    }
+    return true;
+  }
+
+ private:
+  bool FlushBucket(uint32_t bucket) {
+    std::vector<char>& buffer = buffers_[bucket];
+    if (buffer.empty()) {
+      return true;
+    }
+    chunks_[bucket].emplace_back(file_.size(), buffer.size());
+    if (!file_.Append(buffer.data(), buffer.size())) {
+      return false;
+    }
+    buffer.clear();
+    return true;
+  }
+
+  TempFile file_;
+  size_t record_size_ = 0;
+  size_t buffer_size_ = 0;
+  std::vector<std::vector<char>> buffers_;
+  // (offset, size) of the chunks of every bucket
+  std::vector<std::vector<std::pair<uint64_t, size_t>>> chunks_;
+  std::vector<uint64_t> counts_;
+};
+
+// Buffered reader of the input for both text lines and binary data.
+class InputReader {
+ public:
+  ~InputReader() {
+    if (fp_ != nullptr) {
+      std::fclose(fp_);
+    }
+  }
+
+  bool Open(const std::string& path) {
+    fp_ = std::fopen(path.c_str(), "rb");
+    if (fp_ == nullptr) {
+      printf("Error: Failed to open %s.\n", path.c_str());
+      return false;
+    }
+    buffer_.resize(kIoBufferSize);
+    return true;
+  }
+
+  // Reads the next line without its line break. Returns false at the end of
+  // the file.
+  bool ReadLine(std::string& line) {
+    line.clear();
+    while (true) {
+      if (pos_ == end_ && !Fill()) {
+        return !line.empty();
+      }
+      const char* begin = buffer_.data() + pos_;
+      const char* nl =
+          static_cast<const char*>(std::memchr(begin, '\n', end_ - pos_));
+      if (nl != nullptr) {
+        line.append(begin, nl);
+        pos_ = nl - buffer_.data() + 1;
+        if (!line.empty() && line.back() == '\r') {
+          line.pop_back();
+        }
+        return true;
+      }
+      line.append(begin, end_ - pos_);
+      pos_ = end_;
+    }
+  }
+
+  bool Read(void* data, size_t size) {
+    char* dst = static_cast<char*>(data);
+    while (size > 0) {
+      if (pos_ == end_ && !Fill()) {
+        return false;
+      }
+      const size_t n = std::min(size, end_ - pos_);
+      std::memcpy(dst, buffer_.data() + pos_, n);
+      pos_ += n;
+      dst += n;
+      size -= n;
+    }
+    return true;
+  }
+
+ private:
+  bool Fill() {
+    pos_ = 0;
+    end_ = std::fread(buffer_.data(), 1, buffer_.size(), fp_);
+    return end_ > 0;
+  }
+
+  std::FILE* fp_ = nullptr;
+  std::vector<char> buffer_;
+  size_t pos_ = 0;
+  size_t end_ = 0;
+};
+
+// Input converted to binary temporary files.
+struct ParsedInput {
+  TempFile vertices;
+  TempFile uvs;
+  TempFile faces;
+  uint64_t num_vertices = 0;
+  uint64_t num_uvs = 0;
+  uint64_t num_faces = 0;
+  bool has_colors = false;
+  bool has_normals = false;
+  // Some face has no uv indices, so uvs are dropped
+  bool faces_without_uvs = false;
+  Eigen::AlignedBox3f bounds;
+
+  bool with_uvs() const { return num_uvs > 0 && !faces_without_uvs; }
+
+  bool AddVertex(const VertexRecord& v) {
+    bounds.extend(Eigen::Vector3f(v.position[0], v.position[1],
+                                  v.position[2]));
+    num_vertices++;
+    return vertices.Append(&v, sizeof(v));
+  }
+
+  bool AddUv(const UvRecord& uv) {
+    num_uvs++;
+    return uvs.Append(&uv, sizeof(uv));
+  }
+
+  // Adds polygon |v| (and |t| if not empty) as a triangle fan.
+  bool AddPolygon(const std::vector<uint32_t>& v,
+                  const std::vector<uint32_t>& t) {
+    if (t.size() != v.size()) {
+      faces_without_uvs = true;
+    }
+    for (size_t k = 1; k + 1 < v.size(); k++) {
+      FaceRecord face;
+      const size_t corners[3] = {0, k, k + 1};
+      for (int j = 0; j < 3; j++) {
+        face.v[j] = v[corners[j]];
+        face.t[j] = t.size() == v.size() ? t[corners[j]] : 0u;
+      }
+      num_faces++;
+      if (!faces.Append(&face, sizeof(face))) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+uint8_t ToColor(float value) {
+  return static_cast<uint8_t>(
+      std::lround(std::min(std::max(value, 0.f), 255.f)));
+}
+
+// Resolves a 1-based, possibly negative OBJ index to a 0-based index.
+uint32_t ObjIndex(long index, uint64_t count) {
+  return static_cast<uint32_t>(index > 0 ? index - 1
+                                         : static_cast<long>(count) + index);
+}
+
+bool ParseObj(InputReader& in, ParsedInput& out) {
+  std::string line;
+  std::vector<uint32_t> v;
+  std::vector<uint32_t> t;
+  while (in.ReadLine(line)) {
+    const char* p = line.c_str();
+    while (*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+      VertexRecord vertex = {};
+      char* end = nullptr;
+      p += 2;
+      for (int k = 0; k < 3; k++) {
+        vertex.position[k] = std::strtof(p, &end);
+        p = end;
+      }
+      // Optional vertex colors in [0, 1]
+      float rgb[3];
+      int num_rgb = 0;
+      for (; num_rgb < 3; num_rgb++) {
+        rgb[num_rgb] = std::strtof(p, &end);
+        if (end == p) {
+          break;
+        }
+        p = end;
+      }
+      if (num_rgb == 3) {
+        out.has_colors = true;
+        for (int k = 0; k < 3; k++) {
+          vertex.color[k] = ToColor(rgb[k] * 255.f);
+        }
+      }
+      if (!out.AddVertex(vertex)) {
+        return false;
+      }
+    } else if (p[0] == 'v' && p[1] == 't') {
+      UvRecord uv = {};
+      char* end = nullptr;
+      p += 2;
+      for (int k = 0; k < 2; k++) {
+        uv.uv[k] = std::strtof(p, &end);
+        p = end;
+      }
+      if (!out.AddUv(uv)) {
+        return false;
+      }
+    } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+      v.clear();
+      t.clear();
+      p += 2;
+      while (true) {
+        char* end = nullptr;
+        const long vi = std::strtol(p, &end, 10);
+        if (end == p) {
+          break;
+        }
+        p = end;
+        v.push_back(ObjIndex(vi, out.num_vertices));
+        if (*p == '/' && p[1] != '/') {
+          const long ti = std::strtol(p + 1, &end, 10);
+          if (end != p + 1) {
+            t.push_back(ObjIndex(ti, out.num_uvs));
+          }
+          p = end;
+        }
+        // Skip normal indices
+        while (*p != '\0' && *p != ' ' && *p != '\t') {
+          p++;
+        }
+      }
+      if (v.size() >= 3 && !out.AddPolygon(v, t)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+enum class PlyType { kInt8, kUint8, kInt16, kUint16, kInt32, kUint32,
+                     kFloat32, kFloat64, kInvalid };
+
+PlyType ToPlyType(const std::string& name) {
+  if (name == "char" || name == "int8") return PlyType::kInt8;
+  if (name == "uchar" || name == "uint8") return PlyType::kUint8;
+  if (name == "short" || name == "int16") return PlyType::kInt16;
+  if (name == "ushort" || name == "uint16") return PlyType::kUint16;
+  if (name == "int" || name == "int32") return PlyType::kInt32;
+  if (name == "uint" || name == "uint32") return PlyType::kUint32;
+  if (name == "float" || name == "float32") return PlyType::kFloat32;
+  if (name == "double" || name == "float64") return PlyType::kFloat64;
+  return PlyType::kInvalid;
+}
+
+struct PlyProperty {
+  std::string name;
+  PlyType type = PlyType::kInvalid;
+  bool is_list = false;
+  PlyType count_type = PlyType::kInvalid;
+};
+
+struct PlyElement {
+  std::string name;
+  uint64_t count = 0;
+  std::vector<PlyProperty> properties;
+};
+
+// Reads PLY values of the body in ascii or binary little endian.
+class PlyValueReader {
+ public:
+  PlyValueReader(InputReader& in, bool ascii) : in_(in), ascii_(ascii) {}
+
+  // Starts the next element instance. Ascii instances are one line each.
+  bool NextInstance() {
+    if (!ascii_) {
+      return true;
+    }
+    if (!in_.ReadLine(line_)) {
+      return false;
+    }
+    cursor_ = line_.c_str();
+    return true;
+  }
+
+  bool Read(PlyType type, double& value) {
+    if (ascii_) {
+      char* end = nullptr;
+      value = std::strtod(cursor_, &end);
+      if (end == cursor_) {
+        return false;
+      }
+      cursor_ = end;
+      return true;
+    }
+    return ReadBinary(type, value);
+  }
+
+ private:
+  template <typename T>
+  bool ReadAs(double& value) {
+    T v;
+    if (!in_.Read(&v, sizeof(v))) {
+      return false;
+    }
+    value = static_cast<double>(v);
+    return true;
+  }
+
+  bool ReadBinary(PlyType type, double& value) {
+    switch (type) {
+      case PlyType::kInt8:
+        return ReadAs<int8_t>(value);
+      case PlyType::kUint8:
+        return ReadAs<uint8_t>(value);
+      case PlyType::kInt16:
+        return ReadAs<int16_t>(value);
+      case PlyType::kUint16:
+        return ReadAs<uint16_t>(value);
+      case PlyType::kInt32:
+        return ReadAs<int32_t>(value);
+      case PlyType::kUint32:
+        return ReadAs<uint32_t>(value);
+      case PlyType::kFloat32:
+        return ReadAs<float>(value);
+      case PlyType::kFloat64:
+        return ReadAs<double>(value);
+      default:
+        return false;
+    }
+  }
+
+  InputReader& in_;
+  const bool ascii_;
+  std::string line_;
+  const char* cursor_ = "";
+};
+
+bool ParsePlyHeader(InputReader& in, bool& ascii,
+                    std::vector<PlyElement>& elements) {
+  std::string line;
+  if (!in.ReadLine(line) || line != "ply") {
+    printf("Error: Not a PLY file.\n");
+    return false;
+  }
+  while (in.ReadLine(line)) {
+    char keyword[32] = {};
+    char a[64] = {};
+    char b[64] = {};
+    char c[64] = {};
+    const int n = std::sscanf(line.c_str(), "%31s %63s %63s %63s", keyword,
+                              a, b, c);
+    const std::string key = n > 0 ? keyword : "";
+    if (key == "end_header") {
+      return true;
+    } else if (key == "format") {
+      ascii = std::strcmp(a, "ascii") == 0;
+      if (!ascii && std::strcmp(a, "binary_little_endian") != 0) {
+        printf("Error: Unsupported PLY format %s.\n", a);
+        return false;
+      }
+    } else if (key == "element" && n >= 3) {
+      PlyElement element;
+      element.name = a;
+      element.count = std::strtoull(b, nullptr, 10);
+      elements.push_back(element);
+    } else if (key == "property" && n >= 3 && !elements.empty()) {
+      PlyProperty property;
+      if (std::strcmp(a, "list") == 0 && n >= 4) {
+        property.is_list = true;
+        property.count_type = ToPlyType(b);
+        property.type = ToPlyType(c);
+        sscanf(line.c_str(), "%*s %*s %*s %*s %63s", a);
+        property.name = a;
+      } else {
+        property.type = ToPlyType(a);
+        property.name = b;
+      }
+      if (property.type == PlyType::kInvalid ||
+          (property.is_list && property.count_type == PlyType::kInvalid)) {
+        printf("Error: Unsupported PLY property: %s\n", line.c_str());
+        return false;
+      }
+      elements.back().properties.push_back(property);
+    }
+  }
+  printf("Error: Truncated PLY header.\n");
+  return false;
+}
+
+bool ParsePly(InputReader& in, ParsedInput& out) {
+  bool ascii = false;
+  std::vector<PlyElement> elements;
+  if (!ParsePlyHeader(in, ascii, elements)) {
+    return false;
+  }
+
+  // Faces may precede the vertices, so indices are checked against the
+  // declared vertex count
+  uint64_t num_vertices = 0;
+  for (const auto& element : elements) {
+    if (element.name == "vertex") {
+      num_vertices += element.count;
+    }
+  }
+
+  PlyValueReader reader(in, ascii);
+  std::vector<uint32_t> polygon;
+  const std::vector<uint32_t> no_uvs;
+  for (const auto& element : elements) {
+    const bool is_vertex = element.name == "vertex";
+    const bool is_face = element.name == "face";
+    // Destination of each vertex property, or -1
+    std::vector<int> slots;
+    bool float_colors = false;
+    for (const auto& property : element.properties) {
+      static const char* const kNames[] = {"x",  "y",  "z",   "nx",    "ny",
+                                           "nz", "red", "green", "blue"};
+      int slot = -1;
+      for (int k = 0; is_vertex && k < 9; k++) {
+        if (property.name == kNames[k]) {
+          slot = k;
+        }
+      }
+      if (slot >= 3 && slot < 6) {
+        out.has_normals = true;
+      } else if (slot >= 6) {
+        out.has_colors = true;
+        float_colors = property.type == PlyType::kFloat32 ||
+                       property.type == PlyType::kFloat64;
+      }
+      slots.push_back(slot);
+    }
+
+    for (uint64_t i = 0; i < element.count; i++) {
+      if (!reader.NextInstance()) {
+        printf("Error: Truncated PLY body.\n");
+        return false;
+      }
+      double values[9] = {};
+      polygon.clear();
+      for (size_t p = 0; p < element.properties.size(); p++) {
+        const PlyProperty& property = element.properties[p];
+        double value = 0.0;
+        if (!property.is_list) {
+          if (!reader.Read(property.type, value)) {
+            printf("Error: Truncated PLY body.\n");
+            return false;
+          }
+          if (slots[p] >= 0) {
+            values[slots[p]] = value;
+          }
+          continue;
+        }
+        double count = 0.0;
+        if (!reader.Read(property.count_type, count)) {
+          printf("Error: Truncated PLY body.\n");
+          return false;
+        }
+        if (!(count >= 0.0) || count > static_cast<double>(INT32_MAX)) {
+          printf("Error: Invalid PLY list size.\n");
+          return false;
+        }
+        const bool is_indices = is_face && (property.name == "vertex_indices" ||
+                                            property.name == "vertex_index");
+        for (int k = 0; k < static_cast<int>(count); k++) {
+          if (!reader.Read(property.type, value)) {
+            printf("Error: Truncated PLY body.\n");
+            return false;
+          }
+          if (is_indices) {
+            // Casting a negative or too large double is undefined
+            if (!(value >= 0.0) ||
+                value >= static_cast<double>(num_vertices) ||
+                value > static_cast<double>(UINT32_MAX)) {
+              printf("Error: Face index out of range.\n");
+              return false;
+            }
+            polygon.push_back(static_cast<uint32_t>(value));
+          }
+        }
+      }
+
+      if (is_vertex) {
+        VertexRecord vertex = {};
+        for (int k = 0; k < 3; k++) {
+          vertex.position[k] = static_cast<float>(values[k]);
+          vertex.normal[k] = static_cast<float>(values[3 + k]);
+          vertex.color[k] = ToColor(static_cast<float>(
+              float_colors ? values[6 + k] * 255.0 : values[6 + k]));
+        }
+        if (!out.AddVertex(vertex)) {
+          return false;
+        }
+      } else if (is_face && polygon.size() >= 3) {
+        if (!out.AddPolygon(polygon, no_uvs)) {
+          return false;
+        }
+      }
+    }
+  }
+  // PLY faces carry no uv indices
+  out.faces_without_uvs = true;
+  return true;
+}
+
+// Morton code of the grid cell of |p|.
+uint32_t CellCode(const Eigen::AlignedBox3f& box, const Eigen::Vector3f& extent,
+                  const Eigen::Vector3f& p) {
+  uint32_t cell[3];
+  for (int k = 0; k < 3; k++) {
+    const int c =
+        static_cast<int>((p[k] - box.min()[k]) / extent[k] * kGridSize);
+    cell[k] = static_cast<uint32_t>(
+        std::max(0, std::min(static_cast<int>(kGridSize) - 1, c)));
+  }
+  uint32_t code = 0;
+  for (int bit = 0; bit < kGridBits; bit++) {
+    for (int k = 0; k < 3; k++) {
+      code |= ((cell[k] >> bit) & 1u) << (bit * 3 + k);
+    }
+  }
+  return code;
+}
+
+Eigen::Vector3f Position(const VertexRecord& v) {
+  return Eigen::Vector3f(v.position[0], v.position[1], v.position[2]);
+}
+
+// Calls |func| for every record of |file| in order, reading it in chunks.
+template <typename T, typename Func>
+bool ForEachRecord(TempFile& file, Func func) {
+  const uint64_t num_records = file.size() / sizeof(T);
+  const size_t chunk = kIoBufferSize / sizeof(T);
+  std::vector<T> records(chunk);
+  for (uint64_t first = 0; first < num_records; first += chunk) {
+    const size_t count =
+        static_cast<size_t>(std::min<uint64_t>(chunk, num_records - first));
+    if (!file.Read(first * sizeof(T), records.data(), count * sizeof(T))) {
+      return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (!func(first + i, records[i])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Sorted unique |ids| and the position of each id of |ids| in it.
+void Renumber(std::vector<uint32_t>& ids, std::vector<uint32_t>& unique) {
+  unique = ids;
+  std::sort(unique.begin(), unique.end());
+  unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+  for (auto& id : ids) {
+    id = static_cast<uint32_t>(
+        std::lower_bound(unique.begin(), unique.end(), id) - unique.begin());
+  }
+}
+
+}  // namespace
+
+namespace draco_out_of_core {
+
+OutOfCoreOptions::OutOfCoreOptions()
+    : memory_budget(size_t(512) << 20), temp_directory() {}
+
+bool DracoEncodeFile(const std::string& input_path,
+                     const std::string& output_path,
+                     const OutOfCoreOptions& options,
+                     OutOfCoreStats* stats) {
+  OutOfCoreStats local_stats;
+  OutOfCoreStats& st = stats != nullptr ? *stats : local_stats;
+  st = OutOfCoreStats();
+
+  // Budget split: vertex and uv caches, bucket buffers, fixed I/O buffers
+  // and grid tables, and the rest for the part being encoded
+  const size_t budget = options.memory_budget;
+  const size_t vertex_cache_budget = budget / 8;
+  const size_t uv_cache_budget = budget / 16;
+  const size_t bucket_budget = budget / 8;
+  const size_t fixed = 10 * kIoBufferSize + kNumCells * 12;
+  const size_t reserved =
+      vertex_cache_budget + uv_cache_budget + bucket_budget + fixed;
+  if (budget < reserved + kBytesPerPoint * 4096) {
+    printf("Error: Memory budget of %zu bytes is too small.\n", budget);
+    return false;
+  }
+  const uint64_t max_part_points = (budget - reserved) / kBytesPerPoint;
+
+  const fs::path output(output_path);
+  const fs::path temp_dir = !options.temp_directory.empty()
+                                ? fs::path(options.temp_directory)
+                                : output.parent_path();
+  const std::string temp_prefix = output.filename().string();
+
+  // Parse the input into binary files
+  ParsedInput input;
+  if (!input.vertices.Open(temp_dir / (temp_prefix + ".vertices.tmp")) ||
+      !input.uvs.Open(temp_dir / (temp_prefix + ".uvs.tmp")) ||
+      !input.faces.Open(temp_dir / (temp_prefix + ".faces.tmp"))) {
+    return false;
+  }
+  {
+    InputReader in;
+    if (!in.Open(input_path)) {
+      return false;
+    }
+    std::string ext = fs::path(input_path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char ch) { return std::tolower(ch); });
+    bool ret = false;
+    if (ext == ".obj") {
+      ret = ParseObj(in, input);
+    } else if (ext == ".ply") {
+      ret = ParsePly(in, input);
+    } else {
+      printf("Error: Unsupported input %s.\n", input_path.c_str());
+    }
+    if (!ret || !input.vertices.Flush() || !input.uvs.Flush() ||
+        !input.faces.Flush()) {
+      return false;
+    }
+  }
+  st.num_vertices = input.num_vertices;
+  st.num_uvs = input.num_uvs;
+  st.num_faces = input.num_faces;
+  if (input.num_vertices == 0 || input.num_vertices > UINT32_MAX) {
+    printf("Error: Unsupported number of vertices %llu.\n",
+           static_cast<unsigned long long>(input.num_vertices));
+    return false;
+  }
+  const bool is_mesh = input.num_faces > 0;
+  const bool with_uvs = is_mesh && input.with_uvs();
+
+  // Cell of every face centroid (every point for point clouds), kept in a
+  // temporary file, and their histogram over the grid
+  const Eigen::AlignedBox3f box = input.bounds;
+  const Eigen::Vector3f extent =
+      box.sizes().cwiseMax(Eigen::Vector3f::Constant(1e-6f));
+  RecordCache<VertexRecord> vertex_cache(input.vertices, vertex_cache_budget);
+  RecordCache<UvRecord> uv_cache(input.uvs, uv_cache_budget);
+  TempFile cells;
+  if (!cells.Open(temp_dir / (temp_prefix + ".cells.tmp"))) {
+    return false;
+  }
+  std::vector<uint64_t> counts(kNumCells, 0);
+  bool ret = true;
+  if (is_mesh) {
+    ret = ForEachRecord<FaceRecord>(
+        input.faces, [&](uint64_t, const FaceRecord& face) {
+          Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+          for (int j = 0; j < 3; j++) {
+            if (face.v[j] >= input.num_vertices ||
+                (with_uvs && face.t[j] >= input.num_uvs)) {
+              printf("Error: Face index out of range.\n");
+              return false;
+            }
+            centroid += Position(vertex_cache.Get(face.v[j]));
+          }
+          const uint32_t code = CellCode(box, extent, centroid / 3.f);
+          counts[code]++;
+          return cells.Append(&code, sizeof(code));
+        });
+  } else {
+    ret = ForEachRecord<VertexRecord>(
+        input.vertices, [&](uint64_t, const VertexRecord& v) {
+          const uint32_t code = CellCode(box, extent, Position(v));
+          counts[code]++;
+          return cells.Append(&code, sizeof(code));
+        });
+  }
+  if (!ret || !cells.Flush() || vertex_cache.failed()) {
+    return false;
+  }
+
+  // Cut the Morton order of the cells into parts of about equal size within
+  // the budget. A face is counted as two points: closed meshes have half as
+  // many vertices as faces, but parts cut through thin or noisy surfaces
+  // share few vertices.
+  const uint64_t num_units = is_mesh ? input.num_faces : input.num_vertices;
+  const uint64_t max_part_units =
+      is_mesh ? std::max<uint64_t>(max_part_points / 2, 1) : max_part_points;
+  const uint64_t num_parts = (num_units + max_part_units - 1) / max_part_units;
+  const uint64_t target = (num_units + num_parts - 1) / num_parts;
+  std::vector<uint32_t> cell_part(kNumCells, 0);
+  uint32_t part = 0;
+  uint64_t in_part = 0;
+  for (uint32_t code = 0; code < kNumCells; code++) {
+    if (in_part > 0 && in_part + counts[code] > target) {
+      part++;
+      in_part = 0;
+    }
+    cell_part[code] = part;
+    in_part += counts[code];
+  }
+  st.num_parts = part + 1;
+
+  // Bucket the records by part
+  BucketFile buckets;
+  const size_t record_size =
+      is_mesh ? sizeof(FaceRecord) : sizeof(VertexRecord);
+  const size_t bucket_buffer_size = std::min<size_t>(
+      kIoBufferSize, std::max<size_t>(4096, bucket_budget / st.num_parts));
+  if (!buckets.Open(temp_dir / (temp_prefix + ".parts.tmp"), st.num_parts,
+                    record_size, bucket_buffer_size)) {
+    return false;
+  }
+  RecordCache<uint32_t> cell_codes(cells, kIoBufferSize);
+  if (is_mesh) {
+    ret = ForEachRecord<FaceRecord>(
+        input.faces, [&](uint64_t i, const FaceRecord& face) {
+          return buckets.Append(cell_part[cell_codes.Get(i)], &face);
+        });
+  } else {
+    ret = ForEachRecord<VertexRecord>(
+        input.vertices, [&](uint64_t i, const VertexRecord& v) {
+          return buckets.Append(cell_part[cell_codes.Get(i)], &v);
+        });
+  }
+  if (!ret || !buckets.Finish() || cell_codes.failed()) {
+    return false;
+  }
+  st.temp_bytes = input.vertices.size() + input.uvs.size() +
+                  input.faces.size() + cells.size() + buckets.bytes();
+  cells.Close();
+  // Point clouds are fully copied into the buckets
+  if (!is_mesh) {
+    input.vertices.Close();
+  }
+
+  // Encode parts one at a time and append them to the output. The index at
+  // the head is written last.
+  std::vector<uint32_t> parts;
+  for (uint32_t p = 0; p < st.num_parts; p++) {
+    if (buckets.count(p) > 0) {
+      parts.push_back(p);
+    }
+  }
+  st.num_parts = static_cast<uint32_t>(parts.size());
+  std::FILE* fp = std::fopen(output_path.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("Error: Failed to open %s.\n", output_path.c_str());
+    return false;
+  }
+  const size_t index_size = draco_tile::TileIndexSize(parts.size());
+  std::vector<char> index(index_size, 0);
+  ret = std::fwrite(index.data(), 1, index.size(), fp) == index.size();
+
+  // Quantize all parts on one grid over the input so that vertices
+  // duplicated across parts decode to the same position
+  draco_encode::DracoEncodeOptions encode_options = options.encode_options;
+  if (encode_options.pos_quantization_range <= 0.f) {
+    encode_options.pos_quantization_origin = input.bounds.min();
+    encode_options.pos_quantization_range = input.bounds.sizes().maxCoeff();
+    if (encode_options.pos_quantization_range == 0.f) {
+      encode_options.pos_quantization_range = 1.f;
+    }
+  }
+
+  std::vector<draco_tile::TileInfo> tiles(parts.size());
+  uint64_t offset = index_size;
+  for (size_t i = 0; ret && i < parts.size(); i++) {
+    mesh_util::MeshArrays part;
+    const uint64_t count = buckets.count(parts[i]);
+    if (is_mesh) {
+      std::vector<FaceRecord> faces(count);
+      if (!buckets.Read(parts[i], faces.data())) {
+        ret = false;
+        break;
+      }
+      // Gather the vertices and uvs of the faces, renumbered
+      std::vector<uint32_t> v_ids(count * 3);
+      std::vector<uint32_t> t_ids(with_uvs ? count * 3 : 0);
+      for (uint64_t f = 0; f < count; f++) {
+        for (int j = 0; j < 3; j++) {
+          v_ids[f * 3 + j] = faces[f].v[j];
+          if (with_uvs) {
+            t_ids[f * 3 + j] = faces[f].t[j];
+          }
+        }
+      }
+      faces = std::vector<FaceRecord>();
+      std::vector<uint32_t> unique;
+      Renumber(v_ids, unique);
+      part.verts.resize(unique.size());
+      if (input.has_colors) {
+        part.colors.resize(unique.size());
+      }
+      if (input.has_normals) {
+        part.normals.resize(unique.size());
+      }
+      for (size_t k = 0; k < unique.size(); k++) {
+        const VertexRecord& v = vertex_cache.Get(unique[k]);
+        part.verts[k] = Position(v);
+        if (input.has_colors) {
+          part.colors[k] = Eigen::Vector<uint8_t, 3>(v.color[0], v.color[1],
+                                                     v.color[2]);
+        }
+        if (input.has_normals) {
+          part.normals[k] =
+              Eigen::Vector3f(v.normal[0], v.normal[1], v.normal[2]);
+        }
+      }
+      part.indices.resize(count);
+      for (uint64_t f = 0; f < count; f++) {
+        part.indices[f] = Eigen::Vector3i(v_ids[f * 3], v_ids[f * 3 + 1],
+                                          v_ids[f * 3 + 2]);
+      }
+      if (with_uvs) {
+        Renumber(t_ids, unique);
+        part.uvs.resize(unique.size());
+        for (size_t k = 0; k < unique.size(); k++) {
+          const UvRecord& uv = uv_cache.Get(unique[k]);
+          part.uvs[k] = Eigen::Vector2f(uv.uv[0], uv.uv[1]);
+        }
+        part.uv_indices.resize(count);
+        for (uint64_t f = 0; f < count; f++) {
+          part.uv_indices[f] = Eigen::Vector3i(
+              t_ids[f * 3], t_ids[f * 3 + 1], t_ids[f * 3 + 2]);
+        }
+      }
+      if (vertex_cache.failed() || uv_cache.failed()) {
+        ret = false;
+        break;
+      }
+    } else {
+      std::vector<VertexRecord> points(count);
+      if (!buckets.Read(parts[i], points.data())) {
+        ret = false;
+        break;
+      }
+      part.verts.resize(count);
+      for (uint64_t k = 0; k < count; k++) {
+        part.verts[k] = Position(points[k]);
+        if (input.has_colors) {
+          part.colors.emplace_back(points[k].color[0], points[k].color[1],
+                                   points[k].color[2]);
+        }
+        if (input.has_normals) {
+          part.normals.emplace_back(points[k].normal[0], points[k].normal[1],
+                                    points[k].normal[2]);
+        }
+      }
+    }
+    st.max_part_points =
+        std::max<uint64_t>(st.max_part_points, part.verts.size());
+
+    for (const auto& v : part.verts) {
+      tiles[i].bounds.extend(v);
+    }
+    std::vector<char> stream;
+    if (!draco_encode::DracoEncode(part.verts, part.uvs, part.indices,
+                                   part.uv_indices, part.colors, part.normals,
+                                   encode_options, stream)) {
+      printf("Failed to encode part %zu.\n", i);
+      ret = false;
+      break;
+    }
+    tiles[i].offset = offset;
+    tiles[i].size = stream.size();
+    offset += stream.size();
+    ret = std::fwrite(stream.data(), 1, stream.size(), fp) == stream.size();
+  }
+
+  if (ret) {
+    draco_tile::WriteTileIndex(tiles, index.data());
+    ret = Seek(fp, 0) &&
+          std::fwrite(index.data(), 1, index.size(), fp) == index.size();
+  }
+  if (std::fclose(fp) != 0) {
+    ret = false;
+  }
+  if (!ret) {
+    printf("Error: Failed to write %s.\n", output_path.c_str());
+    std::error_code ec;
+    fs::remove(output, ec);
+  }
+  return ret;
+}
+
+}  // namespace draco_out_of_core
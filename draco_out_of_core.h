@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "draco_encode.h"
+
+namespace draco_out_of_core {
+
+struct OutOfCoreOptions {
+  OutOfCoreOptions();
+  // Applied to every part. Unless a quantization range is set, positions
+  // are quantized on a grid over the bounding box of the whole input.
+  draco_encode::DracoEncodeOptions encode_options;
+  // Memory the encode may use in bytes, parsing buffers, vertex caches and
+  // the encoder working set of a part included
+  size_t memory_budget;
+  // Directory of the temporary files. Empty uses the output directory.
+  std::string temp_directory;
+};
+
+struct OutOfCoreStats {
+  uint64_t num_vertices = 0;
+  uint64_t num_uvs = 0;
+  uint64_t num_faces = 0;
+  uint32_t num_parts = 0;
+  // Points of the largest part, shared vertices counted in each part
+  uint64_t max_part_points = 0;
+  // Bytes written to temporary files
+  uint64_t temp_bytes = 0;
+};
+
+// Encodes the OBJ or PLY file at |input_path| into a tiled container at
+// |output_path| without holding the input in memory. The file is parsed in
+// chunks into temporary binary files, faces (points for point clouds) are
+// bucketed on disk into spatially compact parts sized to the budget, and
+// the parts are encoded one at a time and appended to the output. The
+// result has the draco_tile format, so draco_tile::ReadTileIndex() and
+// DracoDecodeTiled() read it and parts can be decoded selectively.
+//
+// Parts are cut along the Morton order of a 64^3 grid over the bounding
+// box, so a part never splits a grid cell; a single cell denser than the
+// budget allows becomes an oversized part.
+//
+// Supported input: OBJ with v (optionally followed by r g b in [0, 1]), vt
+// and f, polygons fanned into triangles; PLY in ascii or binary little
+// endian with vertex x y z, optional nx ny nz and red green blue, and face
+// vertex_indices.
+bool DracoEncodeFile(const std::string& input_path,
+                     const std::string& output_path,
+                     const OutOfCoreOptions& options,
+                     OutOfCoreStats* stats = nullptr);
+
+}  // namespace draco_out_of_core
@@ -0,0 +1,265 @@
+#include "draco_sequence.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "draco_batch.h"
+#include "draco_decode.h"
+
+namespace {
+
+// Archive layout (native endianness):
+//   char magic[4] = "C3DS", uint32 version, uint32 num_frames,
+//   float frame_rate, float pos_quantization_origin[3],
+//   float pos_quantization_range
+//   num_frames x {uint64 offset, uint64 size}
+//   frame Draco streams
+constexpr char kMagic[4] = {'C', '3', 'D', 'S'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 32;
+constexpr size_t kEntrySize = 16;
+
+template <typename T>
+void WritePod(char* dst, size_t& pos, const T& value) {
+  std::memcpy(dst + pos, &value, sizeof(T));
+  pos += sizeof(T);
+}
+
+template <typename T>
+T ReadPod(const char* src, size_t& pos) {
+  T value;
+  std::memcpy(&value, src + pos, sizeof(T));
+  pos += sizeof(T);
+  return value;
+}
+
+}  // namespace
+
+namespace draco_sequence {
+
+SequenceEncodeOptions::SequenceEncodeOptions()
+    : shared_quantization_box(true), frame_rate(30.f) {}
+
+bool DracoEncodeSequence(const std::vector<mesh_util::MeshArrays>& frames,
+                         const SequenceEncodeOptions& options,
+                         std::vector<char>& bytes) {
+  bytes.clear();
+  if (frames.empty()) {
+    return false;
+  }
+
+  draco_encode::DracoEncodeOptions encode_options = options.encode_options;
+  if (options.shared_quantization_box) {
+    Eigen::AlignedBox3f box;
+    for (const auto& frame : frames) {
+      for (const auto& v : frame.verts) {
+        box.extend(v);
+      }
+    }
+    if (box.isEmpty()) {
+      printf("Error: Sequence has no points.\n");
+      return false;
+    }
+    encode_options.pos_quantization_origin = box.min();
+    encode_options.pos_quantization_range = box.sizes().maxCoeff();
+    if (encode_options.pos_quantization_range == 0.f) {
+      encode_options.pos_quantization_range = 1.f;
+    }
+  }
+
+  std::vector<std::vector<char>> streams;
+  if (!draco_batch::DracoEncodeBatch(frames, encode_options, streams)) {
+    return false;
+  }
+
+  // Write the archive
+  const size_t num_frames = streams.size();
+  size_t total = kHeaderSize + kEntrySize * num_frames;
+  for (const auto& stream : streams) {
+    total += stream.size();
+  }
+  bytes.resize(total);
+  size_t pos = 0;
+  std::memcpy(bytes.data(), kMagic, sizeof(kMagic));
+  pos += sizeof(kMagic);
+  WritePod(bytes.data(), pos, kVersion);
+  WritePod(bytes.data(), pos, static_cast<uint32_t>(num_frames));
+  WritePod(bytes.data(), pos, options.frame_rate);
+  for (int k = 0; k < 3; k++) {
+    WritePod(bytes.data(), pos, encode_options.pos_quantization_origin[k]);
+  }
+  WritePod(bytes.data(), pos, encode_options.pos_quantization_range);
+  uint64_t offset = kHeaderSize + kEntrySize * num_frames;
+  for (const auto& stream : streams) {
+    WritePod(bytes.data(), pos, offset);
+    WritePod(bytes.data(), pos, static_cast<uint64_t>(stream.size()));
+    offset += stream.size();
+  }
+  for (const auto& stream : streams) {
+    std::memcpy(bytes.data() + pos, stream.data(), stream.size());
+    pos += stream.size();
+  }
+
+  return true;
+}
+
+bool ReadSequenceIndex(const std::vector<char>& bytes, SequenceInfo& info) {
+  return ReadSequenceIndex(bytes.data(), bytes.size(), info);
+}
+
+bool ReadSequenceIndex(const char* data, size_t size, SequenceInfo& info) {
+  info = SequenceInfo();
+  if (size < kHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+    printf("Error: Not a sequence archive.\n");
+    return false;
+  }
+  size_t pos = sizeof(kMagic);
+  const uint32_t version = ReadPod<uint32_t>(data, pos);
+  const uint32_t num_frames = ReadPod<uint32_t>(data, pos);
+  if (version != kVersion) {
+    printf("Error: Unsupported sequence archive version %u.\n", version);
+    return false;
+  }
+  if (size < kHeaderSize + kEntrySize * num_frames) {
+    printf("Error: Truncated frame index.\n");
+    return false;
+  }
+  info.frame_rate = ReadPod<float>(data, pos);
+  for (int k = 0; k < 3; k++) {
+    info.pos_quantization_origin[k] = ReadPod<float>(data, pos);
+  }
+  info.pos_quantization_range = ReadPod<float>(data, pos);
+
+  info.frames.resize(num_frames);
+  for (auto& frame : info.frames) {
+    frame.offset = ReadPod<uint64_t>(data, pos);
+    frame.size = ReadPod<uint64_t>(data, pos);
+    if (frame.offset > size || frame.size > size - frame.offset) {
+      printf("Error: Frame exceeds the archive.\n");
+      info.frames.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DracoDecodeFrame(const std::vector<char>& bytes, const SequenceInfo& info,
+                      size_t frame, mesh_util::MeshArrays& out) {
+  return DracoDecodeFrame(bytes.data(), bytes.size(), info, frame, out);
+}
+
+bool DracoDecodeFrame(const char* data, size_t size, const SequenceInfo& info,
+                      size_t frame, mesh_util::MeshArrays& out) {
+  if (frame >= info.frames.size()) {
+    printf("Error: Frame %zu out of range.\n", frame);
+    return false;
+  }
+  const FrameInfo& entry = info.frames[frame];
+  if (entry.offset > size || entry.size > size - entry.offset) {
+    printf("Error: Frame exceeds the archive.\n");
+    return false;
+  }
+  return draco_decode::DracoDecode(data + entry.offset, entry.size, out.verts,
+                                   out.uvs, out.indices, out.uv_indices,
+                                   out.colors, out.normals);
+}
+
+SequencePlayer::SequencePlayer(const std::vector<char>& bytes,
+                               const SequenceInfo& info, int prefetch,
+                               parallel_util::ThreadPool& pool)
+    : SequencePlayer(bytes.data(), bytes.size(), info, prefetch, pool) {}
+
+SequencePlayer::SequencePlayer(const char* data, size_t size,
+                               const SequenceInfo& info, int prefetch,
+                               parallel_util::ThreadPool& pool)
+    : data_(data),
+      size_(size),
+      info_(info),
+      pool_(pool),
+      slots_(std::max(prefetch, 1)),
+      position_(0) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Schedule();
+}
+
+SequencePlayer::~SequencePlayer() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  WaitIdle(lock);
+}
+
+void SequencePlayer::Seek(size_t frame) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  WaitIdle(lock);
+  position_ = std::min(frame, info_.frames.size());
+  // Keep frames already decoded for the new window
+  for (auto& slot : slots_) {
+    if (slot.frame < position_ || slot.frame >= position_ + slots_.size()) {
+      slot.state = SlotState::kEmpty;
+    }
+  }
+  Schedule();
+}
+
+bool SequencePlayer::Next(mesh_util::MeshArrays& frame) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (position_ >= info_.frames.size()) {
+    return false;
+  }
+  Slot& slot = slots_[position_ % slots_.size()];
+  cv_.wait(lock, [&]() {
+    return slot.state == SlotState::kReady || slot.state == SlotState::kFailed;
+  });
+  const bool ret = slot.state == SlotState::kReady;
+  if (ret) {
+    std::swap(frame, slot.data);
+  }
+  slot.state = SlotState::kEmpty;
+  position_++;
+  Schedule();
+  return ret;
+}
+
+size_t SequencePlayer::position() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return position_;
+}
+
+size_t SequencePlayer::num_ready() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::count_if(slots_.begin(), slots_.end(), [](const Slot& slot) {
+    return slot.state == SlotState::kReady;
+  });
+}
+
+void SequencePlayer::Schedule() {
+  const size_t end =
+      std::min(position_ + slots_.size(), info_.frames.size());
+  for (size_t f = position_; f < end; f++) {
+    const size_t index = f % slots_.size();
+    Slot& slot = slots_[index];
+    if (slot.state != SlotState::kEmpty) {
+      continue;
+    }
+    slot.state = SlotState::kDecoding;
+    slot.frame = f;
+    pool_.Submit([this, index]() {
+      // The slot is owned by this task until its state changes
+      Slot& slot = slots_[index];
+      const bool ret =
+          DracoDecodeFrame(data_, size_, info_, slot.frame, slot.data);
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot.state = ret ? SlotState::kReady : SlotState::kFailed;
+      cv_.notify_all();
+    });
+  }
+}
+
+void SequencePlayer::WaitIdle(std::unique_lock<std::mutex>& lock) {
+  cv_.wait(lock, [&]() {
+    return std::none_of(slots_.begin(), slots_.end(), [](const Slot& slot) {
+      return slot.state == SlotState::kDecoding;
+    });
+  });
+}
+
+}  // namespace draco_sequence
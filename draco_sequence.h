@@ -0,0 +1,125 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "draco_encode.h"
+#include "mesh_util.h"
+#include "thread_pool.h"
+
+namespace draco_sequence {
+
+struct SequenceEncodeOptions {
+  SequenceEncodeOptions();
+  // Applied to every frame
+  draco_encode::DracoEncodeOptions encode_options;
+  // Quantize positions of all frames on one grid over the bounding box of
+  // the whole sequence. Decoded frames then share the grid and can be
+  // compared or concatenated without requantization. Overrides the
+  // quantization box of |encode_options|.
+  bool shared_quantization_box;
+  // Stored in the archive for playback
+  float frame_rate;
+};
+
+// Entry of the frame index stored at the head of a sequence archive.
+struct FrameInfo {
+  // Location of the frame's Draco stream in the archive
+  uint64_t offset = 0;
+  uint64_t size = 0;
+};
+
+struct SequenceInfo {
+  float frame_rate = 0.f;
+  // Shared quantization box, or a range of 0 if frames were quantized
+  // independently
+  Eigen::Vector3f pos_quantization_origin = Eigen::Vector3f::Zero();
+  float pos_quantization_range = 0.f;
+  std::vector<FrameInfo> frames;
+};
+
+// Encodes |frames| in parallel, reusing encoder sessions across frames, and
+// writes an archive with a frame index. Every frame is an independent Draco
+// stream.
+bool DracoEncodeSequence(const std::vector<mesh_util::MeshArrays>& frames,
+                         const SequenceEncodeOptions& options,
+                         std::vector<char>& bytes);
+
+// Reads the frame index without decoding any frame.
+bool ReadSequenceIndex(const std::vector<char>& bytes, SequenceInfo& info);
+
+// Reads the index of the archive of |size| bytes at |data|, e.g. a mapped
+// file.
+bool ReadSequenceIndex(const char* data, size_t size, SequenceInfo& info);
+
+// Decodes frame |frame| of an archive whose index is |info|.
+bool DracoDecodeFrame(const std::vector<char>& bytes, const SequenceInfo& info,
+                      size_t frame, mesh_util::MeshArrays& out);
+
+// Decodes the frame in place from the archive of |size| bytes at |data|.
+// The archive is read directly and is not copied.
+bool DracoDecodeFrame(const char* data, size_t size, const SequenceInfo& info,
+                      size_t frame, mesh_util::MeshArrays& out);
+
+// Plays an archive back in order, decoding up to |prefetch| frames ahead on
+// a thread pool so that Next() rarely waits. The archive and |info| must
+// outlive the player.
+class SequencePlayer {
+ public:
+  SequencePlayer(
+      const std::vector<char>& bytes, const SequenceInfo& info,
+      int prefetch = 4,
+      parallel_util::ThreadPool& pool = parallel_util::ThreadPool::Shared());
+  SequencePlayer(
+      const char* data, size_t size, const SequenceInfo& info,
+      int prefetch = 4,
+      parallel_util::ThreadPool& pool = parallel_util::ThreadPool::Shared());
+  // Waits for frames being decoded.
+  ~SequencePlayer();
+  SequencePlayer(const SequencePlayer&) = delete;
+  SequencePlayer& operator=(const SequencePlayer&) = delete;
+
+  // Moves to |frame| and starts decoding ahead of it.
+  void Seek(size_t frame);
+
+  // Swaps the next frame into |frame|, waiting if it is still being decoded.
+  // The previous contents of |frame| are reused for a later frame. Returns
+  // false at the end of the sequence or if the frame failed to decode; the
+  // player then moves on to the following frame.
+  bool Next(mesh_util::MeshArrays& frame);
+
+  // Index of the frame returned by the next call of Next().
+  size_t position() const;
+
+  // Number of frames decoded ahead and ready to be returned without waiting.
+  size_t num_ready() const;
+
+ private:
+  enum class SlotState { kEmpty, kDecoding, kReady, kFailed };
+  struct Slot {
+    SlotState state = SlotState::kEmpty;
+    size_t frame = 0;
+    mesh_util::MeshArrays data;
+  };
+
+  // Starts decoding frames of the window [position_, position_ + prefetch)
+  // that are not decoded yet. Called with |mutex_| held.
+  void Schedule();
+  // Waits until no slot is being decoded. Called with |lock| held.
+  void WaitIdle(std::unique_lock<std::mutex>& lock);
+
+  const char* data_;
+  size_t size_;
+  const SequenceInfo& info_;
+  parallel_util::ThreadPool& pool_;
+  // Frame f lives in slot f % slots_.size()
+  std::vector<Slot> slots_;
+  size_t position_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+}  // namespace draco_sequence
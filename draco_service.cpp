@@ -0,0 +1,1201 @@
+#include "draco_service.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include "bounded_queue.h"
+#include "draco_cache.h"
+#include "file_util.h"
+
+namespace {
+
+// Frame magic, distinct from the file formats ("C3DS" is a sequence archive)
+constexpr char kMagic[4] = {'C', '3', 'D', 'P'};
+constexpr uint32_t kVersion = 1;
+
+enum MessageType : uint32_t {
+  kPing = 1,
+  kEncode = 2,
+  kEncodeFile = 3,
+  kDecode = 4,
+  kDecodeFile = 5,
+};
+// Replies carry the type of their request with this bit set
+constexpr uint32_t kReplyFlag = 0x80000000u;
+
+enum Status : uint32_t {
+  kOk = 0,
+  kFailed = 1,
+};
+
+struct FrameHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t type;
+  uint32_t status;
+  uint64_t request_id;
+  // Bytes following the header on the socket
+  uint64_t payload_size;
+  // If not 0, the payload is this many bytes at the start of the shared
+  // memory object passed with the header, and |payload_size| is 0
+  uint64_t shm_size;
+};
+static_assert(sizeof(FrameHeader) == 40, "");
+
+// Garbage headers are rejected before allocating their payload
+constexpr uint64_t kMaxInlinePayload = uint64_t(1) << 30;
+
+// DracoEncodeOptions on the wire, trace excluded
+struct WireOptions {
+  int32_t pos_quantization_bits;
+  int32_t tex_coords_quantization_bits;
+  int32_t normals_quantization_bits;
+  int32_t compression_level;
+  float pos_quantization_range;
+  float pos_quantization_origin[3];
+  uint8_t tex_coords_deleted;
+  uint8_t normals_deleted;
+  uint8_t deduplicate_points;
+  uint8_t voxelize_points;
+  uint8_t write_stream_info;
+  uint8_t padding[3];
+};
+static_assert(sizeof(WireOptions) == 40, "");
+
+WireOptions ToWire(const draco_encode::DracoEncodeOptions& options) {
+  WireOptions wire = {};
+  wire.pos_quantization_bits = options.pos_quantization_bits;
+  wire.tex_coords_quantization_bits = options.tex_coords_quantization_bits;
+  wire.normals_quantization_bits = options.normals_quantization_bits;
+  wire.compression_level = options.compression_level;
+  wire.pos_quantization_range = options.pos_quantization_range;
+  for (int i = 0; i < 3; i++) {
+    wire.pos_quantization_origin[i] = options.pos_quantization_origin[i];
+  }
+  wire.tex_coords_deleted = options.tex_coords_deleted;
+  wire.normals_deleted = options.normals_deleted;
+  wire.deduplicate_points = options.deduplicate_points;
+  wire.voxelize_points = options.voxelize_points;
+  wire.write_stream_info = options.write_stream_info;
+  return wire;
+}
+
+draco_encode::DracoEncodeOptions FromWire(const WireOptions& wire) {
+  draco_encode::DracoEncodeOptions options;
+  options.pos_quantization_bits = wire.pos_quantization_bits;
+  options.tex_coords_quantization_bits = wire.tex_coords_quantization_bits;
+  options.normals_quantization_bits = wire.normals_quantization_bits;
+  options.compression_level = wire.compression_level;
+  options.pos_quantization_range = wire.pos_quantization_range;
+  options.pos_quantization_origin =
+      Eigen::Vector3f(wire.pos_quantization_origin[0],
+                      wire.pos_quantization_origin[1],
+                      wire.pos_quantization_origin[2]);
+  options.tex_coords_deleted = wire.tex_coords_deleted != 0;
+  options.normals_deleted = wire.normals_deleted != 0;
+  options.deduplicate_points = wire.deduplicate_points != 0;
+  options.voxelize_points = wire.voxelize_points != 0;
+  options.write_stream_info = wire.write_stream_info != 0;
+  return options;
+}
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+// A peer closing its end must fail the send, not kill the process
+void DisableSigPipe(int fd) {
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+  (void)fd;
+#endif
+}
+
+// True if the process at the other end of |fd| runs as the same user.
+bool PeerIsOwner(int fd) {
+#ifdef SO_PEERCRED
+  ucred cred = {};
+  socklen_t len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+    return false;
+  }
+  return cred.uid == geteuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  if (getpeereid(fd, &uid, &gid) != 0) {
+    return false;
+  }
+  return uid == geteuid();
+#endif
+}
+
+bool SendAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = send(fd, data, size, kSendFlags);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// Returns false on errors and if the peer closes the connection first.
+bool RecvAll(int fd, char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t n = recv(fd, data, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// Shared memory object holding one payload. It is unlinked right after
+// creation, so it lives only as long as descriptors and mappings of it and
+// is never leaked by a crashed peer.
+class SharedMemory {
+ public:
+  SharedMemory() : fd_(-1), data_(nullptr), size_(0) {}
+  ~SharedMemory() { Reset(); }
+  SharedMemory(const SharedMemory&) = delete;
+  SharedMemory& operator=(const SharedMemory&) = delete;
+
+  // Creates a writable object of |size| bytes.
+  bool Create(size_t size) {
+    Reset();
+    static std::atomic<uint32_t> counter(0);
+    char name[32];
+    int fd = -1;
+    for (int attempt = 0; attempt < 8 && fd < 0; attempt++) {
+      snprintf(name, sizeof(name), "/c3d.%d.%u", static_cast<int>(getpid()),
+               counter++);
+      fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd < 0) {
+      printf("Error: Failed to create shared memory: %s.\n",
+             std::strerror(errno));
+      return false;
+    }
+    shm_unlink(name);
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      printf("Error: Failed to allocate %zu bytes of shared memory.\n", size);
+      close(fd);
+      return false;
+    }
+    fd_ = fd;
+    return MapFd(size, PROT_READ | PROT_WRITE);
+  }
+
+  // Takes ownership of |fd| received from the peer and maps its first
+  // |size| bytes read-only.
+  bool Map(int fd, size_t size) {
+    Reset();
+    fd_ = fd;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < size) {
+      printf("Error: Shared memory is smaller than its payload.\n");
+      Reset();
+      return false;
+    }
+    return MapFd(size, PROT_READ);
+  }
+
+  void Reset() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    fd_ = -1;
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  int fd() const { return fd_; }
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  bool MapFd(size_t size, int prot) {
+    void* data = mmap(nullptr, size, prot, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      printf("Error: Failed to map %zu bytes of shared memory.\n", size);
+      Reset();
+      return false;
+    }
+    data_ = static_cast<char*>(data);
+    size_ = size;
+    return true;
+  }
+
+  int fd_;
+  char* data_;
+  size_t size_;
+};
+
+// Payload being built for sending. Storage is a reused vector, or a shared
+// memory object from |shm_threshold| bytes on.
+class OutPayload {
+ public:
+  char* Allocate(size_t size, size_t shm_threshold) {
+    shm_.Reset();
+    size_ = size;
+    if (size > 0 && size >= shm_threshold) {
+      return shm_.Create(size) ? shm_.data() : nullptr;
+    }
+    buffer_.resize(size);
+    return buffer_.data();
+  }
+
+  bool in_shm() const { return shm_.fd() >= 0; }
+
+  // Sends |header| and the payload, filling in the payload sizes. The
+  // shared memory object is released once its descriptor is sent; the peer
+  // keeps it alive.
+  bool Send(int fd, FrameHeader header) {
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.payload_size = in_shm() ? 0 : size_;
+    header.shm_size = in_shm() ? size_ : 0;
+
+    iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = buffer_.data();
+    iov[1].iov_len = static_cast<size_t>(header.payload_size);
+    msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = header.payload_size > 0 ? 2 : 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (in_shm()) {
+      std::memset(control, 0, sizeof(control));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      const int shm_fd = shm_.fd();
+      std::memcpy(CMSG_DATA(cmsg), &shm_fd, sizeof(int));
+    }
+
+    ssize_t n;
+    do {
+      n = sendmsg(fd, &msg, kSendFlags);
+    } while (n < 0 && errno == EINTR);
+    shm_.Reset();
+    if (n < 0) {
+      return false;
+    }
+    // The descriptor went with the first byte; the rest is plain data
+    size_t sent = static_cast<size_t>(n);
+    if (sent < sizeof(header)) {
+      if (!SendAll(fd, reinterpret_cast<const char*>(&header) + sent,
+                   sizeof(header) - sent)) {
+        return false;
+      }
+      sent = sizeof(header);
+    }
+    const size_t payload_sent = sent - sizeof(header);
+    return SendAll(fd, buffer_.data() + payload_sent,
+                   static_cast<size_t>(header.payload_size) - payload_sent);
+  }
+
+ private:
+  std::vector<char> buffer_;
+  SharedMemory shm_;
+  size_t size_ = 0;
+};
+
+// A received frame and its payload, inline or mapped.
+struct InMessage {
+  FrameHeader header;
+  std::vector<char> buffer;
+  SharedMemory shm;
+
+  const char* data() const {
+    return shm.data() != nullptr ? shm.data() : buffer.data();
+  }
+  size_t size() const {
+    return shm.data() != nullptr ? shm.size() : buffer.size();
+  }
+};
+
+// Reads the next frame. Returns false without a message if the peer closed
+// the connection between frames.
+bool Receive(int fd, InMessage& message) {
+  FrameHeader& header = message.header;
+  char* dst = reinterpret_cast<char*>(&header);
+  size_t received = 0;
+  int shm_fd = -1;
+  while (received < sizeof(header)) {
+    iovec iov;
+    iov.iov_base = dst + received;
+    iov.iov_len = sizeof(header) - received;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+#ifdef MSG_CMSG_CLOEXEC
+    const ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+#else
+    const ssize_t n = recvmsg(fd, &msg, 0);
+#endif
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      if (shm_fd >= 0) {
+        close(shm_fd);
+      }
+      if (n < 0 || received > 0) {
+        printf("Error: Connection lost while reading a frame.\n");
+      }
+      return false;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (size_t i = 0; i < count; i++) {
+        int received_fd;
+        std::memcpy(&received_fd, CMSG_DATA(cmsg) + i * sizeof(int),
+                    sizeof(int));
+        if (shm_fd < 0) {
+          shm_fd = received_fd;
+        } else {
+          close(received_fd);
+        }
+      }
+    }
+    received += static_cast<size_t>(n);
+  }
+
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion ||
+      header.payload_size > kMaxInlinePayload ||
+      (header.shm_size > 0) != (shm_fd >= 0) ||
+      (header.shm_size > 0 && header.payload_size > 0)) {
+    printf("Error: Invalid frame header.\n");
+    if (shm_fd >= 0) {
+      close(shm_fd);
+    }
+    return false;
+  }
+
+  message.shm.Reset();
+  if (shm_fd >= 0) {
+    message.buffer.clear();
+    return message.shm.Map(shm_fd, static_cast<size_t>(header.shm_size));
+  }
+  message.buffer.resize(static_cast<size_t>(header.payload_size));
+  if (!RecvAll(fd, message.buffer.data(), message.buffer.size())) {
+    printf("Error: Connection lost while reading a payload.\n");
+    return false;
+  }
+  return true;
+}
+
+// Sequential writer into a payload sized in advance
+class Writer {
+ public:
+  explicit Writer(char* dst) : dst_(dst), pos_(0) {}
+
+  template <typename T>
+  void Pod(const T& value) {
+    std::memcpy(dst_ + pos_, &value, sizeof(T));
+    pos_ += sizeof(T);
+  }
+
+  void Bytes(const void* data, size_t size) {
+    if (size > 0) {
+      std::memcpy(dst_ + pos_, data, size);
+    }
+    pos_ += size;
+  }
+
+  template <typename T>
+  void Array(const T* data, size_t size) {
+    Pod(static_cast<uint64_t>(size));
+    Bytes(data, size * sizeof(T));
+  }
+
+  void String(const std::string& str) { Array(str.data(), str.size()); }
+
+ private:
+  char* dst_;
+  size_t pos_;
+};
+
+template <typename T>
+size_t ArraySize(size_t size) {
+  return sizeof(uint64_t) + size * sizeof(T);
+}
+
+// Bounds checked sequential reader of a received payload
+class Reader {
+ public:
+  Reader(const char* data, size_t size) : data_(data), size_(size), pos_(0) {}
+
+  template <typename T>
+  bool Pod(T& value) {
+    if (size_ - pos_ < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&value, data_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  template <typename T>
+  bool Array(std::vector<T>& out) {
+    uint64_t size;
+    if (!Pod(size) || size > (size_ - pos_) / sizeof(T)) {
+      return false;
+    }
+    out.resize(static_cast<size_t>(size));
+    if (size > 0) {
+      std::memcpy(static_cast<void*>(out.data()), data_ + pos_,
+                  out.size() * sizeof(T));
+    }
+    pos_ += out.size() * sizeof(T);
+    return true;
+  }
+
+  bool String(std::string& out) {
+    uint64_t size;
+    if (!Pod(size) || size > size_ - pos_) {
+      return false;
+    }
+    out.assign(data_ + pos_, static_cast<size_t>(size));
+    pos_ += static_cast<size_t>(size);
+    return true;
+  }
+
+  const char* rest() const { return data_ + pos_; }
+  size_t rest_size() const { return size_ - pos_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+};
+
+bool ReadArrays(Reader& reader, mesh_util::MeshArrays& arrays) {
+  return reader.Array(arrays.verts) && reader.Array(arrays.uvs) &&
+         reader.Array(arrays.indices) && reader.Array(arrays.uv_indices) &&
+         reader.Array(arrays.colors) && reader.Array(arrays.normals);
+}
+
+bool ReadDecodeReply(const InMessage& reply,
+                     std::vector<Eigen::Vector3f>& verts,
+                     std::vector<Eigen::Vector2f>& uvs,
+                     std::vector<Eigen::Vector3i>& indices,
+                     std::vector<Eigen::Vector3i>& uv_indices,
+                     std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                     std::vector<Eigen::Vector3f>& normals) {
+  Reader reader(reply.data(), reply.size());
+  if (!reader.Array(verts) || !reader.Array(uvs) || !reader.Array(indices) ||
+      !reader.Array(uv_indices) || !reader.Array(colors) ||
+      !reader.Array(normals)) {
+    printf("Error: Malformed decode reply.\n");
+    return false;
+  }
+  return true;
+}
+
+double ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+namespace draco_service {
+
+ServiceOptions::ServiceOptions()
+    : num_workers(0),
+      queue_capacity(64),
+      shm_threshold(size_t(256) << 10),
+      cache_memory_bytes(0) {}
+
+ClientOptions::ClientOptions() : shm_threshold(size_t(256) << 10) {}
+
+class Server::Impl {
+ public:
+  explicit Impl(const ServiceOptions& options)
+      : options_(options),
+        listen_fd_(-1),
+        queue_(options.queue_capacity) {
+    wake_pipe_[0] = -1;
+    wake_pipe_[1] = -1;
+    if (options.cache_memory_bytes > 0 || !options.cache_directory.empty()) {
+      draco_cache::CacheOptions cache_options;
+      cache_options.max_memory_bytes = options.cache_memory_bytes;
+      cache_options.directory = options.cache_directory;
+      cache_ = std::make_unique<draco_cache::EncodeCache>(cache_options);
+    }
+  }
+
+  ~Impl() {
+    StopWorkers();
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+    }
+    for (int fd : wake_pipe_) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  bool Start() {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (options_.socket_path.empty() ||
+        options_.socket_path.size() >= sizeof(addr.sun_path)) {
+      printf("Error: Invalid socket path %s.\n", options_.socket_path.c_str());
+      return false;
+    }
+    std::memcpy(addr.sun_path, options_.socket_path.c_str(),
+                options_.socket_path.size() + 1);
+
+    // A socket file nobody accepts on is left over from a killed server
+    const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0) {
+      const bool in_use =
+          connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ==
+          0;
+      close(probe);
+      if (in_use) {
+        printf("Error: Another server is listening on %s.\n",
+               options_.socket_path.c_str());
+        return false;
+      }
+    }
+    unlink(options_.socket_path.c_str());
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0 ||
+        bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) !=
+            0 ||
+        listen(listen_fd_, 64) != 0) {
+      printf("Error: Failed to listen on %s: %s.\n",
+             options_.socket_path.c_str(), std::strerror(errno));
+      return false;
+    }
+    // Clients can make the service read and write files with its rights,
+    // so only its own user may connect. PeerIsOwner() covers connections
+    // made before the chmod.
+    if (chmod(options_.socket_path.c_str(), S_IRUSR | S_IWUSR) != 0) {
+      printf("Error: Failed to restrict %s: %s.\n",
+             options_.socket_path.c_str(), std::strerror(errno));
+      return false;
+    }
+    fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+    if (pipe(wake_pipe_) != 0) {
+      printf("Error: Failed to create a pipe.\n");
+      return false;
+    }
+
+    int num_workers = options_.num_workers;
+    if (num_workers <= 0) {
+      num_workers =
+          std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i < num_workers; i++) {
+      workers_.emplace_back([this]() { WorkerLoop(); });
+    }
+    return true;
+  }
+
+  void Run() {
+    while (true) {
+      pollfd fds[2];
+      fds[0].fd = listen_fd_;
+      fds[0].events = POLLIN;
+      fds[1].fd = wake_pipe_[0];
+      fds[1].events = POLLIN;
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        printf("Error: poll failed: %s.\n", std::strerror(errno));
+        break;
+      }
+      if (fds[1].revents != 0) {
+        break;
+      }
+      if ((fds[0].revents & POLLIN) == 0) {
+        continue;
+      }
+      const int fd = accept(listen_fd_, nullptr, nullptr);
+      if (fd < 0) {
+        continue;
+      }
+      if (!PeerIsOwner(fd)) {
+        printf("Error: Rejected a connection from another user.\n");
+        close(fd);
+        continue;
+      }
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      DisableSigPipe(fd);
+      JoinClosedConnections();
+      auto connection = std::make_shared<Connection>(fd);
+      connection->reader =
+          std::thread([this, connection]() { ReadLoop(connection); });
+      connections_.push_back(connection);
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      stats_.connections++;
+    }
+
+    // Readers see end of stream, queued requests are still answered
+    for (auto& connection : connections_) {
+      shutdown(connection->fd, SHUT_RD);
+    }
+    for (auto& connection : connections_) {
+      connection->reader.join();
+    }
+    StopWorkers();
+    connections_.clear();
+    close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(options_.socket_path.c_str());
+  }
+
+  void Stop() {
+    if (wake_pipe_[1] >= 0) {
+      const char c = 0;
+      ssize_t ret = write(wake_pipe_[1], &c, 1);
+      (void)ret;
+    }
+  }
+
+  ServiceStats stats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+  }
+
+ private:
+  struct Connection {
+    explicit Connection(int fd) : fd(fd), closed(false) {}
+    ~Connection() { close(fd); }
+    const int fd;
+    // Replies of different workers must not interleave
+    std::mutex write_mutex;
+    std::thread reader;
+    std::atomic<bool> closed;
+  };
+
+  struct Job {
+    std::shared_ptr<Connection> connection;
+    std::unique_ptr<InMessage> message;
+  };
+
+  // State a worker keeps warm between requests
+  struct WorkerState {
+    draco_decode::DracoDecoderSession decoder;
+    mesh_util::MeshArrays arrays;
+    std::vector<char> bytes;
+    OutPayload reply;
+  };
+
+  void ReadLoop(const std::shared_ptr<Connection>& connection) {
+    OutPayload pong;
+    while (true) {
+      auto message = std::make_unique<InMessage>();
+      if (!Receive(connection->fd, *message)) {
+        break;
+      }
+      if (message->header.type == kPing) {
+        // Answered here, so it measures transport alone
+        FrameHeader reply = {};
+        reply.type = kPing | kReplyFlag;
+        reply.request_id = message->header.request_id;
+        pong.Allocate(0, options_.shm_threshold);
+        std::lock_guard<std::mutex> lock(connection->write_mutex);
+        pong.Send(connection->fd, reply);
+        continue;
+      }
+      if (message->shm.data() != nullptr) {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.shm_requests++;
+      }
+      if (!queue_.Push(Job{connection, std::move(message)})) {
+        break;
+      }
+    }
+    connection->closed = true;
+  }
+
+  void JoinClosedConnections() {
+    for (auto it = connections_.begin(); it != connections_.end();) {
+      if ((*it)->closed) {
+        (*it)->reader.join();
+        it = connections_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void StopWorkers() {
+    queue_.Close();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+    workers_.clear();
+  }
+
+  void WorkerLoop() {
+    WorkerState state;
+    Job job;
+    while (queue_.Pop(job)) {
+      const auto start = std::chrono::steady_clock::now();
+      const FrameHeader& request = job.message->header;
+      FrameHeader reply = {};
+      reply.type = request.type | kReplyFlag;
+      reply.request_id = request.request_id;
+      const bool ok = Process(*job.message, state);
+      if (!ok) {
+        state.reply.Allocate(0, options_.shm_threshold);
+      }
+      reply.status = ok ? kOk : kFailed;
+      // The request payload is not needed anymore; unmap it before replying
+      job.message.reset();
+      {
+        // A client gone in the meantime only loses its reply
+        std::lock_guard<std::mutex> lock(job.connection->write_mutex);
+        state.reply.Send(job.connection->fd, reply);
+      }
+      job.connection.reset();
+
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      stats_.requests++;
+      stats_.failed += ok ? 0 : 1;
+      stats_.busy_ms += ElapsedMs(start);
+    }
+  }
+
+  bool Process(const InMessage& message, WorkerState& state) {
+    Reader reader(message.data(), message.size());
+    switch (message.header.type) {
+      case kEncode: {
+        WireOptions wire;
+        if (!reader.Pod(wire) || !ReadArrays(reader, state.arrays)) {
+          printf("Error: Malformed encode request.\n");
+          return false;
+        }
+        return Encode(FromWire(wire), std::string(), state);
+      }
+      case kEncodeFile: {
+        WireOptions wire;
+        std::string input_path, output_path;
+        if (!reader.Pod(wire) || !reader.String(input_path) ||
+            !reader.String(output_path)) {
+          printf("Error: Malformed encode request.\n");
+          return false;
+        }
+        if (!options_.load_file) {
+          printf("Error: The server cannot load files.\n");
+          return false;
+        }
+        // Arrays the loader does not set must not leak from an earlier
+        // request; clear() keeps their capacity
+        mesh_util::MeshArrays& a = state.arrays;
+        a.verts.clear();
+        a.uvs.clear();
+        a.indices.clear();
+        a.uv_indices.clear();
+        a.colors.clear();
+        a.normals.clear();
+        if (!options_.load_file(input_path, state.arrays)) {
+          printf("Error: Failed to load %s.\n", input_path.c_str());
+          return false;
+        }
+        return Encode(FromWire(wire), output_path, state);
+      }
+      case kDecode: {
+        uint32_t mask;
+        if (!reader.Pod(mask)) {
+          printf("Error: Malformed decode request.\n");
+          return false;
+        }
+        return Decode(reader.rest(), reader.rest_size(), mask, state);
+      }
+      case kDecodeFile: {
+        uint32_t mask;
+        std::string path;
+        if (!reader.Pod(mask) || !reader.String(path)) {
+          printf("Error: Malformed decode request.\n");
+          return false;
+        }
+        file_util::MappedFile file;
+        if (!file.Open(path)) {
+          return false;
+        }
+        return Decode(file.data(), file.size(), mask, state);
+      }
+      default:
+        printf("Error: Unknown request type %u.\n", message.header.type);
+        return false;
+    }
+  }
+
+  bool Encode(const draco_encode::DracoEncodeOptions& options,
+              const std::string& output_path, WorkerState& state) {
+    const mesh_util::MeshArrays& a = state.arrays;
+    // DracoEncode trusts its indices; a bad request must not crash the
+    // service for every client
+    if (!mesh_util::IndicesInRange(a)) {
+      printf("Error: Face indices out of range in encode request.\n");
+      return false;
+    }
+    const bool ok =
+        cache_ ? cache_->Encode(a.verts, a.uvs, a.indices, a.uv_indices,
+                                a.colors, a.normals, options, state.bytes)
+               : draco_encode::DracoEncode(a.verts, a.uvs, a.indices,
+                                           a.uv_indices, a.colors, a.normals,
+                                           options, state.bytes);
+    {
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      stats_.encodes++;
+    }
+    if (!ok) {
+      return false;
+    }
+    if (!output_path.empty()) {
+      state.reply.Allocate(0, options_.shm_threshold);
+      return file_util::WriteFile(output_path, state.bytes.data(),
+                                  state.bytes.size());
+    }
+    char* dst = AllocateReply(state.bytes.size(), state);
+    if (dst == nullptr) {
+      return false;
+    }
+    Writer(dst).Bytes(state.bytes.data(), state.bytes.size());
+    return true;
+  }
+
+  bool Decode(const char* data, size_t size, uint32_t mask,
+              WorkerState& state) {
+    draco_decode::DecodedArrays out;
+    const bool ok = state.decoder.Decode(data, size, out, mask);
+    {
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      stats_.decodes++;
+    }
+    if (!ok) {
+      return false;
+    }
+    // Views into the session arena are copied straight into the reply
+    const size_t reply_size =
+        ArraySize<Eigen::Vector3f>(out.verts.size) +
+        ArraySize<Eigen::Vector2f>(out.uvs.size) +
+        ArraySize<Eigen::Vector3i>(out.indices.size) +
+        ArraySize<Eigen::Vector3i>(out.uv_indices.size) +
+        ArraySize<Eigen::Vector<uint8_t, 3>>(out.colors.size) +
+        ArraySize<Eigen::Vector3f>(out.normals.size);
+    char* dst = AllocateReply(reply_size, state);
+    if (dst == nullptr) {
+      return false;
+    }
+    Writer writer(dst);
+    writer.Array(out.verts.data, out.verts.size);
+    writer.Array(out.uvs.data, out.uvs.size);
+    writer.Array(out.indices.data, out.indices.size);
+    writer.Array(out.uv_indices.data, out.uv_indices.size);
+    writer.Array(out.colors.data, out.colors.size);
+    writer.Array(out.normals.data, out.normals.size);
+    return true;
+  }
+
+  char* AllocateReply(size_t size, WorkerState& state) {
+    char* dst = state.reply.Allocate(size, options_.shm_threshold);
+    if (state.reply.in_shm()) {
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      stats_.shm_replies++;
+    }
+    return dst;
+  }
+
+  const ServiceOptions options_;
+  int listen_fd_;
+  int wake_pipe_[2];
+  parallel_util::BoundedQueue<Job> queue_;
+  std::vector<std::thread> workers_;
+  // Only touched by the thread in Run()
+  std::list<std::shared_ptr<Connection>> connections_;
+  std::unique_ptr<draco_cache::EncodeCache> cache_;
+  mutable std::mutex stats_mutex_;
+  ServiceStats stats_;
+};
+
+Server::Server(const ServiceOptions& options)
+    : impl_(std::make_unique<Impl>(options)) {}
+
+Server::~Server() = default;
+
+bool Server::Start() { return impl_->Start(); }
+
+void Server::Run() { impl_->Run(); }
+
+void Server::Stop() { impl_->Stop(); }
+
+ServiceStats Server::stats() const { return impl_->stats(); }
+
+class Client::Impl {
+ public:
+  explicit Impl(const ClientOptions& options)
+      : options_(options), fd_(-1), next_request_id_(1) {}
+
+  ~Impl() { Close(); }
+
+  bool Connect(const std::string& socket_path) {
+    Close();
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+      printf("Error: Invalid socket path %s.\n", socket_path.c_str());
+      return false;
+    }
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 ||
+        connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      printf("Error: Failed to connect to %s: %s.\n", socket_path.c_str(),
+             std::strerror(errno));
+      if (fd >= 0) {
+        close(fd);
+      }
+      return false;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    DisableSigPipe(fd);
+    fd_ = fd;
+    return true;
+  }
+
+  void Close() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    fd_ = -1;
+  }
+
+  bool connected() const { return fd_ >= 0; }
+
+  // Room for a request payload of |size| bytes
+  char* Allocate(size_t size) {
+    return request_.Allocate(size, options_.shm_threshold);
+  }
+
+  // Sends the allocated request and waits for its reply in reply().
+  bool Call(MessageType type) {
+    if (fd_ < 0) {
+      printf("Error: Not connected.\n");
+      return false;
+    }
+    FrameHeader header = {};
+    header.type = type;
+    header.request_id = next_request_id_++;
+    if (!request_.Send(fd_, header) || !Receive(fd_, reply_)) {
+      printf("Error: Lost the connection to the server.\n");
+      Close();
+      return false;
+    }
+    if (reply_.header.request_id != header.request_id ||
+        reply_.header.type != (type | kReplyFlag)) {
+      printf("Error: Unexpected reply from the server.\n");
+      Close();
+      return false;
+    }
+    if (reply_.header.status != kOk) {
+      printf("Error: The server failed the request.\n");
+      return false;
+    }
+    return true;
+  }
+
+  const InMessage& reply() const { return reply_; }
+
+  // Releases the reply payload, e.g. a shared memory mapping.
+  void ReleaseReply() {
+    reply_.shm.Reset();
+    reply_.buffer.clear();
+  }
+
+ private:
+  const ClientOptions options_;
+  int fd_;
+  uint64_t next_request_id_;
+  OutPayload request_;
+  InMessage reply_;
+};
+
+Client::Client(const ClientOptions& options)
+    : impl_(std::make_unique<Impl>(options)) {}
+
+Client::~Client() = default;
+
+bool Client::Connect(const std::string& socket_path) {
+  return impl_->Connect(socket_path);
+}
+
+void Client::Close() { impl_->Close(); }
+
+bool Client::connected() const { return impl_->connected(); }
+
+bool Client::Ping() {
+  impl_->Allocate(0);
+  const bool ok = impl_->Call(kPing);
+  impl_->ReleaseReply();
+  return ok;
+}
+
+bool Client::Encode(const std::vector<Eigen::Vector3f>& verts,
+                    const std::vector<Eigen::Vector2f>& uvs,
+                    const std::vector<Eigen::Vector3i>& indices,
+                    const std::vector<Eigen::Vector3i>& uv_indices,
+                    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    const std::vector<Eigen::Vector3f>& normals,
+                    const draco_encode::DracoEncodeOptions& options,
+                    std::vector<char>& bytes) {
+  bytes.clear();
+  const size_t size = sizeof(WireOptions) +
+                      ArraySize<Eigen::Vector3f>(verts.size()) +
+                      ArraySize<Eigen::Vector2f>(uvs.size()) +
+                      ArraySize<Eigen::Vector3i>(indices.size()) +
+                      ArraySize<Eigen::Vector3i>(uv_indices.size()) +
+                      ArraySize<Eigen::Vector<uint8_t, 3>>(colors.size()) +
+                      ArraySize<Eigen::Vector3f>(normals.size());
+  char* dst = impl_->Allocate(size);
+  if (dst == nullptr) {
+    return false;
+  }
+  Writer writer(dst);
+  writer.Pod(ToWire(options));
+  writer.Array(verts.data(), verts.size());
+  writer.Array(uvs.data(), uvs.size());
+  writer.Array(indices.data(), indices.size());
+  writer.Array(uv_indices.data(), uv_indices.size());
+  writer.Array(colors.data(), colors.size());
+  writer.Array(normals.data(), normals.size());
+  if (!impl_->Call(kEncode)) {
+    return false;
+  }
+  const InMessage& reply = impl_->reply();
+  bytes.assign(reply.data(), reply.data() + reply.size());
+  impl_->ReleaseReply();
+  return true;
+}
+
+bool Client::EncodeFile(const std::string& input_path,
+                        const std::string& output_path,
+                        const draco_encode::DracoEncodeOptions& options,
+                        std::vector<char>& bytes) {
+  bytes.clear();
+  const size_t size = sizeof(WireOptions) +
+                      ArraySize<char>(input_path.size()) +
+                      ArraySize<char>(output_path.size());
+  char* dst = impl_->Allocate(size);
+  if (dst == nullptr) {
+    return false;
+  }
+  Writer writer(dst);
+  writer.Pod(ToWire(options));
+  writer.String(input_path);
+  writer.String(output_path);
+  if (!impl_->Call(kEncodeFile)) {
+    return false;
+  }
+  const InMessage& reply = impl_->reply();
+  bytes.assign(reply.data(), reply.data() + reply.size());
+  impl_->ReleaseReply();
+  return true;
+}
+
+bool Client::Decode(const char* data, size_t size,
+                    std::vector<Eigen::Vector3f>& verts,
+                    std::vector<Eigen::Vector2f>& uvs,
+                    std::vector<Eigen::Vector3i>& indices,
+                    std::vector<Eigen::Vector3i>& uv_indices,
+                    std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    std::vector<Eigen::Vector3f>& normals, uint32_t mask) {
+  char* dst = impl_->Allocate(sizeof(uint32_t) + size);
+  if (dst == nullptr) {
+    return false;
+  }
+  Writer writer(dst);
+  writer.Pod(mask);
+  writer.Bytes(data, size);
+  if (!impl_->Call(kDecode)) {
+    return false;
+  }
+  const bool ok = ReadDecodeReply(impl_->reply(), verts, uvs, indices,
+                                  uv_indices, colors, normals);
+  impl_->ReleaseReply();
+  return ok;
+}
+
+bool Client::DecodeFile(const std::string& path,
+                        std::vector<Eigen::Vector3f>& verts,
+                        std::vector<Eigen::Vector2f>& uvs,
+                        std::vector<Eigen::Vector3i>& indices,
+                        std::vector<Eigen::Vector3i>& uv_indices,
+                        std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                        std::vector<Eigen::Vector3f>& normals,
+                        uint32_t mask) {
+  char* dst = impl_->Allocate(sizeof(uint32_t) + ArraySize<char>(path.size()));
+  if (dst == nullptr) {
+    return false;
+  }
+  Writer writer(dst);
+  writer.Pod(mask);
+  writer.String(path);
+  if (!impl_->Call(kDecodeFile)) {
+    return false;
+  }
+  const bool ok = ReadDecodeReply(impl_->reply(), verts, uvs, indices,
+                                  uv_indices, colors, normals);
+  impl_->ReleaseReply();
+  return ok;
+}
+
+}  // namespace draco_service
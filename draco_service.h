@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "draco_decode.h"
+#include "draco_encode.h"
+#include "mesh_util.h"
+
+// Resident encode/decode service on a Unix domain socket. POSIX only.
+//
+// Every message is a fixed FrameHeader followed by |payload_size| inline
+// bytes. Payloads of at least ClientOptions::shm_threshold bytes (requests)
+// or ServiceOptions::shm_threshold bytes (replies) are instead written to an
+// unlinked shared memory object whose descriptor is passed with the header
+// as SCM_RIGHTS ancillary data, so large arrays cross the socket as one
+// mapping rather than being copied through the kernel.
+//
+// Clients are trusted with the service's rights: file requests read and
+// write any path the service can. The socket is therefore created with mode
+// 0600 and connections from other users are rejected; run the service as
+// the user of its clients. Arrays in encode requests are checked before
+// encoding, so a malformed request fails alone.
+namespace draco_service {
+
+// Loads an input file by path for kEncodeFile requests.
+using LoadFunction =
+    std::function<bool(const std::string& path, mesh_util::MeshArrays& out)>;
+
+struct ServiceOptions {
+  ServiceOptions();
+  std::string socket_path;
+  // Encode/decode threads kept alive between requests. <= 0 means the
+  // number of hardware threads.
+  int num_workers;
+  // Requests read from all connections but not yet taken by a worker.
+  // Connections stop being read while it is full.
+  size_t queue_capacity;
+  // Replies of at least this many bytes go through shared memory
+  size_t shm_threshold;
+  // Memory tier of an encode cache shared by all clients. 0 disables it.
+  size_t cache_memory_bytes;
+  // Disk tier of the cache. Empty disables it.
+  std::string cache_directory;
+  // Required for kEncodeFile requests. The service library does not parse
+  // mesh files itself.
+  LoadFunction load_file;
+};
+
+struct ServiceStats {
+  uint64_t connections = 0;
+  uint64_t requests = 0;
+  uint64_t failed = 0;
+  uint64_t encodes = 0;
+  uint64_t decodes = 0;
+  // Requests and replies whose payload went through shared memory
+  uint64_t shm_requests = 0;
+  uint64_t shm_replies = 0;
+  // Wall time workers spent on requests, summed over workers
+  double busy_ms = 0.0;
+};
+
+// Accepts connections and runs their requests on a warm worker pool. Each
+// worker keeps a DracoDecoderSession and its input arrays between requests,
+// so steady traffic does not reallocate; the encode cache, if enabled, is
+// shared by all connections.
+class Server {
+ public:
+  explicit Server(const ServiceOptions& options);
+  ~Server();
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  // Binds and listens on the socket path, replacing a stale socket file,
+  // makes it accessible to the owner only and starts the workers.
+  bool Start();
+
+  // Accepts connections until Stop(), then closes them, drains the workers
+  // and removes the socket file.
+  void Run();
+
+  // Makes Run() return. Only writes to a pipe, so it may be called from a
+  // signal handler or another thread.
+  void Stop();
+
+  ServiceStats stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+struct ClientOptions {
+  ClientOptions();
+  // Requests of at least this many bytes go through shared memory
+  size_t shm_threshold;
+};
+
+// Blocking client of one connection. Requests are sent one at a time; use a
+// Client per thread to run requests in parallel.
+class Client {
+ public:
+  explicit Client(const ClientOptions& options = ClientOptions());
+  ~Client();
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  bool Connect(const std::string& socket_path);
+  void Close();
+  bool connected() const;
+
+  // Round trip without work, to measure transport latency.
+  bool Ping();
+
+  // Same as draco_encode::DracoEncode, run by the service.
+  // DracoEncodeOptions::trace is not sent.
+  bool Encode(const std::vector<Eigen::Vector3f>& verts,
+              const std::vector<Eigen::Vector2f>& uvs,
+              const std::vector<Eigen::Vector3i>& indices,
+              const std::vector<Eigen::Vector3i>& uv_indices,
+              const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+              const std::vector<Eigen::Vector3f>& normals,
+              const draco_encode::DracoEncodeOptions& options,
+              std::vector<char>& bytes);
+
+  // The service loads |input_path| with its LoadFunction and encodes it. If
+  // |output_path| is not empty the service writes the stream there and
+  // |bytes| is left empty; otherwise the stream is returned.
+  bool EncodeFile(const std::string& input_path,
+                  const std::string& output_path,
+                  const draco_encode::DracoEncodeOptions& options,
+                  std::vector<char>& bytes);
+
+  // Same as draco_decode::DracoDecode, run by the service.
+  bool Decode(const char* data, size_t size,
+              std::vector<Eigen::Vector3f>& verts,
+              std::vector<Eigen::Vector2f>& uvs,
+              std::vector<Eigen::Vector3i>& indices,
+              std::vector<Eigen::Vector3i>& uv_indices,
+              std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+              std::vector<Eigen::Vector3f>& normals,
+              uint32_t mask = draco_decode::kDecodeAll);
+
+  // The service maps the .drc file at |path| and decodes it.
+  bool DecodeFile(const std::string& path,
+                  std::vector<Eigen::Vector3f>& verts,
+                  std::vector<Eigen::Vector2f>& uvs,
+                  std::vector<Eigen::Vector3i>& indices,
+                  std::vector<Eigen::Vector3i>& uv_indices,
+                  std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                  std::vector<Eigen::Vector3f>& normals,
+                  uint32_t mask = draco_decode::kDecodeAll);
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace draco_service
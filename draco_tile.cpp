@@ -0,0 +1,343 @@
+#include "draco_tile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "draco_decode.h"
+#include "mesh_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Container layout (native endianness):
+//   char magic[4] = "C3DT", uint32 version, uint32 num_tiles, uint32 reserved
+//   num_tiles x {float min[3], float max[3], uint64 offset, uint64 size}
+//   tile Draco streams
+constexpr char kMagic[4] = {'C', '3', 'D', 'T'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderSize = 16;
+constexpr size_t kEntrySize = 40;
+
+template <typename T>
+void WritePod(char* dst, size_t& pos, const T& value) {
+  std::memcpy(dst + pos, &value, sizeof(T));
+  pos += sizeof(T);
+}
+
+template <typename T>
+T ReadPod(const char* src, size_t& pos) {
+  T value;
+  std::memcpy(&value, src + pos, sizeof(T));
+  pos += sizeof(T);
+  return value;
+}
+
+// Grid cell of |p| in a grid of |grid_size|^3 cells over |box|.
+uint32_t CellId(const Eigen::AlignedBox3f& box, const Eigen::Vector3f& extent,
+                int grid_size, const Eigen::Vector3f& p) {
+  uint32_t id = 0;
+  for (int k = 2; k >= 0; k--) {
+    int c = static_cast<int>((p[k] - box.min()[k]) / extent[k] * grid_size);
+    c = std::max(0, std::min(grid_size - 1, c));
+    id = id * grid_size + c;
+  }
+  return id;
+}
+
+}  // namespace
+
+namespace draco_tile {
+
+TileEncodeOptions::TileEncodeOptions() : grid_size(4) {}
+
+bool DracoEncodeTiled(const std::vector<Eigen::Vector3f>& verts,
+                      const std::vector<Eigen::Vector2f>& uvs,
+                      const std::vector<Eigen::Vector3i>& indices,
+                      const std::vector<Eigen::Vector3i>& uv_indices,
+                      const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                      const std::vector<Eigen::Vector3f>& normals,
+                      const TileEncodeOptions& options,
+                      std::vector<char>& bytes) {
+  bytes.clear();
+  if (verts.empty() || options.grid_size < 1) {
+    return false;
+  }
+
+  const bool is_mesh = indices.size() > 0;
+
+  Eigen::AlignedBox3f box;
+  for (const auto& v : verts) {
+    box.extend(v);
+  }
+  const Eigen::Vector3f extent =
+      box.sizes().cwiseMax(Eigen::Vector3f::Constant(1e-6f));
+
+  // Assign faces, or points for point clouds, to grid cells
+  const int grid_size = options.grid_size;
+  const size_t num_cells =
+      static_cast<size_t>(grid_size) * grid_size * grid_size;
+  std::vector<std::vector<uint32_t>> cells(num_cells);
+  if (is_mesh) {
+    for (uint32_t i = 0; i < static_cast<uint32_t>(indices.size()); i++) {
+      const Eigen::Vector3f centroid =
+          (verts[indices[i][0]] + verts[indices[i][1]] + verts[indices[i][2]]) /
+          3.f;
+      cells[CellId(box, extent, grid_size, centroid)].push_back(i);
+    }
+  } else {
+    for (uint32_t i = 0; i < static_cast<uint32_t>(verts.size()); i++) {
+      cells[CellId(box, extent, grid_size, verts[i])].push_back(i);
+    }
+  }
+  cells.erase(std::remove_if(cells.begin(), cells.end(),
+                             [](const std::vector<uint32_t>& c) {
+                               return c.empty();
+                             }),
+              cells.end());
+
+  // Quantize all tiles on one grid so that vertices duplicated across tiles
+  // decode to the same position and seams stay closed
+  draco_encode::DracoEncodeOptions encode_options = options.encode_options;
+  if (encode_options.pos_quantization_range <= 0.f) {
+    encode_options.pos_quantization_origin = box.min();
+    encode_options.pos_quantization_range = box.sizes().maxCoeff();
+    if (encode_options.pos_quantization_range == 0.f) {
+      encode_options.pos_quantization_range = 1.f;
+    }
+  }
+
+  // Encode tiles in parallel
+  const size_t num_tiles = cells.size();
+  std::vector<std::vector<char>> streams(num_tiles);
+  std::vector<Eigen::AlignedBox3f> bounds(num_tiles);
+  std::vector<char> succeeded(num_tiles, 0);
+  std::vector<std::function<void()>> tasks;
+  for (size_t t = 0; t < num_tiles; t++) {
+    tasks.push_back([&, t]() {
+      mesh_util::MeshArrays tile;
+      if (is_mesh) {
+        mesh_util::GatherFaces(verts, uvs, indices, uv_indices, colors,
+                               normals, cells[t], tile);
+      } else {
+        mesh_util::GatherPoints(verts, uvs, colors, normals, cells[t], tile);
+      }
+      for (const auto& v : tile.verts) {
+        bounds[t].extend(v);
+      }
+      succeeded[t] = draco_encode::DracoEncode(
+          tile.verts, tile.uvs, tile.indices, tile.uv_indices, tile.colors,
+          tile.normals, encode_options, streams[t]);
+    });
+  }
+  parallel_util::ThreadPool::Current().Run(std::move(tasks));
+
+  for (size_t t = 0; t < num_tiles; t++) {
+    if (!succeeded[t]) {
+      printf("Failed to encode tile %zu.\n", t);
+      return false;
+    }
+  }
+
+  // Write the container
+  std::vector<TileInfo> tiles(num_tiles);
+  uint64_t offset = TileIndexSize(num_tiles);
+  for (size_t t = 0; t < num_tiles; t++) {
+    tiles[t].bounds = bounds[t];
+    tiles[t].offset = offset;
+    tiles[t].size = streams[t].size();
+    offset += streams[t].size();
+  }
+  bytes.resize(offset);
+  WriteTileIndex(tiles, bytes.data());
+  size_t pos = TileIndexSize(num_tiles);
+  for (const auto& stream : streams) {
+    std::memcpy(bytes.data() + pos, stream.data(), stream.size());
+    pos += stream.size();
+  }
+
+  return true;
+}
+
+size_t TileIndexSize(size_t num_tiles) {
+  return kHeaderSize + kEntrySize * num_tiles;
+}
+
+void WriteTileIndex(const std::vector<TileInfo>& tiles, char* dst) {
+  size_t pos = 0;
+  std::memcpy(dst, kMagic, sizeof(kMagic));
+  pos += sizeof(kMagic);
+  WritePod(dst, pos, kVersion);
+  WritePod(dst, pos, static_cast<uint32_t>(tiles.size()));
+  WritePod(dst, pos, uint32_t(0));
+  for (const auto& tile : tiles) {
+    for (int k = 0; k < 3; k++) {
+      WritePod(dst, pos, tile.bounds.min()[k]);
+    }
+    for (int k = 0; k < 3; k++) {
+      WritePod(dst, pos, tile.bounds.max()[k]);
+    }
+    WritePod(dst, pos, tile.offset);
+    WritePod(dst, pos, tile.size);
+  }
+}
+
+bool ReadTileIndex(const std::vector<char>& bytes,
+                   std::vector<TileInfo>& tiles) {
+  return ReadTileIndex(bytes.data(), bytes.size(), tiles);
+}
+
+bool ReadTileIndex(const char* data, size_t size,
+                   std::vector<TileInfo>& tiles) {
+  tiles.clear();
+  if (size < kHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+    printf("Error: Not a tiled container.\n");
+    return false;
+  }
+  size_t pos = sizeof(kMagic);
+  const uint32_t version = ReadPod<uint32_t>(data, pos);
+  const uint32_t num_tiles = ReadPod<uint32_t>(data, pos);
+  pos += sizeof(uint32_t);
+  if (version != kVersion) {
+    printf("Error: Unsupported tiled container version %u.\n", version);
+    return false;
+  }
+  if (size < kHeaderSize + kEntrySize * num_tiles) {
+    printf("Error: Truncated tile index.\n");
+    return false;
+  }
+
+  tiles.resize(num_tiles);
+  for (auto& tile : tiles) {
+    Eigen::Vector3f min, max;
+    for (int k = 0; k < 3; k++) {
+      min[k] = ReadPod<float>(data, pos);
+    }
+    for (int k = 0; k < 3; k++) {
+      max[k] = ReadPod<float>(data, pos);
+    }
+    tile.bounds = Eigen::AlignedBox3f(min, max);
+    tile.offset = ReadPod<uint64_t>(data, pos);
+    tile.size = ReadPod<uint64_t>(data, pos);
+    if (tile.offset > size || tile.size > size - tile.offset) {
+      printf("Error: Tile exceeds the container.\n");
+      tiles.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DracoDecodeTiled(
+    const std::vector<char>& bytes,
+    const std::function<bool(const Eigen::AlignedBox3f&)>& filter,
+    std::vector<Eigen::Vector3f>& verts, std::vector<Eigen::Vector2f>& uvs,
+    std::vector<Eigen::Vector3i>& indices,
+    std::vector<Eigen::Vector3i>& uv_indices,
+    std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+    std::vector<Eigen::Vector3f>& normals) {
+  return DracoDecodeTiled(bytes.data(), bytes.size(), filter, verts, uvs,
+                          indices, uv_indices, colors, normals);
+}
+
+bool DracoDecodeTiled(
+    const char* data, size_t size,
+    const std::function<bool(const Eigen::AlignedBox3f&)>& filter,
+    std::vector<Eigen::Vector3f>& verts, std::vector<Eigen::Vector2f>& uvs,
+    std::vector<Eigen::Vector3i>& indices,
+    std::vector<Eigen::Vector3i>& uv_indices,
+    std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+    std::vector<Eigen::Vector3f>& normals) {
+  verts.clear();
+  uvs.clear();
+  indices.clear();
+  uv_indices.clear();
+  colors.clear();
+  normals.clear();
+
+  std::vector<TileInfo> tiles;
+  if (!ReadTileIndex(data, size, tiles)) {
+    return false;
+  }
+  tiles.erase(std::remove_if(tiles.begin(), tiles.end(),
+                             [&](const TileInfo& tile) {
+                               return !filter(tile.bounds);
+                             }),
+              tiles.end());
+
+  // Decode selected tiles in parallel
+  std::vector<mesh_util::MeshArrays> decoded(tiles.size());
+  std::vector<char> succeeded(tiles.size(), 0);
+  std::vector<std::function<void()>> tasks;
+  for (size_t t = 0; t < tiles.size(); t++) {
+    tasks.push_back([&, t]() {
+      mesh_util::MeshArrays& tile = decoded[t];
+      succeeded[t] = draco_decode::DracoDecode(
+          data + tiles[t].offset, tiles[t].size, tile.verts, tile.uvs,
+          tile.indices, tile.uv_indices, tile.colors, tile.normals);
+    });
+  }
+  parallel_util::ThreadPool::Current().Run(std::move(tasks));
+
+  // Concatenate tiles, offsetting indices
+  mesh_util::MeshArrays merged;
+  for (size_t t = 0; t < tiles.size(); t++) {
+    if (!succeeded[t]) {
+      printf("Failed to decode tile %zu.\n", t);
+      return false;
+    }
+    mesh_util::Append(decoded[t], merged);
+  }
+  verts.swap(merged.verts);
+  uvs.swap(merged.uvs);
+  indices.swap(merged.indices);
+  uv_indices.swap(merged.uv_indices);
+  colors.swap(merged.colors);
+  normals.swap(merged.normals);
+
+  return true;
+}
+
+bool DracoDecodeTiled(const std::vector<char>& bytes,
+                      const Eigen::AlignedBox3f& query,
+                      std::vector<Eigen::Vector3f>& verts,
+                      std::vector<Eigen::Vector2f>& uvs,
+                      std::vector<Eigen::Vector3i>& indices,
+                      std::vector<Eigen::Vector3i>& uv_indices,
+                      std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                      std::vector<Eigen::Vector3f>& normals) {
+  return DracoDecodeTiled(bytes.data(), bytes.size(), query, verts, uvs,
+                          indices, uv_indices, colors, normals);
+}
+
+bool DracoDecodeTiled(const char* data, size_t size,
+                      const Eigen::AlignedBox3f& query,
+                      std::vector<Eigen::Vector3f>& verts,
+                      std::vector<Eigen::Vector2f>& uvs,
+                      std::vector<Eigen::Vector3i>& indices,
+                      std::vector<Eigen::Vector3i>& uv_indices,
+                      std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                      std::vector<Eigen::Vector3f>& normals) {
+  return DracoDecodeTiled(
+      data, size,
+      [&](const Eigen::AlignedBox3f& bounds) {
+        return query.intersects(bounds);
+      },
+      verts, uvs, indices, uv_indices, colors, normals);
+}
+
+bool IntersectsFrustum(const std::array<Eigen::Vector4f, 6>& planes,
+                       const Eigen::AlignedBox3f& box) {
+  for (const auto& plane : planes) {
+    // Corner of the box furthest along the plane normal
+    Eigen::Vector3f p;
+    for (int k = 0; k < 3; k++) {
+      p[k] = plane[k] >= 0.f ? box.max()[k] : box.min()[k];
+    }
+    if (plane.head<3>().dot(p) + plane[3] < 0.f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace draco_tile
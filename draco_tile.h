@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "draco_encode.h"
+
+namespace draco_tile {
+
+struct TileEncodeOptions {
+  TileEncodeOptions();
+  // Applied to every tile
+  draco_encode::DracoEncodeOptions encode_options;
+  // Number of grid cells along each axis of the bounding box
+  int grid_size;
+};
+
+// Entry of the tile index stored at the head of a tiled container.
+struct TileInfo {
+  // Bounds of the tile content
+  Eigen::AlignedBox3f bounds;
+  // Location of the tile's Draco stream in the container
+  uint64_t offset = 0;
+  uint64_t size = 0;
+};
+
+// Splits the input into grid tiles, encodes them in parallel with
+// DracoEncode on parallel_util::ThreadPool::Current(), so on the caller's
+// pool when called from a pool task, and writes a container with a tile
+// index. Faces go to the
+// tile of their centroid; vertices shared across tiles are duplicated.
+// Unless |options| sets a quantization range, all tiles are quantized on a
+// grid over the whole bounding box so that shared vertices match exactly.
+bool DracoEncodeTiled(const std::vector<Eigen::Vector3f>& verts,
+                      const std::vector<Eigen::Vector2f>& uvs,
+                      const std::vector<Eigen::Vector3i>& indices,
+                      const std::vector<Eigen::Vector3i>& uv_indices,
+                      const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                      const std::vector<Eigen::Vector3f>& normals,
+                      const TileEncodeOptions& options,
+                      std::vector<char>& bytes);
+
+// Size of the container header and index of |num_tiles| tiles. Tile streams
+// follow them.
+size_t TileIndexSize(size_t num_tiles);
+
+// Writes the header and index of |tiles| to TileIndexSize(tiles.size())
+// bytes at |dst|. For writing containers tile by tile, e.g. to a file.
+void WriteTileIndex(const std::vector<TileInfo>& tiles, char* dst);
+
+// Reads the tile index without decoding any tile.
+bool ReadTileIndex(const std::vector<char>& bytes,
+                   std::vector<TileInfo>& tiles);
+
+// Reads the index of the container of |size| bytes at |data|, e.g. a mapped
+// file.
+bool ReadTileIndex(const char* data, size_t size,
+                   std::vector<TileInfo>& tiles);
+
+// Decodes in parallel, on ThreadPool::Current(), the tiles whose bounds pass
+// |filter| and concatenates them. Indices are offset so that they refer to
+// the concatenated arrays.
+bool DracoDecodeTiled(
+    const std::vector<char>& bytes,
+    const std::function<bool(const Eigen::AlignedBox3f&)>& filter,
+    std::vector<Eigen::Vector3f>& verts, std::vector<Eigen::Vector2f>& uvs,
+    std::vector<Eigen::Vector3i>& indices,
+    std::vector<Eigen::Vector3i>& uv_indices,
+    std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+    std::vector<Eigen::Vector3f>& normals);
+
+// Decodes tiles of the container of |size| bytes at |data| in place. The
+// container is read directly and is not copied.
+bool DracoDecodeTiled(
+    const char* data, size_t size,
+    const std::function<bool(const Eigen::AlignedBox3f&)>& filter,
+    std::vector<Eigen::Vector3f>& verts, std::vector<Eigen::Vector2f>& uvs,
+    std::vector<Eigen::Vector3i>& indices,
+    std::vector<Eigen::Vector3i>& uv_indices,
+    std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+    std::vector<Eigen::Vector3f>& normals);
+
+// Decodes the tiles intersecting |query|.
+bool DracoDecodeTiled(const std::vector<char>& bytes,
+                      const Eigen::AlignedBox3f& query,
+                      std::vector<Eigen::Vector3f>& verts,
+                      std::vector<Eigen::Vector2f>& uvs,
+                      std::vector<Eigen::Vector3i>& indices,
+                      std::vector<Eigen::Vector3i>& uv_indices,
+                      std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                      std::vector<Eigen::Vector3f>& normals);
+bool DracoDecodeTiled(const char* data, size_t size,
+                      const Eigen::AlignedBox3f& query,
+                      std::vector<Eigen::Vector3f>& verts,
+                      std::vector<Eigen::Vector2f>& uvs,
+                      std::vector<Eigen::Vector3i>& indices,
+                      std::vector<Eigen::Vector3i>& uv_indices,
+                      std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                      std::vector<Eigen::Vector3f>& normals);
+
+// True if |box| is at least partially on the positive side of all |planes|
+// (a, b, c, d) with ax + by + cz + d >= 0 inside. Use as a frustum filter.
+bool IntersectsFrustum(const std::array<Eigen::Vector4f, 6>& planes,
+                       const Eigen::AlignedBox3f& box);
+
+}  // namespace draco_tile
@@ -0,0 +1,90 @@
+#include "draco_trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#include "file_util.h"
+
+namespace draco_trace {
+
+Trace::Trace() : epoch_(std::chrono::steady_clock::now()) {}
+
+void Trace::Add(const char* name, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::time_point end, uint64_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  TraceEvent event;
+  event.name = name;
+  event.start_us =
+      std::chrono::duration<double, std::micro>(start - epoch_).count();
+  event.duration_us =
+      std::chrono::duration<double, std::micro>(end - start).count();
+  event.bytes = bytes;
+  event.thread_id = ThreadId();
+  events_.push_back(event);
+}
+
+void Trace::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  epoch_ = std::chrono::steady_clock::now();
+  events_.clear();
+  threads_.clear();
+}
+
+std::vector<TraceEvent> Trace::events() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return events_;
+}
+
+std::vector<StageStats> Trace::Summarize() const {
+  std::vector<StageStats> stats;
+  for (const auto& event : events()) {
+    auto it = std::find_if(
+        stats.begin(), stats.end(),
+        [&](const StageStats& s) { return s.name == event.name; });
+    if (it == stats.end()) {
+      stats.emplace_back();
+      stats.back().name = event.name;
+      it = stats.end() - 1;
+    }
+    const double ms = event.duration_us / 1000.0;
+    it->count++;
+    it->total_ms += ms;
+    it->max_ms = std::max(it->max_ms, ms);
+    it->bytes += event.bytes;
+  }
+  return stats;
+}
+
+std::string Trace::ToChromeTrace() const {
+  std::ostringstream os;
+  os << "{\"traceEvents\": [\n";
+  const std::vector<TraceEvent> all = events();
+  for (size_t i = 0; i < all.size(); i++) {
+    const TraceEvent& e = all[i];
+    os << "  {\"name\": \"" << e.name << "\", \"cat\": \"compress_3d\", "
+       << "\"ph\": \"X\", \"ts\": " << e.start_us
+       << ", \"dur\": " << e.duration_us << ", \"pid\": 1, \"tid\": "
+       << e.thread_id << ", \"args\": {\"bytes\": " << e.bytes << "}}"
+       << (i + 1 < all.size() ? "," : "") << "\n";
+  }
+  os << "], \"displayTimeUnit\": \"ms\"}\n";
+  return os.str();
+}
+
+bool Trace::WriteChromeTrace(const std::string& path) const {
+  const std::string json = ToChromeTrace();
+  return file_util::WriteFile(path, json.data(), json.size());
+}
+
+uint32_t Trace::ThreadId() {
+  const std::thread::id id = std::this_thread::get_id();
+  auto it = std::find(threads_.begin(), threads_.end(), id);
+  if (it == threads_.end()) {
+    threads_.push_back(id);
+    return static_cast<uint32_t>(threads_.size());
+  }
+  return static_cast<uint32_t>(it - threads_.begin()) + 1;
+}
+
+}  // namespace draco_trace
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace draco_trace {
+
+// One timed stage.
+struct TraceEvent {
+  // Stage name. Must be a string literal or otherwise outlive the trace.
+  const char* name = nullptr;
+  // Microseconds since the trace was created or cleared
+  double start_us = 0.0;
+  double duration_us = 0.0;
+  // Bytes allocated or written by the stage, 0 if not applicable
+  uint64_t bytes = 0;
+  // Small sequential id of the thread that ran the stage
+  uint32_t thread_id = 0;
+};
+
+// Totals of the events sharing a name.
+struct StageStats {
+  std::string name;
+  uint32_t count = 0;
+  double total_ms = 0.0;
+  double max_ms = 0.0;
+  uint64_t bytes = 0;
+};
+
+// Collects stage events from DracoEncode (DracoEncodeOptions::trace) and
+// DracoDecode. Safe to share between threads.
+class Trace {
+ public:
+  Trace();
+
+  void Add(const char* name, std::chrono::steady_clock::time_point start,
+           std::chrono::steady_clock::time_point end, uint64_t bytes);
+  void Clear();
+
+  std::vector<TraceEvent> events() const;
+
+  // Per stage totals in order of first appearance.
+  std::vector<StageStats> Summarize() const;
+
+  // Chrome trace event JSON, for chrome://tracing or Perfetto.
+  std::string ToChromeTrace() const;
+  bool WriteChromeTrace(const std::string& path) const;
+
+ private:
+  uint32_t ThreadId();
+
+  mutable std::mutex mutex_;
+  std::chrono::steady_clock::time_point epoch_;
+  std::vector<TraceEvent> events_;
+  std::vector<std::thread::id> threads_;
+};
+
+// Records the lifetime of a scope as an event of |trace|. Does nothing, not
+// even reading the clock, if |trace| is null. Defining
+// COMPRESS_3D_DISABLE_TRACE compiles all scoped events out.
+class ScopedEvent {
+ public:
+  ScopedEvent(const ScopedEvent&) = delete;
+  ScopedEvent& operator=(const ScopedEvent&) = delete;
+#ifdef COMPRESS_3D_DISABLE_TRACE
+  ScopedEvent(Trace*, const char*) {}
+  void set_bytes(uint64_t) {}
+#else
+  ScopedEvent(Trace* trace, const char* name)
+      : trace_(trace), name_(name), bytes_(0) {
+    if (trace_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~ScopedEvent() {
+    if (trace_ != nullptr) {
+      trace_->Add(name_, start_, std::chrono::steady_clock::now(), bytes_);
+    }
+  }
+  void set_bytes(uint64_t bytes) { bytes_ = bytes; }
+
+ private:
+  Trace* trace_;
+  const char* name_;
+  uint64_t bytes_;
+  std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+}  // namespace draco_trace
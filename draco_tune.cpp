@@ -0,0 +1,390 @@
+#include "draco_tune.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "parallel_util.h"
+#include "thread_pool.h"
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+struct ErrorStats {
+  double max2 = 0.0;
+  double sum2 = 0.0;
+};
+
+// Reduces the squared errors sq_error(i) for i in [0, n) in parallel blocks.
+template <typename Func>
+float ReduceError(size_t n, draco_tune::ErrorMetric metric, Func sq_error) {
+  if (n == 0) {
+    return 0.f;
+  }
+  constexpr size_t kBlockSize = 4096;
+  const size_t num_blocks = (n + kBlockSize - 1) / kBlockSize;
+  std::vector<ErrorStats> partial(num_blocks);
+  parallel_util::ParallelFor(
+      0, num_blocks,
+      [&](size_t b) {
+        ErrorStats& stats = partial[b];
+        const size_t end = std::min(n, (b + 1) * kBlockSize);
+        for (size_t i = b * kBlockSize; i < end; i++) {
+          const double e2 = sq_error(i);
+          stats.max2 = std::max(stats.max2, e2);
+          stats.sum2 += e2;
+        }
+      },
+      16);
+
+  ErrorStats total;
+  for (const auto& stats : partial) {
+    total.max2 = std::max(total.max2, stats.max2);
+    total.sum2 += stats.sum2;
+  }
+  if (metric == draco_tune::ErrorMetric::kMax) {
+    return static_cast<float>(std::sqrt(total.max2));
+  }
+  return static_cast<float>(std::sqrt(total.sum2 / n));
+}
+
+// Bounds as computed by Draco's AttributeQuantizationTransform: per
+// component minimum and a single range, the largest extent.
+template <int N>
+struct QuantizationBounds {
+  Eigen::Matrix<float, N, 1> min;
+  float range = 1.f;
+};
+
+template <int N>
+QuantizationBounds<N> ComputeBounds(
+    const std::vector<Eigen::Matrix<float, N, 1>>& values) {
+  QuantizationBounds<N> bounds;
+  Eigen::Matrix<float, N, 1> max;
+  bounds.min = values[0];
+  max = values[0];
+  for (const auto& v : values) {
+    bounds.min = bounds.min.cwiseMin(v);
+    max = max.cwiseMax(v);
+  }
+  bounds.range = (max - bounds.min).maxCoeff();
+  if (bounds.range == 0.f) {
+    bounds.range = 1.f;
+  }
+  return bounds;
+}
+
+// Error of quantizing |values| to |bits| the way Draco does.
+template <int N>
+float QuantizationError(const std::vector<Eigen::Matrix<float, N, 1>>& values,
+                        const QuantizationBounds<N>& bounds, int bits,
+                        draco_tune::ErrorMetric metric) {
+  const float max_quantized = static_cast<float>((1u << bits) - 1);
+  const float inverse_delta = max_quantized / bounds.range;
+  const float delta = bounds.range / max_quantized;
+  return ReduceError(values.size(), metric, [&](size_t i) {
+    double e2 = 0.0;
+    for (int k = 0; k < N; k++) {
+      const float q =
+          std::floor((values[i][k] - bounds.min[k]) * inverse_delta + 0.5f);
+      const double d = q * delta + bounds.min[k] - values[i][k];
+      e2 += d * d;
+    }
+    return e2;
+  });
+}
+
+float SignNotZero(float v) { return v < 0.f ? -1.f : 1.f; }
+
+// Octahedral mapping used by Draco for normals.
+Eigen::Vector2f OctahedronEncode(const Eigen::Vector3f& n) {
+  const Eigen::Vector3f p = n / n.cwiseAbs().sum();
+  if (p[2] >= 0.f) {
+    return Eigen::Vector2f(p[0], p[1]);
+  }
+  return Eigen::Vector2f((1.f - std::abs(p[1])) * SignNotZero(p[0]),
+                         (1.f - std::abs(p[0])) * SignNotZero(p[1]));
+}
+
+Eigen::Vector3f OctahedronDecode(const Eigen::Vector2f& p) {
+  Eigen::Vector3f n(p[0], p[1], 1.f - std::abs(p[0]) - std::abs(p[1]));
+  if (n[2] < 0.f) {
+    n[0] = (1.f - std::abs(p[1])) * SignNotZero(p[0]);
+    n[1] = (1.f - std::abs(p[0])) * SignNotZero(p[1]);
+  }
+  return n.normalized();
+}
+
+// Angular error in degrees of octahedral quantization to |bits|. Close to,
+// but not bit exact with, Draco's integer implementation.
+float NormalError(const std::vector<Eigen::Vector3f>& normals, int bits,
+                  draco_tune::ErrorMetric metric) {
+  const float max_quantized = static_cast<float>((1u << bits) - 1);
+  return ReduceError(normals.size(), metric, [&](size_t i) {
+    const float norm = normals[i].norm();
+    if (norm == 0.f) {
+      return 0.0;
+    }
+    const Eigen::Vector3f n = normals[i] / norm;
+    Eigen::Vector2f p = OctahedronEncode(n);
+    for (int k = 0; k < 2; k++) {
+      const float q = std::floor((p[k] + 1.f) * 0.5f * max_quantized + 0.5f);
+      p[k] = q / max_quantized * 2.f - 1.f;
+    }
+    const float cos_angle =
+        std::max(-1.f, std::min(1.f, n.dot(OctahedronDecode(p))));
+    const double deg = std::acos(cos_angle) * 180.0 / kPi;
+    return deg * deg;
+  });
+}
+
+// Binary search for the fewest bits in [min_bits, max_bits] with
+// error(bits) <= target, assuming the error does not grow with bits.
+// Returns max_bits and sets |met| to false if even that is not enough.
+int FewestBits(int min_bits, int max_bits, float target,
+               const std::function<float(int)>& error, bool& met) {
+  met = error(max_bits) <= target;
+  if (!met) {
+    return max_bits;
+  }
+  int lo = min_bits;
+  int hi = max_bits;
+  while (lo < hi) {
+    const int mid = (lo + hi) / 2;
+    if (error(mid) <= target) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+struct Trial {
+  draco_encode::DracoEncodeOptions options;
+  std::vector<char> bytes;
+  bool succeeded = false;
+};
+
+}  // namespace
+
+namespace draco_tune {
+
+TuneOptions::TuneOptions()
+    : metric(ErrorMetric::kMax),
+      max_position_error(0.f),
+      max_uv_error(0.f),
+      max_normal_error_deg(0.f),
+      max_bytes(0),
+      min_bits(4),
+      max_bits(20),
+      compression_levels({5, 7, 10}) {}
+
+bool DracoTune(const std::vector<Eigen::Vector3f>& verts,
+               const std::vector<Eigen::Vector2f>& uvs,
+               const std::vector<Eigen::Vector3i>& indices,
+               const std::vector<Eigen::Vector3i>& uv_indices,
+               const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+               const std::vector<Eigen::Vector3f>& normals,
+               const TuneOptions& options, TuneResult& result,
+               std::vector<char>* bytes) {
+  result = TuneResult();
+  if (verts.empty() || options.min_bits < 1 || options.max_bits > 30 ||
+      options.min_bits > options.max_bits ||
+      options.compression_levels.empty()) {
+    printf("Error: Invalid tune input.\n");
+    return false;
+  }
+
+  const draco_encode::DracoEncodeOptions& base = options.encode_options;
+  // Same conditions as DracoEncode for writing the attributes
+  const bool with_uvs = uvs.size() > 0 &&
+                        uv_indices.size() == indices.size() &&
+                        base.tex_coords_quantization_bits >= 0;
+  const bool with_normals =
+      normals.size() == verts.size() && base.normals_quantization_bits >= 0;
+
+  QuantizationBounds<3> pos_bounds = ComputeBounds(verts);
+  if (base.pos_quantization_range > 0.f) {
+    pos_bounds.min = base.pos_quantization_origin;
+    pos_bounds.range = base.pos_quantization_range;
+  }
+  Eigen::AlignedBox3f box;
+  for (const auto& v : verts) {
+    box.extend(v);
+  }
+  const float diagonal = std::max(box.diagonal().norm(), 1e-12f);
+  QuantizationBounds<2> uv_bounds;
+  if (with_uvs) {
+    uv_bounds = ComputeBounds(uvs);
+  }
+
+  auto position_error = [&](int bits) {
+    return QuantizationError(verts, pos_bounds, bits, options.metric) /
+           diagonal;
+  };
+  auto uv_error = [&](int bits) {
+    return with_uvs ? QuantizationError(uvs, uv_bounds, bits, options.metric)
+                    : 0.f;
+  };
+  auto normal_error = [&](int bits) {
+    return with_normals ? NormalError(normals, bits, options.metric) : 0.f;
+  };
+
+  // Fewest bits meeting each error target, without encoding
+  draco_encode::DracoEncodeOptions tuned = base;
+  bool met = true;
+  bool attribute_met = true;
+  const bool pos_target = options.max_position_error > 0.f;
+  if (pos_target) {
+    tuned.pos_quantization_bits =
+        FewestBits(options.min_bits, options.max_bits,
+                   options.max_position_error, position_error, attribute_met);
+    met = met && attribute_met;
+  }
+  if (with_uvs && options.max_uv_error > 0.f) {
+    tuned.tex_coords_quantization_bits =
+        FewestBits(options.min_bits, options.max_bits, options.max_uv_error,
+                   uv_error, attribute_met);
+    met = met && attribute_met;
+  }
+  if (with_normals && options.max_normal_error_deg > 0.f) {
+    tuned.normals_quantization_bits =
+        FewestBits(options.min_bits, options.max_bits,
+                   options.max_normal_error_deg, normal_error, attribute_met);
+    met = met && attribute_met;
+  }
+
+  // Encodes all |trials| in parallel, on the caller's pool when called from
+  // a pool task
+  parallel_util::ThreadPool& pool = parallel_util::ThreadPool::Current();
+  auto run_trials = [&](std::vector<Trial>& trials) {
+    std::vector<std::function<void()>> tasks;
+    for (auto& trial : trials) {
+      tasks.push_back([&]() {
+        trial.succeeded = draco_encode::DracoEncode(
+            verts, uvs, indices, uv_indices, colors, normals, trial.options,
+            trial.bytes);
+      });
+    }
+    pool.Run(std::move(tasks));
+    result.num_trial_encodes += static_cast<int>(trials.size());
+  };
+
+  // Smallest stream among |trials|, or nullptr if all failed
+  auto smallest = [](std::vector<Trial>& trials) {
+    Trial* best = nullptr;
+    for (auto& trial : trials) {
+      if (trial.succeeded &&
+          (best == nullptr || trial.bytes.size() < best->bytes.size())) {
+        best = &trial;
+      }
+    }
+    return best;
+  };
+
+  const size_t num_levels = options.compression_levels.size();
+  auto make_trials = [&](const std::vector<int>& pos_bits) {
+    std::vector<Trial> trials;
+    for (int bits : pos_bits) {
+      for (int level : options.compression_levels) {
+        Trial trial;
+        trial.options = tuned;
+        trial.options.pos_quantization_bits = bits;
+        trial.options.compression_level = level;
+        trials.push_back(std::move(trial));
+      }
+    }
+    return trials;
+  };
+
+  Trial chosen;
+  if (options.max_bytes > 0 && !pos_target) {
+    // Most accurate positions that fit. Size grows with bits, so narrow the
+    // range with several probes per round, each encoded at every level.
+    const size_t probes_per_round =
+        std::max<size_t>(1, pool.num_threads() / num_levels);
+    int lo = options.min_bits;
+    int hi = options.max_bits;
+    bool found = false;
+    Trial closest;
+    while (lo <= hi) {
+      const int n = hi - lo + 1;
+      const int k = static_cast<int>(
+          std::min<size_t>(probes_per_round, static_cast<size_t>(n)));
+      std::vector<int> probes;
+      for (int i = 0; i < k; i++) {
+        probes.push_back(lo + (2 * i + 1) * n / (2 * k));
+      }
+      std::vector<Trial> trials = make_trials(probes);
+      run_trials(trials);
+
+      int fit = -1;
+      int no_fit = -1;
+      for (int i = 0; i < k; i++) {
+        std::vector<Trial> level_trials(
+            std::make_move_iterator(trials.begin() + i * num_levels),
+            std::make_move_iterator(trials.begin() + (i + 1) * num_levels));
+        Trial* best = smallest(level_trials);
+        if (best == nullptr) {
+          printf("Error: Trial encode failed.\n");
+          return false;
+        }
+        if (best->bytes.size() <= options.max_bytes) {
+          fit = i;
+          chosen = std::move(*best);
+        } else {
+          if (no_fit < 0) {
+            no_fit = i;
+          }
+          if (closest.bytes.empty() ||
+              best->bytes.size() < closest.bytes.size()) {
+            closest = std::move(*best);
+          }
+        }
+      }
+      if (fit >= 0) {
+        found = true;
+        lo = probes[fit] + 1;
+      }
+      if (no_fit >= 0) {
+        hi = probes[no_fit] - 1;
+      }
+    }
+    if (!found) {
+      chosen = std::move(closest);
+      met = false;
+    }
+  } else {
+    std::vector<Trial> trials = make_trials({tuned.pos_quantization_bits});
+    run_trials(trials);
+    Trial* best = smallest(trials);
+    if (best == nullptr) {
+      printf("Error: Trial encode failed.\n");
+      return false;
+    }
+    chosen = std::move(*best);
+    if (options.max_bytes > 0 && chosen.bytes.size() > options.max_bytes) {
+      met = false;
+    }
+  }
+
+  result.options = chosen.options;
+  result.size = chosen.bytes.size();
+  result.position_error = position_error(chosen.options.pos_quantization_bits);
+  if (with_uvs) {
+    result.uv_error = uv_error(chosen.options.tex_coords_quantization_bits);
+  }
+  if (with_normals) {
+    result.normal_error_deg =
+        normal_error(chosen.options.normals_quantization_bits);
+  }
+  result.met_target = met;
+  if (bytes != nullptr) {
+    bytes->swap(chosen.bytes);
+  }
+  return true;
+}
+
+}  // namespace draco_tune
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "draco_encode.h"
+
+namespace draco_tune {
+
+enum class ErrorMetric {
+  // Largest displacement of a value. For meshes this bounds the Hausdorff
+  // distance between the input and decoded surfaces.
+  kMax,
+  // Root mean square displacement
+  kRms,
+};
+
+struct TuneOptions {
+  TuneOptions();
+  // Starting point. Quantization bits without a target below and the
+  // deleted flags are kept as is.
+  draco_encode::DracoEncodeOptions encode_options;
+  ErrorMetric metric;
+  // Position error relative to the bounding box diagonal. <= 0 disables.
+  float max_position_error;
+  // Texture coordinate error in uv units. <= 0 disables.
+  float max_uv_error;
+  // Normal error in degrees. <= 0 disables.
+  float max_normal_error_deg;
+  // Stream size budget. 0 disables. Without a position error target the
+  // most accurate positions that fit are searched for.
+  size_t max_bytes;
+  // Range of quantization bits searched
+  int min_bits;
+  int max_bits;
+  // Candidate compression levels, encoded in parallel. The smallest stream
+  // wins.
+  std::vector<int> compression_levels;
+};
+
+struct TuneResult {
+  draco_encode::DracoEncodeOptions options;
+  // Size of the stream encoded with |options|
+  size_t size = 0;
+  // Errors of |options| in the units and metric of the targets
+  float position_error = 0.f;
+  float uv_error = 0.f;
+  float normal_error_deg = 0.f;
+  // False if no options in the searched range meet all targets. |options|
+  // are then the closest found.
+  bool met_target = false;
+  int num_trial_encodes = 0;
+};
+
+// Searches for the cheapest options meeting the targets.
+//
+// Quantization error does not depend on the encoder, so the fewest bits
+// meeting each error target are found by simulating Draco's quantization
+// with a parallel error kernel, without encoding. Only stream sizes need
+// trial encodes, which run in parallel on ThreadPool::Current(), so on an
+// ingest pool when called from one, with as many probes as that pool has
+// threads. If |bytes| is given, it receives the stream of
+// the returned options.
+bool DracoTune(const std::vector<Eigen::Vector3f>& verts,
+               const std::vector<Eigen::Vector2f>& uvs,
+               const std::vector<Eigen::Vector3i>& indices,
+               const std::vector<Eigen::Vector3i>& uv_indices,
+               const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+               const std::vector<Eigen::Vector3f>& normals,
+               const TuneOptions& options, TuneResult& result,
+               std::vector<char>* bytes = nullptr);
+
+}  // namespace draco_tune
@@ -0,0 +1,468 @@
+#include "draco_typed.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "draco/compression/decode.h"
+#include "draco/compression/expert_encode.h"
+#include "draco/mesh/mesh.h"
+#include "draco_metadata_keys.h"
+#include "draco_trace.h"
+#include "mesh_util.h"
+#include "parallel_util.h"
+
+namespace {
+
+using draco_typed::AttributeSource;
+using draco_typed::ComponentType;
+using draco_typed::Semantic;
+
+// Values converted per call of an attribute's write or read function. Large
+// attributes are converted in parallel, one chunk per task.
+constexpr size_t kChunkSize = 4096;
+
+template <typename Func>
+void ForEachChunk(size_t num_values, Func func) {
+  const size_t num_chunks = (num_values + kChunkSize - 1) / kChunkSize;
+  parallel_util::ParallelFor(
+      0, num_chunks,
+      [&](size_t c) {
+        const size_t begin = c * kChunkSize;
+        func(begin, std::min(num_values, begin + kChunkSize));
+      },
+      (1 << 16) / kChunkSize);
+}
+
+draco::GeometryAttribute::Type ToAttributeType(Semantic semantic) {
+  switch (semantic) {
+    case Semantic::kPosition:
+      return draco::GeometryAttribute::POSITION;
+    case Semantic::kTexCoord:
+      return draco::GeometryAttribute::TEX_COORD;
+    case Semantic::kColor:
+      return draco::GeometryAttribute::COLOR;
+    case Semantic::kNormal:
+      return draco::GeometryAttribute::NORMAL;
+    default:
+      return draco::GeometryAttribute::GENERIC;
+  }
+}
+
+draco::DataType ToDataType(ComponentType type) {
+  switch (type) {
+    case ComponentType::kInt8:
+      return draco::DT_INT8;
+    case ComponentType::kUint8:
+      return draco::DT_UINT8;
+    case ComponentType::kInt16:
+      return draco::DT_INT16;
+    case ComponentType::kUint16:
+      return draco::DT_UINT16;
+    case ComponentType::kInt32:
+      return draco::DT_INT32;
+    case ComponentType::kUint32:
+      return draco::DT_UINT32;
+    case ComponentType::kFloat32:
+      return draco::DT_FLOAT32;
+    case ComponentType::kFloat64:
+      return draco::DT_FLOAT64;
+  }
+  return draco::DT_INVALID;
+}
+
+bool ToComponentType(draco::DataType data_type, ComponentType& type) {
+  switch (data_type) {
+    case draco::DT_INT8:
+      type = ComponentType::kInt8;
+      return true;
+    case draco::DT_UINT8:
+      type = ComponentType::kUint8;
+      return true;
+    case draco::DT_INT16:
+      type = ComponentType::kInt16;
+      return true;
+    case draco::DT_UINT16:
+      type = ComponentType::kUint16;
+      return true;
+    case draco::DT_INT32:
+      type = ComponentType::kInt32;
+      return true;
+    case draco::DT_UINT32:
+      type = ComponentType::kUint32;
+      return true;
+    case draco::DT_FLOAT32:
+      type = ComponentType::kFloat32;
+      return true;
+    case draco::DT_FLOAT64:
+      type = ComponentType::kFloat64;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Quantization bits of |source| after applying the defaults of |options|.
+int QuantizationBits(const AttributeSource& source,
+                     const draco_encode::DracoEncodeOptions& options) {
+  if (source.quantization_bits >= 0) {
+    return source.quantization_bits;
+  }
+  switch (source.semantic) {
+    case Semantic::kPosition:
+      return options.pos_quantization_bits;
+    case Semantic::kTexCoord:
+      return options.tex_coords_quantization_bits;
+    case Semantic::kNormal:
+      return options.normals_quantization_bits;
+    default:
+      return 0;
+  }
+}
+
+// Assigns a point to every face corner. Each group is a distinct per corner
+// index array, the position indices first, and |point_values| receives the
+// value index of every point per group. With |dedup|, corners with equal
+// indices in all groups share a point: every pass of |table| merges one
+// more group into the running point ids, so any number of groups costs one
+// 64 bit key per corner and pass.
+void MakePoints(const std::vector<const std::vector<Eigen::Vector3i>*>& groups,
+                bool dedup, mesh_util::WedgeTable& table,
+                std::vector<uint32_t>& corner_to_point,
+                std::vector<std::vector<uint32_t>>& point_values) {
+  const std::vector<Eigen::Vector3i>& indices = *groups[0];
+  const size_t num_corners = indices.size() * 3;
+  auto corner_index = [&](size_t g, size_t c) {
+    return static_cast<uint32_t>((*groups[g])[c / 3][c % 3]);
+  };
+
+  point_values.resize(groups.size());
+  if (!dedup) {
+    corner_to_point.resize(num_corners);
+    for (size_t g = 0; g < groups.size(); ++g) {
+      point_values[g].resize(num_corners);
+    }
+    parallel_util::ParallelFor(0, num_corners, [&](size_t c) {
+      corner_to_point[c] = static_cast<uint32_t>(c);
+      for (size_t g = 0; g < groups.size(); ++g) {
+        point_values[g][c] = corner_index(g, c);
+      }
+    });
+    return;
+  }
+
+  corner_to_point.resize(num_corners);
+  for (size_t c = 0; c < num_corners; ++c) {
+    corner_to_point[c] = corner_index(0, c);
+  }
+  // One pass per additional group, and one to number the points densely if
+  // there is none
+  const size_t num_passes = std::max<size_t>(groups.size() - 1, 1);
+  std::vector<std::vector<uint32_t>> parents(num_passes);
+  std::vector<std::vector<uint32_t>> values(num_passes);
+  for (size_t pass = 0; pass < num_passes; ++pass) {
+    const bool with_group = pass + 1 < groups.size();
+    table.Reset(num_corners);
+    for (size_t c = 0; c < num_corners; ++c) {
+      const uint32_t value = with_group ? corner_index(pass + 1, c) : 0u;
+      const uint64_t key =
+          (static_cast<uint64_t>(corner_to_point[c]) << 32) | value;
+      const uint32_t next = static_cast<uint32_t>(parents[pass].size());
+      const uint32_t point = table.FindOrInsert(key, next);
+      if (point == next) {
+        parents[pass].push_back(corner_to_point[c]);
+        values[pass].push_back(value);
+      }
+      corner_to_point[c] = point;
+    }
+  }
+
+  // Walk the passes back to recover the value indices of every point
+  const size_t num_points = parents.back().size();
+  for (auto& v : point_values) {
+    v.resize(num_points);
+  }
+  parallel_util::ParallelFor(0, num_points, [&](size_t p) {
+    uint32_t id = static_cast<uint32_t>(p);
+    for (size_t pass = num_passes; pass-- > 0;) {
+      if (pass + 1 < groups.size()) {
+        point_values[pass + 1][p] = values[pass][id];
+      }
+      id = parents[pass][id];
+    }
+    point_values[0][p] = id;
+  });
+}
+
+// Adds |source| to |mesh| and converts its values straight into the
+// attribute buffer.
+int AddAttribute(const AttributeSource& source, bool identity_mapping,
+                 draco::Mesh* mesh) {
+  const draco::DataType data_type = ToDataType(source.type);
+  const int64_t value_size =
+      draco::DataTypeLength(data_type) * source.num_components;
+  draco::GeometryAttribute att;
+  att.Init(ToAttributeType(source.semantic), nullptr,
+           static_cast<uint8_t>(source.num_components), data_type,
+           source.normalized, value_size, 0);
+  const int att_id = mesh->AddAttribute(
+      att, identity_mapping, static_cast<uint32_t>(source.num_values));
+  if (source.num_values == 0) {
+    return att_id;
+  }
+  uint8_t* out =
+      mesh->attribute(att_id)->GetAddress(draco::AttributeValueIndex(0));
+  ForEachChunk(source.num_values, [&](size_t begin, size_t end) {
+    source.write(source.values, begin, end, out + begin * value_size);
+  });
+  return att_id;
+}
+
+}  // namespace
+
+namespace draco_typed {
+
+bool DracoEncode(const std::vector<AttributeSource>& attributes,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const draco_encode::DracoEncodeOptions& options,
+                 std::vector<char>& bytes) {
+  // Attributes which would be deleted by the options are never added
+  std::vector<const AttributeSource*> sources;
+  const AttributeSource* position = nullptr;
+  for (const auto& source : attributes) {
+    if ((source.semantic == Semantic::kTexCoord &&
+         options.tex_coords_quantization_bits < 0) ||
+        (source.semantic == Semantic::kNormal &&
+         options.normals_quantization_bits < 0)) {
+      continue;
+    }
+    if (source.semantic == Semantic::kPosition) {
+      if (position != nullptr) {
+        printf("Error: Only one position attribute is allowed.\n");
+        return false;
+      }
+      position = &source;
+    }
+    sources.push_back(&source);
+  }
+  if (position == nullptr || options.pos_quantization_bits < 0) {
+    printf("Error: Position attribute cannot be skipped.\n");
+    return false;
+  }
+
+  const bool is_mesh = !indices.empty();
+  for (const AttributeSource* source : sources) {
+    const bool valid =
+        source->write != nullptr && source->num_components > 0 &&
+        source->num_components <= 255 &&
+        (source->indices == nullptr
+             ? source->num_values == position->num_values
+             : is_mesh && source->indices->size() == indices.size());
+    if (!valid) {
+      printf("Error: Invalid attribute.\n");
+      return false;
+    }
+  }
+
+  std::unique_ptr<draco::Mesh> mesh(new draco::Mesh());
+  std::vector<int> att_ids(sources.size());
+  {
+    draco_trace::ScopedEvent event(options.trace, "make_mesh");
+
+    // Distinct corner index arrays, positions first
+    std::vector<const std::vector<Eigen::Vector3i>*> groups = {&indices};
+    std::vector<size_t> source_group(sources.size(), 0);
+    for (size_t i = 0; i < sources.size(); ++i) {
+      if (sources[i]->indices == nullptr) {
+        continue;
+      }
+      auto it = std::find(groups.begin(), groups.end(), sources[i]->indices);
+      source_group[i] = it - groups.begin();
+      if (it == groups.end()) {
+        groups.push_back(sources[i]->indices);
+      }
+    }
+
+    std::vector<uint32_t> corner_to_point;
+    std::vector<std::vector<uint32_t>> point_values;
+    if (is_mesh) {
+      mesh_util::WedgeTable table;
+      MakePoints(groups, options.deduplicate_points, table, corner_to_point,
+                 point_values);
+    }
+
+    const uint32_t num_points =
+        is_mesh ? static_cast<uint32_t>(point_values[0].size())
+                : static_cast<uint32_t>(position->num_values);
+    mesh->SetNumFaces(indices.size());
+    mesh->set_num_points(num_points);
+
+    std::vector<draco::PointAttribute*> point_atts(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+      att_ids[i] = AddAttribute(*sources[i], !is_mesh, mesh.get());
+      point_atts[i] = mesh->attribute(att_ids[i]);
+    }
+
+    if (is_mesh) {
+      draco::Mesh* m = mesh.get();
+      parallel_util::ParallelFor(0, indices.size(), [&](size_t i) {
+        draco::Mesh::Face face;
+        for (uint32_t j = 0; j < 3; ++j) {
+          face[j] = corner_to_point[3 * i + j];
+        }
+        m->SetFace(draco::FaceIndex(static_cast<uint32_t>(i)), face);
+      });
+      parallel_util::ParallelFor(0, num_points, [&](size_t p) {
+        const draco::PointIndex point(static_cast<uint32_t>(p));
+        for (size_t i = 0; i < sources.size(); ++i) {
+          const uint32_t value = point_values[source_group[i]][p];
+          point_atts[i]->SetPointMapEntry(point,
+                                          draco::AttributeValueIndex(value));
+        }
+      });
+    }
+  }
+
+  if (options.write_stream_info) {
+    draco_trace::ScopedEvent event(options.trace, "stream_info");
+    draco_metadata_keys::AddStreamInfo(mesh.get());
+  }
+
+  // Convert compression level to speed (that 0 = slowest, 10 = fastest).
+  const int speed = 10 - options.compression_level;
+  std::unique_ptr<draco::ExpertEncoder> encoder;
+  if (is_mesh) {
+    encoder.reset(new draco::ExpertEncoder(*mesh));
+  } else {
+    encoder.reset(
+        new draco::ExpertEncoder(static_cast<draco::PointCloud&>(*mesh)));
+  }
+  encoder->SetSpeedOptions(speed, speed);
+  for (size_t i = 0; i < sources.size(); ++i) {
+    const AttributeSource& source = *sources[i];
+    const int bits = QuantizationBits(source, options);
+    if (bits <= 0 || (source.type != ComponentType::kFloat32 &&
+                      source.type != ComponentType::kFloat64)) {
+      continue;
+    }
+    const int32_t att_id = att_ids[i];
+    if (source.semantic == Semantic::kPosition &&
+        options.pos_quantization_range > 0.f) {
+      encoder->SetAttributeExplicitQuantization(
+          att_id, bits, 3, options.pos_quantization_origin.data(),
+          options.pos_quantization_range);
+    } else {
+      encoder->SetAttributeQuantization(att_id, bits);
+    }
+  }
+
+  draco::EncoderBuffer buffer;
+  draco::Status status;
+  {
+    draco_trace::ScopedEvent event(options.trace, "encode");
+    status = encoder->EncodeToBuffer(&buffer);
+    event.set_bytes(buffer.size());
+  }
+  if (!status.ok()) {
+    printf("Failed to encode the mesh.\n");
+    printf("%s\n", status.error_msg());
+    return false;
+  }
+  bytes.swap(*buffer.buffer());
+  return true;
+}
+
+bool DracoDecode(const std::vector<char>& bytes,
+                 const std::vector<AttributeTarget>& attributes,
+                 std::vector<Eigen::Vector3i>& indices) {
+  return DracoDecode(bytes.data(), bytes.size(), attributes, indices);
+}
+
+bool DracoDecode(const char* data, size_t size,
+                 const std::vector<AttributeTarget>& attributes,
+                 std::vector<Eigen::Vector3i>& indices) {
+  draco::DecoderBuffer buffer;
+  buffer.Init(data, size);
+  auto type_statusor = draco::Decoder::GetEncodedGeometryType(&buffer);
+  if (!type_statusor.ok()) {
+    printf("Decode error: %s\n", type_statusor.status().error_msg());
+    return false;
+  }
+
+  draco::Decoder decoder;
+  std::unique_ptr<draco::PointCloud> pc;
+  const draco::Mesh* mesh = nullptr;
+  if (type_statusor.value() == draco::TRIANGULAR_MESH) {
+    auto statusor = decoder.DecodeMeshFromBuffer(&buffer);
+    if (!statusor.ok()) {
+      printf("Decode error: %s\n", statusor.status().error_msg());
+      return false;
+    }
+    std::unique_ptr<draco::Mesh> in_mesh = std::move(statusor).value();
+    mesh = in_mesh.get();
+    pc = std::move(in_mesh);
+  } else {
+    auto statusor = decoder.DecodePointCloudFromBuffer(&buffer);
+    if (!statusor.ok()) {
+      printf("Decode error: %s\n", statusor.status().error_msg());
+      return false;
+    }
+    pc = std::move(statusor).value();
+  }
+  if (pc == nullptr) {
+    printf("Failed to decode the input file.\n");
+    return false;
+  }
+
+  // Value index of every face corner of |att|
+  auto read_indices = [&](const draco::PointAttribute* att,
+                          std::vector<Eigen::Vector3i>& out) {
+    if (mesh == nullptr || att == nullptr) {
+      out.clear();
+      return;
+    }
+    out.resize(mesh->num_faces());
+    parallel_util::ParallelFor(0, out.size(), [&](size_t i) {
+      const draco::Mesh::Face& face =
+          mesh->face(draco::FaceIndex(static_cast<uint32_t>(i)));
+      for (int j = 0; j < 3; j++) {
+        out[i][j] = static_cast<int32_t>(att->mapped_index(face[j]).value());
+      }
+    });
+  };
+
+  for (const auto& target : attributes) {
+    const draco::PointAttribute* att =
+        pc->GetNamedAttribute(ToAttributeType(target.semantic), target.index);
+    ComponentType type = ComponentType::kFloat32;
+    if (att != nullptr && !ToComponentType(att->data_type(), type)) {
+      printf("Error: Unsupported attribute data type %d.\n",
+             static_cast<int>(att->data_type()));
+      return false;
+    }
+    if (att != nullptr &&
+        att->byte_stride() !=
+            draco::DataTypeLength(att->data_type()) * att->num_components()) {
+      printf("Error: Interleaved attributes are not supported.\n");
+      return false;
+    }
+
+    const size_t num_values = att != nullptr ? att->size() : 0;
+    target.resize(num_values, target.values);
+    if (num_values > 0) {
+      const uint8_t* in = att->GetAddress(draco::AttributeValueIndex(0));
+      const int num_components = att->num_components();
+      ForEachChunk(num_values, [&](size_t begin, size_t end) {
+        target.read(type, in, num_components, begin, end, target.values);
+      });
+    }
+    if (target.indices != nullptr) {
+      read_indices(att, *target.indices);
+    }
+  }
+
+  read_indices(pc->GetNamedAttribute(draco::GeometryAttribute::POSITION),
+               indices);
+  return true;
+}
+
+}  // namespace draco_typed
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "draco_encode.h"
+
+// Encode and decode of any number of attributes of any scalar or fixed size
+// Eigen vector type, e.g. float colors, several uv sets or per point
+// intensities and labels. Element types are described at compile time and
+// converted while values are copied into or out of Draco's attribute
+// buffers, so no intermediate arrays are built.
+namespace draco_typed {
+
+enum class Semantic { kPosition, kTexCoord, kColor, kNormal, kGeneric };
+
+// Component types a stream can store.
+enum class ComponentType {
+  kInt8,
+  kUint8,
+  kInt16,
+  kUint16,
+  kInt32,
+  kUint32,
+  kFloat32,
+  kFloat64,
+};
+
+template <typename T>
+struct ComponentTypeOf;
+template <>
+struct ComponentTypeOf<int8_t> {
+  static constexpr ComponentType value = ComponentType::kInt8;
+};
+template <>
+struct ComponentTypeOf<uint8_t> {
+  static constexpr ComponentType value = ComponentType::kUint8;
+};
+template <>
+struct ComponentTypeOf<int16_t> {
+  static constexpr ComponentType value = ComponentType::kInt16;
+};
+template <>
+struct ComponentTypeOf<uint16_t> {
+  static constexpr ComponentType value = ComponentType::kUint16;
+};
+template <>
+struct ComponentTypeOf<int32_t> {
+  static constexpr ComponentType value = ComponentType::kInt32;
+};
+template <>
+struct ComponentTypeOf<uint32_t> {
+  static constexpr ComponentType value = ComponentType::kUint32;
+};
+template <>
+struct ComponentTypeOf<float> {
+  static constexpr ComponentType value = ComponentType::kFloat32;
+};
+template <>
+struct ComponentTypeOf<double> {
+  static constexpr ComponentType value = ComponentType::kFloat64;
+};
+
+// Element of an attribute array: a scalar or a fixed size Eigen vector.
+template <typename T>
+struct ElementTraits {
+  static_assert(std::is_arithmetic<T>::value,
+                "Elements must be scalars or fixed size Eigen vectors");
+  using Scalar = T;
+  static constexpr int kComponents = 1;
+  static const Scalar* data(const T& value) { return &value; }
+  static Scalar* data(T& value) { return &value; }
+};
+
+template <typename S, int N, int Options, int MaxRows, int MaxCols>
+struct ElementTraits<Eigen::Matrix<S, N, 1, Options, MaxRows, MaxCols>> {
+  static_assert(N > 0, "Elements must be scalars or fixed size Eigen vectors");
+  using Scalar = S;
+  static constexpr int kComponents = N;
+  using Element = Eigen::Matrix<S, N, 1, Options, MaxRows, MaxCols>;
+  static const Scalar* data(const Element& value) { return value.data(); }
+  static Scalar* data(Element& value) { return value.data(); }
+};
+
+// Numeric conversion of one component. Floats converted to integers are
+// rounded; integers are saturated to the range of |To|. Values are not
+// rescaled, so float colors in [0, 255] map to uint8 colors as is.
+template <typename To, typename From>
+inline To ConvertComponent(From value) {
+  if constexpr (std::is_same<To, From>::value) {
+    return value;
+  } else if constexpr (std::is_integral<To>::value &&
+                       std::is_floating_point<From>::value) {
+    const double v = std::round(static_cast<double>(value));
+    if (!(v > static_cast<double>(std::numeric_limits<To>::lowest()))) {
+      return std::numeric_limits<To>::lowest();
+    }
+    if (v >= static_cast<double>(std::numeric_limits<To>::max())) {
+      return std::numeric_limits<To>::max();
+    }
+    return static_cast<To>(v);
+  } else if constexpr (std::is_integral<To>::value) {
+    using Wide =
+        std::conditional_t<std::is_signed<From>::value, int64_t, uint64_t>;
+    const Wide v = static_cast<Wide>(value);
+    if constexpr (std::is_signed<From>::value) {
+      if (v < static_cast<int64_t>(std::numeric_limits<To>::lowest())) {
+        return std::numeric_limits<To>::lowest();
+      }
+    }
+    if (v > static_cast<Wide>(std::numeric_limits<To>::max())) {
+      return std::numeric_limits<To>::max();
+    }
+    return static_cast<To>(v);
+  } else {
+    return static_cast<To>(value);
+  }
+}
+
+// Converts values [begin, end) of a std::vector<T> at |values| into |out|,
+// tightly packed Stored components.
+template <typename Stored, typename T>
+void WriteValues(const void* values, size_t begin, size_t end, void* out) {
+  using Traits = ElementTraits<T>;
+  static_assert(sizeof(T) == sizeof(typename Traits::Scalar) *
+                                 Traits::kComponents,
+                "Elements must be tightly packed");
+  const T* in = static_cast<const T*>(values);
+  if constexpr (std::is_same<Stored, typename Traits::Scalar>::value) {
+    std::memcpy(out, in + begin, (end - begin) * sizeof(T));
+  } else {
+    Stored* dst = static_cast<Stored*>(out);
+    for (size_t i = begin; i < end; ++i) {
+      const typename Traits::Scalar* src = Traits::data(in[i]);
+      for (int c = 0; c < Traits::kComponents; ++c) {
+        *dst++ = ConvertComponent<Stored>(src[c]);
+      }
+    }
+  }
+}
+
+// Converts values [begin, end) of |num_components| Stored components at |in|
+// into the same range of the std::vector<T> at |values|. Missing components
+// are set to 0 and extra ones dropped.
+template <typename Stored, typename T>
+void ReadValuesAs(const void* in, int num_components, size_t begin,
+                  size_t end, void* values) {
+  using Traits = ElementTraits<T>;
+  using Scalar = typename Traits::Scalar;
+  static_assert(sizeof(T) == sizeof(Scalar) * Traits::kComponents,
+                "Elements must be tightly packed");
+  T* out = static_cast<std::vector<T>*>(values)->data();
+  const Stored* src = static_cast<const Stored*>(in) + begin * num_components;
+  if constexpr (std::is_same<Stored, Scalar>::value) {
+    if (num_components == Traits::kComponents) {
+      std::memcpy(static_cast<void*>(out + begin), src,
+                  (end - begin) * sizeof(T));
+      return;
+    }
+  }
+  for (size_t i = begin; i < end; ++i, src += num_components) {
+    Scalar* dst = Traits::data(out[i]);
+    for (int c = 0; c < Traits::kComponents; ++c) {
+      dst[c] = c < num_components ? ConvertComponent<Scalar>(src[c])
+                                  : Scalar(0);
+    }
+  }
+}
+
+template <typename T>
+void ReadValues(ComponentType type, const void* in, int num_components,
+                size_t begin, size_t end, void* values) {
+  switch (type) {
+    case ComponentType::kInt8:
+      ReadValuesAs<int8_t, T>(in, num_components, begin, end, values);
+      break;
+    case ComponentType::kUint8:
+      ReadValuesAs<uint8_t, T>(in, num_components, begin, end, values);
+      break;
+    case ComponentType::kInt16:
+      ReadValuesAs<int16_t, T>(in, num_components, begin, end, values);
+      break;
+    case ComponentType::kUint16:
+      ReadValuesAs<uint16_t, T>(in, num_components, begin, end, values);
+      break;
+    case ComponentType::kInt32:
+      ReadValuesAs<int32_t, T>(in, num_components, begin, end, values);
+      break;
+    case ComponentType::kUint32:
+      ReadValuesAs<uint32_t, T>(in, num_components, begin, end, values);
+      break;
+    case ComponentType::kFloat32:
+      ReadValuesAs<float, T>(in, num_components, begin, end, values);
+      break;
+    case ComponentType::kFloat64:
+      ReadValuesAs<double, T>(in, num_components, begin, end, values);
+      break;
+  }
+}
+
+template <typename T>
+void ResizeValues(size_t num_values, void* values) {
+  static_cast<std::vector<T>*>(values)->resize(num_values);
+}
+
+// Type erased input attribute. Build with Attribute().
+struct AttributeSource {
+  Semantic semantic = Semantic::kGeneric;
+  // Type and count of the components stored in the stream
+  ComponentType type = ComponentType::kFloat32;
+  int num_components = 0;
+  bool normalized = false;
+  size_t num_values = 0;
+  const void* values = nullptr;
+  void (*write)(const void* values, size_t begin, size_t end,
+                void* out) = nullptr;
+  // Value index of every face corner. Null means the values are per
+  // position and share the position indices; point clouds have no indices.
+  const std::vector<Eigen::Vector3i>* indices = nullptr;
+  // Quantization of float attributes. < 0 takes the bits of
+  // DracoEncodeOptions for positions, uvs and normals and keeps other
+  // attributes lossless. 0 is lossless.
+  int quantization_bits = -1;
+};
+
+// Describes |values| as an attribute stored with Stored components, by
+// default the scalar type of T. Integer colors are marked normalized.
+template <typename Stored = void, typename T>
+AttributeSource Attribute(
+    Semantic semantic, const std::vector<T>& values,
+    const std::vector<Eigen::Vector3i>* indices = nullptr) {
+  using S = std::conditional_t<std::is_void<Stored>::value,
+                               typename ElementTraits<T>::Scalar, Stored>;
+  AttributeSource source;
+  source.semantic = semantic;
+  source.type = ComponentTypeOf<S>::value;
+  source.num_components = ElementTraits<T>::kComponents;
+  source.normalized =
+      semantic == Semantic::kColor && std::is_integral<S>::value;
+  source.num_values = values.size();
+  source.values = values.data();
+  source.write = &WriteValues<S, T>;
+  source.indices = indices;
+  return source;
+}
+
+// Type erased output attribute. Build with Output().
+struct AttributeTarget {
+  Semantic semantic = Semantic::kGeneric;
+  // Which of the attributes with |semantic|, in encode order
+  int index = 0;
+  void* values = nullptr;
+  void (*resize)(size_t num_values, void* values) = nullptr;
+  void (*read)(ComponentType type, const void* in, int num_components,
+               size_t begin, size_t end, void* values) = nullptr;
+  // If set, receives the value index of every face corner
+  std::vector<Eigen::Vector3i>* indices = nullptr;
+};
+
+// Describes |values| as the destination of the |index|-th attribute with
+// |semantic|. Stored values are converted to the element type of |values|.
+template <typename T>
+AttributeTarget Output(Semantic semantic, std::vector<T>& values,
+                       int index = 0,
+                       std::vector<Eigen::Vector3i>* indices = nullptr) {
+  AttributeTarget target;
+  target.semantic = semantic;
+  target.index = index;
+  target.values = &values;
+  target.resize = &ResizeValues<T>;
+  target.read = &ReadValues<T>;
+  target.indices = indices;
+  return target;
+}
+
+// Encodes |attributes|, which must include exactly one kPosition, and faces
+// of position |indices| (empty for point clouds). Attributes with
+// Semantic::kTexCoord or kNormal are left out if the matching quantization
+// bits of |options| are negative. Stream info is written if
+// |options|.write_stream_info is set, as for draco_encode::DracoEncode().
+bool DracoEncode(const std::vector<AttributeSource>& attributes,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const draco_encode::DracoEncodeOptions& options,
+                 std::vector<char>& bytes);
+
+// Fills |attributes| and the position |indices| of each face. Outputs whose
+// attribute is not in the stream are cleared.
+bool DracoDecode(const char* data, size_t size,
+                 const std::vector<AttributeTarget>& attributes,
+                 std::vector<Eigen::Vector3i>& indices);
+
+bool DracoDecode(const std::vector<char>& bytes,
+                 const std::vector<AttributeTarget>& attributes,
+                 std::vector<Eigen::Vector3i>& indices);
+
+}  // namespace draco_typed
@@ -0,0 +1,180 @@
+#include "file_util.h"
+
+#include <cerrno>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace file_util {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+    : data_(nullptr), size_(0), file_(nullptr), mapping_(nullptr) {}
+
+bool MappedFile::Open(const std::string& path) {
+  Close();
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    printf("Error: Failed to open %s.\n", path.c_str());
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    printf("Error: Failed to get the size of %s.\n", path.c_str());
+    CloseHandle(file);
+    return false;
+  }
+  file_ = file;
+  if (size.QuadPart == 0) {
+    return true;
+  }
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    printf("Error: Failed to map %s.\n", path.c_str());
+    Close();
+    return false;
+  }
+  mapping_ = mapping;
+  const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (data == nullptr) {
+    printf("Error: Failed to map %s.\n", path.c_str());
+    Close();
+    return false;
+  }
+  data_ = static_cast<const char*>(data);
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+  }
+  if (file_ != nullptr) {
+    CloseHandle(file_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  mapping_ = nullptr;
+  file_ = nullptr;
+}
+
+bool WriteFile(const std::string& path, const char* data, size_t size) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr,
+                            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    printf("Error: Failed to open %s.\n", path.c_str());
+    return false;
+  }
+  bool ret = true;
+  while (size > 0) {
+    // WriteFile takes a 32 bit size
+    const DWORD chunk =
+        static_cast<DWORD>(size < 0x40000000u ? size : 0x40000000u);
+    DWORD written = 0;
+    if (!::WriteFile(file, data, chunk, &written, nullptr)) {
+      printf("Error: Failed to write %s.\n", path.c_str());
+      ret = false;
+      break;
+    }
+    data += written;
+    size -= written;
+  }
+  CloseHandle(file);
+  return ret;
+}
+
+#else
+
+MappedFile::MappedFile() : data_(nullptr), size_(0) {}
+
+bool MappedFile::Open(const std::string& path) {
+  Close();
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    printf("Error: Failed to open %s.\n", path.c_str());
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    printf("Error: Failed to get the size of %s.\n", path.c_str());
+    close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return true;
+  }
+  void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                    MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("Error: Failed to map %s.\n", path.c_str());
+    return false;
+  }
+  // Decoders read the stream front to back
+  posix_madvise(data, static_cast<size_t>(st.st_size),
+                POSIX_MADV_SEQUENTIAL);
+  data_ = static_cast<const char*>(data);
+  size_ = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool WriteFile(const std::string& path, const char* data, size_t size) {
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("Error: Failed to open %s.\n", path.c_str());
+    return false;
+  }
+  bool ret = true;
+  while (size > 0) {
+    const ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("Error: Failed to write %s.\n", path.c_str());
+      ret = false;
+      break;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  if (close(fd) != 0) {
+    ret = false;
+  }
+  return ret;
+}
+
+#endif
+
+MappedFile::~MappedFile() { Close(); }
+
+const char* MappedFile::data() const { return data_; }
+
+size_t MappedFile::size() const { return size_; }
+
+}  // namespace file_util
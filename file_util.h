@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace file_util {
+
+// Read-only memory mapping of a whole file. Pass data() and size() to the
+// pointer overloads of draco_decode to decode a .drc file without reading
+// it into a heap buffer first.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Maps |path|, unmapping any previous file. An empty file maps to a null
+  // data() with size() 0.
+  bool Open(const std::string& path);
+  void Close();
+
+  const char* data() const;
+  size_t size() const;
+
+ private:
+  const char* data_;
+  size_t size_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#endif
+};
+
+// Writes |size| bytes to |path|, replacing the file, with a single write
+// call unless the OS returns a partial write.
+bool WriteFile(const std::string& path, const char* data, size_t size);
+
+}  // namespace file_util
@@ -0,0 +1,300 @@
+#include "mesh_util.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+#include "parallel_util.h"
+#include "radix_sort.h"
+
+namespace {
+
+// Sorted unique list of the values of |ids|. Used to renumber indices of a
+// subset of faces.
+std::vector<int> UniqueIds(std::vector<int> ids) {
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  return ids;
+}
+
+// Rounds |value| to the nearest byte, saturating like
+// draco_typed::ConvertComponent(). NaN becomes 0.
+uint8_t ToColor8(float value) {
+  const float v = std::round(value);
+  if (!(v > 0.f)) {
+    return 0;
+  }
+  if (v >= 255.f) {
+    return 255;
+  }
+  return static_cast<uint8_t>(v);
+}
+
+int LocalId(const std::vector<int>& used, int id) {
+  return static_cast<int>(std::lower_bound(used.begin(), used.end(), id) -
+                          used.begin());
+}
+
+// Spreads the low 21 bits of |v| to every third bit.
+uint64_t SpreadBits(uint32_t v) {
+  uint64_t x = v & 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+uint32_t CompactBits(uint64_t x) {
+  x &= 0x1249249249249249ULL;
+  x = (x ^ (x >> 2)) & 0x10c30c30c30c30c3ULL;
+  x = (x ^ (x >> 4)) & 0x100f00f00f00f00fULL;
+  x = (x ^ (x >> 8)) & 0x1f0000ff0000ffULL;
+  x = (x ^ (x >> 16)) & 0x1f00000000ffffULL;
+  x = (x ^ (x >> 32)) & 0x1fffffULL;
+  return static_cast<uint32_t>(x);
+}
+
+}  // namespace
+
+namespace mesh_util {
+
+void GatherFaces(const std::vector<Eigen::Vector3f>& verts,
+                 const std::vector<Eigen::Vector2f>& uvs,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const std::vector<Eigen::Vector3i>& uv_indices,
+                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 const std::vector<Eigen::Vector3f>& normals,
+                 const std::vector<uint32_t>& faces, MeshArrays& out) {
+  const bool with_uvs = uvs.size() > 0 && uv_indices.size() == indices.size();
+  const bool with_colors = colors.size() == verts.size();
+  const bool with_normals = normals.size() == verts.size();
+
+  std::vector<int> used;
+  used.reserve(faces.size() * 3);
+  for (uint32_t f : faces) {
+    for (int j = 0; j < 3; j++) {
+      used.push_back(indices[f][j]);
+    }
+  }
+  used = UniqueIds(std::move(used));
+
+  out.verts.resize(used.size());
+  for (size_t i = 0; i < used.size(); i++) {
+    out.verts[i] = verts[used[i]];
+  }
+  if (with_colors) {
+    out.colors.resize(used.size());
+    for (size_t i = 0; i < used.size(); i++) {
+      out.colors[i] = colors[used[i]];
+    }
+  }
+  if (with_normals) {
+    out.normals.resize(used.size());
+    for (size_t i = 0; i < used.size(); i++) {
+      out.normals[i] = normals[used[i]];
+    }
+  }
+  out.indices.resize(faces.size());
+  for (size_t i = 0; i < faces.size(); i++) {
+    for (int j = 0; j < 3; j++) {
+      out.indices[i][j] = LocalId(used, indices[faces[i]][j]);
+    }
+  }
+
+  if (with_uvs) {
+    std::vector<int> used_uvs;
+    used_uvs.reserve(faces.size() * 3);
+    for (uint32_t f : faces) {
+      for (int j = 0; j < 3; j++) {
+        used_uvs.push_back(uv_indices[f][j]);
+      }
+    }
+    used_uvs = UniqueIds(std::move(used_uvs));
+
+    out.uvs.resize(used_uvs.size());
+    for (size_t i = 0; i < used_uvs.size(); i++) {
+      out.uvs[i] = uvs[used_uvs[i]];
+    }
+    out.uv_indices.resize(faces.size());
+    for (size_t i = 0; i < faces.size(); i++) {
+      for (int j = 0; j < 3; j++) {
+        out.uv_indices[i][j] = LocalId(used_uvs, uv_indices[faces[i]][j]);
+      }
+    }
+  }
+}
+
+void GatherPoints(const std::vector<Eigen::Vector3f>& verts,
+                  const std::vector<Eigen::Vector2f>& uvs,
+                  const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                  const std::vector<Eigen::Vector3f>& normals,
+                  const std::vector<uint32_t>& points, MeshArrays& out) {
+  out.verts.resize(points.size());
+  for (size_t i = 0; i < points.size(); i++) {
+    out.verts[i] = verts[points[i]];
+  }
+  if (uvs.size() == verts.size()) {
+    out.uvs.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+      out.uvs[i] = uvs[points[i]];
+    }
+  }
+  if (colors.size() == verts.size()) {
+    out.colors.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+      out.colors[i] = colors[points[i]];
+    }
+  }
+  if (normals.size() == verts.size()) {
+    out.normals.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+      out.normals[i] = normals[points[i]];
+    }
+  }
+}
+
+void VoxelizePoints(const std::vector<Eigen::Vector3f>& verts,
+                    const std::vector<Eigen::Vector2f>& uvs,
+                    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    const std::vector<Eigen::Vector3f>& normals,
+                    const Eigen::Vector3f& origin, float range, int bits,
+                    MeshArrays& out) {
+  const size_t n = verts.size();
+  const bool with_uvs = uvs.size() == n;
+  const bool with_colors = colors.size() == n;
+  const bool with_normals = normals.size() == n;
+
+  // Morton code of the grid point of every point, rounded as Draco's
+  // quantizer does
+  const uint32_t max_value = (1u << bits) - 1;
+  const float scale = range > 0.f ? max_value / range : 0.f;
+  std::vector<uint64_t> codes(n);
+  std::vector<uint32_t> order(n);
+  parallel_util::ParallelFor(0, n, [&](size_t i) {
+    uint64_t code = 0;
+    for (int k = 0; k < 3; ++k) {
+      const float q = std::floor((verts[i][k] - origin[k]) * scale + 0.5f);
+      const float clamped =
+          std::min(std::max(q, 0.f), static_cast<float>(max_value));
+      code |= SpreadBits(static_cast<uint32_t>(clamped)) << k;
+    }
+    codes[i] = code;
+    order[i] = static_cast<uint32_t>(i);
+  });
+  parallel_util::RadixSortPairs(codes, order);
+
+  // Runs of equal codes become one point each
+  std::vector<size_t> run_starts;
+  for (size_t i = 0; i < n; ++i) {
+    if (i == 0 || codes[i] != codes[i - 1]) {
+      run_starts.push_back(i);
+    }
+  }
+  const size_t num_points = run_starts.size();
+  run_starts.push_back(n);
+
+  out.verts.resize(num_points);
+  out.uvs.resize(with_uvs ? num_points : 0);
+  out.colors.resize(with_colors ? num_points : 0);
+  out.normals.resize(with_normals ? num_points : 0);
+  out.indices.clear();
+  out.uv_indices.clear();
+  const float step = range / max_value;
+  parallel_util::ParallelFor(0, num_points, [&](size_t p) {
+    const size_t begin = run_starts[p];
+    const size_t end = run_starts[p + 1];
+    const uint64_t code = codes[begin];
+    for (int k = 0; k < 3; ++k) {
+      out.verts[p][k] = origin[k] + CompactBits(code >> k) * step;
+    }
+    if (with_uvs) {
+      Eigen::Vector2f sum = Eigen::Vector2f::Zero();
+      for (size_t i = begin; i < end; ++i) {
+        sum += uvs[order[i]];
+      }
+      out.uvs[p] = sum / static_cast<float>(end - begin);
+    }
+    if (with_colors) {
+      const uint32_t count = static_cast<uint32_t>(end - begin);
+      uint32_t sum[3] = {0, 0, 0};
+      for (size_t i = begin; i < end; ++i) {
+        for (int k = 0; k < 3; ++k) {
+          sum[k] += colors[order[i]][k];
+        }
+      }
+      for (int k = 0; k < 3; ++k) {
+        out.colors[p][k] = static_cast<uint8_t>((sum[k] + count / 2) / count);
+      }
+    }
+    if (with_normals) {
+      Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+      for (size_t i = begin; i < end; ++i) {
+        sum += normals[order[i]];
+      }
+      const float norm = sum.norm();
+      out.normals[p] = norm > 0.f ? Eigen::Vector3f(sum / norm)
+                                  : normals[order[begin]];
+    }
+  });
+}
+
+void Append(const MeshArrays& src, MeshArrays& dst) {
+  const Eigen::Vector3i vert_offset =
+      Eigen::Vector3i::Constant(static_cast<int>(dst.verts.size()));
+  const Eigen::Vector3i uv_offset =
+      Eigen::Vector3i::Constant(static_cast<int>(dst.uvs.size()));
+  dst.verts.insert(dst.verts.end(), src.verts.begin(), src.verts.end());
+  dst.uvs.insert(dst.uvs.end(), src.uvs.begin(), src.uvs.end());
+  dst.colors.insert(dst.colors.end(), src.colors.begin(), src.colors.end());
+  dst.normals.insert(dst.normals.end(), src.normals.begin(),
+                     src.normals.end());
+  for (const auto& face : src.indices) {
+    dst.indices.push_back(face + vert_offset);
+  }
+  for (const auto& face : src.uv_indices) {
+    dst.uv_indices.push_back(face + uv_offset);
+  }
+}
+
+bool IndicesInRange(const MeshArrays& arrays) {
+  auto in_range = [](const std::vector<Eigen::Vector3i>& faces, size_t size) {
+    for (const auto& face : faces) {
+      for (int j = 0; j < 3; j++) {
+        if (face[j] < 0 || static_cast<size_t>(face[j]) >= size) {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+  return in_range(arrays.indices, arrays.verts.size()) &&
+         (arrays.uvs.empty() ||
+          in_range(arrays.uv_indices, arrays.uvs.size()));
+}
+
+std::string LowerExtension(const std::string& path) {
+  const size_t dot = path.find_last_of('.');
+  const size_t slash = path.find_last_of("/\\");
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    return std::string();
+  }
+  std::string ext = path.substr(dot);
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return ext;
+}
+
+void ToColors8(const std::vector<Eigen::Vector3f>& colors,
+               std::vector<Eigen::Vector<uint8_t, 3>>& out) {
+  out.resize(colors.size());
+  for (size_t i = 0; i < colors.size(); i++) {
+    out[i] = Eigen::Vector<uint8_t, 3>(ToColor8(colors[i][0]),
+                                       ToColor8(colors[i][1]),
+                                       ToColor8(colors[i][2]));
+  }
+}
+
+}  // namespace mesh_util
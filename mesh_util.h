@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Eigen/Geometry"
+
+namespace mesh_util {
+
+// Arrays in the layout taken by DracoEncode and returned by DracoDecode.
+struct MeshArrays {
+  std::vector<Eigen::Vector3f> verts;
+  std::vector<Eigen::Vector2f> uvs;
+  std::vector<Eigen::Vector3i> indices;
+  std::vector<Eigen::Vector3i> uv_indices;
+  std::vector<Eigen::Vector<uint8_t, 3>> colors;
+  std::vector<Eigen::Vector3f> normals;
+};
+
+// Open addressing hash table which maps a wedge, a pair of 32 bit indices
+// such as a position index and a uv index, to a point index. Capacity is a
+// power of two and at least twice the number of corners, so linear probing
+// stays short.
+class WedgeTable {
+ public:
+  // Clears the table. Allocated slots are kept if they are large enough.
+  void Reset(size_t num_corners) {
+    size_t capacity = 16;
+    while (capacity < num_corners * 2) {
+      capacity <<= 1;
+    }
+    mask_ = capacity - 1;
+    keys_.assign(capacity, kEmpty);
+    values_.resize(capacity);
+  }
+
+  // Returns the point index of |key|. If |key| is new, |next| is registered.
+  uint32_t FindOrInsert(uint64_t key, uint32_t next) {
+    size_t slot = Hash(key) & mask_;
+    while (true) {
+      if (keys_[slot] == key) {
+        return values_[slot];
+      }
+      if (keys_[slot] == kEmpty) {
+        keys_[slot] = key;
+        values_[slot] = next;
+        return next;
+      }
+      slot = (slot + 1) & mask_;
+    }
+  }
+
+ private:
+  static constexpr uint64_t kEmpty = ~uint64_t(0);
+
+  static size_t Hash(uint64_t key) {
+    // splitmix64 finalizer
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return static_cast<size_t>(key);
+  }
+
+  size_t mask_ = 0;
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> values_;
+};
+
+// Gathers |faces| of the input mesh into a self-contained mesh. Vertices and
+// uvs not referenced by |faces| are dropped and the rest are renumbered.
+void GatherFaces(const std::vector<Eigen::Vector3f>& verts,
+                 const std::vector<Eigen::Vector2f>& uvs,
+                 const std::vector<Eigen::Vector3i>& indices,
+                 const std::vector<Eigen::Vector3i>& uv_indices,
+                 const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                 const std::vector<Eigen::Vector3f>& normals,
+                 const std::vector<uint32_t>& faces, MeshArrays& out);
+
+// Gathers |points| of the input point cloud.
+void GatherPoints(const std::vector<Eigen::Vector3f>& verts,
+                  const std::vector<Eigen::Vector2f>& uvs,
+                  const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                  const std::vector<Eigen::Vector3f>& normals,
+                  const std::vector<uint32_t>& points, MeshArrays& out);
+
+// Largest quantization bits per axis VoxelizePoints() supports, so that the
+// Morton code of a grid point fits in 64 bits.
+constexpr int kMaxVoxelBits = 21;
+
+// Snaps the points to the grid of 2^|bits| values per axis over the cube at
+// |origin| with side |range|, the grid of Draco's position quantization,
+// merges points on the same grid point and sorts them in Morton order of
+// their grid points. uvs, colors and normals of merged points are averaged;
+// normals are renormalized. Inputs other than |verts| are used only if they
+// have one value per point. |bits| must be in [1, kMaxVoxelBits].
+void VoxelizePoints(const std::vector<Eigen::Vector3f>& verts,
+                    const std::vector<Eigen::Vector2f>& uvs,
+                    const std::vector<Eigen::Vector<uint8_t, 3>>& colors,
+                    const std::vector<Eigen::Vector3f>& normals,
+                    const Eigen::Vector3f& origin, float range, int bits,
+                    MeshArrays& out);
+
+// Appends |src| to |dst|, offsetting face indices of |src|.
+void Append(const MeshArrays& src, MeshArrays& dst);
+
+// True if every face index of |arrays| is a valid index into its verts and,
+// if there are uvs, every uv index is a valid index into its uvs.
+// DracoEncode does not check them; callers passing untrusted arrays must.
+bool IndicesInRange(const MeshArrays& arrays);
+
+// Extension of |path| in lower case with the leading dot, e.g. ".obj".
+std::string LowerExtension(const std::string& path);
+
+// Converts colors stored as floats in [0, 255], as loaded by ugu, to bytes.
+// Values are rounded and clamped as by draco_typed::Attribute<uint8_t>().
+void ToColors8(const std::vector<Eigen::Vector3f>& colors,
+               std::vector<Eigen::Vector<uint8_t, 3>>& out);
+
+// Loads the OBJ or PLY file at |path| with |mesh|, a ugu::MeshPtr, into
+// |out|. A template so that this library does not depend on ugu.
+template <typename MeshPtr>
+bool LoadMeshFile(const std::string& path, const MeshPtr& mesh,
+                  MeshArrays& out) {
+  const std::string ext = LowerExtension(path);
+  if (ext != ".obj" && ext != ".ply") {
+    printf("Error: %s is neither an obj nor a ply file.\n", path.c_str());
+    return false;
+  }
+  if (!(ext == ".obj" ? mesh->LoadObj(path) : mesh->LoadPly(path))) {
+    printf("Error: Failed to load %s.\n", path.c_str());
+    return false;
+  }
+  out.verts = mesh->vertices();
+  out.uvs = mesh->uv();
+  out.indices = mesh->vertex_indices();
+  out.uv_indices = mesh->uv_indices();
+  out.normals = mesh->normals();
+  ToColors8(mesh->vertex_colors(), out.colors);
+  return true;
+}
+
+}  // namespace mesh_util
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+
+#include "thread_pool.h"
+
+namespace parallel_util {
+
+// Runs func(i) for every i in [begin, end). Ranges with at least
+// |min_parallel| items are split into contiguous chunks, one per thread of
+// ThreadPool::Current() plus the calling thread, which runs chunks too while
+// it waits; smaller ranges run on the calling thread. No threads are
+// created and no task storage is allocated, so this is safe and cheap to
+// call from tasks already running on a pool.
+template <typename Func>
+void ParallelFor(size_t begin, size_t end, Func func,
+                 size_t min_parallel = 1 << 16) {
+  if (end <= begin) {
+    return;
+  }
+  const size_t n = end - begin;
+  ThreadPool& pool = ThreadPool::Current();
+  const size_t num_chunks =
+      std::min(pool.num_threads() + 1,
+               n / std::max<size_t>(min_parallel / 4, 1));
+  if (n < min_parallel || num_chunks < 2) {
+    for (size_t i = begin; i < end; ++i) {
+      func(i);
+    }
+    return;
+  }
+
+  struct Range {
+    size_t begin;
+    size_t end;
+    size_t chunk;
+    Func* func;
+  };
+  Range range = {begin, end, (n + num_chunks - 1) / num_chunks, &func};
+  pool.RunChunks((n + range.chunk - 1) / range.chunk,
+                 [](void* context, size_t c) {
+                   const Range& r = *static_cast<const Range*>(context);
+                   const size_t st = r.begin + c * r.chunk;
+                   const size_t ed = std::min(r.end, st + r.chunk);
+                   for (size_t i = st; i < ed; ++i) {
+                     (*r.func)(i);
+                   }
+                 },
+                 &range);
+}
+
+}  // namespace parallel_util
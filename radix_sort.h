@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "parallel_util.h"
+
+namespace parallel_util {
+
+// Sorts |keys| ascending and permutes |values| along with them. Stable LSD
+// radix sort on 11 bit digits; digits that are the same in all keys are
+// skipped, so keys using few bits, such as Morton codes of a coarse grid,
+// take few passes. Each pass histograms and scatters contiguous blocks of at
+// least |min_parallel| / 4 keys in parallel.
+template <typename Value>
+void RadixSortPairs(std::vector<uint64_t>& keys, std::vector<Value>& values,
+                    size_t min_parallel = 1 << 16) {
+  constexpr int kDigitBits = 11;
+  constexpr size_t kNumBuckets = size_t(1) << kDigitBits;
+  constexpr uint64_t kDigitMask = kNumBuckets - 1;
+  const size_t n = keys.size();
+  if (n < 2) {
+    return;
+  }
+
+  const size_t hw_threads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t num_blocks =
+      n < min_parallel
+          ? 1
+          : std::max<size_t>(
+                1, std::min(hw_threads,
+                            n / std::max<size_t>(min_parallel / 4, 1)));
+  const size_t block_size = (n + num_blocks - 1) / num_blocks;
+  auto block_range = [&](size_t b) {
+    return std::make_pair(std::min(n, b * block_size),
+                          std::min(n, (b + 1) * block_size));
+  };
+
+  // Bits that differ between keys
+  std::vector<uint64_t> block_or(num_blocks, 0);
+  std::vector<uint64_t> block_and(num_blocks, ~uint64_t(0));
+  ParallelFor(
+      0, num_blocks,
+      [&](size_t b) {
+        const auto range = block_range(b);
+        for (size_t i = range.first; i < range.second; ++i) {
+          block_or[b] |= keys[i];
+          block_and[b] &= keys[i];
+        }
+      },
+      1);
+  uint64_t all_or = 0;
+  uint64_t all_and = ~uint64_t(0);
+  for (size_t b = 0; b < num_blocks; ++b) {
+    all_or |= block_or[b];
+    all_and &= block_and[b];
+  }
+  const uint64_t varying = all_or ^ all_and;
+
+  std::vector<uint64_t> tmp_keys(n);
+  std::vector<Value> tmp_values(n);
+  // Histogram of each block, then the output position of its next key per
+  // digit
+  std::vector<size_t> offsets(num_blocks * kNumBuckets);
+  for (int shift = 0; shift < 64; shift += kDigitBits) {
+    if (((varying >> shift) & kDigitMask) == 0) {
+      continue;
+    }
+    ParallelFor(
+        0, num_blocks,
+        [&](size_t b) {
+          size_t* hist = &offsets[b * kNumBuckets];
+          std::fill(hist, hist + kNumBuckets, 0);
+          const auto range = block_range(b);
+          for (size_t i = range.first; i < range.second; ++i) {
+            hist[(keys[i] >> shift) & kDigitMask]++;
+          }
+        },
+        1);
+    // Blocks keep their order within a digit, which keeps the sort stable
+    size_t sum = 0;
+    for (size_t d = 0; d < kNumBuckets; ++d) {
+      for (size_t b = 0; b < num_blocks; ++b) {
+        const size_t count = offsets[b * kNumBuckets + d];
+        offsets[b * kNumBuckets + d] = sum;
+        sum += count;
+      }
+    }
+    ParallelFor(
+        0, num_blocks,
+        [&](size_t b) {
+          size_t* offset = &offsets[b * kNumBuckets];
+          const auto range = block_range(b);
+          for (size_t i = range.first; i < range.second; ++i) {
+            const size_t dst = offset[(keys[i] >> shift) & kDigitMask]++;
+            tmp_keys[dst] = keys[i];
+            tmp_values[dst] = values[i];
+          }
+        },
+        1);
+    keys.swap(tmp_keys);
+    values.swap(tmp_values);
+  }
+}
+
+}  // namespace parallel_util
@@ -0,0 +1,218 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace parallel_util {
+
+namespace {
+
+// Pool and deque index of the calling thread if it is a worker
+thread_local const ThreadPool* tls_pool = nullptr;
+thread_local size_t tls_index = 0;
+// Pool whose task the calling thread is running
+thread_local ThreadPool* tls_current = nullptr;
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads)
+    : next_queue_(0), pending_(0), stop_(false) {
+  if (num_threads <= 0) {
+    num_threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  if (num_threads <= 0) {
+    num_threads = 1;
+  }
+  for (int i = 0; i < num_threads; i++) {
+    queues_.emplace_back(new TaskQueue());
+  }
+  workers_.reserve(num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    workers_.emplace_back([this, i]() { WorkerLoop(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+size_t ThreadPool::num_threads() const { return workers_.size(); }
+
+void ThreadPool::Submit(std::function<void()> task) {
+  const size_t index = tls_pool == this
+                           ? tls_index
+                           : next_queue_.fetch_add(1) % queues_.size();
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    pending_++;
+  }
+  cv_.notify_one();
+}
+
+void ThreadPool::Run(std::vector<std::function<void()>> tasks) {
+  struct Group {
+    std::atomic<size_t> remaining;
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+  auto group = std::make_shared<Group>();
+  group->remaining = tasks.size();
+
+  for (auto& task : tasks) {
+    Submit([group, task = std::move(task)]() {
+      task();
+      if (--group->remaining == 0) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        group->done.notify_all();
+      }
+    });
+  }
+
+  ThreadPool* const outer = tls_current;
+  tls_current = this;
+  while (group->remaining > 0) {
+    std::function<void()> task;
+    if (TryPop(task)) {
+      task();
+      continue;
+    }
+    // Every task of the group has been taken by a worker
+    std::unique_lock<std::mutex> lock(group->mutex);
+    group->done.wait(lock, [&]() { return group->remaining == 0; });
+  }
+  tls_current = outer;
+}
+
+void ThreadPool::RunChunks(size_t num_chunks,
+                           void (*func)(void* context, size_t chunk),
+                           void* context) {
+  struct Batch {
+    void (*func)(void*, size_t);
+    void* context;
+    size_t num_chunks;
+    std::atomic<size_t> next;
+    // Helper tasks which have not finished yet
+    size_t remaining;
+    std::mutex mutex;
+    std::condition_variable done;
+
+    void Work() {
+      for (size_t c = next++; c < num_chunks; c = next++) {
+        func(context, c);
+      }
+    }
+  };
+  if (num_chunks == 0) {
+    return;
+  }
+  Batch batch;
+  batch.func = func;
+  batch.context = context;
+  batch.num_chunks = num_chunks;
+  batch.next = 0;
+  batch.remaining = std::min(num_chunks - 1, workers_.size());
+
+  const size_t num_helpers = batch.remaining;
+  for (size_t i = 0; i < num_helpers; i++) {
+    Batch* const b = &batch;
+    Submit([b]() {
+      b->Work();
+      // Decremented under the lock: |batch| lives on the caller's stack and
+      // may be gone as soon as the caller sees zero.
+      std::lock_guard<std::mutex> lock(b->mutex);
+      if (--b->remaining == 0) {
+        b->done.notify_all();
+      }
+    });
+  }
+
+  ThreadPool* const outer = tls_current;
+  tls_current = this;
+  batch.Work();
+  // Help with other tasks until every helper has been taken
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(batch.mutex);
+      if (batch.remaining == 0) {
+        break;
+      }
+    }
+    std::function<void()> task;
+    if (TryPop(task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.done.wait(lock, [&]() { return batch.remaining == 0; });
+    break;
+  }
+  tls_current = outer;
+}
+
+ThreadPool& ThreadPool::Shared() {
+  static ThreadPool pool;
+  return pool;
+}
+
+ThreadPool& ThreadPool::Current() {
+  return tls_current != nullptr ? *tls_current : Shared();
+}
+
+bool ThreadPool::TryPop(std::function<void()>& task) {
+  const size_t n = queues_.size();
+  const bool is_worker = tls_pool == this;
+  const size_t first = is_worker ? tls_index : 0;
+
+  if (is_worker) {
+    TaskQueue& own = *queues_[first];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      pending_--;
+      return true;
+    }
+  }
+
+  for (size_t k = is_worker ? 1 : 0; k < n; k++) {
+    TaskQueue& victim = *queues_[(first + k) % n];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      pending_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+  tls_pool = this;
+  tls_index = index;
+  tls_current = this;
+  while (true) {
+    std::function<void()> task;
+    if (TryPop(task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    cv_.wait(lock, [this]() { return stop_ || pending_ > 0; });
+    if (stop_ && pending_ <= 0) {
+      return;
+    }
+  }
+}
+
+}  // namespace parallel_util
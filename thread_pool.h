@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel_util {
+
+// Work-stealing pool. Every worker owns a task deque: tasks submitted from a
+// worker go to its own deque and are popped LIFO for locality, tasks from
+// other threads are spread over the deques, and idle workers steal FIFO from
+// the others.
+class ThreadPool {
+ public:
+  // |num_threads| <= 0 means the number of hardware threads.
+  explicit ThreadPool(int num_threads = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t num_threads() const;
+
+  // Enqueues |task| to be run on a worker.
+  void Submit(std::function<void()> task);
+
+  // Runs all |tasks| and returns when every one has finished. The calling
+  // thread executes queued tasks while it waits, so this may be called from a
+  // worker without deadlocking.
+  void Run(std::vector<std::function<void()>> tasks);
+
+  // Runs func(context, c) for every chunk c in [0, |num_chunks|) and returns
+  // when all have finished. Workers and the calling thread claim chunks as
+  // they become free. Unlike Run(), no task storage is allocated: helper
+  // tasks only hold a pointer to state on the caller's stack, which fits in
+  // std::function's inline storage. Queue blocks are still allocated now and
+  // then as tasks cycle through the deques.
+  void RunChunks(size_t num_chunks, void (*func)(void* context, size_t chunk),
+                 void* context);
+
+  // Process wide pool with one thread per hardware thread.
+  static ThreadPool& Shared();
+
+  // Pool whose task the calling thread is running, either as a worker or
+  // while waiting in Run(), or Shared() outside of any task. Nested parallel
+  // work uses it so that it stays on the pool the outer work was given.
+  static ThreadPool& Current();
+
+ private:
+  struct TaskQueue {
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+  };
+
+  // Pops from the calling worker's own deque, then steals from the others.
+  bool TryPop(std::function<void()>& task);
+  void WorkerLoop(size_t index);
+
+  std::vector<std::unique_ptr<TaskQueue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> next_queue_;
+  // Number of queued tasks. Changes are made under |sleep_mutex_| when
+  // increasing so that sleeping workers never miss a task.
+  std::atomic<int64_t> pending_;
+  std::mutex sleep_mutex_;
+  std::condition_variable cv_;
+  bool stop_;
+};
+
+}  // namespace parallel_util